@@ -0,0 +1,794 @@
+/** @file Simulator.c
+ * @see Simulator.h for description.
+ * @author Adrien RICCIARDI
+ */
+#define _GNU_SOURCE // Needed by the pseudo-terminal functions
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Configuration.h"
+#include "SPI.h"
+#include "Simulator_Flash.h"
+
+// The simulator entry point is the real main()
+#undef main
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The system clock frequency in Hz. */
+#define SIMULATOR_SYSTEM_CLOCK_FREQUENCY 24500000ULL
+
+/** The DMA0NCF peripheral request of the SPI0 transmit buffer. */
+#define SIMULATOR_DMA_PERIPHERAL_SPI0_TRANSMIT 0x08
+/** The DMA0NCF peripheral request of the SPI0 receive buffer. */
+#define SIMULATOR_DMA_PERIPHERAL_SPI0_RECEIVE 0x09
+
+/** The value of the data registers when the firmware did not write to them. */
+#define SIMULATOR_DATA_REGISTER_EMPTY 0x100
+
+/** How many received bytes can wait for their transmission time on the simulated wire. */
+#define SIMULATOR_UART_RECEPTION_QUEUE_SIZE 65536
+/** How many sent bytes can wait for the link delay to elapse before being written to the pseudo-terminal. */
+#define SIMULATOR_UART_TRANSMISSION_QUEUE_SIZE 65536
+/** The longest link delay (in milliseconds), the bytes sent meanwhile at the highest baud rate must fit in the transmission queue. */
+#define SIMULATOR_UART_MAXIMUM_DELAY 1000
+/** How often the pseudo-terminal is checked for new bytes while the firmware is busy (in nanoseconds). */
+#define SIMULATOR_UART_POLLING_PERIOD 20000
+
+/** How far the simulated time can run ahead of the real time before the simulator sleeps (in nanoseconds). */
+#define SIMULATOR_MAXIMUM_TIME_ADVANCE 1000000
+
+/** The value the bit errors random generator starts from, so a given bit error rate always corrupts the same bits. */
+#define SIMULATOR_BIT_ERRORS_RANDOM_SEED 0x2545F491
+
+/** How many chip models a socket can cycle through. */
+#define SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT 16
+/** The socket model name telling that the socket is empty. */
+#define SIMULATOR_SOCKET_EMPTY_NAME "none"
+
+/** The flash chip to simulate when none is provided on the command line. */
+#if CONFIGURATION_FLASH_SELECT_MX25L6435E
+	#define SIMULATOR_DEFAULT_FLASH_MODEL "MX25L6435E"
+#elif CONFIGURATION_FLASH_SELECT_MX25L25635F
+	#define SIMULATOR_DEFAULT_FLASH_MODEL "MX25L25635F"
+#elif CONFIGURATION_FLASH_SELECT_W25Q64CV
+	#define SIMULATOR_DEFAULT_FLASH_MODEL "W25Q64CV"
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A byte traveling on the simulated wire. */
+typedef struct
+{
+	unsigned char Byte; //!< The byte value.
+	unsigned long long Arrival_Time; //!< When the byte stop bit reaches the other side (simulated time in nanoseconds).
+} TSimulatorWireByte;
+
+/** A chip socket connected to a Slave Select pin, in which the chips are swapped on request. */
+typedef struct
+{
+	const TSimulatorFlashModel *Pointer_Models[SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT]; //!< The chips inserted one after the other, NULL meaning that the socket is empty.
+	TSimulatorFlashFault Faults[SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT][SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT]; //!< The faulty bytes of each chip.
+	unsigned int Faults_Counts[SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT]; //!< How many bytes of each chip are faulty.
+	unsigned int Models_Count; //!< How many chips the socket cycles through.
+	unsigned int Current_Model_Index; //!< The chip currently inserted.
+} TSimulatorSocket;
+
+//-------------------------------------------------------------------------------------------------
+// Registers
+//-------------------------------------------------------------------------------------------------
+volatile unsigned char SFRPAGE, P0 = 0xFF, P2 = 0xFF, P0SKIP, P1SKIP, P0MDOUT, P1MDOUT, P2MDOUT, XBR0, XBR1, OSCICN = OSCICN_IFRDY__SET, CLKSEL = CLKSEL_CLKRDY__SET, PCA0MD, IE, CKCON, TMOD, TH1, TL1, TCON, SCON0, SPI0CFG, SPI0CKR, SPI0CN, SCON0_TI, SCON0_RI, SPI0CN_SPIF;
+volatile unsigned short Simulator_SBUF0 = SIMULATOR_DATA_REGISTER_EMPTY, Simulator_SPI0DAT = SIMULATOR_DATA_REGISTER_EMPTY;
+volatile unsigned char DMA0SEL, DMA0EN, DMA0INT, EIE2;
+volatile unsigned char Simulator_DMA0NCF[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NMD[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NAOL[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NAOH[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NSZL[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NSZH[SIMULATOR_DMA_CHANNELS_COUNT];
+
+/** The real port 1 register. */
+static volatile unsigned char Simulator_Port_1 = 0xFF;
+/** The timer 0 registers values computed on each access. */
+static volatile unsigned char Simulator_Timer_0_High_Byte, Simulator_Timer_0_Low_Byte;
+
+/** The UART interrupt handler, registered by the INTERRUPT() macro. */
+extern void (*Simulator_Interrupt_Handler_UART0_IRQn)(void);
+/** The DMA interrupt handler, which does not exist when the firmware does not use the DMA. */
+extern void (*Simulator_Interrupt_Handler_DMA0_IRQn)(void) __attribute__((weak));
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The simulated time in nanoseconds since the simulator started. */
+static unsigned long long Simulator_Time = 0;
+/** The real time the simulator started at. */
+static struct timespec Simulator_Start_Time;
+
+/** The pseudo-terminal master side. */
+static int Simulator_Terminal_Master = -1;
+/** The pseudo-terminal slave side, kept opened so the master side does not report errors while the PC program is not running. */
+static int Simulator_Terminal_Slave = -1;
+
+/** The bytes read from the pseudo-terminal that are still traveling on the simulated wire. */
+static TSimulatorWireByte Simulator_Reception_Queue[SIMULATOR_UART_RECEPTION_QUEUE_SIZE];
+/** The oldest received byte index. */
+static unsigned int Simulator_Reception_Queue_Read_Index = 0;
+/** How many bytes the reception queue contains. */
+static unsigned int Simulator_Reception_Queue_Bytes_Count = 0;
+/** When the last received byte is fully received. */
+static unsigned long long Simulator_Reception_Last_Arrival_Time = 0;
+/** When the pseudo-terminal must be checked again. */
+static unsigned long long Simulator_Reception_Next_Polling_Time = 0;
+
+/** The bytes sent by the firmware that are delayed by the link before the PC program can read them. */
+static TSimulatorWireByte Simulator_Transmission_Queue[SIMULATOR_UART_TRANSMISSION_QUEUE_SIZE];
+/** The oldest delayed byte index. */
+static unsigned int Simulator_Transmission_Queue_Read_Index = 0;
+/** How many bytes the transmission queue contains. */
+static unsigned int Simulator_Transmission_Queue_Bytes_Count = 0;
+/** How long the link delays each byte sent to the PC program, like a USB serial adapter or a network serial server does (--delay option, in nanoseconds). */
+static unsigned long long Simulator_UART_Delay = 0;
+
+/** Set to 1 while a byte is being transmitted. */
+static int Simulator_Is_Transmission_Running = 0;
+/** The byte being transmitted. */
+static unsigned char Simulator_Transmitted_Byte;
+/** When the byte being transmitted is fully sent. */
+static unsigned long long Simulator_Transmission_End_Time;
+
+/** The block each DMA channel transfers. */
+static unsigned char *Simulator_DMA_Pointers[SIMULATOR_DMA_CHANNELS_COUNT];
+
+/** The flash chips connected to the SPI bus (the model is NULL when the socket is empty). */
+static TSimulatorFlash Simulator_Flashes[SPI_CHIPS_COUNT];
+/** The socket each chip is inserted in. */
+static TSimulatorSocket Simulator_Sockets[SPI_CHIPS_COUNT];
+/** How many sockets are connected. */
+static unsigned int Simulator_Flashes_Count = 0;
+/** The port 1 value the Slave Select pins state was last computed from. */
+static unsigned char Simulator_Last_Port_1 = 0xFF;
+
+/** The probability for each bit traveling on the simulated UART wire to be flipped (--bit-errors option). */
+static double Simulator_Bit_Error_Rate = 0;
+/** The bit errors random generator state. */
+static unsigned int Simulator_Bit_Errors_Random_State = SIMULATOR_BIT_ERRORS_RANDOM_SEED;
+
+/** Some statistics displayed when the simulator exits. */
+static unsigned long long Simulator_SPI_Bytes_Count = 0, Simulator_UART_Transmitted_Bytes_Count = 0, Simulator_UART_Received_Bytes_Count = 0, Simulator_UART_Flipped_Bits_Count = 0;
+
+/** Set to 1 by the signal handler to tell that the simulator must exit. */
+static volatile sig_atomic_t Simulator_Is_Exit_Requested = 0;
+/** Set to 1 by the signal handler to tell that the next chip of each socket must be inserted. */
+static volatile sig_atomic_t Simulator_Is_Chips_Swap_Requested = 0;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Tell how long the simulator has been running for.
+ * @return The real elapsed time in nanoseconds.
+ */
+static unsigned long long SimulatorGetRealTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) (Time.tv_sec - Simulator_Start_Time.tv_sec) * 1000000000ULL + Time.tv_nsec - Simulator_Start_Time.tv_nsec;
+}
+
+/** Keep the simulated time close to the real time, so the PC program sees the simulated hardware timings. The simulator sleeps when the simulated time is ahead, the simulated time jumps forward when the PC was slower than the simulated hardware. */
+static void SimulatorSynchronizeTime(void)
+{
+	unsigned long long Real_Time, Advance;
+	struct timespec Sleep_Time;
+
+	Real_Time = SimulatorGetRealTime();
+	if (Real_Time >= Simulator_Time)
+	{
+		Simulator_Time = Real_Time;
+		return;
+	}
+
+	Advance = Simulator_Time - Real_Time;
+	if (Advance < SIMULATOR_MAXIMUM_TIME_ADVANCE) return;
+	Sleep_Time.tv_sec = Advance / 1000000000ULL;
+	Sleep_Time.tv_nsec = Advance % 1000000000ULL;
+	nanosleep(&Sleep_Time, NULL);
+}
+
+/** Compute how long a byte lasts on the UART wire from the timer 1 configuration.
+ * @return The byte duration in nanoseconds (a start bit, 8 data bits and a stop bit).
+ */
+static unsigned long long SimulatorGetUARTByteTime(void)
+{
+	unsigned long long Timer_Period;
+
+	// The timer 1 overflows every (256 - TH1) clock cycles, the UART needs two overflows per bit
+	Timer_Period = 256 - TH1;
+	if (!(CKCON & CKCON_T1M__SYSCLK)) Timer_Period *= 12; // The timer is clocked by the prescaler, only SYSCLK / 12 is simulated
+	return 10 * 2 * Timer_Period * 1000000000ULL / SIMULATOR_SYSTEM_CLOCK_FREQUENCY;
+}
+
+/** Compute how long a byte lasts on the SPI bus from the SPI clock configuration.
+ * @return The byte duration in nanoseconds.
+ */
+static unsigned long long SimulatorGetSPIByteTime(void)
+{
+	// The SPI clock frequency is SYSCLK / (2 * (SPI0CKR + 1))
+	return 8 * 2 * (SPI0CKR + 1ULL) * 1000000000ULL / SIMULATOR_SYSTEM_CLOCK_FREQUENCY;
+}
+
+/** Flip the bits of a byte traveling on the UART wire according to the bit error rate.
+ * @param Byte The sent byte.
+ * @return The byte the other side receives.
+ */
+static unsigned char SimulatorCorruptUARTByte(unsigned char Byte)
+{
+	int i;
+
+	if (Simulator_Bit_Error_Rate <= 0) return Byte;
+
+	for (i = 0; i < 8; i++)
+	{
+		// Use a xorshift generator, which always gives the same numbers unlike rand()
+		Simulator_Bit_Errors_Random_State ^= Simulator_Bit_Errors_Random_State << 13;
+		Simulator_Bit_Errors_Random_State ^= Simulator_Bit_Errors_Random_State >> 17;
+		Simulator_Bit_Errors_Random_State ^= Simulator_Bit_Errors_Random_State << 5;
+		if (Simulator_Bit_Errors_Random_State < Simulator_Bit_Error_Rate * 4294967296.0)
+		{
+			Byte ^= 1 << i;
+			Simulator_UART_Flipped_Bits_Count++;
+		}
+	}
+	return Byte;
+}
+
+/** Call the UART interrupt handler if an interrupt flag is set and the interrupts are enabled. */
+static void SimulatorCallUARTInterruptHandler(void)
+{
+	if (!(IE & IE_EA__ENABLED) || !(IE & IE_ES0__ENABLED)) return;
+	if (SCON0_TI || SCON0_RI) Simulator_Interrupt_Handler_UART0_IRQn();
+}
+
+/** Read the bytes sent by the PC program.
+ * @param Timeout How long to wait for a byte in milliseconds (0 to return immediately, -1 to wait forever).
+ */
+static void SimulatorReadTerminal(int Timeout)
+{
+	struct pollfd Poll_Descriptor;
+	unsigned char Buffer[4096];
+	unsigned int Size, Index, i;
+	ssize_t Read_Bytes_Count;
+
+	Simulator_Reception_Next_Polling_Time = Simulator_Time + SIMULATOR_UART_POLLING_PERIOD;
+
+	// Leave the bytes in the pseudo-terminal while the simulated wire is full
+	Size = SIMULATOR_UART_RECEPTION_QUEUE_SIZE - Simulator_Reception_Queue_Bytes_Count;
+	if (Size == 0) return;
+	if (Size > sizeof(Buffer)) Size = sizeof(Buffer);
+
+	Poll_Descriptor.fd = Simulator_Terminal_Master;
+	Poll_Descriptor.events = POLLIN;
+	if (poll(&Poll_Descriptor, 1, Timeout) <= 0) return;
+
+	Read_Bytes_Count = read(Simulator_Terminal_Master, Buffer, Size);
+	if (Read_Bytes_Count <= 0) return;
+	SimulatorSynchronizeTime(); // The simulated time stood still while waiting
+
+	// The bytes travel one after the other at the baud rate
+	for (i = 0; i < (unsigned int) Read_Bytes_Count; i++)
+	{
+		if (Simulator_Reception_Last_Arrival_Time < Simulator_Time) Simulator_Reception_Last_Arrival_Time = Simulator_Time;
+		Simulator_Reception_Last_Arrival_Time += SimulatorGetUARTByteTime();
+
+		Index = (Simulator_Reception_Queue_Read_Index + Simulator_Reception_Queue_Bytes_Count) % SIMULATOR_UART_RECEPTION_QUEUE_SIZE;
+		Simulator_Reception_Queue[Index].Byte = SimulatorCorruptUARTByte(Buffer[i]);
+		Simulator_Reception_Queue[Index].Arrival_Time = Simulator_Reception_Last_Arrival_Time;
+		Simulator_Reception_Queue_Bytes_Count++;
+	}
+}
+
+/** Terminate the UART transmission and reception whose time has come. */
+static void SimulatorUpdateUART(void)
+{
+	TSimulatorWireByte *Pointer_Received_Byte, *Pointer_Sent_Byte;
+	unsigned int Index;
+
+	// The byte travels to the PC program when its stop bit has been sent
+	if (Simulator_Is_Transmission_Running && (Simulator_Time >= Simulator_Transmission_End_Time))
+	{
+		// Make room for the byte by giving the oldest one to the PC program early (this can't happen unless the baud rate is higher than the firmware one)
+		if (Simulator_Transmission_Queue_Bytes_Count == SIMULATOR_UART_TRANSMISSION_QUEUE_SIZE) Simulator_Transmission_Queue[Simulator_Transmission_Queue_Read_Index].Arrival_Time = Simulator_Time;
+		else
+		{
+			Index = (Simulator_Transmission_Queue_Read_Index + Simulator_Transmission_Queue_Bytes_Count) % SIMULATOR_UART_TRANSMISSION_QUEUE_SIZE;
+			Simulator_Transmission_Queue[Index].Byte = SimulatorCorruptUARTByte(Simulator_Transmitted_Byte);
+			Simulator_Transmission_Queue[Index].Arrival_Time = Simulator_Transmission_End_Time + Simulator_UART_Delay;
+			Simulator_Transmission_Queue_Bytes_Count++;
+			Simulator_UART_Transmitted_Bytes_Count++;
+			Simulator_Is_Transmission_Running = 0;
+			SCON0_TI = 1;
+			SimulatorCallUARTInterruptHandler();
+		}
+	}
+
+	// Give the PC program the bytes that went through the link
+	while (Simulator_Transmission_Queue_Bytes_Count > 0)
+	{
+		Pointer_Sent_Byte = &Simulator_Transmission_Queue[Simulator_Transmission_Queue_Read_Index];
+		if (Pointer_Sent_Byte->Arrival_Time > Simulator_Time) break;
+
+		if (write(Simulator_Terminal_Master, &Pointer_Sent_Byte->Byte, 1) != 1) printf("Error : could not write to the pseudo-terminal (%s).\n", strerror(errno));
+		Simulator_Transmission_Queue_Read_Index = (Simulator_Transmission_Queue_Read_Index + 1) % SIMULATOR_UART_TRANSMISSION_QUEUE_SIZE;
+		Simulator_Transmission_Queue_Bytes_Count--;
+	}
+
+	// Receive the bytes that have arrived, one byte at a time like the hardware
+	while ((Simulator_Reception_Queue_Bytes_Count > 0) && !SCON0_RI)
+	{
+		Pointer_Received_Byte = &Simulator_Reception_Queue[Simulator_Reception_Queue_Read_Index];
+		if (Pointer_Received_Byte->Arrival_Time > Simulator_Time) break;
+
+		Simulator_Reception_Queue_Read_Index = (Simulator_Reception_Queue_Read_Index + 1) % SIMULATOR_UART_RECEPTION_QUEUE_SIZE;
+		Simulator_Reception_Queue_Bytes_Count--;
+		if (!(SCON0 & SCON0_REN__RECEIVE_ENABLED)) continue; // The byte is lost
+
+		Simulator_UART_Received_Bytes_Count++;
+		Simulator_SBUF0 = SIMULATOR_DATA_REGISTER_EMPTY | Pointer_Received_Byte->Byte; // Reading the register as an 8-bit value gives the byte
+		SCON0_RI = 1;
+		SimulatorCallUARTInterruptHandler();
+	}
+}
+
+/** Tell the flash chips which Slave Select pins changed since the last check. */
+static void SimulatorUpdateSlaveSelectPins(void)
+{
+	unsigned int i;
+	unsigned char Changed_Pins;
+
+	Changed_Pins = (Simulator_Port_1 ^ Simulator_Last_Port_1) & SPI_SLAVE_SELECT_PINS_MASK;
+	if (Changed_Pins == 0) return;
+	Simulator_Last_Port_1 = Simulator_Port_1;
+
+	// The chip 0 Slave Select pin is P1.2 (the pins are active low)
+	for (i = 0; i < Simulator_Flashes_Count; i++)
+	{
+		if (Simulator_Flashes[i].Pointer_Model == NULL) continue; // Nothing is connected to an empty socket
+		if (Changed_Pins & (1 << (i + 2))) SimulatorFlashSetSelected(&Simulator_Flashes[i], !(Simulator_Port_1 & (1 << (i + 2))), Simulator_Time);
+	}
+}
+
+/** Exchange the byte written to SPI0DAT with all selected chips. */
+static void SimulatorTransferSPIByte(void)
+{
+	unsigned char Received_Byte = 0xFF;
+	unsigned int i;
+
+	SimulatorUpdateSlaveSelectPins();
+
+	// Several selected chips drive the MISO line at the same time, a low level wins
+	for (i = 0; i < Simulator_Flashes_Count; i++)
+	{
+		if ((Simulator_Flashes[i].Pointer_Model != NULL) && Simulator_Flashes[i].Is_Selected) Received_Byte &= SimulatorFlashApplyWiringFaults(&Simulator_Flashes[i], SimulatorFlashTransferByte(&Simulator_Flashes[i], (unsigned char) Simulator_SPI0DAT, Simulator_Time), SPI0CKR);
+	}
+
+	Simulator_Time += SimulatorGetSPIByteTime();
+	Simulator_SPI0DAT = SIMULATOR_DATA_REGISTER_EMPTY | Received_Byte; // Reading the register as an 8-bit value gives the byte
+	SPI0CN_SPIF = 1;
+	Simulator_SPI_Bytes_Count++;
+}
+
+/** Find the running DMA channel serving a peripheral request.
+ * @param Peripheral The request to look for.
+ * @return The channel number or -1 if no running channel serves this request.
+ */
+static int SimulatorFindDMAChannel(unsigned char Peripheral)
+{
+	int i;
+	unsigned int Offset, Size;
+
+	for (i = 0; i < SIMULATOR_DMA_CHANNELS_COUNT; i++)
+	{
+		if (!(DMA0EN & (1 << i)) || ((Simulator_DMA0NCF[i] & DMA0NCF_PERIPH__FMASK) != Peripheral)) continue;
+
+		// A channel that transferred its whole block waits for the firmware to disable it
+		Offset = (Simulator_DMA0NAOH[i] << 8) | Simulator_DMA0NAOL[i];
+		Size = (Simulator_DMA0NSZH[i] << 8) | Simulator_DMA0NSZL[i];
+		if (Offset < Size) return i;
+	}
+	return -1;
+}
+
+/** Get the address of the next byte a DMA channel transfers, then move the channel to the following byte. The DMA interrupt is raised when the channel reaches the block end.
+ * @param Channel The channel.
+ * @return The byte address.
+ */
+static unsigned char *SimulatorAdvanceDMAChannel(int Channel)
+{
+	unsigned int Offset, Size;
+	unsigned char *Pointer_Byte;
+
+	Offset = (Simulator_DMA0NAOH[Channel] << 8) | Simulator_DMA0NAOL[Channel];
+	Size = (Simulator_DMA0NSZH[Channel] << 8) | Simulator_DMA0NSZL[Channel];
+	Pointer_Byte = &Simulator_DMA_Pointers[Channel][Offset];
+
+	Offset++;
+	Simulator_DMA0NAOH[Channel] = (unsigned char) (Offset >> 8);
+	Simulator_DMA0NAOL[Channel] = (unsigned char) Offset;
+	if (Offset == Size)
+	{
+		DMA0INT |= 1 << Channel;
+		if ((Simulator_DMA0NCF[Channel] & DMA0NCF_IEN__ENABLED) && (IE & IE_EA__ENABLED) && (EIE2 & EIE2_EDMA0__ENABLED) && (&Simulator_Interrupt_Handler_DMA0_IRQn != NULL)) Simulator_Interrupt_Handler_DMA0_IRQn();
+	}
+
+	return Pointer_Byte;
+}
+
+/** Let the DMA exchange a byte with the SPI module, like the firmware would do.
+ * @return 1 if a byte was transferred, 0 if no SPI transmit channel is running.
+ */
+static int SimulatorTransferDMAByte(void)
+{
+	int Transmit_Channel, Receive_Channel;
+
+	// The SPI master receives a byte only when it sends one
+	Transmit_Channel = SimulatorFindDMAChannel(SIMULATOR_DMA_PERIPHERAL_SPI0_TRANSMIT);
+	if ((Transmit_Channel < 0) || !(SPI0CN & SPI0CN_SPIEN__ENABLED)) return 0;
+	Receive_Channel = SimulatorFindDMAChannel(SIMULATOR_DMA_PERIPHERAL_SPI0_RECEIVE);
+
+	Simulator_SPI0DAT = *SimulatorAdvanceDMAChannel(Transmit_Channel);
+	SimulatorTransferSPIByte();
+
+	if (Receive_Channel >= 0)
+	{
+		*SimulatorAdvanceDMAChannel(Receive_Channel) = (unsigned char) Simulator_SPI0DAT;
+		SPI0CN_SPIF = 0;
+	}
+	return 1;
+}
+
+/** Start sending the byte the firmware wrote to SBUF0. */
+static void SimulatorStartUARTTransmission(void)
+{
+	if (Simulator_SBUF0 >= SIMULATOR_DATA_REGISTER_EMPTY) return;
+
+	Simulator_Transmitted_Byte = (unsigned char) Simulator_SBUF0;
+	Simulator_SBUF0 = SIMULATOR_DATA_REGISTER_EMPTY;
+	if (Simulator_Transmission_End_Time < Simulator_Time) Simulator_Transmission_End_Time = Simulator_Time;
+	Simulator_Transmission_End_Time += SimulatorGetUARTByteTime();
+	Simulator_Is_Transmission_Running = 1;
+}
+
+/** Let the UART progress while the SPI bus is busy, the PC keeps sending bytes meanwhile. */
+static void SimulatorUpdateUARTDuringSPITransfer(void)
+{
+	if (Simulator_Time >= Simulator_Reception_Next_Polling_Time)
+	{
+		SimulatorSynchronizeTime();
+		SimulatorReadTerminal(0);
+	}
+	SimulatorUpdateUART();
+}
+
+/** Display what the simulated hardware did and exit. */
+static void SimulatorExit(void)
+{
+	unsigned int i;
+
+	printf("Simulated time : %llu ms.\n", Simulator_Time / 1000000);
+	printf("SPI bytes : %llu, UART bytes sent : %llu, UART bytes received : %llu.\n", Simulator_SPI_Bytes_Count, Simulator_UART_Transmitted_Bytes_Count, Simulator_UART_Received_Bytes_Count);
+	if (Simulator_Bit_Error_Rate > 0) printf("UART flipped bits : %llu.\n", Simulator_UART_Flipped_Bits_Count);
+	for (i = 0; i < Simulator_Flashes_Count; i++)
+	{
+		if (Simulator_Flashes[i].Pointer_Model != NULL) printf("Chip %u (%s) busy time : %llu ms.\n", i, Simulator_Flashes[i].Pointer_Model->String_Name, Simulator_Flashes[i].Busy_Time / 1000000);
+	}
+	exit(EXIT_SUCCESS);
+}
+
+/** Request the simulator to exit, or to swap the chips on SIGUSR1.
+ * @param Signal_Number The received signal.
+ */
+static void SimulatorSignalHandler(int Signal_Number)
+{
+	if (Signal_Number == SIGUSR1) Simulator_Is_Chips_Swap_Requested = 1;
+	else Simulator_Is_Exit_Requested = 1;
+}
+
+/** Put the current chip of a socket in it. A new chip is erased.
+ * @param Socket_Index The socket.
+ * @return 0 on success, -1 if the chip memory could not be allocated (an error message is displayed).
+ */
+static int SimulatorInsertChip(unsigned int Socket_Index)
+{
+	TSimulatorSocket *Pointer_Socket = &Simulator_Sockets[Socket_Index];
+	const TSimulatorFlashModel *Pointer_Model;
+
+	Pointer_Model = Pointer_Socket->Pointer_Models[Pointer_Socket->Current_Model_Index];
+	if (Pointer_Model == NULL)
+	{
+		memset(&Simulator_Flashes[Socket_Index], 0, sizeof(TSimulatorFlash));
+		return 0;
+	}
+	return SimulatorFlashInitialize(&Simulator_Flashes[Socket_Index], Pointer_Model, Pointer_Socket->Faults[Pointer_Socket->Current_Model_Index], Pointer_Socket->Faults_Counts[Pointer_Socket->Current_Model_Index]);
+}
+
+/** Replace the chip of each socket cycling through several chips by the next one. */
+static void SimulatorSwapChips(void)
+{
+	unsigned int i;
+	TSimulatorSocket *Pointer_Socket;
+
+	Simulator_Is_Chips_Swap_Requested = 0;
+	for (i = 0; i < Simulator_Flashes_Count; i++)
+	{
+		Pointer_Socket = &Simulator_Sockets[i];
+		if (Pointer_Socket->Models_Count < 2) continue;
+
+		if (Simulator_Flashes[i].Pointer_Model != NULL) SimulatorFlashUninitialize(&Simulator_Flashes[i]);
+		Pointer_Socket->Current_Model_Index = (Pointer_Socket->Current_Model_Index + 1) % Pointer_Socket->Models_Count;
+		if (SimulatorInsertChip(i) != 0) exit(EXIT_FAILURE);
+
+		if (Simulator_Flashes[i].Pointer_Model == NULL) printf("Socket %u : empty.\n", i);
+		else printf("Socket %u : %s inserted.\n", i, Simulator_Flashes[i].Pointer_Model->String_Name);
+		fflush(stdout);
+	}
+}
+
+/** Create the pseudo-terminal the PC program will connect to.
+ * @return 0 if the pseudo-terminal was created, -1 if an error occurred (an error message is displayed).
+ */
+static int SimulatorCreateTerminal(void)
+{
+	char *String_Slave_Name;
+	struct termios Parameters;
+
+	Simulator_Terminal_Master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((Simulator_Terminal_Master == -1) || (grantpt(Simulator_Terminal_Master) != 0) || (unlockpt(Simulator_Terminal_Master) != 0))
+	{
+		printf("Error : could not create the pseudo-terminal (%s).\n", strerror(errno));
+		return -1;
+	}
+	String_Slave_Name = ptsname(Simulator_Terminal_Master);
+
+	// Transmit the bytes as they are
+	Simulator_Terminal_Slave = open(String_Slave_Name, O_RDWR | O_NOCTTY);
+	if ((Simulator_Terminal_Slave == -1) || (tcgetattr(Simulator_Terminal_Slave, &Parameters) != 0))
+	{
+		printf("Error : could not open the pseudo-terminal '%s' (%s).\n", String_Slave_Name, strerror(errno));
+		return -1;
+	}
+	cfmakeraw(&Parameters);
+	tcsetattr(Simulator_Terminal_Slave, TCSANOW, &Parameters);
+
+	// Tell the serial port name to use
+	printf("%s\n", String_Slave_Name);
+	fflush(stdout);
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+void SimulatorWait(void)
+{
+	unsigned long long Next_Event_Time;
+
+	if (Simulator_Is_Exit_Requested) SimulatorExit();
+	if (Simulator_Is_Chips_Swap_Requested) SimulatorSwapChips();
+
+	// The DMA moves a SPI byte while the firmware serves the UART
+	if (SimulatorTransferDMAByte())
+	{
+		SimulatorStartUARTTransmission();
+		SimulatorUpdateUARTDuringSPITransfer();
+		return;
+	}
+
+	// The firmware started a SPI transfer
+	if (Simulator_SPI0DAT < SIMULATOR_DATA_REGISTER_EMPTY)
+	{
+		if (SPI0CN & SPI0CN_SPIEN__ENABLED) SimulatorTransferSPIByte();
+		SimulatorUpdateUARTDuringSPITransfer();
+		return;
+	}
+	SimulatorUpdateSlaveSelectPins();
+
+	// The firmware started a UART transmission
+	SimulatorStartUARTTransmission();
+
+	// Nothing else can happen until the next UART event, so jump to it
+	if (Simulator_Is_Transmission_Running) Next_Event_Time = Simulator_Transmission_End_Time;
+	else if (Simulator_Reception_Queue_Bytes_Count > 0) Next_Event_Time = Simulator_Reception_Queue[Simulator_Reception_Queue_Read_Index].Arrival_Time;
+	else if (Simulator_Transmission_Queue_Bytes_Count > 0)
+	{
+		// The firmware is waiting for the PC while the sent bytes are still delayed by the link, so the PC can send bytes until the oldest one arrives
+		SimulatorSynchronizeTime();
+		Next_Event_Time = Simulator_Transmission_Queue[Simulator_Transmission_Queue_Read_Index].Arrival_Time;
+		if (Next_Event_Time > Simulator_Time) SimulatorReadTerminal((Next_Event_Time - Simulator_Time + 999999) / 1000000);
+		SimulatorSynchronizeTime();
+		SimulatorUpdateUART();
+		return;
+	}
+	else
+	{
+		// The firmware is waiting for the PC
+		SimulatorReadTerminal(-1);
+		return;
+	}
+	if ((Simulator_Transmission_Queue_Bytes_Count > 0) && (Simulator_Transmission_Queue[Simulator_Transmission_Queue_Read_Index].Arrival_Time < Next_Event_Time)) Next_Event_Time = Simulator_Transmission_Queue[Simulator_Transmission_Queue_Read_Index].Arrival_Time;
+
+	if (Next_Event_Time > Simulator_Time) Simulator_Time = Next_Event_Time;
+	SimulatorSynchronizeTime();
+	SimulatorReadTerminal(0);
+	SimulatorUpdateUART();
+}
+
+void SimulatorSetDMAAddress(unsigned char *Pointer_Buffer)
+{
+	Simulator_DMA_Pointers[DMA0SEL] = Pointer_Buffer;
+}
+
+volatile unsigned char *SimulatorAccessPort1(void)
+{
+	// The previous access may have changed the pins
+	SimulatorUpdateSlaveSelectPins();
+	return &Simulator_Port_1;
+}
+
+volatile unsigned char *SimulatorAccessTimer0(int Is_High_Byte)
+{
+	unsigned long long Divider, Ticks;
+
+	// Find the timer clock (the written values are ignored, only the elapsed time between two reads matters)
+	if (CKCON & CKCON_T0M__SYSCLK) Divider = 1;
+	else if ((CKCON & CKCON_SCA__FMASK) == CKCON_SCA__SYSCLK_DIV_4) Divider = 4;
+	else if ((CKCON & CKCON_SCA__FMASK) == CKCON_SCA__SYSCLK_DIV_48) Divider = 48;
+	else Divider = 12;
+
+	if (TCON & TCON_TR0__RUN) Ticks = Simulator_Time * (SIMULATOR_SYSTEM_CLOCK_FREQUENCY / 500000) / (2000 * Divider); // Avoid an overflow when the simulator runs for long
+	else Ticks = 0;
+
+	if (Is_High_Byte)
+	{
+		Simulator_Timer_0_High_Byte = (unsigned char) (Ticks >> 8);
+		return &Simulator_Timer_0_High_Byte;
+	}
+	Simulator_Timer_0_Low_Byte = (unsigned char) Ticks;
+	return &Simulator_Timer_0_Low_Byte;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	char *String_Chips, *String_Socket, *String_Model, *String_Fault, *Pointer_Chips_Context, *Pointer_Socket_Context, *Pointer_Model_Context;
+	const TSimulatorFlashModel *Pointer_Model;
+	TSimulatorSocket *Pointer_Socket;
+	int Delay;
+
+	// Get the options
+	while ((argc > 2) && (argv[1][0] == '-'))
+	{
+		if (strcmp(argv[1], "--bit-errors") == 0)
+		{
+			Simulator_Bit_Error_Rate = atof(argv[2]);
+			if ((Simulator_Bit_Error_Rate < 0) || (Simulator_Bit_Error_Rate >= 1))
+			{
+				printf("Error : the bit error rate must be between 0 and 1.\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[1], "--delay") == 0)
+		{
+			Delay = atoi(argv[2]);
+			if ((Delay < 0) || (Delay > SIMULATOR_UART_MAXIMUM_DELAY))
+			{
+				printf("Error : the delay must be between 0 and %d milliseconds.\n", SIMULATOR_UART_MAXIMUM_DELAY);
+				return EXIT_FAILURE;
+			}
+			Simulator_UART_Delay = Delay * 1000000ULL;
+		}
+		else break;
+		argv += 2;
+		argc -= 2;
+	}
+
+	// Check parameters
+	if ((argc > 2) || ((argc == 2) && (argv[1][0] == '-')))
+	{
+		printf("Usage : %s [--bit-errors Rate] [--delay Milliseconds] [Chips]\n"
+			"Simulate the programmer board and print the serial port to connect to.\n"
+			"--bit-errors flips each bit sent on the UART wire in both directions with the probability Rate (for instance 1e-5), always the same bits for a given Rate.\n"
+			"--delay makes each byte sent to the PC arrive Milliseconds later (up to %d), like a USB serial adapter or a network serial server adds latency.\n"
+			"Chips is a comma-separated list of up to %d sockets, the first one is connected to the chip 0 Slave Select pin (default : %s).\n"
+			"A socket is a chip reference, '%s' for an empty socket, or several of them separated by '/' : the socket holds the first one, and the next one replaces it each time the simulator receives SIGUSR1.\n"
+			"A chip reference can be followed by up to %d faulty bytes, each one written as ':Type@Address(hex)' (for instance W25Q64CV:weak@1000:stuck@2345) :\n"
+			"  weak       the first %d program cycles following an erase do not change the byte,\n"
+			"  stuck      the byte stays erased whatever is programmed,\n"
+			"  disturbed  the first program cycle of the page clears all the byte bits, once,\n"
+			"  wiring     the Address is a SPI0CKR value, the bytes sent by the chip are corrupted with faster SPI clocks.\n"
+			"Known chips :\n", argv[0], SIMULATOR_UART_MAXIMUM_DELAY, SPI_CHIPS_COUNT, SIMULATOR_DEFAULT_FLASH_MODEL, SIMULATOR_SOCKET_EMPTY_NAME, SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT, SIMULATOR_FLASH_WEAK_IGNORED_PROGRAMS_COUNT);
+		SimulatorFlashDisplayModels();
+		return EXIT_FAILURE;
+	}
+	if (argc == 2) String_Chips = argv[1];
+	else String_Chips = SIMULATOR_DEFAULT_FLASH_MODEL;
+
+	// Connect the sockets
+	String_Socket = strtok_r(String_Chips, ",", &Pointer_Chips_Context);
+	while (String_Socket != NULL)
+	{
+		if (Simulator_Flashes_Count == SPI_CHIPS_COUNT)
+		{
+			printf("Error : no more than %d chips can be connected.\n", SPI_CHIPS_COUNT);
+			return EXIT_FAILURE;
+		}
+		Pointer_Socket = &Simulator_Sockets[Simulator_Flashes_Count];
+
+		// Find all chips the socket will hold
+		String_Model = strtok_r(String_Socket, "/", &Pointer_Socket_Context);
+		while (String_Model != NULL)
+		{
+			if (Pointer_Socket->Models_Count == SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT)
+			{
+				printf("Error : a socket can't hold more than %d chips.\n", SIMULATOR_SOCKET_MAXIMUM_MODELS_COUNT);
+				return EXIT_FAILURE;
+			}
+
+			// Separate the faulty bytes from the chip reference
+			String_Model = strtok_r(String_Model, ":", &Pointer_Model_Context);
+			String_Fault = strtok_r(NULL, ":", &Pointer_Model_Context);
+			while (String_Fault != NULL)
+			{
+				if (Pointer_Socket->Faults_Counts[Pointer_Socket->Models_Count] == SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT)
+				{
+					printf("Error : a chip can't have more than %d faulty bytes.\n", SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT);
+					return EXIT_FAILURE;
+				}
+				if (SimulatorFlashParseFault(String_Fault, &Pointer_Socket->Faults[Pointer_Socket->Models_Count][Pointer_Socket->Faults_Counts[Pointer_Socket->Models_Count]]) != 0)
+				{
+					printf("Error : invalid fault '%s'.\n", String_Fault);
+					return EXIT_FAILURE;
+				}
+				Pointer_Socket->Faults_Counts[Pointer_Socket->Models_Count]++;
+				String_Fault = strtok_r(NULL, ":", &Pointer_Model_Context);
+			}
+
+			if (strcmp(String_Model, SIMULATOR_SOCKET_EMPTY_NAME) == 0) Pointer_Model = NULL;
+			else
+			{
+				Pointer_Model = SimulatorFlashFindModel(String_Model);
+				if (Pointer_Model == NULL)
+				{
+					printf("Error : unknown chip '%s'.\n", String_Model);
+					return EXIT_FAILURE;
+				}
+			}
+			Pointer_Socket->Pointer_Models[Pointer_Socket->Models_Count] = Pointer_Model;
+			Pointer_Socket->Models_Count++;
+
+			String_Model = strtok_r(NULL, "/", &Pointer_Socket_Context);
+		}
+
+		if (SimulatorInsertChip(Simulator_Flashes_Count) != 0) return EXIT_FAILURE;
+		Simulator_Flashes_Count++;
+
+		String_Socket = strtok_r(NULL, ",", &Pointer_Chips_Context);
+	}
+
+	if (SimulatorCreateTerminal() != 0) return EXIT_FAILURE;
+
+	// Display the statistics when the simulator is stopped
+	signal(SIGINT, SimulatorSignalHandler);
+	signal(SIGTERM, SimulatorSignalHandler);
+	signal(SIGUSR1, SimulatorSignalHandler); // Swap the chips
+
+	clock_gettime(CLOCK_MONOTONIC, &Simulator_Start_Time);
+	SimulatorFirmwareMain();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/** @file Simulator.h
+ * Emulate the C8051F970 registers and peripherals used by the firmware, so that the unmodified firmware can be built with gcc and run on a PC.
+ * The UART is connected to a pseudo-terminal the PC program can open like a real serial port, the SPI bus is connected to flash chip models.
+ * Only the peripherals are timed : SPI and UART bytes last what they last on the board at the configured clocks and the flash chips are busy as long as their datasheet tells. The firmware code itself runs at the PC speed.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_SIMULATOR_H
+#define H_SIMULATOR_H
+
+//-------------------------------------------------------------------------------------------------
+// Keil C51 extensions
+//-------------------------------------------------------------------------------------------------
+#define xdata
+#define code const
+#define bit unsigned char
+
+/** Register the interrupt handler so the simulator can call it. */
+#define INTERRUPT(Name, Vector) void Name(void); void (*Simulator_Interrupt_Handler_##Vector)(void) = Name; void Name(void)
+
+/** The firmware entry point is called by the simulator one. */
+#define main SimulatorFirmwareMain
+
+/** Let the simulated peripherals progress while the firmware is busy waiting. */
+#define HARDWARE_WAIT() SimulatorWait()
+
+/** Keep the real pointer, which does not fit in the DMA address registers. */
+#define HARDWARE_DMA_SET_ADDRESS(Pointer_Buffer) SimulatorSetDMAAddress(Pointer_Buffer)
+
+//-------------------------------------------------------------------------------------------------
+// Registers
+//-------------------------------------------------------------------------------------------------
+/** The registers without side effects are plain variables. */
+extern volatile unsigned char SFRPAGE, P0, P2, P0SKIP, P1SKIP, P0MDOUT, P1MDOUT, P2MDOUT, XBR0, XBR1, OSCICN, CLKSEL, PCA0MD, IE, CKCON, TMOD, TH1, TL1, TCON, SCON0, SPI0CFG, SPI0CKR, SPI0CN, SCON0_TI, SCON0_RI, SPI0CN_SPIF;
+
+/** The DMA channel registers are banked, DMA0SEL chooses the visible channel. */
+#define SIMULATOR_DMA_CHANNELS_COUNT 7
+extern volatile unsigned char DMA0SEL, DMA0EN, DMA0INT, EIE2;
+extern volatile unsigned char Simulator_DMA0NCF[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NMD[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NAOL[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NAOH[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NSZL[SIMULATOR_DMA_CHANNELS_COUNT], Simulator_DMA0NSZH[SIMULATOR_DMA_CHANNELS_COUNT];
+#define DMA0NCF Simulator_DMA0NCF[DMA0SEL]
+#define DMA0NMD Simulator_DMA0NMD[DMA0SEL]
+#define DMA0NAOL Simulator_DMA0NAOL[DMA0SEL]
+#define DMA0NAOH Simulator_DMA0NAOH[DMA0SEL]
+#define DMA0NSZL Simulator_DMA0NSZL[DMA0SEL]
+#define DMA0NSZH Simulator_DMA0NSZH[DMA0SEL]
+
+/** The data registers hold a value greater than 0xFF when the firmware did not write to them, so the simulator knows when a byte must be sent. */
+extern volatile unsigned short Simulator_SBUF0, Simulator_SPI0DAT;
+#define SBUF0 Simulator_SBUF0
+#define SPI0DAT Simulator_SPI0DAT
+
+/** The port 1 drives the chip Slave Select pins, so each access is seen by the simulator. */
+#define P1 (*SimulatorAccessPort1())
+
+/** The timer 0 value is computed from the simulated time. */
+#define TH0 (*SimulatorAccessTimer0(1))
+#define TL0 (*SimulatorAccessTimer0(0))
+
+//-------------------------------------------------------------------------------------------------
+// Registers values
+//-------------------------------------------------------------------------------------------------
+#define LEGACY_PAGE 0x00
+#define CONFIG_PAGE 0x0F
+
+#define UART0_IRQn 4
+#define DMA0_IRQn 16
+
+#define OSCICN_IOSCEN__ENABLED 0x80
+#define OSCICN_IFRDY__SET 0x40
+#define CLKSEL_CLKDIV__SYSCLK_DIV_1 0x00
+#define CLKSEL_CLKRDY__SET 0x80
+#define XBR0_URT0E__ENABLED 0x01
+#define XBR0_SPI0E__ENABLED 0x02
+#define XBR1_XBARE__ENABLED 0x40
+#define XBR1_WEAKPUD__PULL_UPS_ENABLED 0x00
+#define PCA0MD_WDTE__ENABLED 0x40
+#define IE_EA__ENABLED 0x80
+#define IE_ES0__ENABLED 0x10
+#define CKCON_T1M__SYSCLK 0x08
+#define CKCON_T0M__SYSCLK 0x04
+#define CKCON_T0M__PRESCALE 0x00
+#define CKCON_SCA__FMASK 0x03
+#define CKCON_SCA__SYSCLK_DIV_12 0x00
+#define CKCON_SCA__SYSCLK_DIV_4 0x01
+#define CKCON_SCA__SYSCLK_DIV_48 0x02
+#define TMOD_T1M__MODE2 0x20
+#define TMOD_T0M__MODE1 0x01
+#define TCON_TR1__RUN 0x40
+#define TCON_TR0__RUN 0x10
+#define SCON0_REN__RECEIVE_ENABLED 0x10
+#define EIE2_EDMA0__ENABLED 0x20
+#define DMA0NCF_IEN__ENABLED 0x80
+#define DMA0NCF_PERIPH__FMASK 0x1F
+#define DMA0NMD_WRAP__DISABLED 0x00
+#define SPI0CFG_SPIBSY__SET 0x80
+#define SPI0CFG_MSTEN__MASTER_ENABLED 0x40
+#define SPI0CFG_CKPHA__DATA_CENTERED_FIRST 0x00
+#define SPI0CFG_CKPOL__IDLE_LOW 0x00
+#define SPI0CFG_SRMT__SET 0x04
+#define SPI0CFG_RXBMT__SET 0x01
+#define SPI0CN_NSSMD__3_WIRE 0x00
+#define SPI0CN_TXBMT__SET 0x02
+#define SPI0CN_SPIEN__ENABLED 0x01
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** The firmware entry point (the firmware main() function renamed). */
+void SimulatorFirmwareMain(void);
+
+/** Make the peripherals progress : send the byte written to SPI0DAT or SBUF0, deliver the received UART bytes, and block until something happens if the firmware is only waiting for the PC. */
+void SimulatorWait(void);
+
+/** Set the xdata address of the DMA channel selected by DMA0SEL.
+ * @param Pointer_Buffer The block the channel transfers.
+ */
+void SimulatorSetDMAAddress(unsigned char *Pointer_Buffer);
+
+/** Give access to the port 1 register, detecting the Slave Select pins changes.
+ * @return The port 1 register.
+ */
+volatile unsigned char *SimulatorAccessPort1(void);
+
+/** Give access to a timer 0 register.
+ * @param Is_High_Byte Set to 1 to access TH0, set to 0 to access TL0.
+ * @return The timer register, updated from the simulated time.
+ */
+volatile unsigned char *SimulatorAccessTimer0(int Is_High_Byte);
+
+#endif
@@ -0,0 +1,345 @@
+/** @file Simulator_Flash.c
+ * @see Simulator_Flash.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Simulator_Flash.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The value read on MISO when no chip drives the bus. */
+#define SIMULATOR_FLASH_BUS_IDLE_VALUE 0xFF
+
+/** The status register Write In Progress bit. */
+#define SIMULATOR_FLASH_STATUS_WIP 0x01
+/** The status register Write Enable Latch bit. */
+#define SIMULATOR_FLASH_STATUS_WEL 0x02
+/** The MX25L25635F configuration register bit telling that the 4-byte addressing mode is enabled. */
+#define SIMULATOR_FLASH_CONFIGURATION_4BYTE 0x20
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** All known chips with their datasheet typical times. */
+static const TSimulatorFlashModel Simulator_Flash_Models[] =
+{
+	{"W25Q64CV", 0xEF, 0x4017, 8 * 1024 * 1024, 0, 700, 30000, 15000},
+	{"MX25L6435E", 0xC2, 0x2017, 8 * 1024 * 1024, 0, 1400, 60000, 50000},
+	{"MX25L25635F", 0xC2, 0x2019, 32 * 1024 * 1024, 1, 500, 43000, 150000}
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Tell if a program or erase operation is running.
+ * @param Pointer_Flash The chip.
+ * @param Time The current simulated time in nanoseconds.
+ * @return 1 if the chip is busy, 0 if it is not.
+ */
+static int SimulatorFlashIsBusy(TSimulatorFlash *Pointer_Flash, unsigned long long Time)
+{
+	if (Time < Pointer_Flash->Busy_End_Time) return 1;
+	return 0;
+}
+
+/** Start a program or erase operation.
+ * @param Pointer_Flash The chip.
+ * @param Duration The operation duration in microseconds.
+ * @param Time The current simulated time in nanoseconds.
+ */
+static void SimulatorFlashStartOperation(TSimulatorFlash *Pointer_Flash, unsigned long long Duration, unsigned long long Time)
+{
+	Pointer_Flash->Busy_End_Time = Time + Duration * 1000;
+	Pointer_Flash->Busy_Time += Duration * 1000;
+	Pointer_Flash->Is_Write_Enabled = 0; // The latch is cleared when the operation starts
+}
+
+/** Make the faulty bytes of a page being programmed misbehave, by changing the data programmed to them.
+ * @param Pointer_Flash The chip.
+ * @param Page_Address The programmed page address.
+ */
+static void SimulatorFlashApplyProgramFaults(TSimulatorFlash *Pointer_Flash, unsigned int Page_Address)
+{
+	unsigned int i;
+	TSimulatorFlashFault *Pointer_Fault;
+
+	for (i = 0; i < Pointer_Flash->Faults_Count; i++)
+	{
+		Pointer_Fault = &Pointer_Flash->Faults[i];
+		if ((Pointer_Fault->Address < Page_Address) || (Pointer_Fault->Address >= Page_Address + SIMULATOR_FLASH_PAGE_SIZE)) continue;
+
+		switch (Pointer_Fault->Type)
+		{
+			case SIMULATOR_FLASH_FAULT_TYPE_WEAK:
+				if (Pointer_Fault->Programs_Count < SIMULATOR_FLASH_WEAK_IGNORED_PROGRAMS_COUNT) Pointer_Flash->Page_Buffer[Pointer_Fault->Address - Page_Address] = 0xFF;
+				break;
+
+			case SIMULATOR_FLASH_FAULT_TYPE_STUCK:
+				Pointer_Flash->Page_Buffer[Pointer_Fault->Address - Page_Address] = 0xFF;
+				break;
+
+			case SIMULATOR_FLASH_FAULT_TYPE_DISTURBED:
+				if (Pointer_Fault->Programs_Count == 0) Pointer_Flash->Page_Buffer[Pointer_Fault->Address - Page_Address] = 0;
+				break;
+
+			case SIMULATOR_FLASH_FAULT_TYPE_WIRING:
+				continue; // The wiring does not care about the programmed data
+		}
+		Pointer_Fault->Programs_Count++;
+	}
+}
+
+/** Make the faulty bytes of an erased area behave as after an erase.
+ * @param Pointer_Flash The chip.
+ * @param Address The erased area address.
+ * @param Size The erased area size in bytes.
+ */
+static void SimulatorFlashResetFaults(TSimulatorFlash *Pointer_Flash, unsigned int Address, unsigned int Size)
+{
+	unsigned int i;
+
+	for (i = 0; i < Pointer_Flash->Faults_Count; i++)
+	{
+		if (Pointer_Flash->Faults[i].Type == SIMULATOR_FLASH_FAULT_TYPE_DISTURBED) continue; // A disturbance happens only once
+		if ((Pointer_Flash->Faults[i].Address >= Address) && (Pointer_Flash->Faults[i].Address < Address + Size)) Pointer_Flash->Faults[i].Programs_Count = 0;
+	}
+}
+
+/** Execute the command that was sent when the chip is deselected.
+ * @param Pointer_Flash The chip.
+ * @param Time The current simulated time in nanoseconds.
+ */
+static void SimulatorFlashExecuteCommand(TSimulatorFlash *Pointer_Flash, unsigned long long Time)
+{
+	unsigned int Address_Bytes_Count, Page_Address, i;
+
+	if (Pointer_Flash->Is_4_Byte_Addressing_Enabled) Address_Bytes_Count = 4;
+	else Address_Bytes_Count = 3;
+
+	switch (Pointer_Flash->Command)
+	{
+		// Page program
+		case 0x02:
+			if (!Pointer_Flash->Is_Write_Enabled || (Pointer_Flash->Transferred_Bytes_Count <= 1 + Address_Bytes_Count)) break;
+
+			// Bits can only be cleared
+			Page_Address = Pointer_Flash->Address & ~(SIMULATOR_FLASH_PAGE_SIZE - 1);
+			SimulatorFlashApplyProgramFaults(Pointer_Flash, Page_Address);
+			for (i = 0; i < SIMULATOR_FLASH_PAGE_SIZE; i++) Pointer_Flash->Pointer_Memory[Page_Address + i] &= Pointer_Flash->Page_Buffer[i];
+			SimulatorFlashStartOperation(Pointer_Flash, Pointer_Flash->Pointer_Model->Page_Program_Time, Time);
+			break;
+
+		// Sector erase
+		case 0x20:
+			if (!Pointer_Flash->Is_Write_Enabled || (Pointer_Flash->Transferred_Bytes_Count != 1 + Address_Bytes_Count)) break;
+
+			memset(&Pointer_Flash->Pointer_Memory[Pointer_Flash->Address & ~(SIMULATOR_FLASH_SECTOR_SIZE - 1)], 0xFF, SIMULATOR_FLASH_SECTOR_SIZE);
+			SimulatorFlashResetFaults(Pointer_Flash, Pointer_Flash->Address & ~(SIMULATOR_FLASH_SECTOR_SIZE - 1), SIMULATOR_FLASH_SECTOR_SIZE);
+			SimulatorFlashStartOperation(Pointer_Flash, Pointer_Flash->Pointer_Model->Sector_Erase_Time, Time);
+			break;
+
+		// Chip erase
+		case 0x60:
+		case 0xC7:
+			if (!Pointer_Flash->Is_Write_Enabled || (Pointer_Flash->Transferred_Bytes_Count != 1)) break;
+
+			memset(Pointer_Flash->Pointer_Memory, 0xFF, Pointer_Flash->Pointer_Model->Size);
+			SimulatorFlashResetFaults(Pointer_Flash, 0, Pointer_Flash->Pointer_Model->Size);
+			SimulatorFlashStartOperation(Pointer_Flash, (unsigned long long) Pointer_Flash->Pointer_Model->Chip_Erase_Time * 1000, Time);
+			break;
+
+		// Write enable
+		case 0x06:
+			Pointer_Flash->Is_Write_Enabled = 1;
+			break;
+
+		// Write disable
+		case 0x04:
+			Pointer_Flash->Is_Write_Enabled = 0;
+			break;
+
+		// Enter 4-byte addressing mode
+		case 0xB7:
+			if (Pointer_Flash->Pointer_Model->Is_4_Byte_Addressing_Supported) Pointer_Flash->Is_4_Byte_Addressing_Enabled = 1;
+			break;
+
+		// Exit 4-byte addressing mode
+		case 0xE9:
+			if (Pointer_Flash->Pointer_Model->Is_4_Byte_Addressing_Supported) Pointer_Flash->Is_4_Byte_Addressing_Enabled = 0;
+			break;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+const TSimulatorFlashModel *SimulatorFlashFindModel(char *String_Name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(Simulator_Flash_Models) / sizeof(Simulator_Flash_Models[0]); i++)
+	{
+		if (strcmp(Simulator_Flash_Models[i].String_Name, String_Name) == 0) return &Simulator_Flash_Models[i];
+	}
+	return NULL;
+}
+
+void SimulatorFlashDisplayModels(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(Simulator_Flash_Models) / sizeof(Simulator_Flash_Models[0]); i++) printf("  %-12s %u MB, page program %u us, sector erase %u ms, chip erase %u s\n", Simulator_Flash_Models[i].String_Name, Simulator_Flash_Models[i].Size / (1024 * 1024), Simulator_Flash_Models[i].Page_Program_Time, Simulator_Flash_Models[i].Sector_Erase_Time / 1000, Simulator_Flash_Models[i].Chip_Erase_Time / 1000);
+}
+
+int SimulatorFlashParseFault(char *String_Fault, TSimulatorFlashFault *Pointer_Fault)
+{
+	static const char *String_Type_Names[] = {"weak", "stuck", "disturbed", "wiring"}; // In the TSimulatorFlashFaultType order
+	char *String_Address, *Pointer_End;
+	unsigned int i;
+
+	String_Address = strchr(String_Fault, '@');
+	if ((String_Address == NULL) || (String_Address[1] == 0)) return -1;
+
+	for (i = 0; i < sizeof(String_Type_Names) / sizeof(String_Type_Names[0]); i++)
+	{
+		if ((strncmp(String_Fault, String_Type_Names[i], String_Address - String_Fault) == 0) && (strlen(String_Type_Names[i]) == (size_t) (String_Address - String_Fault))) break;
+	}
+	if (i == sizeof(String_Type_Names) / sizeof(String_Type_Names[0])) return -1;
+
+	memset(Pointer_Fault, 0, sizeof(TSimulatorFlashFault));
+	Pointer_Fault->Type = (TSimulatorFlashFaultType) i;
+	Pointer_Fault->Address = strtoul(&String_Address[1], &Pointer_End, 16);
+	if (*Pointer_End != 0) return -1;
+	return 0;
+}
+
+int SimulatorFlashInitialize(TSimulatorFlash *Pointer_Flash, const TSimulatorFlashModel *Pointer_Model, const TSimulatorFlashFault *Pointer_Faults, unsigned int Faults_Count)
+{
+	memset(Pointer_Flash, 0, sizeof(TSimulatorFlash));
+	Pointer_Flash->Pointer_Model = Pointer_Model;
+	if (Faults_Count > 0) memcpy(Pointer_Flash->Faults, Pointer_Faults, Faults_Count * sizeof(TSimulatorFlashFault));
+	Pointer_Flash->Faults_Count = Faults_Count;
+
+	// A new chip is erased
+	Pointer_Flash->Pointer_Memory = malloc(Pointer_Model->Size);
+	if (Pointer_Flash->Pointer_Memory == NULL)
+	{
+		printf("Error : could not allocate the %s memory.\n", Pointer_Model->String_Name);
+		return -1;
+	}
+	memset(Pointer_Flash->Pointer_Memory, 0xFF, Pointer_Model->Size);
+
+	return 0;
+}
+
+void SimulatorFlashUninitialize(TSimulatorFlash *Pointer_Flash)
+{
+	free(Pointer_Flash->Pointer_Memory);
+	Pointer_Flash->Pointer_Memory = NULL;
+}
+
+void SimulatorFlashSetSelected(TSimulatorFlash *Pointer_Flash, int Is_Selected, unsigned long long Time)
+{
+	if (Is_Selected == Pointer_Flash->Is_Selected) return;
+	Pointer_Flash->Is_Selected = Is_Selected;
+
+	// A new command begins
+	if (Is_Selected)
+	{
+		Pointer_Flash->Transferred_Bytes_Count = 0;
+		memset(Pointer_Flash->Page_Buffer, 0xFF, sizeof(Pointer_Flash->Page_Buffer));
+		return;
+	}
+
+	// The busy chip ignores all commands but the status register read
+	if ((Pointer_Flash->Transferred_Bytes_Count > 0) && !SimulatorFlashIsBusy(Pointer_Flash, Time)) SimulatorFlashExecuteCommand(Pointer_Flash, Time);
+}
+
+unsigned char SimulatorFlashTransferByte(TSimulatorFlash *Pointer_Flash, unsigned char Byte, unsigned long long Time)
+{
+	unsigned int Index, Address_Bytes_Count;
+	unsigned char Status;
+
+	Index = Pointer_Flash->Transferred_Bytes_Count;
+	Pointer_Flash->Transferred_Bytes_Count++;
+
+	// The first byte is the command opcode
+	if (Index == 0)
+	{
+		Pointer_Flash->Command = Byte;
+		Pointer_Flash->Address = 0;
+		return SIMULATOR_FLASH_BUS_IDLE_VALUE;
+	}
+
+	// Read status register, it is the only command answered while the chip is busy
+	if (Pointer_Flash->Command == 0x05)
+	{
+		Status = 0;
+		if (SimulatorFlashIsBusy(Pointer_Flash, Time)) Status |= SIMULATOR_FLASH_STATUS_WIP;
+		if (Pointer_Flash->Is_Write_Enabled) Status |= SIMULATOR_FLASH_STATUS_WEL;
+		return Status;
+	}
+	if (SimulatorFlashIsBusy(Pointer_Flash, Time)) return SIMULATOR_FLASH_BUS_IDLE_VALUE;
+
+	switch (Pointer_Flash->Command)
+	{
+		// Read JEDEC ID
+		case 0x9F:
+			if (Index == 1) return Pointer_Flash->Pointer_Model->Manufacturer_ID;
+			if (Index == 2) return (unsigned char) (Pointer_Flash->Pointer_Model->Device_ID >> 8);
+			if (Index == 3) return (unsigned char) Pointer_Flash->Pointer_Model->Device_ID;
+			break;
+
+		// Read configuration register
+		case 0x15:
+			if (!Pointer_Flash->Pointer_Model->Is_4_Byte_Addressing_Supported) break;
+			if (Pointer_Flash->Is_4_Byte_Addressing_Enabled) return SIMULATOR_FLASH_CONFIGURATION_4BYTE;
+			return 0;
+
+		// Commands followed by an address
+		case 0x02:
+		case 0x03:
+		case 0x20:
+			if (Pointer_Flash->Is_4_Byte_Addressing_Enabled) Address_Bytes_Count = 4;
+			else Address_Bytes_Count = 3;
+
+			// Receive the address, most significant byte first
+			if (Index <= Address_Bytes_Count)
+			{
+				Pointer_Flash->Address = (Pointer_Flash->Address << 8) | Byte;
+				if (Index == Address_Bytes_Count) Pointer_Flash->Address %= Pointer_Flash->Pointer_Model->Size;
+				break;
+			}
+
+			// Read data, the address wraps at the end of the memory
+			if (Pointer_Flash->Command == 0x03)
+			{
+				Byte = Pointer_Flash->Pointer_Memory[Pointer_Flash->Address];
+				Pointer_Flash->Address = (Pointer_Flash->Address + 1) % Pointer_Flash->Pointer_Model->Size;
+				return Byte;
+			}
+
+			// Receive the page program data, the address wraps at the end of the page
+			if (Pointer_Flash->Command == 0x02)
+			{
+				Pointer_Flash->Page_Buffer[(Pointer_Flash->Address + Index - Address_Bytes_Count - 1) % SIMULATOR_FLASH_PAGE_SIZE] = Byte;
+			}
+			break;
+	}
+	return SIMULATOR_FLASH_BUS_IDLE_VALUE;
+}
+
+unsigned char SimulatorFlashApplyWiringFaults(TSimulatorFlash *Pointer_Flash, unsigned char Byte, unsigned char Clock_Divider)
+{
+	unsigned int i;
+
+	// The least significant bit is sampled before the MISO line settles
+	for (i = 0; i < Pointer_Flash->Faults_Count; i++)
+	{
+		if ((Pointer_Flash->Faults[i].Type == SIMULATOR_FLASH_FAULT_TYPE_WIRING) && (Clock_Divider < Pointer_Flash->Faults[i].Address)) return Byte ^ 0x01;
+	}
+	return Byte;
+}
@@ -0,0 +1,128 @@
+/** @file Simulator_Flash.h
+ * SPI NOR flash chip models. Each model answers the commands the firmware uses and stays busy as long as the datasheet typical times tell after a program or an erase.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_SIMULATOR_FLASH_H
+#define H_SIMULATOR_FLASH_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** A page program writes at most this amount of bytes. */
+#define SIMULATOR_FLASH_PAGE_SIZE 256
+/** The smallest erasable area size in bytes. */
+#define SIMULATOR_FLASH_SECTOR_SIZE 4096
+
+/** How many faulty bytes a chip can have. */
+#define SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT 8
+/** How many program cycles a weak byte ignores after each erase. */
+#define SIMULATOR_FLASH_WEAK_IGNORED_PROGRAMS_COUNT 2
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** How a faulty byte behaves. */
+typedef enum
+{
+	SIMULATOR_FLASH_FAULT_TYPE_WEAK, //!< The first SIMULATOR_FLASH_WEAK_IGNORED_PROGRAMS_COUNT program cycles following an erase do not change the byte, the next ones do.
+	SIMULATOR_FLASH_FAULT_TYPE_STUCK, //!< The byte stays erased whatever is programmed.
+	SIMULATOR_FLASH_FAULT_TYPE_DISTURBED, //!< The first program cycle of the page clears all the byte bits, whatever is programmed (only an erase can recover it, the next program cycles work).
+	SIMULATOR_FLASH_FAULT_TYPE_WIRING //!< The socket wiring can't carry a fast SPI clock : the bytes sent by the chip are corrupted when SPI0CKR is lower than the fault address field.
+} TSimulatorFlashFaultType;
+
+/** A faulty byte, to check how the firmware handles program failures. */
+typedef struct
+{
+	TSimulatorFlashFaultType Type; //!< How the byte behaves.
+	unsigned int Address; //!< The byte address.
+	unsigned int Programs_Count; //!< How many times the byte page was programmed since the byte was last erased (since the chip was inserted for a disturbed byte).
+} TSimulatorFlashFault;
+
+/** A flash chip reference. */
+typedef struct
+{
+	char *String_Name; //!< The chip reference.
+	unsigned char Manufacturer_ID; //!< The first JEDEC ID byte.
+	unsigned short Device_ID; //!< The last two JEDEC ID bytes.
+	unsigned int Size; //!< The memory size in bytes.
+	int Is_4_Byte_Addressing_Supported; //!< Set to 1 if the chip has the 4-byte addressing mode commands.
+	unsigned int Page_Program_Time; //!< How long programming a page lasts in microseconds.
+	unsigned int Sector_Erase_Time; //!< How long erasing a sector lasts in microseconds.
+	unsigned int Chip_Erase_Time; //!< How long erasing the whole chip lasts in milliseconds.
+} TSimulatorFlashModel;
+
+/** A flash chip connected to the SPI bus. */
+typedef struct
+{
+	const TSimulatorFlashModel *Pointer_Model; //!< The chip reference.
+	unsigned char *Pointer_Memory; //!< The memory content.
+	int Is_Selected; //!< Set to 1 while the Slave Select pin is low.
+	unsigned int Transferred_Bytes_Count; //!< How many bytes were transferred since the chip was selected.
+	unsigned char Command; //!< The current command opcode.
+	unsigned int Address; //!< The current command address.
+	int Is_Write_Enabled; //!< The Write Enable Latch.
+	int Is_4_Byte_Addressing_Enabled; //!< Set to 1 when the addresses are 4-byte long.
+	unsigned long long Busy_End_Time; //!< When the running program or erase operation ends (simulated time in nanoseconds).
+	unsigned char Page_Buffer[SIMULATOR_FLASH_PAGE_SIZE]; //!< The data received by a page program command (the bytes that were not received are left erased, so they do not change the memory).
+	unsigned long long Busy_Time; //!< The cumulated program and erase time in nanoseconds.
+	TSimulatorFlashFault Faults[SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT]; //!< The faulty bytes.
+	unsigned int Faults_Count; //!< How many bytes are faulty.
+} TSimulatorFlash;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Find a chip model from its reference.
+ * @param String_Name The chip reference.
+ * @return The model, or NULL if the reference is unknown.
+ */
+const TSimulatorFlashModel *SimulatorFlashFindModel(char *String_Name);
+
+/** Display all known chip references. */
+void SimulatorFlashDisplayModels(void);
+
+/** Convert a fault description to a fault.
+ * @param String_Fault The description, made of the fault type ("weak", "stuck", "disturbed" or "wiring"), '@' and the byte address in hexadecimal (for "wiring", the SPI0CKR value below which the bytes sent by the chip are corrupted).
+ * @param Pointer_Fault On output, contain the fault.
+ * @return 0 on success, -1 if the description is invalid.
+ */
+int SimulatorFlashParseFault(char *String_Fault, TSimulatorFlashFault *Pointer_Fault);
+
+/** Create an erased chip.
+ * @param Pointer_Flash The chip to initialize.
+ * @param Pointer_Model The chip reference.
+ * @param Pointer_Faults The chip faulty bytes (can be NULL if Faults_Count is 0).
+ * @param Faults_Count How many bytes are faulty (up to SIMULATOR_FLASH_MAXIMUM_FAULTS_COUNT).
+ * @return 0 on success, -1 if the memory could not be allocated (an error message is displayed).
+ */
+int SimulatorFlashInitialize(TSimulatorFlash *Pointer_Flash, const TSimulatorFlashModel *Pointer_Model, const TSimulatorFlashFault *Pointer_Faults, unsigned int Faults_Count);
+
+/** Release the memory of a chip removed from its socket.
+ * @param Pointer_Flash The chip.
+ */
+void SimulatorFlashUninitialize(TSimulatorFlash *Pointer_Flash);
+
+/** Handle a Slave Select pin change. The program and erase commands start when the chip is deselected.
+ * @param Pointer_Flash The chip.
+ * @param Is_Selected Set to 1 when the pin goes low, set to 0 when it goes high.
+ * @param Time The current simulated time in nanoseconds.
+ */
+void SimulatorFlashSetSelected(TSimulatorFlash *Pointer_Flash, int Is_Selected, unsigned long long Time);
+
+/** Exchange a byte with a selected chip.
+ * @param Pointer_Flash The chip.
+ * @param Byte The byte sent by the microcontroller.
+ * @param Time The current simulated time in nanoseconds.
+ * @return The byte sent by the chip.
+ */
+unsigned char SimulatorFlashTransferByte(TSimulatorFlash *Pointer_Flash, unsigned char Byte, unsigned long long Time);
+
+/** Corrupt a byte sent by a chip if the SPI clock is too fast for the chip socket wiring.
+ * @param Pointer_Flash The chip.
+ * @param Byte The byte sent by the chip.
+ * @param Clock_Divider The SPI0CKR value.
+ * @return The byte received by the microcontroller.
+ */
+unsigned char SimulatorFlashApplyWiringFaults(TSimulatorFlash *Pointer_Flash, unsigned char Byte, unsigned char Clock_Divider);
+
+#endif
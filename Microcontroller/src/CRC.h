@@ -0,0 +1,37 @@
+/** @file CRC.h
+ * Compute the CRC-32 (IEEE 802.3 polynomial, the same one used by Ethernet and zlib) of the data exchanged with the PC.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_CRC_H
+#define H_CRC_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The value to start a CRC computation with. */
+#define CRC_INITIAL_VALUE 0xFFFFFFFFUL
+
+/** Get the final CRC value from the running one.
+ * @param CRC The value returned by the last call to CRCUpdate().
+ */
+#define CRC_FINALIZE(CRC) ((CRC) ^ 0xFFFFFFFFUL)
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Add a byte to a running CRC computation.
+ * @param CRC The current CRC value (use CRC_INITIAL_VALUE for the first byte).
+ * @param Byte The byte to add.
+ * @return The new CRC value.
+ */
+unsigned long CRCUpdate(unsigned long CRC, unsigned char Byte);
+
+/** Add a block of bytes to a running CRC computation, without the cost of a CRCUpdate() call for each byte.
+ * @param CRC The current CRC value (use CRC_INITIAL_VALUE for the first block).
+ * @param Pointer_Buffer The bytes to add.
+ * @param Bytes_Count How many bytes to add.
+ * @return The new CRC value.
+ */
+unsigned long CRCUpdateBlock(unsigned long CRC, unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+#endif
@@ -13,11 +13,26 @@
 /** The UART connected to the PC baud rate. */
 #define CONFIGURATION_UART_BAUD_RATE UART_BAUD_RATE_230400
 
-/** Select the MX25L6435E flash. */
-#define CONFIGURATION_FLASH_SELECT_MX25L6435E 0
-/** Select the MX25L25635F flash. */
-#define CONFIGURATION_FLASH_SELECT_MX25L25635F 0
-/** Select the W25Q64CV flash. */
-#define CONFIGURATION_FLASH_SELECT_W25Q64CV 1
+/** Set to 1 to measure where the time goes (each SPI byte costs a few more cycles), set to 0 to disable the measures. */
+#define CONFIGURATION_STATISTICS_ENABLED 1
+
+// The DMA can also be enabled from the compiler command line (to run the simulator with it)
+#ifndef CONFIGURATION_SPI_DMA_ENABLED
+	/** Set to 1 to move the flash data with the DMA while the CPU serves the UART, set to 0 to move it with the CPU. The DMA transfers have only been run on the simulator, keep them disabled until they are checked on a board. */
+	#define CONFIGURATION_SPI_DMA_ENABLED 0
+#endif
+
+/** When the DMA is not used, set to 1 to move the flash data with the assembly loops of SPI_Block.A51, set to 0 to use the C loops (the simulator always uses the C loops). */
+#define CONFIGURATION_SPI_ASSEMBLY_ENABLED 1
+
+// The flash can also be selected from the compiler command line (the simulator is built once for each flash)
+#ifndef CONFIGURATION_FLASH_SELECT_W25Q64CV
+	/** Select the MX25L6435E flash. */
+	#define CONFIGURATION_FLASH_SELECT_MX25L6435E 0
+	/** Select the MX25L25635F flash. */
+	#define CONFIGURATION_FLASH_SELECT_MX25L25635F 0
+	/** Select the W25Q64CV flash. */
+	#define CONFIGURATION_FLASH_SELECT_W25Q64CV 1
+#endif
 
 #endif
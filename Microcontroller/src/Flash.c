@@ -4,10 +4,47 @@
  */
 #include "Flash.h"
 #include "SPI.h"
+#include "Statistics.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many times the chips whose content differs after a program cycle are programmed again before giving up. */
+#define FLASH_MAXIMUM_PROGRAM_RETRIES_COUNT 3
+
+/** The SPI clock divider used to identify the chips (1 MHz), slow enough for any wiring. */
+#define FLASH_DETECTION_SPI_CLOCK_DIVIDER 11
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The chips found by FlashInitialize() and FlashProbeChips(). */
+static unsigned char Flash_Available_Chips_Mask = 0;
+/** The chips the operations apply to. */
+static unsigned char Flash_Selected_Chips_Mask = 1;
+
+/** The chips whose ID was right on the last probe. */
+static unsigned char Flash_Detected_Chips_Mask = 0;
+/** The chips inserted since the events were last read. */
+static unsigned char Flash_Inserted_Chips_Mask = 0;
+/** The chips removed since the events were last read. */
+static unsigned char Flash_Removed_Chips_Mask = 0;
 
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
+/** Drive all selected chips at the same time (the next bytes sent on the bus will be received by all chips). */
+static void FlashSelectAllChips(void)
+{
+	SPISetSelectedChips(Flash_Selected_Chips_Mask);
+}
+
+/** Drive only the lowest-numbered selected chip, so that a single chip answers on the MISO line. */
+static void FlashSelectFirstChip(void)
+{
+	SPISetSelectedChips(Flash_Selected_Chips_Mask & (~Flash_Selected_Chips_Mask + 1));
+}
+
 /** Allow the memory to be written. */
 static void FlashEnableWriting(void)
 {
@@ -39,11 +76,95 @@ static unsigned char FlashReadStatusRegister(void)
 	return Status_Register;
 }
 
+/** Wait for the write or erase cycle of every selected chip to terminate. Each chip Status Register is polled individually. */
+static void FlashWaitForOperationEnd(void)
+{
+	unsigned char i, Chip_Mask;
+	unsigned short Start_Time;
+
+	for (i = 0; i < SPI_CHIPS_COUNT; i++)
+	{
+		Chip_Mask = 1 << i;
+		if (!(Flash_Selected_Chips_Mask & Chip_Mask)) continue;
+
+		SPISetSelectedChips(Chip_Mask);
+		STATISTICS_START_TIME(Start_Time);
+		while (FlashReadStatusRegister() & 1) STATISTICS_ADD_TIME(STATISTICS_TIME_FLASH_STATUS_POLLING, Start_Time); // An erase lasts longer than a timer period, so measure each poll
+	}
+
+	// Go back to broadcast mode
+	FlashSelectAllChips();
+}
+
+/** Probe each Slave Select line on its own, leaving the chips selection untouched.
+ * @return The mask of the chips that were successfully initialized.
+ */
+static unsigned char FlashDetectChips(void)
+{
+	unsigned char i, Selected_Chips_Mask, Clock_Divider, Detected_Chips_Mask = 0;
+
+	// A SPI clock too fast for a socket wiring must not hide its chip, the SPI clock calibration needs it
+	Clock_Divider = SPIGetClockDivider();
+	SPISetClockDivider(FLASH_DETECTION_SPI_CLOCK_DIVIDER);
+
+	// FlashInitializeChip() talks to the selected chip
+	Selected_Chips_Mask = Flash_Selected_Chips_Mask;
+	for (i = 0; i < SPI_CHIPS_COUNT; i++)
+	{
+		Flash_Selected_Chips_Mask = 1 << i;
+		SPISetSelectedChips(Flash_Selected_Chips_Mask);
+		if (FlashInitializeChip()) Detected_Chips_Mask |= Flash_Selected_Chips_Mask;
+	}
+	Flash_Selected_Chips_Mask = Selected_Chips_Mask;
+	FlashSelectAllChips();
+	SPISetClockDivider(Clock_Divider);
+
+	return Detected_Chips_Mask;
+}
+
+/** Write bytes, read them back from each selected chip and program again the chips whose content differs. Programming again can only clear the bits that did not reach 0.
+ * @param Address The address to start writing to.
+ * @param Bytes_Count How many bytes to write.
+ * @param Pointer_Buffer The data to write.
+ * @return The mask of the selected chips whose content still differs after FLASH_MAXIMUM_PROGRAM_RETRIES_COUNT retries.
+ */
+static unsigned char FlashProgramAndVerifyBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer)
+{
+	unsigned char Selected_Chips_Mask, Failed_Chips_Mask, i;
+
+	FlashWriteBytes(Address, Bytes_Count, Pointer_Buffer);
+	Failed_Chips_Mask = FlashVerifyBytes(Address, Bytes_Count, Pointer_Buffer);
+
+	// Program only the failed chips again, the other ones do not need to spend a program cycle
+	Selected_Chips_Mask = Flash_Selected_Chips_Mask;
+	for (i = 0; (i < FLASH_MAXIMUM_PROGRAM_RETRIES_COUNT) && (Failed_Chips_Mask != 0); i++)
+	{
+		Flash_Selected_Chips_Mask = Failed_Chips_Mask;
+		FlashWriteBytes(Address, Bytes_Count, Pointer_Buffer);
+		Failed_Chips_Mask = FlashVerifyBytes(Address, Bytes_Count, Pointer_Buffer);
+	}
+	Flash_Selected_Chips_Mask = Selected_Chips_Mask;
+
+	return Failed_Chips_Mask;
+}
+
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
+unsigned char FlashSelectChips(unsigned char Chips_Mask)
+{
+	Flash_Selected_Chips_Mask = Chips_Mask & Flash_Available_Chips_Mask;
+	return Flash_Selected_Chips_Mask;
+}
+
+unsigned char FlashGetSelectedChips(void)
+{
+	return Flash_Selected_Chips_Mask;
+}
+
 void FlashReadID(unsigned char *Pointer_Manufacturer_ID, unsigned short *Pointer_Device_ID)
 {
+	FlashSelectFirstChip();
 	SPISetSlaveSelectState(1);
 
 	// Send command
@@ -61,6 +182,13 @@ void FlashReadID(unsigned char *Pointer_Manufacturer_ID, unsigned short *Pointer
 
 void FlashReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer)
 {
+	FlashStartReadBytes(Address, Bytes_Count, Pointer_Buffer);
+	FlashWaitReadEnd();
+}
+
+void FlashStartReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer)
+{
+	FlashSelectFirstChip();
 	SPISetSlaveSelectState(1);
 
 	// Send the command
@@ -72,13 +200,12 @@ void FlashReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
 	SPITransferByte(Address);
 
 	// Read the data
-	while (Bytes_Count > 0)
-	{
-		*Pointer_Buffer = SPITransferByte(0xFF);
-		Pointer_Buffer++;
-		Bytes_Count--;
-	}
+	SPIStartReadBlock(Pointer_Buffer, Bytes_Count);
+}
 
+void FlashWaitReadEnd(void)
+{
+	SPIWaitBlockEnd();
 	SPISetSlaveSelectState(0);
 }
 
@@ -86,6 +213,9 @@ void FlashWriteBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
 {
 	unsigned short Bytes_To_Write;
 
+	// All chips are programmed at the same time
+	FlashSelectAllChips();
+
 	// The address is aligned on a page, so use the page as the default write unit to speed operations
 	if ((Address & FLASH_PAGE_SIZE_BIT_MASK) == 0)
 	{
@@ -109,22 +239,17 @@ void FlashWriteBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
 			SPITransferByte(Address);
 
 			// Send up to a page to the flash
-			while (Bytes_To_Write > 0)
-			{
-				// Send the byte to write
-				SPITransferByte(*Pointer_Buffer);
-
-				Address++;
-				Bytes_To_Write--;
-				Bytes_Count--;
-				Pointer_Buffer++;
-			}
+			SPIWriteBlock(Pointer_Buffer, Bytes_To_Write);
+			Address += Bytes_To_Write;
+			Bytes_Count -= Bytes_To_Write;
+			Pointer_Buffer += Bytes_To_Write;
 
 			// Initiate the write cycle
 			SPISetSlaveSelectState(0);
+			STATISTICS_INCREMENT_COUNTER(STATISTICS_COUNTER_PAGE_PROGRAM_CYCLES);
 
 			// Wait for the write cycle to terminate
-			while (FlashReadStatusRegister() & 1);
+			FlashWaitForOperationEnd();
 		}
 	}
 	else
@@ -149,9 +274,10 @@ void FlashWriteBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
 
 			// Initiate the write cycle
 			SPISetSlaveSelectState(0);
+			STATISTICS_INCREMENT_COUNTER(STATISTICS_COUNTER_PAGE_PROGRAM_CYCLES);
 
 			// Wait for the write cycle to terminate
-			while (FlashReadStatusRegister() & 1);
+			FlashWaitForOperationEnd();
 
 			Address++;
 			Bytes_Count--;
@@ -160,8 +286,68 @@ void FlashWriteBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
 	}
 }
 
+unsigned char FlashVerifyBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer)
+{
+	unsigned char i, Chip_Mask, Failed_Chips_Mask = 0;
+	unsigned short j;
+
+	// Read each chip individually
+	for (i = 0; i < SPI_CHIPS_COUNT; i++)
+	{
+		Chip_Mask = 1 << i;
+		if (!(Flash_Selected_Chips_Mask & Chip_Mask)) continue;
+
+		SPISetSelectedChips(Chip_Mask);
+		SPISetSlaveSelectState(1);
+
+		// Send the command
+		SPITransferByte(0x03);
+
+		// Send the address
+		SPITransferByte(Address >> 16);
+		SPITransferByte(Address >> 8);
+		SPITransferByte(Address);
+
+		// Compare the data, there is no need to read further than the first difference
+		for (j = 0; j < Bytes_Count; j++)
+		{
+			if (SPITransferByte(0xFF) != Pointer_Buffer[j])
+			{
+				Failed_Chips_Mask |= Chip_Mask;
+				break;
+			}
+		}
+
+		SPISetSlaveSelectState(0);
+	}
+
+	return Failed_Chips_Mask;
+}
+
+unsigned char FlashWriteVerifiedBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer, unsigned char xdata *Pointer_Sector_Data)
+{
+	unsigned char Selected_Chips_Mask, Failed_Chips_Mask;
+	unsigned long Sector_Data_Address;
+
+	Failed_Chips_Mask = FlashProgramAndVerifyBytes(Address, Bytes_Count, Pointer_Buffer);
+	if ((Failed_Chips_Mask == 0) || (Pointer_Sector_Data == 0)) return Failed_Chips_Mask;
+
+	// Some bits were cleared by mistake, only an erase can set them back, so write the whole sector data again to the failed chips
+	Selected_Chips_Mask = Flash_Selected_Chips_Mask;
+	Flash_Selected_Chips_Mask = Failed_Chips_Mask;
+	Sector_Data_Address = Address - (Pointer_Buffer - Pointer_Sector_Data);
+	FlashEraseSectors(Sector_Data_Address & ~((unsigned long) FLASH_SECTOR_SIZE - 1), 1);
+	Failed_Chips_Mask = FlashProgramAndVerifyBytes(Sector_Data_Address, (Pointer_Buffer - Pointer_Sector_Data) + Bytes_Count, Pointer_Sector_Data);
+	Flash_Selected_Chips_Mask = Selected_Chips_Mask;
+
+	return Failed_Chips_Mask;
+}
+
 void FlashEraseSectors(unsigned long Address, unsigned short Sectors_Count)
 {
+	// All chips are erased at the same time
+	FlashSelectAllChips();
+
 	// Use the "erase chip" command if the whole flash must be erased
 	if ((Address == 0) && (Sectors_Count == FLASH_TOTAL_SIZE / FLASH_SECTOR_SIZE))
 	{
@@ -174,9 +360,10 @@ void FlashEraseSectors(unsigned long Address, unsigned short Sectors_Count)
 
 		// Initiate the erase cycle
 		SPISetSlaveSelectState(0);
+		STATISTICS_INCREMENT_COUNTER(STATISTICS_COUNTER_ERASE_CYCLES);
 
 		// Wait for the erase cycle to terminate
-		while (FlashReadStatusRegister() & 1);
+		FlashWaitForOperationEnd();
 	}
 	else
 	{
@@ -196,12 +383,58 @@ void FlashEraseSectors(unsigned long Address, unsigned short Sectors_Count)
 
 			// Initiate the erase cycle
 			SPISetSlaveSelectState(0);
+			STATISTICS_INCREMENT_COUNTER(STATISTICS_COUNTER_ERASE_CYCLES);
 
 			// Wait for the erase cycle to terminate
-			while (FlashReadStatusRegister() & 1);
+			FlashWaitForOperationEnd();
 
 			Sectors_Count--;
 			Address += FLASH_SECTOR_SIZE;
 		}
 	}
 }
+
+unsigned char FlashInitialize(void)
+{
+	unsigned char Initialized_Chips_Mask;
+
+	Initialized_Chips_Mask = FlashDetectChips();
+
+	// Select all working chips
+	Flash_Available_Chips_Mask = Initialized_Chips_Mask;
+	Flash_Detected_Chips_Mask = Initialized_Chips_Mask;
+	Flash_Selected_Chips_Mask = Initialized_Chips_Mask;
+	FlashSelectAllChips();
+
+	return Initialized_Chips_Mask;
+}
+
+void FlashProbeChips(void)
+{
+	unsigned char Detected_Chips_Mask, Changed_Chips_Mask;
+
+	Detected_Chips_Mask = FlashDetectChips();
+
+	// Keep only the changes seen by two probes in a row, so a chip is not reported before all its pins touch the socket
+	Changed_Chips_Mask = (Detected_Chips_Mask ^ Flash_Available_Chips_Mask) & ~(Detected_Chips_Mask ^ Flash_Detected_Chips_Mask);
+	Flash_Detected_Chips_Mask = Detected_Chips_Mask;
+	if (Changed_Chips_Mask == 0) return;
+
+	Flash_Inserted_Chips_Mask |= Changed_Chips_Mask & Detected_Chips_Mask;
+	Flash_Removed_Chips_Mask |= Changed_Chips_Mask & ~Detected_Chips_Mask;
+	Flash_Available_Chips_Mask ^= Changed_Chips_Mask;
+
+	// A removed chip can't be selected anymore, an inserted chip must be selected explicitly
+	Flash_Selected_Chips_Mask &= Flash_Available_Chips_Mask;
+	FlashSelectAllChips();
+}
+
+unsigned char FlashReadChipsEvents(unsigned char *Pointer_Inserted_Chips_Mask, unsigned char *Pointer_Removed_Chips_Mask)
+{
+	*Pointer_Inserted_Chips_Mask = Flash_Inserted_Chips_Mask;
+	*Pointer_Removed_Chips_Mask = Flash_Removed_Chips_Mask;
+	Flash_Inserted_Chips_Mask = 0;
+	Flash_Removed_Chips_Mask = 0;
+
+	return Flash_Available_Chips_Mask;
+}
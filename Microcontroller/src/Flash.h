@@ -52,6 +52,17 @@
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
+/** Choose the chips the next operations will apply to. Erase and write operations are broadcast to all selected chips at the same time, read operations only access the lowest-numbered selected chip.
+ * @param Chips_Mask Bit n set means that chip n is selected. Chips that were not detected by FlashInitialize() or FlashProbeChips() are ignored.
+ * @return The mask of the chips that are really selected.
+ */
+unsigned char FlashSelectChips(unsigned char Chips_Mask);
+
+/** Tell which chips the operations apply to.
+ * @return The mask of the selected chips.
+ */
+unsigned char FlashGetSelectedChips(void);
+
 /** Read the flash IDs.
  * @param Pointer_Manufacturer_ID On output, contain the Manufacturer ID.
  * @param Pointer_Device_ID On output, contain the Device ID.
@@ -66,6 +77,17 @@ void FlashReadID(unsigned char *Pointer_Manufacturer_ID, unsigned short *Pointer
  */
 void FlashReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer);
 
+/** Start reading a specified number of bytes from the specified address. The data is read in the background when the SPI uses the DMA, so the CPU can do something else until FlashWaitReadEnd() is called.
+ * @param Address The address to start reading from (only 3-byte addresses are supported).
+ * @param Bytes_Count How many bytes to read.
+ * @param Pointer_Buffer On output, contain the read data. It must not be accessed until FlashWaitReadEnd() returns.
+ * @warning No other flash function can be called until FlashWaitReadEnd() returns.
+ */
+void FlashStartReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer);
+
+/** Wait for the read started by FlashStartReadBytes() to finish. */
+void FlashWaitReadEnd(void);
+
 /** Write a specified number of bytes to the specified address.
  * @param Address The address to start writing to.
  * @param Bytes_Count How many bytes to write.
@@ -74,15 +96,50 @@ void FlashReadBytes(unsigned long Address, unsigned short Bytes_Count, unsigned
  */
 void FlashWriteBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer);
 
+/** Compare the content of every selected chip with the provided data.
+ * @param Address The address to start comparing from (only 3-byte addresses are supported).
+ * @param Bytes_Count How many bytes to compare.
+ * @param Pointer_Buffer The expected data.
+ * @return The mask of the selected chips whose content differs from the expected data (0 means that all chips content is right).
+ */
+unsigned char FlashVerifyBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer);
+
+/** Write bytes, then read them back from every selected chip right after the program cycle. The chips whose content differs are programmed again, then their sector is erased and written again if programming again is not enough.
+ * @param Address The address to start writing to.
+ * @param Bytes_Count How many bytes to write (they must not span several sectors when Pointer_Sector_Data is not 0).
+ * @param Pointer_Buffer The data to write.
+ * @param Pointer_Sector_Data The data written to the same sector since it was erased, it must end with the Pointer_Buffer data. It is written again when the sector is erased. Set to 0 if this data is not available, so the sector is never erased.
+ * @return The mask of the selected chips whose content still differs from the data (0 means that all chips were successfully programmed).
+ */
+unsigned char FlashWriteVerifiedBytes(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Buffer, unsigned char xdata *Pointer_Sector_Data);
+
 /** Erase the specified amount of sectors.
  * @param Address The beginning address of the first sector to erase.
  * @param Sectors_Count How many sectors to erase.
  */
 void FlashEraseSectors(unsigned long Address, unsigned short Sectors_Count);
 
-/** Do all needed memory initialization. The function will hang if the flash can't be initialized properly.
+/** Probe all Slave Select lines and do all needed memory initialization on every chip found. All successfully initialized chips are selected.
+ * @return The mask of the chips that were successfully initialized (0 if no chip could be initialized).
+ */
+unsigned char FlashInitialize(void);
+
+/** Probe all Slave Select lines again to find the chips inserted in or removed from their socket since the previous probe. A change is kept only when two probes in a row see it. Removed chips are deselected, inserted chips are initialized but not selected.
+ * @warning No flash operation must be running.
+ */
+void FlashProbeChips(void);
+
+/** Tell which chips were inserted or removed since the previous call.
+ * @param Pointer_Inserted_Chips_Mask On output, contain the mask of the inserted chips.
+ * @param Pointer_Removed_Chips_Mask On output, contain the mask of the removed chips (a chip removed and inserted again between two calls is in both masks).
+ * @return The mask of the chips currently available.
+ */
+unsigned char FlashReadChipsEvents(unsigned char *Pointer_Inserted_Chips_Mask, unsigned char *Pointer_Removed_Chips_Mask);
+
+/** Do all needed memory initialization on a single chip, the one that is currently selected.
+ * @return 1 if the chip was successfully initialized, 0 if the chip is missing or can't be initialized properly.
  * @note This function must be implemented in the specific flash file.
  */
-void FlashInitialize(void);
+unsigned char FlashInitializeChip(void);
 
 #endif
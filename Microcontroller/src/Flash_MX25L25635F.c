@@ -51,7 +51,7 @@ static unsigned char FlashReadConfigurationRegister(void)
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
-void FlashInitialize(void)
+unsigned char FlashInitializeChip(void)
 {
 	unsigned char Byte_Temp;
 	unsigned short Device_ID;
@@ -59,12 +59,13 @@ void FlashInitialize(void)
 	// Force 3-byte address mode
 	FlashEnable4ByteAddressMode(0);
 	Byte_Temp = FlashReadConfigurationRegister();
-	if (Byte_Temp & 0x20) while (1);
+	if (Byte_Temp & 0x20) return 0;
 
 	// Read known IDs
 	FlashReadID(&Byte_Temp, &Device_ID);
-	if (Byte_Temp != 0xC2) while (1);
-	if (Device_ID != 0x2019) while (1);
+	if (Byte_Temp != 0xC2) return 0;
+	if (Device_ID != 0x2019) return 0;
+	return 1;
 }
 
 #endif
@@ -11,15 +11,16 @@
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
-void FlashInitialize(void)
+unsigned char FlashInitializeChip(void)
 {
 	unsigned char Manufacturer_ID;
 	unsigned short Device_ID;
 
 	// Read known IDs
 	FlashReadID(&Manufacturer_ID, &Device_ID);
-	if (Manufacturer_ID != 0xC2) while (1);
-	if (Device_ID != 0x2017) while (1);
+	if (Manufacturer_ID != 0xC2) return 0;
+	if (Device_ID != 0x2017) return 0;
+	return 1;
 }
 
 #endif 
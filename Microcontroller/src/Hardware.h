@@ -0,0 +1,21 @@
+/** @file Hardware.h
+ * Give access to the microcontroller registers. The firmware is built by Keil for the real board, or by gcc for the PC simulator (when SIMULATOR is defined).
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_HARDWARE_H
+#define H_HARDWARE_H
+
+#ifdef SIMULATOR
+	#include "Simulator.h"
+#else
+	#include <compiler_defs.h>
+	#include <SI_C8051F970_Register_Enums.h>
+
+	/** Called by every busy-waiting loop, so the simulator can make the peripherals progress. There is nothing to do on the real hardware. */
+	#define HARDWARE_WAIT()
+
+	/** Set the xdata address of the DMA channel selected by DMA0SEL. The simulator needs to know the real pointer, which does not fit in these registers. */
+	#define HARDWARE_DMA_SET_ADDRESS(Pointer_Buffer) { DMA0NBAL = (unsigned char) (unsigned short) (Pointer_Buffer); DMA0NBAH = (unsigned short) (Pointer_Buffer) >> 8; }
+#endif
+
+#endif
@@ -2,11 +2,13 @@
  * The entry point and main loop.
  * @author Adrien RICCIARDI
  */
-#include <compiler_defs.h>
-#include <SI_C8051F970_Register_Enums.h>
 #include "Configuration.h"
+#include "CRC.h"
 #include "Flash.h"
+#include "Hardware.h"
+#include "Protocol.h"
 #include "SPI.h"
+#include "Statistics.h"
 #include "UART.h"
 
 //-------------------------------------------------------------------------------------------------
@@ -21,8 +23,41 @@
 #define COMMAND_READ_FLASH 0x10
 /** Write data to the flash. */
 #define COMMAND_WRITE_FLASH 0x20
-/** Tell that the microcontroller is ready for another task. */
-#define COMMAND_MICROCONTROLLER_READY 0x42
+/** Compare the flash content with data sent by the PC. */
+#define COMMAND_VERIFY_FLASH 0x30
+/** Choose which chips the next commands apply to. */
+#define COMMAND_SELECT_CHIPS 0x40
+/** Tell where the time went since the previous statistics command. */
+#define COMMAND_READ_STATISTICS 0x50
+/** Send generated data to measure the serial link. */
+#define COMMAND_PING 0x60
+/** Tell which chips were inserted or removed since the previous chips events command. */
+#define COMMAND_READ_CHIPS_EVENTS 0x70
+/** Find the addresses a byte pattern is stored at. */
+#define COMMAND_SEARCH_FLASH 0x80
+/** Tell which pages the last write could not program. */
+#define COMMAND_READ_WRITE_FAILURES 0x90
+/** Find the fastest SPI clock the chips sustain. */
+#define COMMAND_CALIBRATE_SPI_CLOCK 0xA0
+/** Change the SPI clock frequency. */
+#define COMMAND_SET_SPI_CLOCK 0xB0
+/** Compute the CRC of each flash sector. */
+#define COMMAND_READ_SECTORS_CRC 0xC0
+/** Erase the flash sectors containing an area. */
+#define COMMAND_ERASE_FLASH 0xD0
+
+/** The received data is written to the flash. */
+#define MAIN_RECEIVE_MODE_WRITE 0
+/** The received data is compared with the flash content. */
+#define MAIN_RECEIVE_MODE_VERIFY 1
+/** The received data is written to the flash, then each page is read back right after being programmed. */
+#define MAIN_RECEIVE_MODE_WRITE_AND_VERIFY 2
+
+/** How many idle loop iterations separate two chip sockets probes (an iteration lasts a few microseconds). */
+#define MAIN_CHIPS_PROBING_PERIOD 20000
+
+/** How many times the SPI clock calibration reads the pattern back from each chip at each clock. */
+#define MAIN_SPI_CALIBRATION_READS_COUNT 8
 
 //-------------------------------------------------------------------------------------------------
 // Private variables
@@ -30,6 +65,57 @@
 /** A flash-sector sized buffer. */
 static unsigned char xdata Buffer[FLASH_SECTOR_SIZE];
 
+/** The command to execute. */
+static unsigned char xdata Command_Payload[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+/** The command size in bytes (the last parameters of some commands are optional). */
+static unsigned char Command_Payload_Size;
+/** The command frame sequence number. */
+static unsigned char Command_Sequence;
+/** Tell if a command was received and must be executed. */
+static bit Is_Command_Pending = 0;
+
+/** Receive the small frames (acknowledges) sent by the PC during a read. */
+static unsigned char xdata Response_Payload[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+
+/** The buffer half the next flash block is read to while the current block is sent from the other half. */
+static unsigned char xdata *Pointer_Prefetch_Buffer;
+/** The address of the block read in advance. */
+static unsigned long Prefetch_Address;
+/** The size of the block read in advance. */
+static unsigned short Prefetch_Bytes_Count;
+/** Tell if a block is being read in advance. */
+static bit Is_Prefetch_Running = 0;
+
+/** The searched bytes (the bits cleared in the mask are cleared here too). */
+static unsigned char xdata Search_Pattern[PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE];
+/** Only the bits set in the mask are compared. */
+static unsigned char xdata Search_Mask[PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE];
+/** The searched pattern size in bytes. */
+static unsigned char Search_Pattern_Size;
+/** The first pattern byte having a non-null mask, it is compared first to quickly discard most positions. */
+static unsigned char Search_Anchor_Index;
+/** The last bytes of the previously searched block, so a pattern spanning two blocks (or two sectors) is found too. */
+static unsigned char xdata Search_Tail[PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE - 1];
+/** How many bytes the tail contains. */
+static unsigned char Search_Tail_Size;
+/** The addresses the pattern was found at. */
+static unsigned long xdata Search_Matches[PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT];
+/** How many addresses the matches list contains. */
+static unsigned char Search_Matches_Count;
+
+/** The first pages the last verified write could not program. */
+static unsigned long xdata Write_Failed_Pages_Addresses[PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT];
+/** The chips each failed page could not be programmed to. */
+static unsigned char xdata Write_Failed_Pages_Chips_Masks[PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT];
+/** How many pages the last verified write could not program. */
+static unsigned short Write_Failed_Pages_Count = 0;
+
+/** The CRC-32 of the sectors the sectors CRC command went through. */
+static unsigned long xdata Sectors_CRC[PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT];
+
+/** The SPI0CKR values the SPI clock calibration tries, from the fastest clock (12.25 MHz) to the slowest one (510 kHz). */
+static unsigned char code SPI_Calibration_Clock_Dividers[PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT] = {0, 1, 2, 3, 5, 7, 11, 23};
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
@@ -55,7 +141,10 @@ static void MainPinsInitialize(void) // This function is not inlined because the
 	// P0.1 : UART TX
 	// P0.2 : UART RX
 	// P0.5 : Led
-	// P1.2 : SPI /SS (manually driven)
+	// P1.2 : SPI chip 0 /SS (manually driven)
+	// P1.3 : SPI chip 1 /SS (manually driven)
+	// P1.4 : SPI chip 2 /SS (manually driven)
+	// P1.5 : SPI chip 3 /SS (manually driven)
 	// P2.0 : SPI SCK
 	// P2.1 : SPI MISO
 	// P2.2 : SPI MOSI
@@ -66,7 +155,7 @@ static void MainPinsInitialize(void) // This function is not inlined because the
 
 	// Configure the following pins as push-pull outputs
 	P0MDOUT |= 1 << 5; // Led
-	P1MDOUT |= 1 << 2; // Manual Slave Select
+	P1MDOUT |= SPI_SLAVE_SELECT_PINS_MASK; // Manual Slave Select
 	P2MDOUT |= (1 << 2) | (1 << 0); // SPI SCK and SPI MOSI
 
 	// Enable the desired modules
@@ -147,72 +236,701 @@ static void CheckForData(void)
 }
 #endif
 
-/** Read data from the flash memory. */
-static void CommandReadFlash(void)
+/** Receive a frame. If the frame is a command, it is kept aside to be executed by the main loop, so the current command must be aborted as soon as possible.
+ * @param Pointer_Type On output, contain the frame type.
+ * @param Pointer_Sequence On output, contain the frame sequence number.
+ * @param Pointer_Payload On output, contain the frame payload.
+ * @param Maximum_Payload_Size The payload buffer size.
+ * @return The payload size in bytes or PROTOCOL_ERROR_CORRUPTED_FRAME if the frame is corrupted.
+ */
+static signed short MainReceiveFrame(unsigned char *Pointer_Type, unsigned char *Pointer_Sequence, unsigned char xdata *Pointer_Payload, unsigned short Maximum_Payload_Size)
 {
-	unsigned long Address, Bytes_Count;
-	unsigned short Bytes_To_Read, i;
+	signed short Payload_Size;
+	unsigned char i;
 
-	// Receive the address to start reading from
-	Address = UARTReadDoubleWord();
+	Payload_Size = ProtocolReceiveFrame(Pointer_Type, Pointer_Sequence, Pointer_Payload, Maximum_Payload_Size);
 
-	// Receive the amount of bytes to read
-	Bytes_Count = UARTReadDoubleWord();
+	// Keep the command for later
+	if ((Payload_Size > 0) && (Payload_Size <= PROTOCOL_MAXIMUM_COMMAND_SIZE) && (*Pointer_Type == PROTOCOL_FRAME_TYPE_COMMAND))
+	{
+		for (i = 0; i < Payload_Size; i++) Command_Payload[i] = Pointer_Payload[i];
+		Command_Payload_Size = (unsigned char) Payload_Size;
+		Command_Sequence = *Pointer_Sequence;
+		Is_Command_Pending = 1;
+	}
+
+	return Payload_Size;
+}
+
+/** Receive data frames from the PC and write them to the flash or compare them with the flash content. The PC sends up to PROTOCOL_WRITE_WINDOW_SIZE frames in a row, they are stored by the UART reception buffer while the current one is processed. Each processed frame is acknowledged, telling the PC that all previous frames were received too. When a frame is corrupted or missing, the following ones are dropped and the PC is asked to send the frames again starting from the missing one.
+ * @param Address The address of the first byte.
+ * @param Bytes_Count How many bytes to receive.
+ * @param Mode MAIN_RECEIVE_MODE_WRITE to write the data, MAIN_RECEIVE_MODE_VERIFY to compare the data with the flash content (each acknowledge contains the mask of the chips whose content differs), MAIN_RECEIVE_MODE_WRITE_AND_VERIFY to write the data and read each page back (each acknowledge contains the mask of the chips that could not be programmed and the failed pages count).
+ */
+static void MainReceiveData(unsigned long Address, unsigned long Bytes_Count, unsigned char Mode)
+{
+	unsigned char Type, Sequence, Expected_Sequence = 0, Unexpected_Sequence = 0, Failed_Chips_Mask = 0, Page_Failed_Chips_Mask, Acknowledge_Payload[3];
+	unsigned short Block_Size;
+	signed short Payload_Size;
+	unsigned char xdata *Pointer_Block = Buffer;
+	unsigned char xdata *Pointer_Sector_Data = 0;
+	bit Is_Negative_Acknowledge_Sent = 0, Is_Sector_Data_Kept = 0;
+
+	// When the pages are read back, the data written to the current sector is kept in the buffer (each page at its sector offset), so a failed sector can be erased and written again (a write that does not start on a page is done byte per byte, so the pages do not match the frames)
+	if ((Mode == MAIN_RECEIVE_MODE_WRITE_AND_VERIFY) && ((Address & FLASH_PAGE_SIZE_BIT_MASK) == 0)) Is_Sector_Data_Kept = 1;
 
-	// Read data
 	while (Bytes_Count > 0)
 	{
-		// Read at most one sector at a time
-		if (Bytes_Count > FLASH_SECTOR_SIZE) Bytes_To_Read = FLASH_SECTOR_SIZE;
-		else Bytes_To_Read = (unsigned short) Bytes_Count;
-		FlashReadBytes(Address, Bytes_To_Read, Buffer);
+		// Determine the amount of data to receive
+		if (Bytes_Count > PROTOCOL_WRITE_BLOCK_SIZE) Block_Size = PROTOCOL_WRITE_BLOCK_SIZE;
+		else Block_Size = (unsigned short) Bytes_Count;
+
+		// Receive the data
+		if (Is_Sector_Data_Kept) Pointer_Block = &Buffer[(unsigned short) Address & (FLASH_SECTOR_SIZE - 1)];
+		Payload_Size = MainReceiveFrame(&Type, &Sequence, Pointer_Block, PROTOCOL_WRITE_BLOCK_SIZE);
+		if (Is_Command_Pending) return; // The PC gave up this command
+		if ((Payload_Size != PROTOCOL_ERROR_CORRUPTED_FRAME) && (Type != PROTOCOL_FRAME_TYPE_DATA)) continue;
+
+		// The PC did not receive the acknowledge in time, so it sent already received frames again
+		if ((Payload_Size != PROTOCOL_ERROR_CORRUPTED_FRAME) && ((unsigned char) (Expected_Sequence - Sequence - 1) < PROTOCOL_WRITE_WINDOW_SIZE))
+		{
+			ProtocolRepeatLastAcknowledge();
+			continue;
+		}
+		if ((Payload_Size == PROTOCOL_ERROR_CORRUPTED_FRAME) || (Sequence != Expected_Sequence) || (Payload_Size != Block_Size))
+		{
+			// All frames following a lost one are unexpected (and a corrupted length can split a frame into many corrupted ones), ask only once for the missing frame as each request makes the PC send the whole window again. The PC sends increasing sequence numbers until it is asked for a frame again, so a data frame sequence number that does not increase tells that the window was sent again but the missing frame was lost again (the header of a corrupted frame is much less likely to be corrupted than its payload, a wrong guess only makes the PC send the window again)
+			if (!Is_Negative_Acknowledge_Sent || ((Type == PROTOCOL_FRAME_TYPE_DATA) && ((unsigned char) (Sequence - Expected_Sequence) <= (unsigned char) (Unexpected_Sequence - Expected_Sequence))))
+			{
+				ProtocolSendNegativeAcknowledge(Expected_Sequence);
+				Is_Negative_Acknowledge_Sent = 1;
+			}
+			if (Type == PROTOCOL_FRAME_TYPE_DATA) Unexpected_Sequence = Sequence;
+			continue;
+		}
+
+		// Process the data
+		if (Mode == MAIN_RECEIVE_MODE_VERIFY)
+		{
+			Failed_Chips_Mask |= FlashVerifyBytes(Address, Block_Size, Pointer_Block);
+			ProtocolSendAcknowledge(Sequence, &Failed_Chips_Mask, 1);
+		}
+		else if (Mode == MAIN_RECEIVE_MODE_WRITE_AND_VERIFY)
+		{
+			if (Is_Sector_Data_Kept && ((Pointer_Sector_Data == 0) || (((unsigned short) Address & (FLASH_SECTOR_SIZE - 1)) == 0))) Pointer_Sector_Data = Pointer_Block;
+			Page_Failed_Chips_Mask = FlashWriteVerifiedBytes(Address, Block_Size, Pointer_Block, Pointer_Sector_Data);
 
-		// Send the data
-		for (i = 0; i < Bytes_To_Read; i++) UARTWriteByte(Buffer[i]);
+			// Remember the first failed pages for the PC
+			if (Page_Failed_Chips_Mask != 0)
+			{
+				if (Write_Failed_Pages_Count < PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT)
+				{
+					Write_Failed_Pages_Addresses[Write_Failed_Pages_Count] = Address;
+					Write_Failed_Pages_Chips_Masks[Write_Failed_Pages_Count] = Page_Failed_Chips_Mask;
+				}
+				Write_Failed_Pages_Count++;
+				Failed_Chips_Mask |= Page_Failed_Chips_Mask;
+			}
 
-		Address += Bytes_To_Read;
-		Bytes_Count -= Bytes_To_Read;
+			Acknowledge_Payload[0] = Failed_Chips_Mask;
+			Acknowledge_Payload[1] = Write_Failed_Pages_Count >> 8;
+			Acknowledge_Payload[2] = (unsigned char) Write_Failed_Pages_Count;
+			ProtocolSendAcknowledge(Sequence, Acknowledge_Payload, sizeof(Acknowledge_Payload));
+		}
+		else
+		{
+			FlashWriteBytes(Address, Block_Size, Pointer_Block);
+			ProtocolSendAcknowledge(Sequence, 0, 0);
+		}
+		Is_Negative_Acknowledge_Sent = 0;
+
+		Expected_Sequence++;
+		Bytes_Count -= Block_Size;
+		Address += Block_Size;
 	}
 }
 
-/** Write data to the flash memory. */
-static void CommandWriteFlash(void)
+/** Start reading a flash block in the buffer half that does not contain the block being sent. When the SPI uses the DMA, the block is read while the CPU sends the current one through the UART.
+ * @param Address The block address.
+ * @param Bytes_Count The block size, up to half the buffer size.
+ * @param Pointer_Sent_Block The block being sent.
+ */
+static void MainStartFlashBlockPrefetch(unsigned long Address, unsigned short Bytes_Count, unsigned char xdata *Pointer_Sent_Block)
+{
+	if (Pointer_Sent_Block == Buffer) Pointer_Prefetch_Buffer = &Buffer[sizeof(Buffer) / 2];
+	else Pointer_Prefetch_Buffer = Buffer;
+
+	Prefetch_Address = Address;
+	Prefetch_Bytes_Count = Bytes_Count;
+	FlashStartReadBytes(Address, Bytes_Count, Pointer_Prefetch_Buffer);
+	Is_Prefetch_Running = 1;
+}
+
+/** Wait for the block read in advance, so the flash can be accessed again. */
+static void MainStopFlashBlockPrefetch(void)
+{
+	if (!Is_Prefetch_Running) return;
+
+	FlashWaitReadEnd();
+	Is_Prefetch_Running = 0;
+}
+
+/** Get a flash block, from the block read in advance if it is the requested one.
+ * @param Address The block address.
+ * @param Bytes_Count The block size, up to half the buffer size.
+ * @return The block content.
+ */
+static unsigned char xdata *MainReadFlashBlock(unsigned long Address, unsigned short Bytes_Count)
+{
+	unsigned char xdata *Pointer_Block;
+
+	if (Is_Prefetch_Running)
+	{
+		MainStopFlashBlockPrefetch();
+		Pointer_Block = Pointer_Prefetch_Buffer;
+
+		// The PC asked for a frame again, so the block read in advance is not the right one
+		if ((Prefetch_Address != Address) || (Prefetch_Bytes_Count != Bytes_Count)) FlashReadBytes(Address, Bytes_Count, Pointer_Block);
+	}
+	else
+	{
+		Pointer_Block = Buffer;
+		FlashReadBytes(Address, Bytes_Count, Pointer_Block);
+	}
+
+	return Pointer_Block;
+}
+
+/** Send data frames to the PC. Up to Window_Size frames are sent without waiting for the PC to acknowledge them. When the PC asks for a frame again, the data is sent again from this frame.
+ * @param Address The address of the first byte to read from the flash.
+ * @param Bytes_Count How many bytes to send.
+ * @param Block_Size How many bytes each data frame contains (up to the buffer size, or up to half the buffer size when the flash is read).
+ * @param Window_Size How many data frames can wait for their acknowledge.
+ * @param Is_Flash_Read Set to 1 to send the flash content, set to 0 to send the buffer content (already filled) in each data frame. The flash is read one block ahead, so the next block is ready when the current one has been sent.
+ */
+static void MainSendData(unsigned long Address, unsigned long Bytes_Count, unsigned short Block_Size, unsigned char Window_Size, unsigned char Is_Flash_Read)
+{
+	unsigned long Acknowledged_Address, Next_Address, End_Address;
+	unsigned short Bytes_To_Read;
+	unsigned char xdata *Pointer_Block;
+	unsigned char Type, Acknowledged_Sequence = 0, Next_Sequence = 0, Response_Sequence, Acknowledged_Frames_Count;
+	signed short Payload_Size;
+
+	Acknowledged_Address = Address;
+	End_Address = Address + Bytes_Count;
+	Next_Address = Address;
+
+	while (Acknowledged_Address < End_Address)
+	{
+		// Send the next frame if the window is not full
+		if ((Next_Address < End_Address) && ((unsigned char) (Next_Sequence - Acknowledged_Sequence) < Window_Size))
+		{
+			// Read at most one block at a time
+			if (End_Address - Next_Address > Block_Size) Bytes_To_Read = Block_Size;
+			else Bytes_To_Read = (unsigned short) (End_Address - Next_Address);
+			if (Is_Flash_Read)
+			{
+				Pointer_Block = MainReadFlashBlock(Next_Address, Bytes_To_Read);
+
+				// Read the following block while this one is sent
+				if (End_Address - Next_Address > Bytes_To_Read)
+				{
+					if (End_Address - Next_Address - Bytes_To_Read > Block_Size) MainStartFlashBlockPrefetch(Next_Address + Bytes_To_Read, Block_Size, Pointer_Block);
+					else MainStartFlashBlockPrefetch(Next_Address + Bytes_To_Read, (unsigned short) (End_Address - Next_Address - Bytes_To_Read), Pointer_Block);
+				}
+			}
+			else Pointer_Block = Buffer;
+
+			ProtocolSendFrame(PROTOCOL_FRAME_TYPE_DATA, Next_Sequence, Pointer_Block, Bytes_To_Read);
+			Next_Sequence++;
+			Next_Address += Bytes_To_Read;
+
+			// Do not wait for the PC if it has nothing to tell yet
+			if (!ProtocolIsFrameAvailable()) continue;
+		}
+
+		// Wait for an acknowledge (the window is full or all data has been sent)
+		Payload_Size = MainReceiveFrame(&Type, &Response_Sequence, Response_Payload, sizeof(Response_Payload));
+		if (Is_Command_Pending) break; // The PC gave up this command
+		if (Payload_Size == PROTOCOL_ERROR_CORRUPTED_FRAME) continue; // The PC will ask again if it needs a frame
+
+		// An acknowledge tells that all frames up to the acknowledged one were received, a negative acknowledge tells that all frames preceding the requested one were received
+		if (Type == PROTOCOL_FRAME_TYPE_ACKNOWLEDGE) Acknowledged_Frames_Count = Response_Sequence - Acknowledged_Sequence + 1;
+		else if (Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE) Acknowledged_Frames_Count = Response_Sequence - Acknowledged_Sequence;
+		else continue;
+		if (Acknowledged_Frames_Count > (unsigned char) (Next_Sequence - Acknowledged_Sequence)) continue; // This frame relates to a frame that was already acknowledged
+
+		Acknowledged_Sequence += Acknowledged_Frames_Count;
+		Acknowledged_Address += (unsigned long) Acknowledged_Frames_Count * Block_Size;
+		if (Acknowledged_Address > End_Address) Acknowledged_Address = End_Address; // The last block can be smaller
+
+		// Send the frames again starting from the requested one
+		if (Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE)
+		{
+			Next_Sequence = Acknowledged_Sequence;
+			Next_Address = Acknowledged_Address;
+		}
+	}
+
+	// Release the flash
+	MainStopFlashBlockPrefetch();
+}
+
+/** Get a byte of the searched data, made of the previous block tail followed by the current block.
+ * @param Pointer_Block The current block.
+ * @param Position The byte position, the first tail byte being at position 0.
+ * @return The byte value.
+ */
+static unsigned char MainGetSearchedByte(unsigned char xdata *Pointer_Block, unsigned short Position)
+{
+	if (Position < Search_Tail_Size) return Search_Tail[Position];
+	return Pointer_Block[Position - Search_Tail_Size];
+}
+
+/** Tell whether the searched pattern is stored at a position of the searched data.
+ * @param Pointer_Block The current block.
+ * @param Position The position of the first byte to compare, the first tail byte being at position 0.
+ * @return 1 if the pattern was found, 0 if not.
+ */
+static bit MainIsPatternFound(unsigned char xdata *Pointer_Block, unsigned short Position)
+{
+	unsigned char i;
+
+	for (i = 0; i < Search_Pattern_Size; i++)
+	{
+		if ((MainGetSearchedByte(Pointer_Block, Position + i) & Search_Mask[i]) != Search_Pattern[i]) return 0;
+	}
+	return 1;
+}
+
+/** Search the pattern in a flash block following the previously searched one. The patterns starting in the previous block tail are checked first, then the tail is replaced by the end of this block.
+ * @param Address The block address.
+ * @param Pointer_Block The block content.
+ * @param Bytes_Count The block size.
+ * @return The address following the match that filled the matches list, or 0 if the matches list is not full.
+ */
+static unsigned long MainSearchBlock(unsigned long Address, unsigned char xdata *Pointer_Block, unsigned short Bytes_Count)
+{
+	unsigned short Position, Searched_Bytes_Count, Last_Offset, Offset;
+	unsigned char xdata *Pointer_Anchor;
+	unsigned char Anchor_Pattern, Anchor_Mask, Tail_Size, i;
+
+	// Find the patterns starting in the tail and ending in the block
+	Searched_Bytes_Count = Search_Tail_Size + Bytes_Count;
+	for (Position = 0; (Position < Search_Tail_Size) && (Position + Search_Pattern_Size <= Searched_Bytes_Count); Position++)
+	{
+		if (!MainIsPatternFound(Pointer_Block, Position)) continue;
+
+		Search_Matches[Search_Matches_Count] = Address - Search_Tail_Size + Position;
+		Search_Matches_Count++;
+		if (Search_Matches_Count == PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT) return Address - Search_Tail_Size + Position + 1;
+	}
+
+	// Find the patterns fully contained in the block, most positions are discarded by comparing only the anchor byte
+	if (Bytes_Count >= Search_Pattern_Size)
+	{
+		Anchor_Pattern = Search_Pattern[Search_Anchor_Index];
+		Anchor_Mask = Search_Mask[Search_Anchor_Index];
+		Pointer_Anchor = &Pointer_Block[Search_Anchor_Index];
+		Last_Offset = Bytes_Count - Search_Pattern_Size;
+
+		for (Offset = 0; Offset <= Last_Offset; Offset++)
+		{
+			if (((*Pointer_Anchor & Anchor_Mask) == Anchor_Pattern) && MainIsPatternFound(Pointer_Block, Search_Tail_Size + Offset))
+			{
+				Search_Matches[Search_Matches_Count] = Address + Offset;
+				Search_Matches_Count++;
+				if (Search_Matches_Count == PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT) return Address + Offset + 1;
+			}
+			Pointer_Anchor++;
+		}
+	}
+
+	// Keep the data end, a pattern can start there (the tail bytes are moved towards the tail beginning, so they can be overwritten in place)
+	if (Searched_Bytes_Count > Search_Pattern_Size - 1) Tail_Size = Search_Pattern_Size - 1;
+	else Tail_Size = (unsigned char) Searched_Bytes_Count;
+	for (i = 0; i < Tail_Size; i++) Search_Tail[i] = MainGetSearchedByte(Pointer_Block, Searched_Bytes_Count - Tail_Size + i);
+	Search_Tail_Size = Tail_Size;
+
+	return 0;
+}
+
+/** Erase all sectors containing an area. The area does not always start at a sector beginning, so the sectors are counted from the beginning of the first sector.
+ * @param Address The area start address.
+ * @param Bytes_Count The area size.
+ */
+static void MainEraseArea(unsigned long Address, unsigned long Bytes_Count)
+{
+	unsigned long Erased_Bytes_Count;
+	unsigned short Sectors_To_Erase_Count;
+
+	Erased_Bytes_Count = Bytes_Count + ((unsigned short) Address & (FLASH_SECTOR_SIZE - 1));
+	Sectors_To_Erase_Count = Erased_Bytes_Count / FLASH_SECTOR_SIZE;
+	if (Erased_Bytes_Count % FLASH_SECTOR_SIZE != 0) Sectors_To_Erase_Count++; // Erase one more sector if some bytes have to been written to it
+	FlashEraseSectors(Address, Sectors_To_Erase_Count);
+}
+
+/** Read data from the flash memory. Up to PROTOCOL_READ_WINDOW_SIZE frames are sent without waiting for the PC to acknowledge them. A lost frame is read again from the flash. */
+static void CommandReadFlash(void)
 {
 	unsigned long Address, Bytes_Count;
-	unsigned short i, Bytes_To_Write, Sectors_To_Erase_Count;
 
-	// Receive the starting address
-	Address = UARTReadDoubleWord();
+	// Retrieve the address to start reading from and the amount of bytes to read
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]);
+	Bytes_Count = ProtocolGetDoubleWord(&Command_Payload[5]);
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+
+	MainSendData(Address, Bytes_Count, PROTOCOL_READ_BLOCK_SIZE, PROTOCOL_READ_WINDOW_SIZE, 1);
+}
+
+/** Write data to the flash memory. The acknowledge contains how many data frames the PC can send in a row. An optional flags byte can follow the bytes count, the PROTOCOL_WRITE_FLAG_VERIFY_PAGES flag makes each page be read back right after it is programmed. */
+static void CommandWriteFlash(void)
+{
+	unsigned long Address, Bytes_Count;
+	unsigned char Window_Size = PROTOCOL_WRITE_WINDOW_SIZE, Mode = MAIN_RECEIVE_MODE_WRITE;
 
-	// Receive the data to flash size
-	Bytes_Count = UARTReadDoubleWord();
+	// Retrieve the starting address and the data to flash size
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]);
+	Bytes_Count = ProtocolGetDoubleWord(&Command_Payload[5]);
+	if ((Command_Payload_Size > 9) && (Command_Payload[9] & PROTOCOL_WRITE_FLAG_VERIFY_PAGES)) Mode = MAIN_RECEIVE_MODE_WRITE_AND_VERIFY;
+	Write_Failed_Pages_Count = 0;
 
 	// Erase the required sectors
-	Sectors_To_Erase_Count = Bytes_Count / FLASH_SECTOR_SIZE;
-	if (Bytes_Count % FLASH_SECTOR_SIZE != 0) Sectors_To_Erase_Count++; // Erase one more sector if some bytes have to been written to it
-	FlashEraseSectors(Address, Sectors_To_Erase_Count);
-	UARTWriteByte(COMMAND_MICROCONTROLLER_READY); // Used as flow control
+	MainEraseArea(Address, Bytes_Count);
+	ProtocolSendAcknowledge(Command_Sequence, &Window_Size, 1); // Tell the PC that data can be sent
 
 	// Receive data from the UART and write it to the flash
-	while (Bytes_Count > 0)
+	MainReceiveData(Address, Bytes_Count, Mode);
+}
+
+/** Compare the flash content of each selected chip with data received from the UART. The command acknowledge contains how many data frames the PC can send in a row, each data acknowledge contains the mask of the chips whose content differs. */
+static void CommandVerifyFlash(void)
+{
+	unsigned long Address, Bytes_Count;
+	unsigned char Window_Size = PROTOCOL_WRITE_WINDOW_SIZE;
+
+	// Retrieve the starting address and the data to compare size
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]);
+	Bytes_Count = ProtocolGetDoubleWord(&Command_Payload[5]);
+	ProtocolSendAcknowledge(Command_Sequence, &Window_Size, 1);
+
+	// Receive data from the UART and compare it with every chip content
+	MainReceiveData(Address, Bytes_Count, MAIN_RECEIVE_MODE_VERIFY);
+}
+
+/** Select the chips the next commands apply to. The acknowledge contains the mask of the chips really selected. */
+static void CommandSelectChips(void)
+{
+	unsigned char Selected_Chips_Mask;
+
+	Selected_Chips_Mask = FlashSelectChips(Command_Payload[1]);
+	ProtocolSendAcknowledge(Command_Sequence, &Selected_Chips_Mask, 1);
+}
+
+/** Send the statistics in a single data frame following the command acknowledge. The frame is sent again until the PC acknowledges it. */
+static void CommandReadStatistics(void)
+{
+	unsigned char Type, Response_Sequence;
+	signed short Payload_Size;
+
+	// Take a snapshot that stays the same if the frame must be sent again
+	StatisticsRead(Buffer);
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+	ProtocolSendFrame(PROTOCOL_FRAME_TYPE_DATA, 0, Buffer, STATISTICS_SIZE);
+
+	while (1)
 	{
-		// Determine the amount of data to receive
-		if (Bytes_Count > FLASH_SECTOR_SIZE) Bytes_To_Write = FLASH_SECTOR_SIZE;
-		else Bytes_To_Write = (unsigned short) Bytes_Count;
+		Payload_Size = MainReceiveFrame(&Type, &Response_Sequence, Response_Payload, sizeof(Response_Payload));
+		if (Is_Command_Pending) return; // The PC gave up this command
+		if (Payload_Size == PROTOCOL_ERROR_CORRUPTED_FRAME) continue; // The PC will ask again if it needs the frame
 
-		// Receive the data
-		for (i = 0; i < Bytes_To_Write; i++)
+		if (Response_Sequence != 0) continue;
+		if (Type == PROTOCOL_FRAME_TYPE_ACKNOWLEDGE) return;
+		if (Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE) ProtocolSendFrame(PROTOCOL_FRAME_TYPE_DATA, 0, Buffer, STATISTICS_SIZE);
+	}
+}
+
+/** Send generated data without accessing the flash, so the PC can measure the serial link latency and throughput with any frame and window size. The acknowledge echoes the parameters, corrected to what the firmware supports. */
+static void CommandPing(void)
+{
+	unsigned long Bytes_Count;
+	unsigned short Block_Size, i;
+	unsigned char Window_Size;
+
+	// Retrieve the amount of bytes to send, the frames size and how many frames can be sent in a row
+	Bytes_Count = ProtocolGetDoubleWord(&Command_Payload[1]);
+	Block_Size = (Command_Payload[5] << 8) | Command_Payload[6];
+	if ((Block_Size == 0) || (Block_Size > sizeof(Buffer))) Block_Size = sizeof(Buffer);
+	Window_Size = Command_Payload[7];
+	if (Window_Size == 0) Window_Size = 1;
+	else if (Window_Size > PROTOCOL_MAXIMUM_PING_WINDOW_SIZE) Window_Size = PROTOCOL_MAXIMUM_PING_WINDOW_SIZE;
+
+	// All frames contain the same bytes, so the PC can check them
+	for (i = 0; i < Block_Size; i++) Buffer[i] = (unsigned char) i;
+
+	Command_Payload[5] = Block_Size >> 8;
+	Command_Payload[6] = (unsigned char) Block_Size;
+	Command_Payload[7] = Window_Size;
+	ProtocolSendAcknowledge(Command_Sequence, &Command_Payload[1], 7);
+
+	MainSendData(0, Bytes_Count, Block_Size, Window_Size, 0);
+}
+
+/** Probe the chip sockets, then tell which chips are available and which ones were inserted or removed since the previous command. The acknowledge contains the available, inserted and removed chips masks. */
+static void CommandReadChipsEvents(void)
+{
+	unsigned char Chips_Masks[3];
+
+	FlashProbeChips();
+	Chips_Masks[0] = FlashReadChipsEvents(&Chips_Masks[1], &Chips_Masks[2]);
+	ProtocolSendAcknowledge(Command_Sequence, Chips_Masks, sizeof(Chips_Masks));
+}
+
+/** Find the addresses a byte pattern is stored at, the bits cleared in the mask being ignored. The flash is read one block ahead, so the current block is searched while the next one is read. The command is acknowledged when the search ends, then the result is sent in a single data frame. The search stops when the matches list is full, the result tells where to continue from.
+ * @note The command contains the address (32-bit), the bytes count (32-bit), the pattern size (8-bit), the pattern and the mask.
+ */
+static void CommandSearchFlash(void)
+{
+	unsigned long Address, End_Address, Next_Address = 0;
+	unsigned short Bytes_Count;
+	unsigned char xdata *Pointer_Block;
+	unsigned char i;
+
+	// Retrieve the searched area and the pattern
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]);
+	End_Address = Address + ProtocolGetDoubleWord(&Command_Payload[5]);
+	Search_Pattern_Size = Command_Payload[9];
+	if ((Search_Pattern_Size == 0) || (Search_Pattern_Size > PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE))
+	{
+		ProtocolRejectCommand(Command_Sequence, PROTOCOL_COMMAND_REJECTION_INVALID);
+		return;
+	}
+	Search_Anchor_Index = 0xFF;
+	for (i = 0; i < Search_Pattern_Size; i++)
+	{
+		Search_Mask[i] = Command_Payload[10 + Search_Pattern_Size + i];
+		Search_Pattern[i] = Command_Payload[10 + i] & Search_Mask[i];
+		if ((Search_Anchor_Index == 0xFF) && (Search_Mask[i] != 0)) Search_Anchor_Index = i;
+	}
+	if (Search_Anchor_Index == 0xFF) Search_Anchor_Index = 0; // The pattern matches everywhere
+	Search_Tail_Size = 0;
+	Search_Matches_Count = 0;
+
+	// Search each buffer half while the next block is read to the other half
+	while (Address < End_Address)
+	{
+		if (End_Address - Address > sizeof(Buffer) / 2) Bytes_Count = sizeof(Buffer) / 2;
+		else Bytes_Count = (unsigned short) (End_Address - Address);
+		Pointer_Block = MainReadFlashBlock(Address, Bytes_Count);
+
+		if (End_Address - Address > Bytes_Count)
+		{
+			if (End_Address - Address - Bytes_Count > sizeof(Buffer) / 2) MainStartFlashBlockPrefetch(Address + Bytes_Count, sizeof(Buffer) / 2, Pointer_Block);
+			else MainStartFlashBlockPrefetch(Address + Bytes_Count, (unsigned short) (End_Address - Address - Bytes_Count), Pointer_Block);
+		}
+
+		Next_Address = MainSearchBlock(Address, Pointer_Block, Bytes_Count);
+		if (Next_Address != 0) break;
+		Address += Bytes_Count;
+	}
+	MainStopFlashBlockPrefetch();
+	if (Next_Address == 0) Next_Address = End_Address;
+
+	// Send the result
+	ProtocolSetDoubleWord(Buffer, Next_Address);
+	ProtocolSetDoubleWord(&Buffer[4], Search_Matches_Count);
+	for (i = 0; i < PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT; i++)
+	{
+		if (i < Search_Matches_Count) ProtocolSetDoubleWord(&Buffer[8 + i * 4], Search_Matches[i]);
+		else ProtocolSetDoubleWord(&Buffer[8 + i * 4], 0);
+	}
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+	MainSendData(0, PROTOCOL_SEARCH_RESULT_SIZE, PROTOCOL_SEARCH_RESULT_SIZE, 1, 0);
+}
+
+/** Tell which pages the last write could not program when each page was read back. The failures are sent in a single data frame following the command acknowledge. */
+static void CommandReadWriteFailures(void)
+{
+	unsigned char i;
+
+	ProtocolSetDoubleWord(Buffer, Write_Failed_Pages_Count);
+	for (i = 0; i < PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT; i++)
+	{
+		if (i < Write_Failed_Pages_Count)
+		{
+			ProtocolSetDoubleWord(&Buffer[4 + i * 8], Write_Failed_Pages_Addresses[i]);
+			ProtocolSetDoubleWord(&Buffer[8 + i * 8], Write_Failed_Pages_Chips_Masks[i]);
+		}
+		else
+		{
+			ProtocolSetDoubleWord(&Buffer[4 + i * 8], 0);
+			ProtocolSetDoubleWord(&Buffer[8 + i * 8], 0);
+		}
+	}
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+	MainSendData(0, PROTOCOL_WRITE_FAILURES_SIZE, PROTOCOL_WRITE_FAILURES_SIZE, 1, 0);
+}
+
+/** Find the fastest SPI clock the chips and their wiring sustain. The clocks are tried from the slowest one : the pattern programmed at the previous clock is read back first, so a clock corrupting the commands is detected before it can erase or program anything, then the sector is erased, a page pattern is programmed and read back several times from each selected chip. The calibration stops at the first clock that fails. The fastest clock without errors is used, or the next slower one if a faster clock failed, to keep a margin. The command is acknowledged when the calibration ends, then the result is sent in a single data frame (see PROTOCOL_SPI_CALIBRATION_RESULT_SIZE).
+ * @note The command contains the address of the sector the calibration can erase (32-bit).
+ * @warning The system clock is not calibrated because the UART baud rate is generated from it.
+ */
+static void CommandCalibrateSPIClock(void)
+{
+	unsigned long Address, Frequency = 0, Failed_Reads_Count;
+	unsigned char xdata *Pointer_Pattern;
+	unsigned char Clock_Index, Passed_Clock_Index = PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT, Previous_Clock_Divider, Failed_Chips_Mask, Read_Failed_Chips_Mask, Is_Pattern_Programmed = 0, i;
+	unsigned short j;
+
+	if (FlashGetSelectedChips() == 0)
+	{
+		ProtocolRejectCommand(Command_Sequence, PROTOCOL_COMMAND_REJECTION_INVALID);
+		return;
+	}
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]) & ~((unsigned long) FLASH_SECTOR_SIZE - 1);
+	Previous_Clock_Divider = SPIGetClockDivider();
+
+	// Make each data line toggle at each bit, and go through many byte values (the beginning of the buffer holds the result)
+	Pointer_Pattern = &Buffer[sizeof(Buffer) - FLASH_PAGE_SIZE];
+	for (j = 0; j < FLASH_PAGE_SIZE; j++)
+	{
+		if (j & 1) Pointer_Pattern[j] = (unsigned char) j ^ 0xAA;
+		else Pointer_Pattern[j] = (unsigned char) j ^ 0x55;
+	}
+
+	Clock_Index = PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT;
+	while (Clock_Index > 0)
+	{
+		Clock_Index--;
+		SPISetClockDivider(SPI_Calibration_Clock_Dividers[Clock_Index]);
+		Failed_Reads_Count = 0;
+
+		// Do not erase anything if the pattern can't be read
+		if (Is_Pattern_Programmed) Failed_Chips_Mask = FlashVerifyBytes(Address, FLASH_PAGE_SIZE, Pointer_Pattern);
+		else Failed_Chips_Mask = 0;
+		if (Failed_Chips_Mask != 0) Failed_Reads_Count = 1;
+		else
 		{
-			UARTWriteByte(COMMAND_MICROCONTROLLER_READY); // Used as flow control
-			Buffer[i] = UARTReadByte();
+			FlashEraseSectors(Address, 1);
+			FlashWriteBytes(Address, FLASH_PAGE_SIZE, Pointer_Pattern);
+			Is_Pattern_Programmed = 1;
+
+			for (i = 0; i < MAIN_SPI_CALIBRATION_READS_COUNT; i++)
+			{
+				Read_Failed_Chips_Mask = FlashVerifyBytes(Address, FLASH_PAGE_SIZE, Pointer_Pattern);
+				if (Read_Failed_Chips_Mask != 0)
+				{
+					Failed_Chips_Mask |= Read_Failed_Chips_Mask;
+					Failed_Reads_Count++;
+				}
+			}
 		}
 
-		// Write the data
-		FlashWriteBytes(Address, Bytes_To_Write, Buffer);
+		ProtocolSetDoubleWord(&Buffer[4 + Clock_Index * 12], SPI_COMPUTE_CLOCK_FREQUENCY(SPI_Calibration_Clock_Dividers[Clock_Index]));
+		ProtocolSetDoubleWord(&Buffer[8 + Clock_Index * 12], Failed_Chips_Mask);
+		ProtocolSetDoubleWord(&Buffer[12 + Clock_Index * 12], Failed_Reads_Count);
+		if (Failed_Chips_Mask != 0) break;
+		Passed_Clock_Index = Clock_Index;
+	}
 
-		Bytes_Count -= Bytes_To_Write;
-		Address += Bytes_To_Write;
+	// Tell which faster clocks were not tried
+	while (Clock_Index > 0)
+	{
+		Clock_Index--;
+		ProtocolSetDoubleWord(&Buffer[4 + Clock_Index * 12], SPI_COMPUTE_CLOCK_FREQUENCY(SPI_Calibration_Clock_Dividers[Clock_Index]));
+		ProtocolSetDoubleWord(&Buffer[8 + Clock_Index * 12], 0);
+		ProtocolSetDoubleWord(&Buffer[12 + Clock_Index * 12], PROTOCOL_SPI_CALIBRATION_CLOCK_SKIPPED);
 	}
+
+	// Keep the previous clock if no clock works
+	if (Passed_Clock_Index < PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT)
+	{
+		if ((Passed_Clock_Index > 0) && (Passed_Clock_Index < PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT - 1)) Passed_Clock_Index++; // The next faster clock failed
+		SPISetClockDivider(SPI_Calibration_Clock_Dividers[Passed_Clock_Index]);
+		Frequency = SPI_COMPUTE_CLOCK_FREQUENCY(SPI_Calibration_Clock_Dividers[Passed_Clock_Index]);
+	}
+	else SPISetClockDivider(Previous_Clock_Divider);
+
+	ProtocolSetDoubleWord(Buffer, Frequency);
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+	MainSendData(0, PROTOCOL_SPI_CALIBRATION_RESULT_SIZE, PROTOCOL_SPI_CALIBRATION_RESULT_SIZE, 1, 0);
+}
+
+/** Use the fastest SPI clock that is not faster than the requested frequency (the slowest clock is used if all are faster). The acknowledge contains the frequency really used (32-bit).
+ * @note The command contains the frequency in Hz (32-bit).
+ */
+static void CommandSetSPIClock(void)
+{
+	unsigned long Frequency, Divider;
+
+	// SPI0CKR = SYSCLK / (2 * Frequency) - 1, rounded up so the clock is not faster than requested
+	Frequency = ProtocolGetDoubleWord(&Command_Payload[1]);
+	if (Frequency == 0) Divider = 255;
+	else
+	{
+		Divider = (SPI_COMPUTE_CLOCK_FREQUENCY(0) + Frequency - 1) / Frequency;
+		if (Divider > 256) Divider = 256;
+		Divider--;
+	}
+	SPISetClockDivider((unsigned char) Divider);
+
+	// Echo the frequency really used
+	ProtocolSetDoubleWord(&Command_Payload[1], SPI_COMPUTE_CLOCK_FREQUENCY(Divider));
+	ProtocolSendAcknowledge(Command_Sequence, &Command_Payload[1], 4);
+}
+
+/** Compute the CRC-32 of consecutive flash sectors, so the PC transfers only the sectors its cached copy of the chip does not match. The flash is read one block ahead, so the current block CRC is computed while the next block is read. The command is acknowledged when all CRCs are computed, then the result is sent in a single data frame (see PROTOCOL_SECTORS_CRC_RESULT_SIZE).
+ * @note The command contains the first sector address (32-bit) and the sectors count (32-bit), only the first PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT sectors are computed.
+ */
+static void CommandReadSectorsCRC(void)
+{
+	unsigned long Address, End_Address, CRC = CRC_INITIAL_VALUE, Sectors_Count;
+	unsigned short Device_ID;
+	unsigned char xdata *Pointer_Block;
+	unsigned char Manufacturer_ID, i;
+
+	// Retrieve the sectors to go through
+	Address = ProtocolGetDoubleWord(&Command_Payload[1]) & ~((unsigned long) FLASH_SECTOR_SIZE - 1);
+	Sectors_Count = ProtocolGetDoubleWord(&Command_Payload[5]);
+	if (Sectors_Count > PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT) Sectors_Count = PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT;
+	End_Address = Address + Sectors_Count * FLASH_SECTOR_SIZE;
+
+	// Each sector is read in two buffer halves
+	i = 0;
+	while (Address < End_Address)
+	{
+		Pointer_Block = MainReadFlashBlock(Address, sizeof(Buffer) / 2);
+		if (End_Address - Address > sizeof(Buffer) / 2) MainStartFlashBlockPrefetch(Address + sizeof(Buffer) / 2, sizeof(Buffer) / 2, Pointer_Block);
+
+		CRC = CRCUpdateBlock(CRC, Pointer_Block, sizeof(Buffer) / 2);
+		Address += sizeof(Buffer) / 2;
+		if ((Address & (FLASH_SECTOR_SIZE - 1)) == 0)
+		{
+			Sectors_CRC[i] = CRC_FINALIZE(CRC);
+			i++;
+			CRC = CRC_INITIAL_VALUE;
+		}
+	}
+	MainStopFlashBlockPrefetch();
+
+	// Send the result
+	FlashReadID(&Manufacturer_ID, &Device_ID);
+	ProtocolSetDoubleWord(Buffer, ((unsigned long) Manufacturer_ID << 16) | Device_ID);
+	ProtocolSetDoubleWord(&Buffer[4], Sectors_Count);
+	for (i = 0; i < PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT; i++)
+	{
+		if (i < Sectors_Count) ProtocolSetDoubleWord(&Buffer[8 + i * 4], Sectors_CRC[i]);
+		else ProtocolSetDoubleWord(&Buffer[8 + i * 4], 0);
+	}
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
+	MainSendData(0, PROTOCOL_SECTORS_CRC_RESULT_SIZE, PROTOCOL_SECTORS_CRC_RESULT_SIZE, 1, 0);
+}
+
+/** Erase the flash sectors containing an area, so the PC does not have to send erased data to erase the flash. The command contains the area address (32-bit) and size (32-bit), it is acknowledged when all sectors are erased. */
+static void CommandEraseFlash(void)
+{
+	MainEraseArea(ProtocolGetDoubleWord(&Command_Payload[1]), ProtocolGetDoubleWord(&Command_Payload[5]));
+	ProtocolSendAcknowledge(Command_Sequence, 0, 0);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -220,7 +938,9 @@ static void CommandWriteFlash(void)
 //-------------------------------------------------------------------------------------------------
 void main(void)
 {
-	unsigned char Byte_Temp;
+	unsigned char Type, Sequence = 0;
+	signed short Payload_Size;
+	unsigned short Idle_Loops_Count = 0;
 
 	// Disable the watchdog timer
 	PCA0MD &= ~PCA0MD_WDTE__ENABLED;
@@ -231,6 +951,7 @@ void main(void)
 	// Initialize all peripherals
 	UARTInitialize(CONFIGURATION_UART_BAUD_RATE);
 	SPIInitialize();
+	StatisticsInitialize();
 
 	// Give the desired pins to the desired peripherals (must be done after the peripherals initialization because the SPI pins count is configurable)
 	MainPinsInitialize();
@@ -238,7 +959,7 @@ void main(void)
 	// Enable interrupts
 	IE |= IE_EA__ENABLED;
 
-	// Initialize the memory now that all microcontroller modules are working
+	// Initialize the memories now that all microcontroller modules are working (the sockets can be empty, the chips are probed again while the programmer is idle)
 	FlashInitialize();
 
 	// Light the led to tell that the programmer is ready
@@ -248,13 +969,32 @@ void main(void)
 	while (1)
 	{
 		// Wait for a command
-		Byte_Temp = UARTReadByte();
+		while (!Is_Command_Pending)
+		{
+			// Being idle is not accounted as waiting for the PC
+			while (!ProtocolIsFrameAvailable())
+			{
+				HARDWARE_WAIT();
+
+				// Detect the chips inserted in or removed from their socket
+				Idle_Loops_Count++;
+				if (Idle_Loops_Count >= MAIN_CHIPS_PROBING_PERIOD)
+				{
+					FlashProbeChips();
+					Idle_Loops_Count = 0;
+				}
+			}
+			Payload_Size = MainReceiveFrame(&Type, &Sequence, Buffer, sizeof(Buffer));
+			if (Payload_Size == PROTOCOL_ERROR_CORRUPTED_FRAME) ProtocolSendNegativeAcknowledge(Sequence); // Make the PC send the command again
+			else if (Type == PROTOCOL_FRAME_TYPE_DATA) ProtocolRepeatLastAcknowledge(); // The PC did not receive the last data acknowledge of the previous command
+		}
+		Is_Command_Pending = 0;
 
 		// Turn off the led while the programmer is busy
 		LED_PORT |= 1 << LED_PIN;
 
 		// Execute the right command
-		switch (Byte_Temp)
+		switch (Command_Payload[0])
 		{
 			case COMMAND_READ_FLASH:
 				CommandReadFlash();
@@ -264,7 +1004,52 @@ void main(void)
 				CommandWriteFlash();
 				break;
 
+			case COMMAND_VERIFY_FLASH:
+				CommandVerifyFlash();
+				break;
+
+			case COMMAND_SELECT_CHIPS:
+				CommandSelectChips();
+				break;
+
+			case COMMAND_READ_STATISTICS:
+				CommandReadStatistics();
+				break;
+
+			case COMMAND_PING:
+				CommandPing();
+				break;
+
+			case COMMAND_READ_CHIPS_EVENTS:
+				CommandReadChipsEvents();
+				break;
+
+			case COMMAND_SEARCH_FLASH:
+				CommandSearchFlash();
+				break;
+
+			case COMMAND_READ_WRITE_FAILURES:
+				CommandReadWriteFailures();
+				break;
+
+			case COMMAND_CALIBRATE_SPI_CLOCK:
+				CommandCalibrateSPIClock();
+				break;
+
+			case COMMAND_SET_SPI_CLOCK:
+				CommandSetSPIClock();
+				break;
+
+			case COMMAND_READ_SECTORS_CRC:
+				CommandReadSectorsCRC();
+				break;
+
+			case COMMAND_ERASE_FLASH:
+				CommandEraseFlash();
+				break;
+
 			default:
+				ProtocolRejectCommand(Command_Sequence, PROTOCOL_COMMAND_REJECTION_UNSUPPORTED);
 				break;
 		}
 
@@ -0,0 +1,161 @@
+/** @file Protocol.c
+ * @see Protocol.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include "CRC.h"
+#include "Protocol.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The last acknowledge sequence number. */
+static unsigned char Protocol_Last_Acknowledge_Sequence = 0;
+/** The last acknowledge payload. */
+static unsigned char Protocol_Last_Acknowledge_Payload[PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE];
+/** The last acknowledge payload size in bytes. */
+static unsigned char Protocol_Last_Acknowledge_Payload_Size = 0;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Send a byte and add it to the running CRC.
+ * @param CRC The current CRC value.
+ * @param Byte The byte to send.
+ * @return The new CRC value.
+ */
+static unsigned long ProtocolSendByte(unsigned long CRC, unsigned char Byte)
+{
+	UARTWriteByte(Byte);
+	return CRCUpdate(CRC, Byte);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+signed short ProtocolReceiveFrame(unsigned char *Pointer_Type, unsigned char *Pointer_Sequence, unsigned char xdata *Pointer_Payload, unsigned short Maximum_Payload_Size)
+{
+	unsigned long CRC, Received_CRC = 0;
+	unsigned short Payload_Size, i;
+	unsigned char Byte;
+
+	// Wait for the beginning of a frame
+	while (UARTReadByte() != PROTOCOL_FRAME_MARKER);
+
+	// Receive the header
+	*Pointer_Type = UARTReadByte();
+	CRC = CRCUpdate(CRC_INITIAL_VALUE, *Pointer_Type);
+	*Pointer_Sequence = UARTReadByte();
+	CRC = CRCUpdate(CRC, *Pointer_Sequence);
+	Byte = UARTReadByte();
+	CRC = CRCUpdate(CRC, Byte);
+	Payload_Size = Byte << 8;
+	Byte = UARTReadByte();
+	CRC = CRCUpdate(CRC, Byte);
+	Payload_Size |= Byte;
+
+	// A corrupted length can't be trusted to receive the payload
+	if (Payload_Size > Maximum_Payload_Size) return PROTOCOL_ERROR_CORRUPTED_FRAME;
+
+	// Receive the payload
+	for (i = 0; i < Payload_Size; i++)
+	{
+		Byte = UARTReadByte();
+		Pointer_Payload[i] = Byte;
+		CRC = CRCUpdate(CRC, Byte);
+	}
+
+	// Receive the CRC (Keil is not able to shift by 24, so shift one byte at a time)
+	for (i = 0; i < 4; i++)
+	{
+		Received_CRC <<= 8;
+		Received_CRC |= UARTReadByte();
+	}
+	if (Received_CRC != CRC_FINALIZE(CRC)) return PROTOCOL_ERROR_CORRUPTED_FRAME;
+
+	return Payload_Size;
+}
+
+bit ProtocolIsFrameAvailable(void)
+{
+	return UARTIsByteAvailable();
+}
+
+void ProtocolSendFrame(unsigned char Type, unsigned char Sequence, unsigned char *Pointer_Payload, unsigned short Payload_Size)
+{
+	unsigned long CRC;
+	unsigned short i;
+	unsigned char CRC_Bytes[4];
+
+	// Send the header
+	UARTWriteByte(PROTOCOL_FRAME_MARKER);
+	CRC = ProtocolSendByte(CRC_INITIAL_VALUE, Type);
+	CRC = ProtocolSendByte(CRC, Sequence);
+	CRC = ProtocolSendByte(CRC, Payload_Size >> 8);
+	CRC = ProtocolSendByte(CRC, Payload_Size);
+
+	// Send the payload
+	for (i = 0; i < Payload_Size; i++) CRC = ProtocolSendByte(CRC, Pointer_Payload[i]);
+
+	// Send the CRC in big endian (Keil is not able to shift by 24, so shift one byte at a time)
+	CRC = CRC_FINALIZE(CRC);
+	for (i = 0; i < 4; i++)
+	{
+		CRC_Bytes[3 - i] = (unsigned char) CRC;
+		CRC >>= 8;
+	}
+	for (i = 0; i < 4; i++) UARTWriteByte(CRC_Bytes[i]);
+}
+
+void ProtocolSendAcknowledge(unsigned char Sequence, unsigned char *Pointer_Payload, unsigned char Payload_Size)
+{
+	unsigned char i;
+
+	// Remember the acknowledge
+	Protocol_Last_Acknowledge_Sequence = Sequence;
+	for (i = 0; i < Payload_Size; i++) Protocol_Last_Acknowledge_Payload[i] = Pointer_Payload[i];
+	Protocol_Last_Acknowledge_Payload_Size = Payload_Size;
+
+	ProtocolSendFrame(PROTOCOL_FRAME_TYPE_ACKNOWLEDGE, Sequence, Pointer_Payload, Payload_Size);
+}
+
+void ProtocolRepeatLastAcknowledge(void)
+{
+	ProtocolSendFrame(PROTOCOL_FRAME_TYPE_ACKNOWLEDGE, Protocol_Last_Acknowledge_Sequence, Protocol_Last_Acknowledge_Payload, Protocol_Last_Acknowledge_Payload_Size);
+}
+
+void ProtocolSendNegativeAcknowledge(unsigned char Sequence)
+{
+	ProtocolSendFrame(PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE, Sequence, 0, 0);
+}
+
+void ProtocolRejectCommand(unsigned char Sequence, unsigned char Reason)
+{
+	ProtocolSendFrame(PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE, Sequence, &Reason, 1);
+}
+
+unsigned long ProtocolGetDoubleWord(unsigned char xdata *Pointer_Payload)
+{
+	unsigned long Result = 0;
+	unsigned char i;
+
+	// Keil is not able to shift by 24, so here is a dirty trick
+	for (i = 0; i < 4; i++)
+	{
+		Result <<= 8;
+		Result |= Pointer_Payload[i];
+	}
+	return Result;
+}
+
+void ProtocolSetDoubleWord(unsigned char xdata *Pointer_Payload, unsigned long Double_Word)
+{
+	signed char i;
+
+	// Keil is not able to shift by 24, so shift one byte at a time
+	for (i = 3; i >= 0; i--)
+	{
+		Pointer_Payload[i] = (unsigned char) Double_Word;
+		Double_Word >>= 8;
+	}
+}
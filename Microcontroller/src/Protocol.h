@@ -0,0 +1,140 @@
+/** @file Protocol.h
+ * Exchange frames with the PC. Each frame is made of a marker byte, a type, a sequence number, a payload length, the payload and a CRC-32 of all these fields except the marker.
+ * Data frames are sent several at a time, an acknowledge tells that all frames up to the acknowledged one were received and a negative acknowledge makes the sender go back to the requested frame.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_PROTOCOL_H
+#define H_PROTOCOL_H
+
+#include "Flash.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The byte starting every frame. */
+#define PROTOCOL_FRAME_MARKER 0x7E
+
+/** A command sent by the PC, the first payload byte is the command code and the following ones are the command parameters. */
+#define PROTOCOL_FRAME_TYPE_COMMAND 0x01
+/** A block of data, sent by the PC when writing and by the microcontroller when reading. */
+#define PROTOCOL_FRAME_TYPE_DATA 0x02
+/** The frame having the same sequence number was successfully received (the payload can contain the command result). */
+#define PROTOCOL_FRAME_TYPE_ACKNOWLEDGE 0x03
+/** The frame having the same sequence number was corrupted and must be sent again. */
+#define PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE 0x04
+
+/** The payload of a negative acknowledge answering a command with an unknown code (a negative acknowledge without payload asks for the frame again). */
+#define PROTOCOL_COMMAND_REJECTION_UNSUPPORTED 0x01
+/** The payload of a negative acknowledge answering a command that can't be executed with its parameters or with the selected chips. */
+#define PROTOCOL_COMMAND_REJECTION_INVALID 0x02
+
+/** How many bytes a frame contains besides its payload (marker, type, sequence number, payload length and CRC). */
+#define PROTOCOL_FRAME_OVERHEAD_SIZE 9
+
+/** How many bytes the PC sends in each data frame (a flash page is programmed per frame). */
+#define PROTOCOL_WRITE_BLOCK_SIZE FLASH_PAGE_SIZE
+/** How many bytes the microcontroller sends in each data frame. */
+#define PROTOCOL_READ_BLOCK_SIZE 1024
+
+/** How many data frames the PC can send without waiting for their acknowledge. They are all stored by the UART reception buffer while the current page is programmed, this value is sent to the PC in the write and verify commands acknowledge. */
+#define PROTOCOL_WRITE_WINDOW_SIZE (UART_RECEPTION_BUFFER_SIZE / (PROTOCOL_WRITE_BLOCK_SIZE + PROTOCOL_FRAME_OVERHEAD_SIZE))
+/** How many data frames the microcontroller sends without waiting for their acknowledge. A lost frame is read again from the flash, so this does not need any memory. */
+#define PROTOCOL_READ_WINDOW_SIZE 4
+/** The largest window the PC can ask for when pinging (the PC tells repeated frames from new ones up to this window size). */
+#define PROTOCOL_MAXIMUM_PING_WINDOW_SIZE 32
+
+/** The write command optional flags byte (following the bytes count) bit telling to read each page back right after programming it. Each data acknowledge then contains the mask of the chips that could not be programmed and the count of the failed pages (16-bit). */
+#define PROTOCOL_WRITE_FLAG_VERIFY_PAGES 0x01
+/** How many failed pages the programmer remembers during a write. */
+#define PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT 16
+/** The size of the write failures data : the failed pages count, then the address and the mask of the failed chips of the first PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT failed pages, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_WRITE_FAILURES_SIZE (4 + PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT * 8)
+
+/** How many SPI clock frequencies the calibration tries. */
+#define PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT 8
+/** The size of a SPI clock calibration result : the selected clock frequency in Hz (0 if no clock works), then the frequency, the mask of the failed chips and the failed reads count of each tried clock from the fastest one, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SPI_CALIBRATION_RESULT_SIZE (4 + PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT * 12)
+/** The failed reads count of a clock the calibration did not try because a slower clock already failed. */
+#define PROTOCOL_SPI_CALIBRATION_CLOCK_SKIPPED 0xFFFFFFFFUL
+
+/** How many sectors CRC a sectors CRC command result can contain. */
+#define PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT 32
+/** The size of a sectors CRC command result : the JEDEC ID of the read chip (manufacturer ID in bits 23..16, device ID in bits 15..0), the computed sectors count and PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT sector CRC-32 values, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SECTORS_CRC_RESULT_SIZE (8 + PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT * 4)
+
+/** The largest pattern the search command can look for. */
+#define PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE 32
+/** How many match addresses a search command result can contain. */
+#define PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT 64
+/** The size of a search command result : the address the search stopped at, the matches count and PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT match addresses, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SEARCH_RESULT_SIZE (8 + PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT * 4)
+
+/** The maximum size of a command frame payload (the search command is the largest one, it contains the command code, the address, the bytes count, the pattern size, the pattern and its mask). */
+#define PROTOCOL_MAXIMUM_COMMAND_SIZE (10 + 2 * PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE)
+/** The maximum size of an acknowledge frame payload. */
+#define PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE 8
+
+/** ProtocolReceiveFrame() returns this value when the received frame is corrupted. */
+#define PROTOCOL_ERROR_CORRUPTED_FRAME -1
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Wait for a frame and receive it. All bytes preceding the frame marker are discarded.
+ * @param Pointer_Type On output, contain the frame type.
+ * @param Pointer_Sequence On output, contain the frame sequence number.
+ * @param Pointer_Payload On output, contain the frame payload.
+ * @param Maximum_Payload_Size The payload buffer size. Frames with a larger payload are considered as corrupted.
+ * @return The payload size in bytes or PROTOCOL_ERROR_CORRUPTED_FRAME if the frame is corrupted (in this case the output parameters can't be trusted).
+ * @note This is a blocking function.
+ */
+signed short ProtocolReceiveFrame(unsigned char *Pointer_Type, unsigned char *Pointer_Sequence, unsigned char xdata *Pointer_Payload, unsigned short Maximum_Payload_Size);
+
+/** Tell whether the PC started sending a frame.
+ * @return 1 if some bytes were received, 0 if ProtocolReceiveFrame() would wait.
+ */
+bit ProtocolIsFrameAvailable(void);
+
+/** Send a frame.
+ * @param Type The frame type.
+ * @param Sequence The frame sequence number.
+ * @param Pointer_Payload The payload to send, can be 0 if Payload_Size is 0.
+ * @param Payload_Size The payload size in bytes.
+ */
+void ProtocolSendFrame(unsigned char Type, unsigned char Sequence, unsigned char *Pointer_Payload, unsigned short Payload_Size);
+
+/** Acknowledge a frame. The acknowledge is remembered to be sent again by ProtocolRepeatLastAcknowledge() if the PC did not receive it.
+ * @param Sequence The sequence number of the acknowledged frame.
+ * @param Pointer_Payload The command result, can be 0 if Payload_Size is 0.
+ * @param Payload_Size The result size in bytes (up to PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE).
+ */
+void ProtocolSendAcknowledge(unsigned char Sequence, unsigned char *Pointer_Payload, unsigned char Payload_Size);
+
+/** Send the last acknowledge again. */
+void ProtocolRepeatLastAcknowledge(void);
+
+/** Ask the PC to send a frame again.
+ * @param Sequence The sequence number of the frame to send again.
+ */
+void ProtocolSendNegativeAcknowledge(unsigned char Sequence);
+
+/** Tell the PC that a command can't be executed, so it does not send the command again.
+ * @param Sequence The command sequence number.
+ * @param Reason PROTOCOL_COMMAND_REJECTION_UNSUPPORTED or PROTOCOL_COMMAND_REJECTION_INVALID.
+ */
+void ProtocolRejectCommand(unsigned char Sequence, unsigned char Reason);
+
+/** Extract a 32-bit number stored in big endian from a payload.
+ * @param Pointer_Payload The number location.
+ * @return The 32-bit number.
+ */
+unsigned long ProtocolGetDoubleWord(unsigned char xdata *Pointer_Payload);
+
+/** Store a 32-bit number in big endian to a payload.
+ * @param Pointer_Payload The number location.
+ * @param Double_Word The 32-bit number.
+ */
+void ProtocolSetDoubleWord(unsigned char xdata *Pointer_Payload, unsigned long Double_Word);
+
+#endif
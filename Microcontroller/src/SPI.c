@@ -2,9 +2,109 @@
  * @see SPI.h for description.
  * @author Adrien RICCIARDI
  */
-#include <compiler_defs.h>
-#include <SI_C8051F970_Register_Enums.h>
+#include "Configuration.h"
+#include "Hardware.h"
 #include "SPI.h"
+#include "Statistics.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The SFR page holding the DMA registers. */
+#define SPI_DMA_SFR_PAGE 0x02
+
+/** The DMA channel feeding the SPI transmit buffer. */
+#define SPI_DMA_TRANSMIT_CHANNEL 0
+/** The DMA channel emptying the SPI receive buffer. */
+#define SPI_DMA_RECEIVE_CHANNEL 1
+/** Both channels bits in the DMA0EN and DMA0INT registers. */
+#define SPI_DMA_CHANNELS_MASK ((1 << SPI_DMA_TRANSMIT_CHANNEL) | (1 << SPI_DMA_RECEIVE_CHANNEL))
+
+/** The DMA0NCF peripheral request of the SPI0 transmit buffer. */
+#define SPI_DMA_PERIPHERAL_TRANSMIT 0x08
+/** The DMA0NCF peripheral request of the SPI0 receive buffer. */
+#define SPI_DMA_PERIPHERAL_RECEIVE 0x09
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The port 1 bit driving each chip Slave Select pin. */
+static unsigned char code SPI_Slave_Select_Pins[SPI_CHIPS_COUNT] = {1 << 2, 1 << 3, 1 << 4, 1 << 5};
+
+/** The port 1 bits to clear to select the chosen chips. */
+static unsigned char SPI_Selected_Pins_Mask = 1 << 2;
+
+/** Set by the DMA interrupt handler when the last byte of a block has been transferred. */
+static volatile bit SPI_Is_Block_Transfer_Finished = 1;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+#if CONFIGURATION_SPI_DMA_ENABLED
+	/** Handle the DMA interrupt raised by the last channel of a block transfer. */
+	INTERRUPT(SPIDMAInterruptHandler, DMA0_IRQn)
+	{
+		unsigned char Previous_SFR_Page;
+
+		// Save the current page
+		Previous_SFR_Page = SFRPAGE;
+		SFRPAGE = SPI_DMA_SFR_PAGE;
+
+		// Stop both channels and clear their interrupt flags (the transmit channel is done when the receive channel is done)
+		DMA0EN &= ~SPI_DMA_CHANNELS_MASK;
+		DMA0INT &= ~SPI_DMA_CHANNELS_MASK;
+		SPI_Is_Block_Transfer_Finished = 1;
+
+		// Restore the initial page
+		SFRPAGE = Previous_SFR_Page;
+	}
+
+	/** Configure a DMA channel to move a block between the SPI module and the xdata memory.
+	 * @param Channel The channel to configure.
+	 * @param Peripheral The SPI request the channel serves, SPI_DMA_PERIPHERAL_TRANSMIT or SPI_DMA_PERIPHERAL_RECEIVE.
+	 * @param Pointer_Buffer The block to send or to receive to.
+	 * @param Bytes_Count The block size.
+	 * @param Is_Interrupt_Enabled Set to 1 to raise the DMA interrupt when the channel has transferred the whole block.
+	 * @warning The DMA SFR page must be selected.
+	 */
+	static void SPIConfigureDMAChannel(unsigned char Channel, unsigned char Peripheral, unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count, unsigned char Is_Interrupt_Enabled)
+	{
+		DMA0SEL = Channel;
+		if (Is_Interrupt_Enabled) DMA0NCF = Peripheral | DMA0NCF_IEN__ENABLED;
+		else DMA0NCF = Peripheral;
+		DMA0NMD = DMA0NMD_WRAP__DISABLED;
+
+		// Start from the beginning of the block
+		HARDWARE_DMA_SET_ADDRESS(Pointer_Buffer);
+		DMA0NAOL = 0;
+		DMA0NAOH = 0;
+		DMA0NSZL = (unsigned char) Bytes_Count;
+		DMA0NSZH = Bytes_Count >> 8;
+	}
+
+	/** Start the configured channels.
+	 * @param Channels_Mask Bit n set means that channel n is started.
+	 * @warning The DMA SFR page must be selected.
+	 */
+	static void SPIStartDMAChannels(unsigned char Channels_Mask)
+	{
+		SPI_Is_Block_Transfer_Finished = 0;
+		DMA0INT &= ~SPI_DMA_CHANNELS_MASK;
+		DMA0EN |= Channels_Mask;
+	}
+#elif CONFIGURATION_SPI_ASSEMBLY_ENABLED && !defined(SIMULATOR)
+	/** Receive a block of bytes in 23 to 28 cycles per byte (see SPI_Block.A51).
+	 * @param Pointer_Buffer On output, contain the received bytes.
+	 * @param Bytes_Count How many bytes to receive, must not be 0.
+	 */
+	void SPIReadBlockAssembly(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+	/** Send a block of bytes back to back, i.e. in 16 cycles per byte (see SPI_Block.A51).
+	 * @param Pointer_Buffer The bytes to send.
+	 * @param Bytes_Count How many bytes to send, must not be 0.
+	 */
+	void SPIWriteBlockAssembly(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+#endif
 
 //-------------------------------------------------------------------------------------------------
 // Public functions
@@ -15,23 +115,153 @@ void SPIInitialize(void)
 	SPI0CFG = SPI0CFG_MSTEN__MASTER_ENABLED | SPI0CFG_CKPHA__DATA_CENTERED_FIRST | SPI0CFG_CKPOL__IDLE_LOW | SPI0CFG_SRMT__SET | SPI0CFG_RXBMT__SET; // Enable master mode, configure SPI mode 0, set all reception flags to empty value
 	SPI0CKR = 0; // Set the SPI clock to the fastest speed
 	SPI0CN = SPI0CN_NSSMD__3_WIRE | SPI0CN_TXBMT__SET | SPI0CN_SPIEN__ENABLED; // Select 3-wire master mode, set all transmit flags to empty value, enable the SPI module
+
+#if CONFIGURATION_SPI_DMA_ENABLED
+	// Make sure no channel is running, then enable the interrupt telling that a block transfer is finished
+	SFRPAGE = SPI_DMA_SFR_PAGE;
+	DMA0EN = 0;
+	DMA0INT = 0;
+	SFRPAGE = LEGACY_PAGE;
+	EIE2 |= EIE2_EDMA0__ENABLED;
+#endif
+}
+
+void SPISetClockDivider(unsigned char Divider)
+{
+	SPI0CKR = Divider;
+}
+
+unsigned char SPIGetClockDivider(void)
+{
+	return SPI0CKR;
 }
 
 unsigned char SPITransferByte(unsigned char Byte_To_Send)
 {
+	unsigned short Start_Time;
+
 	// Send data
+	STATISTICS_START_TIME(Start_Time);
 	SPI0DAT = Byte_To_Send;
 
 	// Wait for the transfer to finish
-	while (!SPI0CN_SPIF);
+	while (!SPI0CN_SPIF) HARDWARE_WAIT();
 	SPI0CN_SPIF = 0;
+	STATISTICS_ADD_TIME(STATISTICS_TIME_SPI_TRANSFER, Start_Time);
 
 	return SPI0DAT;
 }
 
+void SPIStartReadBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count)
+{
+#if !CONFIGURATION_SPI_DMA_ENABLED
+	unsigned short Start_Time;
+#endif
+
+	if (Bytes_Count == 0) return;
+
+#if CONFIGURATION_SPI_DMA_ENABLED
+	// The flash ignores the MOSI line while it outputs data, so the transmit channel sends the buffer itself, each byte being sent before it is overwritten by the received one
+	SFRPAGE = SPI_DMA_SFR_PAGE;
+	SPIConfigureDMAChannel(SPI_DMA_RECEIVE_CHANNEL, SPI_DMA_PERIPHERAL_RECEIVE, Pointer_Buffer, Bytes_Count, 1);
+	SPIConfigureDMAChannel(SPI_DMA_TRANSMIT_CHANNEL, SPI_DMA_PERIPHERAL_TRANSMIT, Pointer_Buffer, Bytes_Count, 0);
+	SPIStartDMAChannels(SPI_DMA_CHANNELS_MASK);
+	SFRPAGE = LEGACY_PAGE;
+#else
+	// The time is measured once for the whole block instead of once per byte
+	STATISTICS_START_TIME(Start_Time);
+	#if CONFIGURATION_SPI_ASSEMBLY_ENABLED && !defined(SIMULATOR)
+		SPIReadBlockAssembly(Pointer_Buffer, Bytes_Count);
+	#else
+		do
+		{
+			SPI0DAT = 0xFF;
+			while (!SPI0CN_SPIF) HARDWARE_WAIT();
+			SPI0CN_SPIF = 0;
+
+			*Pointer_Buffer = SPI0DAT;
+			Pointer_Buffer++;
+			Bytes_Count--;
+		} while (Bytes_Count > 0);
+	#endif
+	STATISTICS_ADD_TIME(STATISTICS_TIME_SPI_TRANSFER, Start_Time);
+#endif
+}
+
+void SPIStartWriteBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count)
+{
+#if !CONFIGURATION_SPI_DMA_ENABLED
+	unsigned short Start_Time;
+#endif
+
+	if (Bytes_Count == 0) return;
+
+#if CONFIGURATION_SPI_DMA_ENABLED
+	// The received bytes are not needed, so only the transmit channel is used
+	SFRPAGE = SPI_DMA_SFR_PAGE;
+	SPIConfigureDMAChannel(SPI_DMA_TRANSMIT_CHANNEL, SPI_DMA_PERIPHERAL_TRANSMIT, Pointer_Buffer, Bytes_Count, 1);
+	SPIStartDMAChannels(1 << SPI_DMA_TRANSMIT_CHANNEL);
+	SFRPAGE = LEGACY_PAGE;
+#else
+	STATISTICS_START_TIME(Start_Time);
+	#if CONFIGURATION_SPI_ASSEMBLY_ENABLED && !defined(SIMULATOR)
+		SPIWriteBlockAssembly(Pointer_Buffer, Bytes_Count);
+	#else
+		do
+		{
+			SPI0DAT = *Pointer_Buffer;
+			while (!SPI0CN_SPIF) HARDWARE_WAIT();
+			SPI0CN_SPIF = 0;
+
+			Pointer_Buffer++;
+			Bytes_Count--;
+		} while (Bytes_Count > 0);
+	#endif
+	STATISTICS_ADD_TIME(STATISTICS_TIME_SPI_TRANSFER, Start_Time);
+#endif
+}
+
+void SPIWaitBlockEnd(void)
+{
+#if CONFIGURATION_SPI_DMA_ENABLED
+	unsigned short Start_Time;
+
+	STATISTICS_START_TIME(Start_Time);
+	while (!SPI_Is_Block_Transfer_Finished) HARDWARE_WAIT();
+
+	// The transmit channel is done as soon as the last byte is in the SPI transmit buffer, so wait for this byte to be shifted out
+	while (SPI0CFG & SPI0CFG_SPIBSY__SET) HARDWARE_WAIT();
+	SPI0CN_SPIF = 0; // The flag stays set after a block sent without reception, SPITransferByte() would not wait otherwise
+	STATISTICS_ADD_TIME(STATISTICS_TIME_SPI_TRANSFER, Start_Time);
+#endif
+}
+
+void SPIReadBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count)
+{
+	SPIStartReadBlock(Pointer_Buffer, Bytes_Count);
+	SPIWaitBlockEnd();
+}
+
+void SPIWriteBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count)
+{
+	SPIStartWriteBlock(Pointer_Buffer, Bytes_Count);
+	SPIWaitBlockEnd();
+}
+
+void SPISetSelectedChips(unsigned char Chips_Mask)
+{
+	unsigned char i;
+
+	SPI_Selected_Pins_Mask = 0;
+	for (i = 0; i < SPI_CHIPS_COUNT; i++)
+	{
+		if (Chips_Mask & (1 << i)) SPI_Selected_Pins_Mask |= SPI_Slave_Select_Pins[i];
+	}
+}
+
 void SPISetSlaveSelectState(unsigned char Is_Enabled)
 {
-	// The Slave Select pin is active low
-	if (Is_Enabled) P1 &= ~(1 << 2);
-	else P1 |= 1 << 2;
+	// The Slave Select pins are active low
+	if (Is_Enabled) P1 &= ~SPI_Selected_Pins_Mask;
+	else P1 |= SPI_SLAVE_SELECT_PINS_MASK;
 }
@@ -5,12 +5,38 @@
 #ifndef H_SPI_H
 #define H_SPI_H
 
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** How many NOR chips can share the SPI bus, each one having its own Slave Select pin. */
+#define SPI_CHIPS_COUNT 4
+
+/** All port 1 pins used as Slave Select (chip 0 is on P1.2, chip 1 on P1.3, chip 2 on P1.4, chip 3 on P1.5). */
+#define SPI_SLAVE_SELECT_PINS_MASK 0x3C
+
+/** Compute the SPI clock frequency obtained with a clock divider.
+ * @param Divider The SPI0CKR value.
+ * @return The frequency in Hz.
+ */
+#define SPI_COMPUTE_CLOCK_FREQUENCY(Divider) (24500000UL / (2 * ((unsigned long) (Divider) + 1)))
+
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
-/** Initialize the SPI module in master mode at a frequency of 1 MHz. The Slave Select pin is handled manually to fit the NOR custom transfers. */
+/** Initialize the SPI module in master mode at the fastest frequency (12.25 MHz). The Slave Select pin is handled manually to fit the NOR custom transfers. */
 void SPIInitialize(void);
 
+/** Change the SPI clock frequency, which is SYSCLK / (2 * (Divider + 1)).
+ * @param Divider The SPI0CKR value, 0 being the fastest clock.
+ * @warning No transfer must be in progress.
+ */
+void SPISetClockDivider(unsigned char Divider);
+
+/** Tell which SPI clock is in use.
+ * @return The SPI0CKR value.
+ */
+unsigned char SPIGetClockDivider(void);
+
 /** Send a byte through the SPI bus and receive another byte in the same time.
  * @param Byte_To_Send The data to send.
  * @return The received data.
@@ -18,8 +44,46 @@ void SPIInitialize(void);
  */
 unsigned char SPITransferByte(unsigned char Byte_To_Send);
 
-/** Select or not the NOR chip.
- * @param Is_Enabled Set to 1 to select the chip (i.e. Slave Select pin is set to low), set to 0 to deselect the chip (i.e. Slave Select pin is set to high).
+/** Start receiving a block of bytes. When the DMA is enabled, the function returns immediately and the block is received in the background, otherwise the function returns when the block is received.
+ * @param Pointer_Buffer On output, contain the received bytes. It must not be accessed until SPIWaitBlockEnd() returns.
+ * @param Bytes_Count How many bytes to receive (0 does nothing).
+ * @note The sent bytes are 0xFF, or the buffer former content when the DMA is used.
+ * @warning The Slave Select pin must be driven manually and must stay enabled until SPIWaitBlockEnd() returns.
+ */
+void SPIStartReadBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+/** Start sending a block of bytes, discarding the received ones. When the DMA is enabled, the function returns immediately and the block is sent in the background, otherwise the function returns when the block is sent.
+ * @param Pointer_Buffer The bytes to send. They must not be modified until SPIWaitBlockEnd() returns.
+ * @param Bytes_Count How many bytes to send (0 does nothing).
+ * @warning The Slave Select pin must be driven manually and must stay enabled until SPIWaitBlockEnd() returns.
+ */
+void SPIStartWriteBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+/** Wait for the block started by SPIStartReadBlock() or SPIStartWriteBlock() to be fully transferred, so the Slave Select pin can be released right away. */
+void SPIWaitBlockEnd(void);
+
+/** Receive a block of bytes (see SPIStartReadBlock()) and wait for the transfer end.
+ * @param Pointer_Buffer On output, contain the received bytes.
+ * @param Bytes_Count How many bytes to receive (0 does nothing).
+ * @warning The Slave Select pin must be driven manually.
+ */
+void SPIReadBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+/** Send a block of bytes (see SPIStartWriteBlock()) and wait for the transfer end.
+ * @param Pointer_Buffer The bytes to send.
+ * @param Bytes_Count How many bytes to send (0 does nothing).
+ * @warning The Slave Select pin must be driven manually.
+ */
+void SPIWriteBlock(unsigned char xdata *Pointer_Buffer, unsigned short Bytes_Count);
+
+/** Choose the chips driven by the next SPISetSlaveSelectState() calls.
+ * @param Chips_Mask Bit n set means that chip n is selected. When several chips are selected, the bytes sent on the bus are received by all of them at the same time.
+ * @warning Only one chip must be selected when receiving data, otherwise all chips drive the MISO line at the same time.
+ */
+void SPISetSelectedChips(unsigned char Chips_Mask);
+
+/** Select or not the NOR chips chosen with SPISetSelectedChips().
+ * @param Is_Enabled Set to 1 to select the chips (i.e. their Slave Select pin is set to low), set to 0 to deselect all chips (i.e. all Slave Select pins are set to high).
  */
 void SPISetSlaveSelectState(unsigned char Is_Enabled);
 
@@ -0,0 +1,101 @@
+/** @file Statistics.c
+ * @see Statistics.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include "Hardware.h"
+#include "Protocol.h"
+#include "Statistics.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** Each activity cumulated time in timer ticks. */
+static unsigned long xdata Statistics_Times[STATISTICS_TIMES_COUNT];
+/** All counters. */
+static unsigned long xdata Statistics_Counters[STATISTICS_COUNTERS_COUNT];
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Clear all times and counters. */
+static void StatisticsClear(void)
+{
+	unsigned char i;
+
+	for (i = 0; i < STATISTICS_TIMES_COUNT; i++) Statistics_Times[i] = 0;
+	for (i = 0; i < STATISTICS_COUNTERS_COUNT; i++) Statistics_Counters[i] = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+void StatisticsInitialize(void)
+{
+	StatisticsClear();
+
+#if CONFIGURATION_STATISTICS_ENABLED
+	// Configure the timer 0 as a free running 16-bit counter incremented at SYSCLK / 12 (the prescaler is not used by the timer 1, which generates the UART clock from the system clock)
+	CKCON &= ~(CKCON_T0M__SYSCLK | CKCON_SCA__FMASK); // Reset all the timer 0 clock related fields
+	CKCON |= CKCON_T0M__PRESCALE | CKCON_SCA__SYSCLK_DIV_12; // Use the prescaler as timer clock source, divide the system clock by 12
+	TMOD &= 0xF0; // Reset all the timer 0 related fields
+	TMOD |= TMOD_T0M__MODE1; // Timer 0 is always enabled, timer 0 is incremented by the internal clock, select the 16-bit mode
+	TH0 = 0;
+	TL0 = 0;
+	TCON |= TCON_TR0__RUN; // Enable the timer 0
+#endif
+}
+
+unsigned short StatisticsGetTime(void)
+{
+	unsigned char High_Byte, Low_Byte;
+
+	// The timer can't be read atomically, so read the high byte again if the low byte overflowed meanwhile
+	do
+	{
+		High_Byte = TH0;
+		Low_Byte = TL0;
+	} while (High_Byte != TH0);
+
+	return (High_Byte << 8) | Low_Byte;
+}
+
+unsigned short StatisticsAddTime(unsigned char Time_Index, unsigned short Start_Time)
+{
+	unsigned short Time;
+
+	Time = StatisticsGetTime();
+	Statistics_Times[Time_Index] += (unsigned short) (Time - Start_Time); // The subtraction is right even if the timer wrapped around
+	return Time;
+}
+
+void StatisticsIncrementCounter(unsigned char Counter_Index)
+{
+	Statistics_Counters[Counter_Index]++;
+}
+
+void StatisticsRead(unsigned char xdata *Pointer_Buffer)
+{
+	unsigned char i;
+
+#if CONFIGURATION_STATISTICS_ENABLED
+	ProtocolSetDoubleWord(Pointer_Buffer, STATISTICS_TIMER_FREQUENCY);
+#else
+	ProtocolSetDoubleWord(Pointer_Buffer, 0); // Tell the PC that nothing was measured
+#endif
+	Pointer_Buffer += 4;
+
+	for (i = 0; i < STATISTICS_TIMES_COUNT; i++)
+	{
+		ProtocolSetDoubleWord(Pointer_Buffer, Statistics_Times[i]);
+		Pointer_Buffer += 4;
+	}
+	for (i = 0; i < STATISTICS_COUNTERS_COUNT; i++)
+	{
+		ProtocolSetDoubleWord(Pointer_Buffer, Statistics_Counters[i]);
+		Pointer_Buffer += 4;
+	}
+	ProtocolSetDoubleWord(Pointer_Buffer, UARTReadOverrunsCount());
+
+	StatisticsClear();
+}
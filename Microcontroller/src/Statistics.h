@@ -0,0 +1,88 @@
+/** @file Statistics.h
+ * Measure where the firmware spends its time (SPI transfers, waiting for the UART, polling the flash status) and count the flash cycles, so the PC can tell whether a chip or a baud rate is SPI-, flash- or UART-bound.
+ * Times are measured with the timer 0 running freely at SYSCLK / 12. A single measure must not last more than a timer period (about 32 ms), so long waits are measured one polling iteration at a time.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_STATISTICS_H
+#define H_STATISTICS_H
+
+#include "Configuration.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The time measures timer frequency in Hz. */
+#define STATISTICS_TIMER_FREQUENCY (24500000UL / 12)
+
+/** Time spent exchanging bytes with the flash. */
+#define STATISTICS_TIME_SPI_TRANSFER 0
+/** Time spent waiting for a byte to be sent to the PC. */
+#define STATISTICS_TIME_UART_TRANSMISSION_WAIT 1
+/** Time spent waiting for a byte from the PC while a command is executed. */
+#define STATISTICS_TIME_UART_RECEPTION_WAIT 2
+/** Time spent polling the flash status register for an erase or program cycle to terminate. */
+#define STATISTICS_TIME_FLASH_STATUS_POLLING 3
+/** How many times are measured. */
+#define STATISTICS_TIMES_COUNT 4
+
+/** How many erase cycles (sector or whole chip) were started. */
+#define STATISTICS_COUNTER_ERASE_CYCLES 0
+/** How many page program cycles were started. */
+#define STATISTICS_COUNTER_PAGE_PROGRAM_CYCLES 1
+/** How many counters are maintained. */
+#define STATISTICS_COUNTERS_COUNT 2
+
+/** The size in bytes of the statistics sent to the PC : the timer frequency, the times, the counters and the UART overruns count, all stored as 32-bit big endian numbers. */
+#define STATISTICS_SIZE ((1 + STATISTICS_TIMES_COUNT + STATISTICS_COUNTERS_COUNT + 1) * 4)
+
+#if CONFIGURATION_STATISTICS_ENABLED
+	/** Start measuring an activity.
+	 * @param Start_Time The variable to store the current time to.
+	 */
+	#define STATISTICS_START_TIME(Start_Time) Start_Time = StatisticsGetTime()
+
+	/** Account for the time elapsed since the activity start, and restart the measure from now so that the macro can be called once per polling iteration.
+	 * @param Time_Index The activity, use one of the STATISTICS_TIME_xxx constants.
+	 * @param Start_Time The variable set by STATISTICS_START_TIME() or by the previous STATISTICS_ADD_TIME().
+	 */
+	#define STATISTICS_ADD_TIME(Time_Index, Start_Time) Start_Time = StatisticsAddTime(Time_Index, Start_Time)
+
+	/** Increment a counter.
+	 * @param Counter_Index The counter, use one of the STATISTICS_COUNTER_xxx constants.
+	 */
+	#define STATISTICS_INCREMENT_COUNTER(Counter_Index) StatisticsIncrementCounter(Counter_Index)
+#else
+	#define STATISTICS_START_TIME(Start_Time) (void) (Start_Time) // Avoid an unused variable warning
+	#define STATISTICS_ADD_TIME(Time_Index, Start_Time)
+	#define STATISTICS_INCREMENT_COUNTER(Counter_Index)
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Start the timer used to measure times and clear all statistics. */
+void StatisticsInitialize(void);
+
+/** Get the current time.
+ * @return The timer 0 value.
+ */
+unsigned short StatisticsGetTime(void);
+
+/** Add the time elapsed since a given time to an activity.
+ * @param Time_Index The activity, use one of the STATISTICS_TIME_xxx constants.
+ * @param Start_Time When the measure started.
+ * @return The current time.
+ */
+unsigned short StatisticsAddTime(unsigned char Time_Index, unsigned short Start_Time);
+
+/** Increment a counter.
+ * @param Counter_Index The counter, use one of the STATISTICS_COUNTER_xxx constants.
+ */
+void StatisticsIncrementCounter(unsigned char Counter_Index);
+
+/** Store all statistics to a buffer and clear them, so that the next call tells about what happened in between.
+ * @param Pointer_Buffer On output, contain STATISTICS_SIZE bytes. Only the UART overruns count is maintained when the statistics are disabled in the configuration, all other values are zero.
+ */
+void StatisticsRead(unsigned char xdata *Pointer_Buffer);
+
+#endif
@@ -2,8 +2,8 @@
  * @see UART.h for description.
  * @author Adrien RICCIARDI
  */
-#include <compiler_defs.h>
-#include <SI_C8051F970_Register_Enums.h>
+#include "Hardware.h"
+#include "Statistics.h"
 #include "UART.h"
 
 //-------------------------------------------------------------------------------------------------
@@ -11,8 +11,14 @@
 //-------------------------------------------------------------------------------------------------
 /** Fake mutex telling if the transmission is finished or not. */
 static volatile bit Is_Transmission_Finished = 1;
-/** Fake mutex telling if a byte was received from the UART or not. */
-static volatile bit Is_Byte_Received = 0;
+/** The received bytes waiting to be read, filled by the interrupt handler so that no byte is lost while the main program is busy (programming a flash page for instance). */
+static unsigned char xdata UART_Reception_Buffer[UART_RECEPTION_BUFFER_SIZE];
+/** Where the interrupt handler stores the next received byte. */
+static volatile unsigned short UART_Reception_Buffer_Write_Index = 0;
+/** Where the next byte to read is located. */
+static unsigned short UART_Reception_Buffer_Read_Index = 0;
+/** How many received bytes were dropped because the reception buffer was full. */
+static volatile unsigned long UART_Overruns_Count = 0;
 
 //-------------------------------------------------------------------------------------------------
 // Private functions
@@ -21,6 +27,7 @@ static volatile bit Is_Byte_Received = 0;
 INTERRUPT(UARTInterruptsHandler, UART0_IRQn)
 {
 	unsigned char Previous_SFR_Page;
+	unsigned short Next_Write_Index;
 
 	// Save the current page
 	Previous_SFR_Page = SFRPAGE;
@@ -36,7 +43,14 @@ INTERRUPT(UARTInterruptsHandler, UART0_IRQn)
 	// Reception interrupt
 	if (SCON0_RI == 1)
 	{
-		Is_Byte_Received = 1;
+		// Drop the byte if the buffer is full, the protocol CRC will tell that the frame is corrupted
+		Next_Write_Index = (UART_Reception_Buffer_Write_Index + 1) & (UART_RECEPTION_BUFFER_SIZE - 1);
+		if (Next_Write_Index != UART_Reception_Buffer_Read_Index)
+		{
+			UART_Reception_Buffer[UART_Reception_Buffer_Write_Index] = SBUF0;
+			UART_Reception_Buffer_Write_Index = Next_Write_Index;
+		}
+		else UART_Overruns_Count++;
 		SCON0_RI = 0; // Clear the interrupt flag
 	}
 
@@ -66,11 +80,50 @@ void UARTInitialize(unsigned char Baud_Rate)
 
 unsigned char UARTReadByte(void)
 {
+	unsigned char Byte;
+	unsigned short Start_Time;
+
 	// Wait for a byte to be received
-	while (!Is_Byte_Received);
-	Is_Byte_Received = 0;
+	STATISTICS_START_TIME(Start_Time);
+	while (!UARTIsByteAvailable())
+	{
+		HARDWARE_WAIT();
+		STATISTICS_ADD_TIME(STATISTICS_TIME_UART_RECEPTION_WAIT, Start_Time);
+	}
+
+	Byte = UART_Reception_Buffer[UART_Reception_Buffer_Read_Index];
+
+	// The interrupt handler must not see a half-updated index
+	IE &= ~IE_ES0__ENABLED;
+	UART_Reception_Buffer_Read_Index = (UART_Reception_Buffer_Read_Index + 1) & (UART_RECEPTION_BUFFER_SIZE - 1);
+	IE |= IE_ES0__ENABLED;
 
-	return SBUF0;
+	return Byte;
+}
+
+bit UARTIsByteAvailable(void)
+{
+	unsigned short Write_Index;
+
+	// The 8051 can't read a 16-bit variable atomically, so make sure the interrupt handler does not modify the index meanwhile
+	IE &= ~IE_ES0__ENABLED;
+	Write_Index = UART_Reception_Buffer_Write_Index;
+	IE |= IE_ES0__ENABLED;
+
+	return Write_Index != UART_Reception_Buffer_Read_Index;
+}
+
+unsigned long UARTReadOverrunsCount(void)
+{
+	unsigned long Overruns_Count;
+
+	// The interrupt handler must not modify the counter while it is read
+	IE &= ~IE_ES0__ENABLED;
+	Overruns_Count = UART_Overruns_Count;
+	UART_Overruns_Count = 0;
+	IE |= IE_ES0__ENABLED;
+
+	return Overruns_Count;
 }
 
 unsigned long UARTReadDoubleWord(void)
@@ -89,12 +142,16 @@ unsigned long UARTReadDoubleWord(void)
 
 void UARTWriteByte(unsigned char Byte)
 {
+	unsigned short Start_Time;
+
 	// Send the byte
 	SBUF0 = Byte;
 	Is_Transmission_Finished = 0;
 
-	// Wait for the transmission to finish
-	while (!Is_Transmission_Finished);
+	// Wait for the transmission to finish (a byte takes far less than a timer period to be sent)
+	STATISTICS_START_TIME(Start_Time);
+	while (!Is_Transmission_Finished) HARDWARE_WAIT();
+	STATISTICS_ADD_TIME(STATISTICS_TIME_UART_TRANSMISSION_WAIT, Start_Time);
 }
 
 void UARTWriteString(unsigned char *String)
@@ -20,6 +20,9 @@
 /** The timer 1 reload value to achieve 921600 bauds with the current main clock. */
 #define UART_BAUD_RATE_921600 UART_COMPUTE_BAUD_RATE(921600)
 
+/** How many received bytes can wait to be read (must be a power of two). */
+#define UART_RECEPTION_BUFFER_SIZE 2048
+
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
@@ -34,6 +37,16 @@ void UARTInitialize(unsigned char Baud_Rate);
  */
 unsigned char UARTReadByte(void);
 
+/** Tell whether a received byte is waiting to be read.
+ * @return 1 if UARTReadByte() will return immediately, 0 if no byte was received.
+ */
+bit UARTIsByteAvailable(void);
+
+/** Tell how many received bytes were dropped because the reception buffer was full, and start counting again from zero.
+ * @return How many bytes were dropped since the previous call.
+ */
+unsigned long UARTReadOverrunsCount(void);
+
 /** Read a 32-bit number from the UART. The number must be sent in big endian.
  * @return The 32-bit number.
  * @note This is a blocking function.
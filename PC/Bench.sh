@@ -0,0 +1,959 @@
+#!/bin/sh
+# Run write, verify, read and erase scenarios against the firmware simulator of each supported flash chip, built without then with the SPI DMA (Model_DMA rows), and display how long each scenario lasted.
+# The simulator times the SPI bus, the UART and the flash chips like the real board does, so the durations are close to what the board achieves.
+# The slow sink scenario reads SLOW_SINK_BYTES_COUNT bytes (more than a pipe can buffer) to a pipe drained at SLOW_SINK_RATE bytes/s (slower than the serial link). Its time is the transfer phase one : the throughput must stay close to the read scenario one because the transfer never waits for the output.
+# The metrics file written by the slow sink scenario is checked to be valid JSON holding each phase with its throughput, the syscalls counts and the stall time.
+# The gang scenario writes the same data to GANG_PROGRAMMERS_COUNT simulated boards from a single programmer process, then reads each board back.
+# The broadcast scenario writes BROADCAST_CHIPS_COUNT chips of a simulated board at the same time, reads each chip back, then alters a single chip and checks that the verification blames this chip only.
+# The errors scenario writes and reads back the data through a simulated serial link flipping bits at each rate of BIT_ERROR_RATES, showing how the goodput drops as more frames must be sent again.
+# The latency scenario writes and reads back the data through a simulated serial link delaying the programmer answers by each round-trip time of LINK_DELAYS (in milliseconds, like a USB serial adapter or a network serial server) : the throughput must stay above LATENCY_MINIMUM_THROUGHPUT_RATIO % of the undelayed one, as the sliding window keeps frames flowing while the acknowledges travel.
+# The resume scenario interrupts a write and a read of RESUME_BYTES_COUNT bytes with SIGINT (like Ctrl+C does) once half the data went through, continues both with --resume from their last checkpoint and compares the results with the written data byte for byte.
+# The daemon scenario writes and reads back the data through jobs sent to a daemon, reads the data to the job standard output (the output then contains NUL bytes), then checks that a failing job reports its failure, that a client not sending its whole request does not delay the other jobs and is rejected after the request timeout, and that a cut request is rejected.
+# The production scenario programs PRODUCTION_CHIPS_COUNT chips swapped in the same socket in production mode (the simulator removes the chip, then inserts a new erased one, each time it receives SIGUSR1), then checks that each chip was programmed without writing any journal.
+# The stuck scenario writes a board whose chips 1 and 2 contain bytes stuck in the erased state with --verify-pages, then checks that the write fails and that each failed page is reported with the mask of the chips it failed on.
+# The calibrate scenario calibrates the SPI clock of a board whose socket wiring corrupts the chip bytes with SPI clocks faster than 3.0625 MHz (see CALIBRATE_WIRING_FAULT), after checking that a write does not verify with the default clock, checks that the stored clock is the expected margin one, then resets the board and checks that a write verifies with the stored clock.
+# The cache scenario reads an erased chip with an empty cache, checking that every sector is transferred although the never stored sectors read as erased, then writes the data and reads it twice with --cache, checking that the first read transfers every sector and that the second one takes every sector from the cache, then rewrites a single sector and checks that the next read transfers only this sector and returns the new data.
+# The manifest scenario executes a manifest writing, verifying and reading back the data in a single session, then verifying another area against the data (this step fails) and reading the data again : the programmer must fail, stop at the failing step and never execute the last one.
+# The statistics scenario writes the data, then a smaller file starting in the middle of a sector, checks after each write that the programmer statistics count one erase cycle per erased sector and one page program cycle per written page, then checks that reading the statistics cleared them.
+# The probe scenario measures the serial link with PROBE_ITERATIONS_COUNT round trips per frame size and --low-latency, checking that the pseudo-terminal refusing the low latency mode is reported without failing the probe, that each latency histogram row counts every round trip and that each frame size gets a positive throughput for every window.
+# The search scenario writes a pattern inside a sector, across a 2048-byte search chunk boundary and across a sector boundary, then checks the exact addresses displayed by an exact search, a masked search, a search matching nothing and a search of SEARCH_MATCHES_COUNT one-byte matches (more than a single search result holds).
+# The replay scenario replays the sessions recorded in the Fixtures/Trace directory (writing then reading back Data.bin with --sequence 1) against the host, so a host change that alters the bytes sent to the programmer fails the scenario, and displays how long each replayed session lasted.
+# The library scenario drives LIBRARY_SESSIONS_COUNT simulated boards through libprogrammer (see Test_Library.c), each one from its own thread : the data is written, verified, read back and erased, then the erased flash is checked.
+# Usage : sh Bench.sh [Bytes_Count [Scenario...]] (default : 65536 bytes per scenario, all scenarios among ALL_SCENARIOS)
+
+ALL_SCENARIOS="chips gang broadcast errors latency resume daemon library production stuck calibrate cache manifest statistics probe search replay"
+BYTES_COUNT=${1:-65536}
+[ $# -gt 0 ] && shift
+SCENARIOS=${*:-$ALL_SCENARIOS}
+SPARSE_SECTORS_COUNT=32
+SLOW_SINK_BYTES_COUNT=262144
+SLOW_SINK_RATE=16384
+FLASH_MODELS="W25Q64CV MX25L6435E MX25L25635F"
+GANG_PROGRAMMERS_COUNT=3
+BROADCAST_CHIPS_COUNT=3
+BIT_ERROR_RATES="0 0.00001 0.00003 0.0001"
+LINK_DELAYS="0 20"
+LATENCY_MINIMUM_THROUGHPUT_RATIO=80
+RESUME_BYTES_COUNT=262144
+LIBRARY_SESSIONS_COUNT=2
+PRODUCTION_CHIPS_COUNT=3
+CALIBRATE_WIRING_FAULT=wiring@3
+CALIBRATE_EXPECTED_FREQUENCY=2041666
+SEARCH_MATCHES_COUNT=100
+PROBE_ITERATIONS_COUNT=3
+PROBE_FRAME_SIZES="16 64 256 1024 4096"
+
+DIRECTORY=$(mktemp -d)
+trap 'rm -rf "$DIRECTORY"' EXIT
+
+# Random data is neither erased (0xFF) nor easy to compress
+head -c $BYTES_COUNT /dev/urandom > "$DIRECTORY/data.bin"
+
+# An Intel HEX file writing 16 bytes to the beginning of many sectors, so erasing sectors takes most of the time
+awk -v Sectors_Count=$SPARSE_SECTORS_COUNT 'function Record(Type, Address, Data,   Checksum, i, String) {
+	Checksum = length(Data) / 2 + int(Address / 256) + Address % 256 + Type
+	for (i = 1; i < length(Data); i += 2) Checksum += int(("0x" substr(Data, i, 2)) + 0)
+	printf(":%02X%04X%02X%s%02X\n", length(Data) / 2, Address, Type, Data, (256 - Checksum % 256) % 256)
+}
+BEGIN {
+	for (i = 0; i < Sectors_Count; i++)
+	{
+		Address = 0x100000 + i * 4096
+		if (Address % 65536 == 0 || i == 0) Record(4, 0, sprintf("%04X", int(Address / 65536)))
+		Record(0, Address % 65536, "000102030405060708090A0B0C0D0E0F")
+	}
+	Record(1, 0, "")
+}' > "$DIRECTORY/sparse.hex"
+
+# Tell whether a scenario must be run
+# $1 : the scenario name
+IsScenarioSelected()
+{
+	case " $SCENARIOS " in
+		*" $1 "*) return 0 ;;
+	esac
+	return 1
+}
+
+# Start a simulated board and wait for it to tell which serial port to use
+# $1 : the chip reference of the simulator program, next parameters : the simulator parameters
+# SIMULATOR_PID and SERIAL_PORT are set to the simulator process and serial port
+SIMULATORS_COUNT=0
+StartSimulator()
+{
+	Simulator_Model=$1
+	shift
+
+	SIMULATORS_COUNT=$((SIMULATORS_COUNT + 1))
+	SIMULATOR_OUTPUT="$DIRECTORY/simulator_$SIMULATORS_COUNT.txt"
+	./Simulator_$Simulator_Model "$@" > "$SIMULATOR_OUTPUT" &
+	SIMULATOR_PID=$!
+	while [ ! -s "$SIMULATOR_OUTPUT" ]
+	do
+		if ! kill -0 $SIMULATOR_PID 2> /dev/null
+		then
+			echo "Error : the $Simulator_Model simulator could not start."
+			cat "$SIMULATOR_OUTPUT"
+			return 1
+		fi
+		sleep 0.1
+	done
+	SERIAL_PORT=$(head -n 1 "$SIMULATOR_OUTPUT")
+}
+
+# Stop simulated boards
+# Parameters : the simulators process IDs
+StopSimulators()
+{
+	kill "$@"
+	wait "$@"
+}
+
+# Start simulated boards, run the checks of a scenario against them, display the last programmer output if a check fails, then stop the boards
+# $1 : how many boards to start, $2 : the chip reference of the simulator program, $3 : the simulator parameters (an empty string for a single chip), next parameters : the function doing the checks and its parameters
+# SERIAL_PORT is set to the last board serial port, SERIAL_PORTS to all boards serial ports and SIMULATOR_PID to the last board process
+RunSimulatedScenario()
+{
+	Boards_Count=$1
+	Boards_Model=$2
+	Boards_Parameters=$3
+	shift 3
+
+	SERIAL_PORTS=""
+	Boards_PIDs=""
+	while [ $Boards_Count -gt 0 ]
+	do
+		if ! StartSimulator $Boards_Model $Boards_Parameters
+		then
+			[ -z "$Boards_PIDs" ] || StopSimulators $Boards_PIDs
+			return 1
+		fi
+		SERIAL_PORTS="$SERIAL_PORTS${SERIAL_PORTS:+ }$SERIAL_PORT"
+		Boards_PIDs="$Boards_PIDs $SIMULATOR_PID"
+		Boards_Count=$((Boards_Count - 1))
+	done
+
+	rm -f "$DIRECTORY/output.txt"
+	"$@"
+	Scenario_Status=$?
+	[ $Scenario_Status -eq 0 ] || [ ! -e "$DIRECTORY/output.txt" ] || cat "$DIRECTORY/output.txt"
+
+	StopSimulators $Boards_PIDs
+	return $Scenario_Status
+}
+
+# Run a programmer command that must succeed, its output is stored to output.txt
+# $1 : the error to display if the command fails, next parameters : the programmer options, serial port and command
+ExpectSuccess()
+{
+	Error_Message=$1
+	shift
+
+	./Programmer "$@" > "$DIRECTORY/output.txt" && return 0
+	echo "Error : $Error_Message"
+	return 1
+}
+
+# Run a programmer command that must fail, its output is stored to output.txt
+# $1 : the error to display if the command succeeds, next parameters : the programmer options, serial port and command
+ExpectFailure()
+{
+	Error_Message=$1
+	shift
+
+	./Programmer "$@" > "$DIRECTORY/output.txt" || return 0
+	echo "Error : $Error_Message"
+	return 1
+}
+
+# Compare a file with the expected data
+# $1 : the expected data file, $2 : the compared file, $3 : the error to display if they differ
+ExpectSameData()
+{
+	cmp -s "$1" "$2" && return 0
+	echo "Error : $3"
+	return 1
+}
+
+# Check that the last metrics file is valid JSON and holds each phase with its throughput, the syscalls counts and the stall time
+# $1 : the chip reference
+ExpectValidMetrics()
+{
+	if ! python3 -m json.tool "$DIRECTORY/metrics.json" > /dev/null
+	then
+		echo "Error : the metrics file written on $1 is not valid JSON."
+		return 1
+	fi
+	for Key in host_io command erase transfer bytes_per_second syscalls read write wait stall_ms
+	do
+		if ! grep -q "\"$Key\": " "$DIRECTORY/metrics.json"
+		then
+			echo "Error : the metrics file written on $1 lacks the $Key key."
+			return 1
+		fi
+	done
+}
+
+# Run a scenario and display its duration
+# $1 : the chip reference, $2 : the scenario name, $3 : the processed bytes count, next parameters : the programmer command
+RunScenario()
+{
+	Scenario_Model=$1
+	Scenario_Name=$2
+	Scenario_Size=$3
+	shift 3
+
+	ExpectSuccess "the $Scenario_Name scenario failed on $Scenario_Model." --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT "$@" || return 1
+	DisplayScenarioResult $Scenario_Model $Scenario_Name $Scenario_Size
+}
+
+# Display the duration of a successful scenario from the programmer output
+# $1 : the chip reference, $2 : the scenario name, $3 : the processed bytes count
+DisplayScenarioResult()
+{
+	Time=$(sed -n 's/^Total time : \(.*\) ms\.$/\1/p' "$DIRECTORY/output.txt")
+	awk -v Model=$1 -v Name=$2 -v Size=$3 -v Time=$Time 'BEGIN { printf("%-16s %-8s %10d %10.1f %10.1f\n", Model, Name, Size, Time, Size / Time * 1000 / 1024) }'
+
+	# Tell when the serial link lost frames
+	sed -n 's/^Warning : \(.*\)\.$/  (\1)/p' "$DIRECTORY/output.txt"
+}
+
+# Read to a pipe drained slowly and display how long the transfer phase lasted
+# $1 : the chip reference
+RunSlowSinkScenario()
+{
+	Model=$1
+	Size=$SLOW_SINK_BYTES_COUNT
+
+	head -c $Size /dev/urandom > "$DIRECTORY/sink_data.bin"
+	ExpectSuccess "could not write the slowsink scenario data on $Model." $SERIAL_PORT w 0 "$DIRECTORY/sink_data.bin" || return 1
+
+	rm -f "$DIRECTORY/sink.fifo" "$DIRECTORY/sink.bin"
+	mkfifo "$DIRECTORY/sink.fifo"
+	(while [ "$(dd bs=4096 count=1 iflag=fullblock status=none | tee -a "$DIRECTORY/sink.bin" | wc -c)" -gt 0 ]; do sleep $(awk -v Rate=$SLOW_SINK_RATE 'BEGIN { print 4096 / Rate }'); done) < "$DIRECTORY/sink.fifo" &
+	Sink_PID=$!
+
+	if ! ExpectSuccess "the slowsink scenario failed on $Model." --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT r 0 $Size "$DIRECTORY/sink.fifo"
+	then
+		kill $Sink_PID
+		return 1
+	fi
+	wait $Sink_PID
+	ExpectSameData "$DIRECTORY/sink_data.bin" "$DIRECTORY/sink.bin" "the slowly stored data differ from the written data on $Model." || return 1
+
+	Time=$(sed -n 's/^  transfer   : *\([0-9.]*\) ms.*$/\1/p' "$DIRECTORY/output.txt")
+	awk -v Model=$Model -v Size=$Size -v Time=$Time 'BEGIN { printf("%-16s %-8s %10d %10.1f %10.1f\n", Model, "slowsink", Size, Time, Size / Time * 1000 / 1024) }'
+}
+
+# Write, verify, read back and erase a chip
+# $1 : the chip reference
+CheckChip()
+{
+	RunScenario $1 write $BYTES_COUNT w 0 "$DIRECTORY/data.bin" \
+		&& RunScenario $1 verify $BYTES_COUNT v 0 "$DIRECTORY/data.bin" \
+		&& RunScenario $1 read $BYTES_COUNT r 0 $BYTES_COUNT "$DIRECTORY/read.bin" \
+		&& ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/read.bin" "the read data differ from the written data on $1." \
+		&& RunScenario $1 erase $((SPARSE_SECTORS_COUNT * 4096)) w 0 "$DIRECTORY/sparse.hex" \
+		|| return 1
+
+	# The output speed and the metrics file format do not depend on the chip, so the slow sink and the metrics file are only checked once
+	if [ "$1" = "${FLASH_MODELS%% *}" ]
+	then
+		RunSlowSinkScenario $1 && ExpectValidMetrics $1 || return 1
+	fi
+}
+
+# Write the same data to several simulated boards with a single programmer process, then check each board content
+CheckGang()
+{
+	SERIAL_PORT=$(echo $SERIAL_PORTS | tr ' ' ',')
+	RunScenario Gang gang $((GANG_PROGRAMMERS_COUNT * BYTES_COUNT)) w 0 "$DIRECTORY/data.bin" || return 1
+
+	# Each board must contain the whole data
+	for SERIAL_PORT in $SERIAL_PORTS
+	do
+		ExpectSuccess "the gang scenario could not read $SERIAL_PORT back." $SERIAL_PORT r 0 $BYTES_COUNT "$DIRECTORY/gang_read.bin" \
+			&& ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/gang_read.bin" "the gang scenario did not write the data to $SERIAL_PORT." \
+			|| return 1
+	done
+}
+
+RunGangScenario()
+{
+	RunSimulatedScenario $GANG_PROGRAMMERS_COUNT W25Q64CV "" CheckGang
+}
+
+# Program several chips of the same board at once, then check each chip content and the per-chip verification result
+CheckBroadcast()
+{
+	All_Chips_Mask=$(printf "%X" $(((1 << BROADCAST_CHIPS_COUNT) - 1)))
+	Altered_Chip=$((BROADCAST_CHIPS_COUNT - 2))
+
+	ExpectSuccess "the broadcast scenario could not select all chips." $SERIAL_PORT c $All_Chips_Mask \
+		&& RunScenario Broadcast bcast $((BROADCAST_CHIPS_COUNT * BYTES_COUNT)) w 0 "$DIRECTORY/data.bin" \
+		|| return 1
+
+	# Each chip must contain the whole data
+	i=0
+	while [ $i -lt $BROADCAST_CHIPS_COUNT ]
+	do
+		ExpectSuccess "the broadcast scenario could not select chip $i." $SERIAL_PORT c $(printf "%X" $((1 << i))) \
+			&& ExpectSuccess "the broadcast scenario could not read chip $i back." $SERIAL_PORT r 0 $BYTES_COUNT "$DIRECTORY/broadcast_read.bin" \
+			&& ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/broadcast_read.bin" "the broadcast scenario did not write the data to chip $i." \
+			|| return 1
+		i=$((i + 1))
+	done
+
+	# Alter a single chip, the verification of all chips must blame it and only it
+	head -c 256 /dev/urandom > "$DIRECTORY/altered.bin"
+	ExpectSuccess "the broadcast scenario could not select chip $Altered_Chip." $SERIAL_PORT c $(printf "%X" $((1 << Altered_Chip))) \
+		&& ExpectSuccess "the broadcast scenario could not alter chip $Altered_Chip." $SERIAL_PORT w 100 "$DIRECTORY/altered.bin" \
+		&& ExpectSuccess "the broadcast scenario could not select all chips." $SERIAL_PORT c $All_Chips_Mask \
+		&& ExpectFailure "the broadcast scenario verification succeeded although chip $Altered_Chip was altered." $SERIAL_PORT v 0 "$DIRECTORY/data.bin" \
+		|| return 1
+	if [ "$(grep 'content differs' "$DIRECTORY/output.txt")" != "Chip $Altered_Chip content differs from the file." ]
+	then
+		echo "Error : the broadcast scenario verification did not blame chip $Altered_Chip only."
+		return 1
+	fi
+}
+
+RunBroadcastScenario()
+{
+	Chips=W25Q64CV
+	i=1
+	while [ $i -lt $BROADCAST_CHIPS_COUNT ]
+	do
+		Chips="$Chips,W25Q64CV"
+		i=$((i + 1))
+	done
+	RunSimulatedScenario 1 W25Q64CV $Chips CheckBroadcast
+}
+
+# Write and read back the data through a serial link corrupted at a bit error rate, the retransmissions must keep the data intact
+# $1 : the bit error rate
+CheckErrors()
+{
+	RunScenario BER=$1 write $BYTES_COUNT w 0 "$DIRECTORY/data.bin" \
+		&& RunScenario BER=$1 read $BYTES_COUNT r 0 $BYTES_COUNT "$DIRECTORY/read.bin" \
+		&& ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/read.bin" "the read data differ from the written data at bit error rate $1."
+}
+
+RunErrorsScenario()
+{
+	Errors_Result=0
+	for Rate in $BIT_ERROR_RATES
+	do
+		RunSimulatedScenario 1 W25Q64CV "--bit-errors $Rate" CheckErrors $Rate || Errors_Result=1
+	done
+	return $Errors_Result
+}
+
+# Write and read back the data through a serial link with a round-trip time, the throughput must not depend much on the round-trip time
+# $1 : the round-trip time in milliseconds
+CheckLatency()
+{
+	Delay=$1
+
+	for Name in write read
+	do
+		if [ $Name = write ]; then set -- w 0 "$DIRECTORY/data.bin"
+		else set -- r 0 $BYTES_COUNT "$DIRECTORY/read.bin"
+		fi
+		RunScenario RTT=${Delay}ms $Name $BYTES_COUNT "$@" > "$DIRECTORY/latency.txt"
+		Latency_Status=$?
+		cat "$DIRECTORY/latency.txt"
+		[ $Latency_Status -eq 0 ] || return 1
+		if [ $Name = read ]
+		then
+			ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/read.bin" "the read data differ from the written data with a $Delay ms round-trip time." || return 1
+		fi
+
+		# Compare with the throughput of the first round-trip time
+		Throughput=$(awk 'NR == 1 { print $5 }' "$DIRECTORY/latency.txt")
+		eval Reference_Throughput=\${Latency_Reference_$Name:-$Throughput}
+		eval Latency_Reference_$Name=$Reference_Throughput
+		if ! awk -v Throughput=$Throughput -v Reference=$Reference_Throughput -v Ratio=$LATENCY_MINIMUM_THROUGHPUT_RATIO 'BEGIN { exit !(Throughput * 100 >= Reference * Ratio) }'
+		then
+			echo "Error : the $Name throughput with a $Delay ms round-trip time dropped below $LATENCY_MINIMUM_THROUGHPUT_RATIO % of the $Reference_Throughput KB/s reference."
+			return 1
+		fi
+	done
+}
+
+RunLatencyScenario()
+{
+	Latency_Result=0
+	for Delay in $LINK_DELAYS
+	do
+		RunSimulatedScenario 1 W25Q64CV "--delay $Delay" CheckLatency $Delay || Latency_Result=1
+	done
+	return $Latency_Result
+}
+
+# Run a programmer command and interrupt it with SIGINT once it transferred half the data
+# $1 : the bytes count the command transfers, next parameters : the programmer command
+# Return 0 if the command was interrupted
+InterruptProgrammer()
+{
+	Interrupted_Size=$1
+	shift
+
+	# Send SIGINT as soon as the progress line tells that half the data went through
+	rm -f "$DIRECTORY/programmer.pid" "$DIRECTORY/output.txt"
+	(
+		while [ ! -s "$DIRECTORY/programmer.pid" ]; do sleep 0.1; done
+		Programmer_PID=$(cat "$DIRECTORY/programmer.pid")
+		while kill -0 $Programmer_PID 2> /dev/null
+		do
+			Transferred_Bytes_Count=$(tr '\r' '\n' < "$DIRECTORY/output.txt" | sed -n 's/^.* bytes : \([0-9]*\)\/.*$/\1/p' | tail -n 1)
+			if [ ${Transferred_Bytes_Count:-0} -ge $((Interrupted_Size / 2)) ]
+			then
+				kill -INT $Programmer_PID
+				break
+			fi
+			sleep 0.1
+		done
+	) &
+	Watcher_PID=$!
+
+	# A background command would ignore SIGINT, so the programmer runs in the foreground and tells its process ID to the watcher
+	sh -c 'echo $$ > "$0/programmer.pid"; exec ./Programmer "$@"' "$DIRECTORY" $SERIAL_PORT "$@" > "$DIRECTORY/output.txt"
+	Interrupted_Status=$?
+	wait $Watcher_PID
+	[ $Interrupted_Status -eq $((128 + 2)) ]
+}
+
+# Interrupt a write and a read, resume them and compare the results with the written data
+CheckResume()
+{
+	head -c $RESUME_BYTES_COUNT /dev/urandom > "$DIRECTORY/resume_data.bin"
+	rm -f "$DIRECTORY/resume_read.bin"*
+
+	for Name in write read
+	do
+		if [ $Name = write ]; then set -- w 0 "$DIRECTORY/resume_data.bin"
+		else set -- r 0 $RESUME_BYTES_COUNT "$DIRECTORY/resume_read.bin"
+		fi
+
+		if ! InterruptProgrammer $RESUME_BYTES_COUNT "$@"
+		then
+			echo "Error : the resume scenario $Name could not be interrupted."
+			return 1
+		fi
+		ExpectSuccess "the resumed $Name failed." --metrics "$DIRECTORY/metrics.json" --resume $SERIAL_PORT "$@" || return 1
+
+		# Only the data following the last checkpoint must have been transferred again
+		Resume_Offset=$(sed -n 's/^Resuming from offset 0x\([0-9A-F]*\)\.$/\1/p' "$DIRECTORY/output.txt")
+		if [ -z "$Resume_Offset" ]
+		then
+			echo "Error : the interrupted $Name started again from the beginning."
+			return 1
+		fi
+		DisplayScenarioResult Resumed $Name $((RESUME_BYTES_COUNT - 0x$Resume_Offset))
+	done
+
+	# The resumed write must have programmed the whole data, and the resumed read must have stored it
+	ExpectSameData "$DIRECTORY/resume_data.bin" "$DIRECTORY/resume_read.bin" "the resumed read data differ from the written data."
+}
+
+RunResumeScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckResume
+}
+
+# Send a raw job request to a daemon and display its answer
+# $1 : the daemon socket, $2 : the request, $3 : set to 1 to tell that the request is complete, set to 0 to keep the connection opened without sending anything more
+SendRawJob()
+{
+	perl -MIO::Socket::UNIX -e '$Socket = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die; print $Socket $ARGV[1]; $Socket->flush(); $Socket->shutdown(1) if $ARGV[2]; print while <$Socket>' "$1" "$2" "$3"
+}
+
+# Run jobs through the daemon started by CheckDaemon()
+CheckDaemonJobs()
+{
+	SERIAL_PORT="--job $Daemon_Socket $Daemon_Serial_Port"
+	RunScenario Daemon write $BYTES_COUNT w 0 "$DIRECTORY/data.bin" \
+		&& RunScenario Daemon read $BYTES_COUNT r 0 $BYTES_COUNT "$DIRECTORY/daemon_read.bin" \
+		&& ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/daemon_read.bin" "the data read through the daemon differ from the written data." \
+		|| return 1
+
+	# The data contains NUL bytes, they must not be mistaken for the end of the job output
+	if ! ./Programmer --job "$Daemon_Socket" - r 0 $BYTES_COUNT /dev/stdout > "$DIRECTORY/daemon_output.bin" || [ $(wc -c < "$DIRECTORY/daemon_output.bin") -lt $BYTES_COUNT ]
+	then
+		echo "Error : the daemon did not forward a job output containing NUL bytes."
+		return 1
+	fi
+	ExpectFailure "the daemon reported a failing job as successful." --job "$Daemon_Socket" - w 0 "$DIRECTORY/missing.bin" || return 1
+
+	# A stalled client is rejected on its own while the other jobs run
+	SendRawJob "$Daemon_Socket" "$DIRECTORY" 0 > "$DIRECTORY/daemon_stalled.txt" &
+	Stalled_Client_PID=$!
+	SERIAL_PORT="--job $Daemon_Socket -"
+	RunScenario Daemon verify $BYTES_COUNT v 0 "$DIRECTORY/data.bin"
+	Daemon_Status=$?
+	wait $Stalled_Client_PID
+	[ $Daemon_Status -eq 0 ] || return 1
+	if ! grep -q "did not receive the whole job" "$DIRECTORY/daemon_stalled.txt"
+	then
+		echo "Error : the daemon did not reject a stalled client."
+		return 1
+	fi
+	if ! SendRawJob "$Daemon_Socket" "$DIRECTORY" 1 | grep -q "incomplete job"
+	then
+		echo "Error : the daemon did not reject a cut request."
+		return 1
+	fi
+}
+
+# Start a daemon owning the simulated board, run the jobs, then stop the daemon
+CheckDaemon()
+{
+	Daemon_Socket="$DIRECTORY/daemon.socket"
+	Daemon_Serial_Port=$SERIAL_PORT
+	./Programmer --daemon "$Daemon_Socket" $Daemon_Serial_Port > "$DIRECTORY/daemon.txt" &
+	Daemon_PID=$!
+	while [ ! -S "$Daemon_Socket" ]
+	do
+		if ! kill -0 $Daemon_PID 2> /dev/null
+		then
+			echo "Error : the daemon could not start."
+			cat "$DIRECTORY/daemon.txt"
+			return 1
+		fi
+		sleep 0.1
+	done
+
+	CheckDaemonJobs
+	Daemon_Result=$?
+	SERIAL_PORT=$Daemon_Serial_Port
+
+	kill $Daemon_PID
+	wait $Daemon_PID
+	return $Daemon_Result
+}
+
+RunDaemonScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckDaemon
+}
+
+# Program several boards at the same time through the library, one thread per board
+CheckLibrary()
+{
+	if ! ./Test_Library "$DIRECTORY/data.bin" $SERIAL_PORTS > "$DIRECTORY/output.txt"
+	then
+		echo "Error : the library scenario failed."
+		return 1
+	fi
+
+	# Each session reports its operations as "Serial_Port : Operation Bytes_Count bytes in Time ms, ..."
+	awk -F ' : ' '{
+		Operations_Count = split($2, Operations, ", ")
+		for (i = 1; i <= Operations_Count; i++)
+		{
+			split(Operations[i], Fields, " ")
+			printf("%-16s %-8s %10d %10.1f %10.1f\n", "Library", Fields[1], Fields[2], Fields[5], Fields[2] / Fields[5] * 1000 / 1024)
+		}
+	}' "$DIRECTORY/output.txt"
+}
+
+RunLibraryScenario()
+{
+	RunSimulatedScenario $LIBRARY_SESSIONS_COUNT W25Q64CV "" CheckLibrary
+}
+
+# Wait for a programmer running in the background to display some lines
+# $1 : the programmer process ID, $2 : the line to wait for (a basic regular expression), $3 : how many times the line must be displayed
+# Return 0 if the lines were displayed, 1 if the programmer exited before
+WaitForProgrammerLines()
+{
+	while [ $(grep -c "$2" "$DIRECTORY/output.txt") -lt $3 ]
+	do
+		kill -0 $1 2> /dev/null || return 1
+		sleep 0.1
+	done
+}
+
+# Write pages that can't be programmed on some chips, the programmer must tell which pages failed on which chips
+CheckStuck()
+{
+	# Programming zeros changes every bit, so the stuck bytes can't match the written data
+	head -c 32768 /dev/zero > "$DIRECTORY/stuck.bin"
+
+	ExpectSuccess "the stuck scenario could not select the chips." $SERIAL_PORT c 7 || return 1
+	if ./Programmer --metrics "$DIRECTORY/metrics.json" --verify-pages $SERIAL_PORT w 0 "$DIRECTORY/stuck.bin" > "$DIRECTORY/output.txt" || ! grep -q "^Error : some pages could not be programmed\.$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the stuck scenario write did not fail."
+		return 1
+	fi
+	if [ "$(grep '^Page ' "$DIRECTORY/output.txt")" != "$(printf 'Page 0x00002300 could not be programmed on chips 1 2.\nPage 0x00005600 could not be programmed on chips 1.')" ]
+	then
+		echo "Error : the stuck scenario did not report the failed pages and chips."
+		return 1
+	fi
+	DisplayScenarioResult Stuck pages 32768
+}
+
+RunStuckScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV W25Q64CV,W25Q64CV:stuck@2345:stuck@5678,W25Q64CV:stuck@2345 CheckStuck
+}
+
+# Read the same chip several times through the cache, only the changed sectors must be transferred
+# $1 : the expected count of sectors taken from the cache, $2 : the data the read must return
+RunCachedRead()
+{
+	ExpectSuccess "the cache scenario read failed." --metrics "$DIRECTORY/metrics.json" --cache "$DIRECTORY/cache" $SERIAL_PORT r 0 $BYTES_COUNT "$DIRECTORY/cached_read.bin" || return 1
+	if ! grep -q "^$1 of $Cache_Sectors_Count sectors taken from the cache\.$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the cache scenario read did not take $1 of $Cache_Sectors_Count sectors from the cache."
+		return 1
+	fi
+	ExpectSameData "$2" "$DIRECTORY/cached_read.bin" "the cache scenario read data differ from the written data."
+}
+
+CheckCache()
+{
+	Cache_Sectors_Count=$(((BYTES_COUNT + 4095) / 4096))
+	rm -rf "$DIRECTORY/cache"
+	mkdir "$DIRECTORY/cache"
+
+	# The chip is erased, like the bytes past the cache file end
+	head -c $BYTES_COUNT /dev/zero | tr '\000' '\377' > "$DIRECTORY/erased.bin"
+
+	# The new data of the second sector
+	head -c 4096 /dev/urandom > "$DIRECTORY/sector.bin"
+	cp "$DIRECTORY/data.bin" "$DIRECTORY/changed.bin"
+	dd if="$DIRECTORY/sector.bin" of="$DIRECTORY/changed.bin" bs=4096 seek=1 conv=notrunc 2> /dev/null
+
+	RunCachedRead 0 "$DIRECTORY/erased.bin" \
+		&& ExpectSuccess "the cache scenario write failed." $SERIAL_PORT w 0 "$DIRECTORY/data.bin" \
+		&& RunCachedRead 0 "$DIRECTORY/data.bin" \
+		&& RunCachedRead $Cache_Sectors_Count "$DIRECTORY/data.bin" \
+		|| return 1
+	DisplayScenarioResult Cached read $BYTES_COUNT
+
+	ExpectSuccess "the cache scenario could not change a sector." $SERIAL_PORT w 1000 "$DIRECTORY/sector.bin" \
+		&& RunCachedRead $((Cache_Sectors_Count - 1)) "$DIRECTORY/changed.bin" \
+		|| return 1
+	DisplayScenarioResult Changed read $BYTES_COUNT
+}
+
+RunCacheScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckCache
+}
+
+# Execute several operations in a single session from a manifest, a failing operation must stop the session
+CheckManifest()
+{
+	head -c 4096 /dev/urandom > "$DIRECTORY/other.bin"
+	rm -f "$DIRECTORY/manifest_read.bin" "$DIRECTORY/manifest_skipped.bin"
+
+	# The area following the data does not contain the data, so its verification fails
+	Manifest_Failing_Address=$(printf '%X' $(((BYTES_COUNT + 4095) / 4096 * 4096)))
+	cat > "$DIRECTORY/manifest.txt" << EOF
+# Program and check the data
+w 0 $DIRECTORY/data.bin
+v 0 $DIRECTORY/data.bin
+r 0 $BYTES_COUNT $DIRECTORY/manifest_read.bin
+
+w $Manifest_Failing_Address $DIRECTORY/other.bin
+v $Manifest_Failing_Address $DIRECTORY/data.bin # Fails
+r 0 $BYTES_COUNT $DIRECTORY/manifest_skipped.bin
+EOF
+
+	ExpectFailure "the manifest scenario succeeded although a step failed." --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT m "$DIRECTORY/manifest.txt" || return 1
+	if ! grep -q "^Error : the batch stopped at the manifest line 7\.$" "$DIRECTORY/output.txt" || grep -q "^Operation 6/6 " "$DIRECTORY/output.txt" || [ -e "$DIRECTORY/manifest_skipped.bin" ]
+	then
+		echo "Error : the manifest scenario did not stop at the failing step."
+		return 1
+	fi
+	ExpectSameData "$DIRECTORY/data.bin" "$DIRECTORY/manifest_read.bin" "the manifest scenario read data differ from the written data." || return 1
+	DisplayScenarioResult Manifest batch $((BYTES_COUNT * 3 + 4096 * 2))
+
+	# A command failing in the middle of the batch must stop it too, while the next file is being loaded
+	cat > "$DIRECTORY/manifest.txt" << EOF
+w 0 $DIRECTORY/data.bin
+r 0 $BYTES_COUNT $DIRECTORY/missing/manifest_read.bin
+v 0 $DIRECTORY/data.bin
+EOF
+	ExpectFailure "the manifest scenario succeeded although a command could not store its data." $SERIAL_PORT m "$DIRECTORY/manifest.txt" || return 1
+	if ! grep -q "^Error : the batch stopped at the manifest line 2\.$" "$DIRECTORY/output.txt" || grep -q "^Operation 3/3 " "$DIRECTORY/output.txt"
+	then
+		echo "Error : the manifest scenario did not stop at the failing command."
+		return 1
+	fi
+}
+
+RunManifestScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckManifest
+}
+# Write a file, then check that the programmer statistics counted the erased sectors and the programmed pages
+# $1 : the file to write, $2 : the write address (hexadecimal, aligned on a page)
+ExpectWriteStatistics()
+{
+	Written_Size=$(wc -c < "$1")
+	Expected_Erase_Cycles=$((((0x$2 % 4096) + Written_Size + 4095) / 4096))
+	Expected_Page_Program_Cycles=$(((Written_Size + 255) / 256))
+
+	ExpectSuccess "the statistics scenario could not write $Written_Size bytes at 0x$2." --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT w $2 "$1" || return 1
+	DisplayScenarioResult Statistics write $Written_Size
+	ExpectSuccess "the statistics scenario could not read the statistics." $SERIAL_PORT s || return 1
+	if ! grep -q "^Erase cycles *: $Expected_Erase_Cycles$" "$DIRECTORY/output.txt" || ! grep -q "^Page program cycles *: $Expected_Page_Program_Cycles$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the statistics did not count $Expected_Erase_Cycles erase cycles and $Expected_Page_Program_Cycles page program cycles for the $Written_Size bytes written at 0x$2."
+		return 1
+	fi
+}
+
+# Check the erase and page program counters, and that they are cleared once read
+CheckStatistics()
+{
+	head -c 5000 /dev/urandom > "$DIRECTORY/statistics.bin"
+	ExpectWriteStatistics "$DIRECTORY/data.bin" 0 \
+		&& ExpectWriteStatistics "$DIRECTORY/statistics.bin" 1800 \
+		&& ExpectSuccess "the statistics scenario could not read the statistics again." $SERIAL_PORT s \
+		|| return 1
+	if ! grep -q "^Erase cycles *: 0$" "$DIRECTORY/output.txt" || ! grep -q "^Page program cycles *: 0$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : reading the statistics did not clear them."
+		return 1
+	fi
+}
+
+RunStatisticsScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckStatistics
+}
+
+# Check the probe report tables and that the low latency mode refusal is not fatal
+CheckProbe()
+{
+	ExpectSuccess "the probe failed." --low-latency $SERIAL_PORT p $PROBE_ITERATIONS_COUNT || return 1
+	# A pseudo-terminal does not support TIOCSSERIAL, so the probe runs once with the default behavior
+	if ! grep -q "^Warning : the serial port driver does not support the low latency mode.$" "$DIRECTORY/output.txt" || grep -q "low latency mode :$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the low latency mode refusal was not reported as a warning."
+		return 1
+	fi
+	# The progress messages end with a carriage return, so the first table title does not start a line
+	if ! awk -v Iterations_Count=$PROBE_ITERATIONS_COUNT -v Expected_Frame_Sizes="$PROBE_FRAME_SIZES" '
+		/Round-trip latency \(ms\) :$/ { Table = "latency"; next }
+		/^Throughput \(KB\/s\) :$/ { Table = "throughput"; next }
+		/^$/ { Table = ""; next }
+		Table == "latency" && $1 ~ /^[0-9]+$/ {
+			Latency_Frame_Sizes = Latency_Frame_Sizes " " $1
+			Round_Trips_Count = 0
+			for (i = 7; i <= NF; i++) Round_Trips_Count += $i
+			if (NF != 14 || Round_Trips_Count != Iterations_Count) Is_Failed = 1
+		}
+		Table == "throughput" && $1 ~ /^[0-9]+$/ {
+			Throughput_Frame_Sizes = Throughput_Frame_Sizes " " $1
+			if (NF != 6) Is_Failed = 1
+			for (i = 2; i <= NF; i++) if ($i <= 0) Is_Failed = 1
+		}
+		END { exit Is_Failed || (Latency_Frame_Sizes != " " Expected_Frame_Sizes) || (Throughput_Frame_Sizes != " " Expected_Frame_Sizes) }' "$DIRECTORY/output.txt"
+	then
+		echo "Error : the probe report does not hold a latency histogram counting $PROBE_ITERATIONS_COUNT round trips and a throughput for each window for every frame size among $PROBE_FRAME_SIZES."
+		return 1
+	fi
+}
+
+RunProbeScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckProbe
+}
+
+# Search a pattern and compare the displayed addresses with the expected ones
+# $1 : the expected addresses (one 0x%08X address per line, an empty string when nothing must match), next parameters : the 'f' command parameters
+ExpectSearchMatches()
+{
+	Expected_Matches=$1
+	shift
+
+	ExpectSuccess "the search of $3 failed." --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT f "$@" || return 1
+	if [ "$(grep '^0x' "$DIRECTORY/output.txt")" != "$Expected_Matches" ] || ! grep -q "^$(printf '%s' "$Expected_Matches" | grep -c '^0x') matches found\.$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the search of $3 did not display the expected addresses :"
+		printf '%s\n' "$Expected_Matches"
+		return 1
+	fi
+}
+
+# Find patterns placed across the programmer search boundaries
+CheckSearch()
+{
+	# The chunks are searched from the search address, so with a null address 0x800 is a chunk boundary and 0x1000 is both a chunk and a sector boundary
+	perl -e '$Data = "\0" x 12288;
+		substr($Data, $_, 4) = "\xDE\xAD\xBE\xEF" foreach (0x100, 0x7FF, 0xFFE);
+		substr($Data, 0x2000, 4) = "\xDE\x11\xBE\x22";
+		substr($Data, 0x2800 + $_ * 16, 1) = "\xA5" foreach (0 .. $ARGV[0] - 1);
+		print $Data' $SEARCH_MATCHES_COUNT > "$DIRECTORY/search.bin"
+	ExpectSuccess "the search scenario could not write the data." $SERIAL_PORT w 0 "$DIRECTORY/search.bin" || return 1
+
+	ExpectSearchMatches "$(printf '0x%08X\n' 0x100 0x7FF 0xFFE)" 0 12288 DEADBEEF || return 1
+	DisplayScenarioResult Search pattern 12288
+	ExpectSearchMatches "$(printf '0x%08X\n' 0x100 0x7FF 0xFFE 0x2000)" 0 12288 DE00BE00 FF00FF00 || return 1
+	ExpectSearchMatches "" 0 12288 CAFE || return 1
+	ExpectSearchMatches "$(awk -v Count=$SEARCH_MATCHES_COUNT 'BEGIN { for (i = 0; i < Count; i++) printf("0x%08X\n", 10240 + i * 16) }')" 2800 2048 A5
+}
+
+RunSearchScenario()
+{
+	RunSimulatedScenario 1 W25Q64CV "" CheckSearch
+}
+
+# Replay a recorded session against the host, the host must send the recorded bytes
+# $1 : the trace name, next parameters : the recorded programmer command
+RunReplay()
+{
+	Replay_Name=$1
+	shift
+
+	./Replay Fixtures/Trace/$Replay_Name.trace > "$DIRECTORY/replay.txt" &
+	Replay_PID=$!
+	while [ $(grep -c "^Run the recorded command" "$DIRECTORY/replay.txt") -eq 0 ]
+	do
+		if ! kill -0 $Replay_PID 2> /dev/null
+		then
+			echo "Error : the $Replay_Name trace could not be replayed."
+			cat "$DIRECTORY/replay.txt"
+			return 1
+		fi
+		sleep 0.1
+	done
+	Replay_Serial_Port=$(head -n 1 "$DIRECTORY/replay.txt")
+	Replay_Sequence=$(sed -n 's/^Run the recorded command with --sequence \([0-9]*\) .*$/\1/p' "$DIRECTORY/replay.txt")
+
+	./Programmer --sequence $Replay_Sequence $Replay_Serial_Port "$@" > "$DIRECTORY/output.txt"
+	if ! wait $Replay_PID
+	then
+		echo "Error : the host diverged from the recorded $Replay_Name session."
+		cat "$DIRECTORY/replay.txt" "$DIRECTORY/output.txt"
+		return 1
+	fi
+
+	# Both sessions transferred the same bytes, only the duration can change
+	awk -v Name=$Replay_Name -v Size=$(wc -c < Fixtures/Trace/Data.bin) '/^Session \(ms\)/ { printf("%-16s %-8s %10d %10.1f %10.1f\n", "Replay", tolower(Name), Size, $4, Size / $4 * 1000 / 1024) }' "$DIRECTORY/replay.txt"
+}
+
+RunReplayScenario()
+{
+	RunReplay Write w 0 Fixtures/Trace/Data.bin || return 1
+	RunReplay Read r 0 $(wc -c < Fixtures/Trace/Data.bin) "$DIRECTORY/replay_read.bin" || return 1
+	if ! cmp -s Fixtures/Trace/Data.bin "$DIRECTORY/replay_read.bin"
+	then
+		echo "Error : the replayed read data differ from the recorded data."
+		return 1
+	fi
+}
+
+# Calibrate the SPI clock of a board which wiring can't carry the fastest clocks
+CheckCalibration()
+{
+	rm -f "$DIRECTORY/spi_clock.txt"
+
+	if ./Programmer $SERIAL_PORT w 0 "$DIRECTORY/data.bin" > "$DIRECTORY/output.txt" && ./Programmer $SERIAL_PORT v 0 "$DIRECTORY/data.bin" >> "$DIRECTORY/output.txt"
+	then
+		echo "Error : the calibrate scenario verification succeeded with the default SPI clock."
+		return 1
+	fi
+	ExpectSuccess "the calibrate scenario calibration failed." --spi-clock "$DIRECTORY/spi_clock.txt" $SERIAL_PORT k 7FF000 || return 1
+	if [ "$(cat "$DIRECTORY/spi_clock.txt")" != $CALIBRATE_EXPECTED_FREQUENCY ]
+	then
+		echo "Error : the calibrate scenario stored $(cat "$DIRECTORY/spi_clock.txt") Hz instead of $CALIBRATE_EXPECTED_FREQUENCY Hz."
+		return 1
+	fi
+}
+
+# Program the reset board, only the clock stored by the calibration can make it work
+CheckCalibratedClock()
+{
+	ExpectSuccess "the calibrate scenario could not program the board with the stored SPI clock." --spi-clock "$DIRECTORY/spi_clock.txt" $SERIAL_PORT w 0 "$DIRECTORY/data.bin" \
+		&& ExpectSuccess "the calibrate scenario could not verify the board with the stored SPI clock." --metrics "$DIRECTORY/metrics.json" --spi-clock "$DIRECTORY/spi_clock.txt" $SERIAL_PORT v 0 "$DIRECTORY/data.bin" \
+		|| return 1
+	DisplayScenarioResult Calibrated verify $BYTES_COUNT
+}
+
+RunCalibrateScenario()
+{
+	# The fault corrupts the chip bytes when SPI0CKR is lower than 3, so 3.0625 MHz is the fastest working clock and the next slower one must be kept as a margin
+	RunSimulatedScenario 1 W25Q64CV W25Q64CV:$CALIBRATE_WIRING_FAULT CheckCalibration \
+		&& RunSimulatedScenario 1 W25Q64CV W25Q64CV:$CALIBRATE_WIRING_FAULT CheckCalibratedClock
+}
+
+# Swap chips in a socket while the production mode programs each inserted chip, the journal must not be written
+CheckProduction()
+{
+	# The journal can't be created where a directory has its name, so the programmer fails if it tries to write one
+	rm -rf "$DIRECTORY/production.bin.journal"
+	cp "$DIRECTORY/data.bin" "$DIRECTORY/production.bin"
+	mkdir "$DIRECTORY/production.bin.journal"
+
+	./Programmer --metrics "$DIRECTORY/metrics.json" $SERIAL_PORT P 0 "$DIRECTORY/production.bin" $PRODUCTION_CHIPS_COUNT > "$DIRECTORY/output.txt" &
+	Programmer_PID=$!
+	i=1
+	while [ $i -lt $PRODUCTION_CHIPS_COUNT ]
+	do
+		WaitForProgrammerLines $Programmer_PID "^$i chips programmed" 1 || break
+		kill -USR1 $SIMULATOR_PID
+		WaitForProgrammerLines $Programmer_PID "^Chip 0 removed\.$" $i || break
+		kill -USR1 $SIMULATOR_PID
+		i=$((i + 1))
+	done
+	if ! wait $Programmer_PID || ! grep -q "^$PRODUCTION_CHIPS_COUNT chips programmed, 0 failed\.$" "$DIRECTORY/output.txt"
+	then
+		echo "Error : the production scenario did not program $PRODUCTION_CHIPS_COUNT chips."
+		return 1
+	fi
+	if [ -n "$(ls -A "$DIRECTORY/production.bin.journal")" ]
+	then
+		echo "Error : the production mode wrote a journal."
+		return 1
+	fi
+	DisplayScenarioResult Production swap $((PRODUCTION_CHIPS_COUNT * BYTES_COUNT))
+}
+
+RunProductionScenario()
+{
+	# An empty socket stays between two chips, like when the operator removes a chip before inserting the next one
+	Sockets=W25Q64CV
+	i=1
+	while [ $i -lt $PRODUCTION_CHIPS_COUNT ]
+	do
+		Sockets="$Sockets/none/W25Q64CV"
+		i=$((i + 1))
+	done
+	RunSimulatedScenario 1 W25Q64CV $Sockets CheckProduction
+}
+
+printf "%-16s %-8s %10s %10s %10s\n" "Chip" "Scenario" "Bytes" "Time (ms)" "KB/s"
+Result=0
+IsScenarioSelected chips || FLASH_MODELS=""
+for Model in $FLASH_MODELS
+do
+	RunSimulatedScenario 1 $Model "" CheckChip $Model || Result=1
+	RunSimulatedScenario 1 ${Model}_DMA "" CheckChip ${Model}_DMA || Result=1
+done
+
+if IsScenarioSelected gang; then RunGangScenario || Result=1; fi
+if IsScenarioSelected broadcast; then RunBroadcastScenario || Result=1; fi
+if IsScenarioSelected errors; then RunErrorsScenario || Result=1; fi
+if IsScenarioSelected latency; then RunLatencyScenario || Result=1; fi
+if IsScenarioSelected resume; then RunResumeScenario || Result=1; fi
+if IsScenarioSelected daemon; then RunDaemonScenario || Result=1; fi
+if IsScenarioSelected library; then RunLibraryScenario || Result=1; fi
+if IsScenarioSelected production; then RunProductionScenario || Result=1; fi
+if IsScenarioSelected stuck; then RunStuckScenario || Result=1; fi
+if IsScenarioSelected calibrate; then RunCalibrateScenario || Result=1; fi
+if IsScenarioSelected cache; then RunCacheScenario || Result=1; fi
+if IsScenarioSelected manifest; then RunManifestScenario || Result=1; fi
+if IsScenarioSelected statistics; then RunStatisticsScenario || Result=1; fi
+if IsScenarioSelected probe; then RunProbeScenario || Result=1; fi
+if IsScenarioSelected search; then RunSearchScenario || Result=1; fi
+if IsScenarioSelected replay; then RunReplayScenario || Result=1; fi
+
+exit $Result
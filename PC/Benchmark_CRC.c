@@ -0,0 +1,167 @@
+/** @file Benchmark_CRC.c
+ * Check that all CRC implementations the processor supports compute the same values, then display how fast each one is.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "CRC.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The benchmarked buffer size in bytes (a whole 256 Mbit flash is 32 MB). */
+#define BENCHMARK_BUFFER_SIZE (32 * 1024 * 1024)
+
+/** The flash sector size in bytes. */
+#define BENCHMARK_SECTOR_SIZE 4096
+
+/** How many random buffers are checked against the reference implementation. */
+#define BENCHMARK_CHECKS_COUNT 2000
+
+/** The biggest checked buffer size in bytes. */
+#define BENCHMARK_MAXIMUM_CHECK_SIZE 5000
+
+/** How many times the buffer is processed to get a stable measure. */
+#define BENCHMARK_ITERATIONS_COUNT 8
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The benchmarked data. */
+static unsigned char Buffer[BENCHMARK_BUFFER_SIZE];
+
+/** The sectors CRC computed by the reference implementation. */
+static unsigned int Reference_Sectors_CRC[BENCHMARK_BUFFER_SIZE / BENCHMARK_SECTOR_SIZE];
+/** The sectors CRC computed by the checked implementation. */
+static unsigned int Sectors_CRC[BENCHMARK_BUFFER_SIZE / BENCHMARK_SECTOR_SIZE];
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic time.
+ * @return The time in seconds.
+ */
+static double BenchmarkGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+/** Compare an implementation to the bitwise one on random sizes and alignments, in one or several updates.
+ * @param Implementation The checked implementation.
+ * @return 0 if all CRCs are the same, -1 if not.
+ */
+static int BenchmarkCheckImplementation(TCRCImplementation Implementation)
+{
+	int i;
+	unsigned int Offset, Size, Split_Size, Reference_CRC, CRC, Sectors_Count;
+
+	srand(1234);
+	for (i = 0; i < BENCHMARK_CHECKS_COUNT; i++)
+	{
+		Offset = rand() % 64;
+		Size = rand() % BENCHMARK_MAXIMUM_CHECK_SIZE;
+		Split_Size = rand() % (Size + 1);
+
+		CRCSelectImplementation(CRC_IMPLEMENTATION_BITWISE);
+		Reference_CRC = CRCCompute(&Buffer[Offset], Size);
+
+		CRCSelectImplementation(Implementation);
+		CRC = CRCCompute(&Buffer[Offset], Size);
+		if (CRC != Reference_CRC)
+		{
+			printf("Error : %s CRC of %u bytes at offset %u is 0x%08X instead of 0x%08X.\n", CRCGetImplementationName(Implementation), Size, Offset, CRC, Reference_CRC);
+			return -1;
+		}
+
+		CRC = CRC_FINALIZE(CRCUpdate(CRCUpdate(CRC_INITIAL_VALUE, &Buffer[Offset], Split_Size), &Buffer[Offset + Split_Size], Size - Split_Size));
+		if (CRC != Reference_CRC)
+		{
+			printf("Error : %s CRC of %u bytes at offset %u computed in two updates (%u bytes first) is 0x%08X instead of 0x%08X.\n", CRCGetImplementationName(Implementation), Size, Offset, Split_Size, CRC, Reference_CRC);
+			return -1;
+		}
+	}
+
+	// Check the parallel computation on a size that does not end on a sector boundary
+	Size = 1024 * BENCHMARK_SECTOR_SIZE - 100;
+	Sectors_Count = (Size + BENCHMARK_SECTOR_SIZE - 1) / BENCHMARK_SECTOR_SIZE;
+	CRCSelectImplementation(CRC_IMPLEMENTATION_BITWISE);
+	CRCComputeSectors(Buffer, Size, BENCHMARK_SECTOR_SIZE, Reference_Sectors_CRC, 1);
+	CRCSelectImplementation(Implementation);
+	for (i = 1; i <= 4; i++)
+	{
+		CRCComputeSectors(Buffer, Size, BENCHMARK_SECTOR_SIZE, Sectors_CRC, i);
+		for (Offset = 0; Offset < Sectors_Count; Offset++)
+		{
+			if (Sectors_CRC[Offset] != Reference_Sectors_CRC[Offset])
+			{
+				printf("Error : %s CRC of sector %u computed by %d threads is 0x%08X instead of 0x%08X.\n", CRCGetImplementationName(Implementation), Offset, i, Sectors_CRC[Offset], Reference_Sectors_CRC[Offset]);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/** Display how fast an implementation computes the CRC of the whole buffer, then the CRC of each sector using all processors.
+ * @param Implementation The benchmarked implementation.
+ */
+static void BenchmarkImplementation(TCRCImplementation Implementation)
+{
+	int i, Iterations_Count;
+	double Start_Time, Single_Time, Sectors_Time;
+	volatile unsigned int CRC;
+
+	// The bitwise implementation is too slow to process the buffer several times
+	if (Implementation == CRC_IMPLEMENTATION_BITWISE) Iterations_Count = 1;
+	else Iterations_Count = BENCHMARK_ITERATIONS_COUNT;
+
+	CRCSelectImplementation(Implementation);
+
+	Start_Time = BenchmarkGetTime();
+	for (i = 0; i < Iterations_Count; i++) CRC = CRCCompute(Buffer, sizeof(Buffer));
+	Single_Time = BenchmarkGetTime() - Start_Time;
+	(void) CRC;
+
+	Start_Time = BenchmarkGetTime();
+	for (i = 0; i < Iterations_Count; i++) CRCComputeSectors(Buffer, sizeof(Buffer), BENCHMARK_SECTOR_SIZE, Sectors_CRC, 0);
+	Sectors_Time = BenchmarkGetTime() - Start_Time;
+
+	printf("%-14s %10.2f %10.2f\n", CRCGetImplementationName(Implementation), (double) sizeof(Buffer) * Iterations_Count / Single_Time / 1e9, (double) sizeof(Buffer) * Iterations_Count / Sectors_Time / 1e9);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(void)
+{
+	TCRCImplementation Default_Implementation, Implementation;
+	unsigned int i;
+
+	Default_Implementation = CRCGetImplementation();
+	for (i = 0; i < sizeof(Buffer); i++) Buffer[i] = rand();
+
+	// Make sure the fast implementations are right before telling how fast they are
+	for (Implementation = CRC_IMPLEMENTATION_SLICING_BY_8; Implementation < CRC_IMPLEMENTATIONS_COUNT; Implementation++)
+	{
+		if (CRCSelectImplementation(Implementation) != 0)
+		{
+			printf("The %s implementation is not supported by this processor.\n", CRCGetImplementationName(Implementation));
+			continue;
+		}
+		if (BenchmarkCheckImplementation(Implementation) != 0) return EXIT_FAILURE;
+	}
+
+	printf("Default implementation : %s.\n", CRCGetImplementationName(Default_Implementation));
+	printf("%-14s %10s %10s\n", "Implementation", "GB/s", "Sectors GB/s");
+	for (Implementation = CRC_IMPLEMENTATION_BITWISE; Implementation < CRC_IMPLEMENTATIONS_COUNT; Implementation++)
+	{
+		if (CRCSelectImplementation(Implementation) == 0) BenchmarkImplementation(Implementation);
+	}
+
+	return EXIT_SUCCESS;
+}
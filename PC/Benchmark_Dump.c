@@ -0,0 +1,191 @@
+/** @file Benchmark_Dump.c
+ * Check that all dump implementations the processor supports produce the same text, then display how fast each one formats a big dump.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Dump.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The benchmarked buffer size in bytes. */
+#define BENCHMARK_BUFFER_SIZE (16 * 1024 * 1024)
+
+/** How many random formats are checked against the reference implementation. */
+#define BENCHMARK_CHECKS_COUNT 200
+
+/** The biggest checked buffer size in bytes. */
+#define BENCHMARK_MAXIMUM_CHECK_SIZE 5000
+
+/** How many times the buffer is formatted to get a stable measure. */
+#define BENCHMARK_ITERATIONS_COUNT 4
+
+/** The benchmarked formats. */
+static const char *String_Benchmark_Formats[] =
+{
+	"4,little,4",
+	"1,little,16,ascii",
+	"8,big,4"
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The benchmarked data. */
+static unsigned char Buffer[BENCHMARK_BUFFER_SIZE];
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic time.
+ * @return The time in seconds.
+ */
+static double BenchmarkGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+/** Dump a buffer to memory.
+ * @param Pointer_Format The layout to use.
+ * @param Pointer_Data The data to dump.
+ * @param Size The data size in bytes.
+ * @param Pointer_Text_Size On output, contain the text size in bytes.
+ * @return The text (it must be freed), exit the program on failure.
+ */
+static char *BenchmarkDumpToMemory(TDumpFormat *Pointer_Format, const unsigned char *Pointer_Data, unsigned int Size, size_t *Pointer_Text_Size)
+{
+	FILE *File;
+	char *Pointer_Text;
+
+	File = open_memstream(&Pointer_Text, Pointer_Text_Size);
+	if ((File == NULL) || (DumpWrite(Pointer_Format, 0x12345678, Pointer_Data, Size, File) != 0) || (fclose(File) != 0))
+	{
+		printf("Error : could not dump to memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	return Pointer_Text;
+}
+
+/** Compare an implementation to the snprintf one on random formats, sizes and alignments.
+ * @param Implementation The checked implementation.
+ * @return 0 if all dumps are the same, -1 if not.
+ */
+static int BenchmarkCheckImplementation(TDumpImplementation Implementation)
+{
+	static const unsigned int Word_Sizes[] = {1, 2, 4, 8};
+	TDumpFormat Format;
+	int i;
+	unsigned int Offset, Size;
+	char *Pointer_Reference_Text, *Pointer_Text;
+	size_t Reference_Text_Size, Text_Size;
+
+	srand(1234);
+	for (i = 0; i < BENCHMARK_CHECKS_COUNT; i++)
+	{
+		Format.Word_Size = Word_Sizes[rand() % 4];
+		Format.Is_Big_Endian = rand() % 2;
+		Format.Words_Per_Line = rand() % (DUMP_MAXIMUM_LINE_SIZE / Format.Word_Size) + 1;
+		Format.Is_ASCII_Column_Displayed = rand() % 2;
+		Offset = rand() % 64;
+		Size = rand() % BENCHMARK_MAXIMUM_CHECK_SIZE;
+
+		DumpSelectImplementation(DUMP_IMPLEMENTATION_SNPRINTF);
+		Pointer_Reference_Text = BenchmarkDumpToMemory(&Format, &Buffer[Offset], Size, &Reference_Text_Size);
+		DumpSelectImplementation(Implementation);
+		Pointer_Text = BenchmarkDumpToMemory(&Format, &Buffer[Offset], Size, &Text_Size);
+
+		if ((Text_Size != Reference_Text_Size) || (memcmp(Pointer_Text, Pointer_Reference_Text, Text_Size) != 0))
+		{
+			printf("Error : %s dump of %u bytes at offset %u (%u-byte %s endian words, %u words per line) differs from the reference one.\n", DumpGetImplementationName(Implementation), Size, Offset, Format.Word_Size, Format.Is_Big_Endian ? "big" : "little", Format.Words_Per_Line);
+			return -1;
+		}
+		free(Pointer_Text);
+		free(Pointer_Reference_Text);
+	}
+
+	return 0;
+}
+
+/** Display how fast an implementation dumps the whole buffer with each benchmarked format.
+ * @param Implementation The benchmarked implementation.
+ * @param File Where to write the dumps.
+ */
+static void BenchmarkImplementation(TDumpImplementation Implementation, FILE *File)
+{
+	TDumpFormat Format;
+	unsigned int i;
+	int j;
+	double Start_Time, Time;
+
+	DumpSelectImplementation(Implementation);
+
+	printf("%-14s", DumpGetImplementationName(Implementation));
+	for (i = 0; i < sizeof(String_Benchmark_Formats) / sizeof(String_Benchmark_Formats[0]); i++)
+	{
+		DumpParseFormat(&Format, String_Benchmark_Formats[i]);
+
+		Start_Time = BenchmarkGetTime();
+		for (j = 0; j < BENCHMARK_ITERATIONS_COUNT; j++)
+		{
+			if (DumpWrite(&Format, 0, Buffer, sizeof(Buffer), File) != 0)
+			{
+				printf("\nError : could not write the dump.\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		Time = BenchmarkGetTime() - Start_Time;
+
+		printf(" %18.1f", (double) sizeof(Buffer) * BENCHMARK_ITERATIONS_COUNT / Time / 1e6);
+	}
+	printf("\n");
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(void)
+{
+	TDumpImplementation Default_Implementation, Implementation;
+	FILE *File;
+	unsigned int i;
+
+	Default_Implementation = DumpGetImplementation();
+	for (i = 0; i < sizeof(Buffer); i++) Buffer[i] = rand();
+
+	// Make sure the fast implementations are right before telling how fast they are
+	for (Implementation = DUMP_IMPLEMENTATION_TABLE; Implementation < DUMP_IMPLEMENTATIONS_COUNT; Implementation++)
+	{
+		if (DumpSelectImplementation(Implementation) != 0)
+		{
+			printf("The %s implementation is not supported by this processor.\n", DumpGetImplementationName(Implementation));
+			continue;
+		}
+		if (BenchmarkCheckImplementation(Implementation) != 0) return EXIT_FAILURE;
+	}
+
+	// The dumps are thrown away, so only the formatting is measured
+	File = fopen("/dev/null", "wb");
+	if (File == NULL)
+	{
+		printf("Error : could not open /dev/null.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Default implementation : %s.\n", DumpGetImplementationName(Default_Implementation));
+	printf("%-14s", "Implementation");
+	for (i = 0; i < sizeof(String_Benchmark_Formats) / sizeof(String_Benchmark_Formats[0]); i++) printf(" %18s", String_Benchmark_Formats[i]);
+	printf(" (MB/s of dumped data)\n");
+	for (Implementation = DUMP_IMPLEMENTATION_SNPRINTF; Implementation < DUMP_IMPLEMENTATIONS_COUNT; Implementation++)
+	{
+		if (DumpSelectImplementation(Implementation) == 0) BenchmarkImplementation(Implementation, File);
+	}
+
+	fclose(File);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+/** @file Benchmark_Image.c
+ * Check that the image parser decodes the fixture files of the Fixtures/Image directory as expected, then display how fast each file format is parsed.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "CRC.h"
+#include "Image.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** Where the fixture files are stored, relative to the program directory. */
+#define BENCHMARK_FIXTURES_DIRECTORY "Fixtures/Image/"
+
+/** A fixture image can't contain more extents. */
+#define BENCHMARK_MAXIMUM_FIXTURE_EXTENTS_COUNT 3
+
+/** The benchmarked image size in bytes. */
+#define BENCHMARK_IMAGE_SIZE (16 * 1024 * 1024)
+
+/** How many data bytes a benchmarked text record contains (this is what most tools generate). */
+#define BENCHMARK_RECORD_DATA_SIZE 32
+
+/** How many times each file is parsed to get a stable measure. */
+#define BENCHMARK_ITERATIONS_COUNT 4
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** What parsing a fixture file must produce. */
+typedef struct
+{
+	const char *String_File_Name; //!< The file name in the fixtures directory.
+	unsigned int Address; //!< The address given to the parser.
+	TImageFormat Format; //!< The recognized format.
+	unsigned int Extents_Count; //!< How many extents the image contains, 0 if the file must be rejected.
+	TImageExtent Extents[BENCHMARK_MAXIMUM_FIXTURE_EXTENTS_COUNT]; //!< The image extents.
+	unsigned int Data_CRC; //!< The CRC-32 of the whole image data, the bytes not provided by the file being erased.
+} TBenchmarkFixture;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** All fixture files. */
+static const TBenchmarkFixture Benchmark_Fixtures[] =
+{
+	// All Intel HEX record types, mixed case digits, Windows line terminators and a record following the end of file one
+	{"Record_Types.hex", 0, IMAGE_FORMAT_INTEL_HEX, 3, {{0x00000000, 0, 32}, {0x00010020, 32, 8}, {0x00123400, 40, 4}}, 0xF331F99B},
+	// Unordered records sharing a flash sector are merged, the gap between them is erased
+	{"Shared_Sector.hex", 0, IMAGE_FORMAT_INTEL_HEX, 2, {{0x00000000, 0, 272}, {0x00002000, 272, 8}}, 0xADF7DB66},
+	{"Bad_Checksum.hex", 0, IMAGE_FORMAT_INTEL_HEX, 0, {{0, 0, 0}}, 0},
+	{"Unknown_Record_Type.hex", 0, IMAGE_FORMAT_INTEL_HEX, 0, {{0, 0, 0}}, 0},
+	{"Bad_Address_Record.hex", 0, IMAGE_FORMAT_INTEL_HEX, 0, {{0, 0, 0}}, 0},
+	{"Overlapping_Records.hex", 0, IMAGE_FORMAT_INTEL_HEX, 0, {{0, 0, 0}}, 0},
+
+	// Header, 16-bit data, records count and end of file records, the data following the end of file record is ignored
+	{"S1_S9.s19", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 1, {{0x00001000, 0, 32}}, 0x5A88F379},
+	{"S2_S8.s28", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 1, {{0x00123456, 0, 16}}, 0x8D71A233},
+	{"S2_S8.s28", 0x100000, IMAGE_FORMAT_MOTOROLA_S_RECORD, 1, {{0x00223456, 0, 16}}, 0x8D71A233},
+	{"S3_S7.s37", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 2, {{0x89ABCDE0, 0, 16}, {0x89ABD000, 16, 8}}, 0xB09D65E6},
+	{"Bad_Checksum.s19", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 0, {{0, 0, 0}}, 0},
+	{"Unknown_Record_Type.s19", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 0, {{0, 0, 0}}, 0},
+	{"Overlapping_Records.s19", 0, IMAGE_FORMAT_MOTOROLA_S_RECORD, 0, {{0, 0, 0}}, 0},
+
+	// Three loadable segments (two of them sharing a sector) and a note segment, written at their physical address
+	{"ELF32_Little_Endian.elf", 0, IMAGE_FORMAT_ELF, 2, {{0x00008000, 0, 72}, {0x00020000, 72, 4}}, 0xECB148EB},
+	{"ELF32_Big_Endian.elf", 0, IMAGE_FORMAT_ELF, 2, {{0x00008000, 0, 72}, {0x00020000, 72, 4}}, 0xECB148EB},
+	{"ELF64_Little_Endian.elf", 0, IMAGE_FORMAT_ELF, 2, {{0x00008000, 0, 72}, {0x00020000, 72, 4}}, 0xECB148EB},
+	{"ELF64_Big_Endian.elf", 0, IMAGE_FORMAT_ELF, 2, {{0x00008000, 0, 72}, {0x00020000, 72, 4}}, 0xECB148EB},
+	{"Overlapping_Segments.elf", 0, IMAGE_FORMAT_ELF, 0, {{0, 0, 0}}, 0},
+	{"Truncated_Segment.elf", 0, IMAGE_FORMAT_ELF, 0, {{0, 0, 0}}, 0}
+};
+
+/** The benchmarked image data. */
+static unsigned char Image_Data[BENCHMARK_IMAGE_SIZE];
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic time.
+ * @return The time in seconds.
+ */
+static double BenchmarkGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+/** Parse a fixture file and compare the image to the expected one. The parser error message of a rejected file is displayed after the file name.
+ * @param Pointer_Fixture The fixture.
+ * @return 0 if the image is the expected one, -1 if not.
+ */
+static int BenchmarkCheckFixture(const TBenchmarkFixture *Pointer_Fixture)
+{
+	char String_File_Name[256];
+	TImage Image;
+	unsigned int i, CRC;
+	int Result;
+
+	snprintf(String_File_Name, sizeof(String_File_Name), BENCHMARK_FIXTURES_DIRECTORY "%s", Pointer_Fixture->String_File_Name);
+	printf("%-26s : ", Pointer_Fixture->String_File_Name);
+	fflush(stdout);
+
+	Result = ImageLoad(&Image, String_File_Name, Pointer_Fixture->Address);
+	if (Pointer_Fixture->Extents_Count == 0)
+	{
+		if (Result == 0)
+		{
+			printf("Error : the file was accepted instead of being rejected.\n");
+			ImageFree(&Image);
+			return -1;
+		}
+		return 0;
+	}
+	if (Result != 0) return -1;
+
+	// Check the layout before the data
+	if ((Image.Format != Pointer_Fixture->Format) || (Image.Extents_Count != Pointer_Fixture->Extents_Count))
+	{
+		printf("Error : the image has format %d and %u extents instead of format %d and %u extents.\n", Image.Format, Image.Extents_Count, Pointer_Fixture->Format, Pointer_Fixture->Extents_Count);
+		ImageFree(&Image);
+		return -1;
+	}
+	for (i = 0; i < Image.Extents_Count; i++)
+	{
+		if (memcmp(&Image.Pointer_Extents[i], &Pointer_Fixture->Extents[i], sizeof(TImageExtent)) != 0)
+		{
+			printf("Error : the extent %u is address 0x%08X, offset %u, size %u instead of address 0x%08X, offset %u, size %u.\n", i, Image.Pointer_Extents[i].Address, Image.Pointer_Extents[i].Offset, Image.Pointer_Extents[i].Size, Pointer_Fixture->Extents[i].Address, Pointer_Fixture->Extents[i].Offset, Pointer_Fixture->Extents[i].Size);
+			ImageFree(&Image);
+			return -1;
+		}
+	}
+	CRC = CRCCompute(Image.Pointer_Data, Image.Size);
+	ImageFree(&Image);
+	if (CRC != Pointer_Fixture->Data_CRC)
+	{
+		printf("Error : the image data CRC is 0x%08X instead of 0x%08X.\n", CRC, Pointer_Fixture->Data_CRC);
+		return -1;
+	}
+
+	printf("%u extents, data CRC 0x%08X.\n", Pointer_Fixture->Extents_Count, CRC);
+	return 0;
+}
+
+/** Append bytes to a file being built, exit the program if there is no more memory.
+ * @param Pointer_File The file stream.
+ * @param Pointer_Bytes The bytes to append.
+ * @param Size How many bytes to append.
+ */
+static void BenchmarkWrite(FILE *Pointer_File, const void *Pointer_Bytes, unsigned int Size)
+{
+	if (fwrite(Pointer_Bytes, 1, Size, Pointer_File) != Size)
+	{
+		printf("Error : could not build the benchmarked file.\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/** Append a record to an Intel HEX or a Motorola S-record file being built.
+ * @param Pointer_File The file stream.
+ * @param String_Start The record start mark.
+ * @param Pointer_Bytes The record bytes, checksum excluded.
+ * @param Size How many record bytes.
+ * @param Is_Checksum_Complemented Set to 1 for a S-record checksum, set to 0 for an Intel HEX one.
+ */
+static void BenchmarkWriteRecord(FILE *Pointer_File, const char *String_Start, const unsigned char *Pointer_Bytes, unsigned int Size, int Is_Checksum_Complemented)
+{
+	unsigned char Checksum = 0;
+	unsigned int i;
+
+	fputs(String_Start, Pointer_File);
+	for (i = 0; i < Size; i++)
+	{
+		fprintf(Pointer_File, "%02X", Pointer_Bytes[i]);
+		Checksum += Pointer_Bytes[i];
+	}
+	if (Is_Checksum_Complemented) Checksum = ~Checksum;
+	else Checksum = -Checksum;
+	fprintf(Pointer_File, "%02X\n", Checksum);
+}
+
+/** Build a file containing the whole benchmarked image.
+ * @param Format The file format.
+ * @param Pointer_Size On output, contain the file size in bytes.
+ * @return The file content (it must be freed), exit the program on failure.
+ */
+static unsigned char *BenchmarkBuildFile(TImageFormat Format, size_t *Pointer_Size)
+{
+	FILE *Pointer_File;
+	char *Pointer_File_Data;
+	unsigned char Bytes[4 + BENCHMARK_RECORD_DATA_SIZE + 1], Header[64 + 32] = {0};
+	unsigned int Address;
+
+	Pointer_File = open_memstream(&Pointer_File_Data, Pointer_Size);
+	if (Pointer_File == NULL)
+	{
+		printf("Error : could not build the benchmarked file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	switch (Format)
+	{
+		// An extended linear address record is needed each 64 KB
+		case IMAGE_FORMAT_INTEL_HEX:
+			for (Address = 0; Address < BENCHMARK_IMAGE_SIZE; Address += BENCHMARK_RECORD_DATA_SIZE)
+			{
+				if (Address % 0x10000 == 0)
+				{
+					Bytes[0] = 2;
+					Bytes[1] = Bytes[2] = 0;
+					Bytes[3] = 0x04;
+					Bytes[4] = Address >> 24;
+					Bytes[5] = Address >> 16;
+					BenchmarkWriteRecord(Pointer_File, ":", Bytes, 6, 0);
+				}
+				Bytes[0] = BENCHMARK_RECORD_DATA_SIZE;
+				Bytes[1] = Address >> 8;
+				Bytes[2] = Address;
+				Bytes[3] = 0x00;
+				memcpy(&Bytes[4], &Image_Data[Address], BENCHMARK_RECORD_DATA_SIZE);
+				BenchmarkWriteRecord(Pointer_File, ":", Bytes, 4 + BENCHMARK_RECORD_DATA_SIZE, 0);
+			}
+			fputs(":00000001FF\n", Pointer_File);
+			break;
+
+		case IMAGE_FORMAT_MOTOROLA_S_RECORD:
+			for (Address = 0; Address < BENCHMARK_IMAGE_SIZE; Address += BENCHMARK_RECORD_DATA_SIZE)
+			{
+				Bytes[0] = 4 + BENCHMARK_RECORD_DATA_SIZE + 1;
+				Bytes[1] = Address >> 24;
+				Bytes[2] = Address >> 16;
+				Bytes[3] = Address >> 8;
+				Bytes[4] = Address;
+				memcpy(&Bytes[5], &Image_Data[Address], BENCHMARK_RECORD_DATA_SIZE);
+				BenchmarkWriteRecord(Pointer_File, "S3", Bytes, 5 + BENCHMARK_RECORD_DATA_SIZE, 1);
+			}
+			fputs("S70500000000FA\n", Pointer_File);
+			break;
+
+		// A little endian 32-bit file with a single loadable segment following the program header
+		case IMAGE_FORMAT_ELF:
+			memcpy(Header, "\x7F" "ELF\x01\x01\x01", 7);
+			Header[28] = 52; // Program headers offset
+			Header[42] = 32; // Program header size
+			Header[44] = 1; // Program headers count
+			Header[52] = 1; // Loadable segment
+			Header[56] = 52 + 32; // Segment offset
+			Header[68] = BENCHMARK_IMAGE_SIZE & 0xFF; // Segment size
+			Header[69] = (BENCHMARK_IMAGE_SIZE >> 8) & 0xFF;
+			Header[70] = (BENCHMARK_IMAGE_SIZE >> 16) & 0xFF;
+			Header[71] = BENCHMARK_IMAGE_SIZE >> 24;
+			BenchmarkWrite(Pointer_File, Header, 52 + 32);
+			BenchmarkWrite(Pointer_File, Image_Data, BENCHMARK_IMAGE_SIZE);
+			break;
+
+		default:
+			BenchmarkWrite(Pointer_File, Image_Data, BENCHMARK_IMAGE_SIZE);
+			break;
+	}
+
+	if (fclose(Pointer_File) != 0)
+	{
+		printf("Error : could not build the benchmarked file.\n");
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned char *) Pointer_File_Data;
+}
+
+/** Display how fast a file format is parsed.
+ * @param Format The benchmarked format.
+ * @param String_Format_Name The format name.
+ * @return 0 if the parsed image matches the benchmarked data, -1 if not.
+ */
+static int BenchmarkFormat(TImageFormat Format, const char *String_Format_Name)
+{
+	unsigned char *Pointer_File_Data;
+	size_t File_Size;
+	TImage Image;
+	int i;
+	double Start_Time, Time;
+
+	Pointer_File_Data = BenchmarkBuildFile(Format, &File_Size);
+
+	Start_Time = BenchmarkGetTime();
+	for (i = 0; i < BENCHMARK_ITERATIONS_COUNT; i++)
+	{
+		if (ImageParse(&Image, Pointer_File_Data, File_Size, 0) != 0)
+		{
+			free(Pointer_File_Data);
+			return -1;
+		}
+		if ((Image.Format != Format) || (Image.Extents_Count != 1) || (Image.Size != BENCHMARK_IMAGE_SIZE) || (memcmp(Image.Pointer_Data, Image_Data, BENCHMARK_IMAGE_SIZE) != 0))
+		{
+			printf("Error : the parsed %s image differs from the benchmarked data.\n", String_Format_Name);
+			ImageFree(&Image);
+			free(Pointer_File_Data);
+			return -1;
+		}
+		ImageFree(&Image);
+	}
+	Time = BenchmarkGetTime() - Start_Time;
+	free(Pointer_File_Data);
+
+	printf("%-14s %10.1f %10.1f %10.1f\n", String_Format_Name, (double) File_Size / 1e6, (double) File_Size * BENCHMARK_ITERATIONS_COUNT / Time / 1e6, (double) BENCHMARK_IMAGE_SIZE * BENCHMARK_ITERATIONS_COUNT / Time / 1e6);
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(void)
+{
+	unsigned int i;
+
+	// Make sure the parser is right before telling how fast it is
+	for (i = 0; i < sizeof(Benchmark_Fixtures) / sizeof(Benchmark_Fixtures[0]); i++)
+	{
+		if (BenchmarkCheckFixture(&Benchmark_Fixtures[i]) != 0) return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(Image_Data); i++) Image_Data[i] = rand();
+
+	// The checked data is part of the measure, it is small compared to the text decoding
+	printf("%-14s %10s %10s %10s\n", "Format", "File MB", "File MB/s", "Image MB/s");
+	if (BenchmarkFormat(IMAGE_FORMAT_BINARY, "Binary") != 0) return EXIT_FAILURE;
+	if (BenchmarkFormat(IMAGE_FORMAT_INTEL_HEX, "Intel HEX") != 0) return EXIT_FAILURE;
+	if (BenchmarkFormat(IMAGE_FORMAT_MOTOROLA_S_RECORD, "S-record") != 0) return EXIT_FAILURE;
+	if (BenchmarkFormat(IMAGE_FORMAT_ELF, "ELF") != 0) return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
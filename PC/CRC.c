@@ -0,0 +1,351 @@
+/** @file CRC.c
+ * @see CRC.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include "CRC.h"
+
+#ifndef WIN32
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+
+	/** Tell that the carry-less multiplication implementation is built. */
+	#define CRC_IS_CARRY_LESS_MULTIPLICATION_AVAILABLE
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The reflected IEEE 802.3 polynomial. */
+#define CRC_POLYNOMIAL 0xEDB88320
+
+/** How many threads can share the sectors at most. */
+#define CRC_MAXIMUM_THREADS_COUNT 64
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** Add bytes to a running CRC.
+ * @param CRC The current CRC value.
+ * @param Pointer_Bytes The bytes to add.
+ * @param Size How many bytes to add.
+ * @return The new CRC value.
+ */
+typedef unsigned int (*TCRCUpdateFunction)(unsigned int CRC, const unsigned char *Pointer_Bytes, unsigned int Size);
+
+/** The sectors a thread computes the CRC of. */
+typedef struct
+{
+	const unsigned char *Pointer_Buffer; //!< The whole data.
+	unsigned int Size; //!< The whole data size in bytes.
+	unsigned int Sector_Size; //!< The sector size in bytes.
+	unsigned int *Pointer_CRCs; //!< All sectors CRC.
+	unsigned int First_Sector; //!< The first sector to compute.
+	unsigned int Sectors_Count; //!< How many sectors to compute.
+} TCRCSectorsJob;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The CRC of each byte value followed by 0 to 7 null bytes (CRC_Tables[0] is the classic byte-wise table). */
+static unsigned int CRC_Tables[8][256];
+
+/** The implementation in use. */
+static TCRCImplementation CRC_Implementation;
+/** The function of the implementation in use. */
+static TCRCUpdateFunction CRC_Update_Function;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Add bytes to a running CRC one bit at a time.
+ * @see TCRCUpdateFunction for the parameters description.
+ */
+static unsigned int CRCUpdateBitwise(unsigned int CRC, const unsigned char *Pointer_Bytes, unsigned int Size)
+{
+	int i;
+
+	while (Size > 0)
+	{
+		CRC ^= *Pointer_Bytes;
+		for (i = 0; i < 8; i++)
+		{
+			if (CRC & 1) CRC = (CRC >> 1) ^ CRC_POLYNOMIAL;
+			else CRC >>= 1;
+		}
+		Pointer_Bytes++;
+		Size--;
+	}
+	return CRC;
+}
+
+/** Add bytes to a running CRC eight bytes at a time.
+ * @see TCRCUpdateFunction for the parameters description.
+ */
+static unsigned int CRCUpdateSlicingBy8(unsigned int CRC, const unsigned char *Pointer_Bytes, unsigned int Size)
+{
+	unsigned int Low, High;
+
+	while (Size >= 8)
+	{
+		// The CRC is reflected, so the bytes are combined in little endian order whatever the processor
+		Low = (Pointer_Bytes[0] | (Pointer_Bytes[1] << 8) | (Pointer_Bytes[2] << 16) | ((unsigned int) Pointer_Bytes[3] << 24)) ^ CRC;
+		High = Pointer_Bytes[4] | (Pointer_Bytes[5] << 8) | (Pointer_Bytes[6] << 16) | ((unsigned int) Pointer_Bytes[7] << 24);
+		CRC = CRC_Tables[7][Low & 0xFF] ^ CRC_Tables[6][(Low >> 8) & 0xFF] ^ CRC_Tables[5][(Low >> 16) & 0xFF] ^ CRC_Tables[4][Low >> 24] ^ CRC_Tables[3][High & 0xFF] ^ CRC_Tables[2][(High >> 8) & 0xFF] ^ CRC_Tables[1][(High >> 16) & 0xFF] ^ CRC_Tables[0][High >> 24];
+		Pointer_Bytes += 8;
+		Size -= 8;
+	}
+
+	while (Size > 0)
+	{
+		CRC = CRC_Tables[0][(CRC ^ *Pointer_Bytes) & 0xFF] ^ (CRC >> 8);
+		Pointer_Bytes++;
+		Size--;
+	}
+	return CRC;
+}
+
+#ifdef CRC_IS_CARRY_LESS_MULTIPLICATION_AVAILABLE
+/** Add bytes to a running CRC by folding 64-byte blocks with carry-less multiplications, then reducing the result with a Barrett reduction (see Intel "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction").
+ * @see TCRCUpdateFunction for the parameters description.
+ */
+__attribute__((target("pclmul,sse4.1"))) static unsigned int CRCUpdateCarryLessMultiplication(unsigned int CRC, const unsigned char *Pointer_Bytes, unsigned int Size)
+{
+	// The constants are x^(4*128+32) mod P, x^(4*128-32) mod P, x^(128+32) mod P, x^(128-32) mod P, x^64 mod P, then the polynomial and its Barrett constant, all bit-reflected
+	static const unsigned long long Constants_4_Blocks[2] __attribute__((aligned(16))) = {0x0154442BD4, 0x01C6E41596};
+	static const unsigned long long Constants_1_Block[2] __attribute__((aligned(16))) = {0x01751997D0, 0x00CCAA009E};
+	static const unsigned long long Constants_64_Bits[2] __attribute__((aligned(16))) = {0x0163CD6124, 0};
+	static const unsigned long long Constants_Barrett[2] __attribute__((aligned(16))) = {0x01DB710641, 0x01F7011641};
+	__m128i Constants, Block_1, Block_2, Block_3, Block_4, Product_1, Product_2, Product_3, Product_4, Mask;
+	unsigned int Remaining_Bytes_Count;
+
+	// Folding needs at least four 16-byte blocks
+	if (Size < 64) return CRCUpdateSlicingBy8(CRC, Pointer_Bytes, Size);
+	Remaining_Bytes_Count = Size % 16;
+	Size -= Remaining_Bytes_Count;
+
+	Block_1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) Pointer_Bytes), _mm_cvtsi32_si128(CRC));
+	Block_2 = _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 16));
+	Block_3 = _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 32));
+	Block_4 = _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 48));
+	Pointer_Bytes += 64;
+	Size -= 64;
+
+	// Fold four blocks at a time
+	Constants = _mm_load_si128((const __m128i *) Constants_4_Blocks);
+	while (Size >= 64)
+	{
+		Product_1 = _mm_clmulepi64_si128(Block_1, Constants, 0x00);
+		Product_2 = _mm_clmulepi64_si128(Block_2, Constants, 0x00);
+		Product_3 = _mm_clmulepi64_si128(Block_3, Constants, 0x00);
+		Product_4 = _mm_clmulepi64_si128(Block_4, Constants, 0x00);
+		Block_1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_1, Constants, 0x11), Product_1), _mm_loadu_si128((const __m128i *) Pointer_Bytes));
+		Block_2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_2, Constants, 0x11), Product_2), _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 16)));
+		Block_3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_3, Constants, 0x11), Product_3), _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 32)));
+		Block_4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_4, Constants, 0x11), Product_4), _mm_loadu_si128((const __m128i *) (Pointer_Bytes + 48)));
+		Pointer_Bytes += 64;
+		Size -= 64;
+	}
+
+	// Fold the four blocks into a single one
+	Constants = _mm_load_si128((const __m128i *) Constants_1_Block);
+	Block_1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_1, Constants, 0x11), _mm_clmulepi64_si128(Block_1, Constants, 0x00)), Block_2);
+	Block_1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_1, Constants, 0x11), _mm_clmulepi64_si128(Block_1, Constants, 0x00)), Block_3);
+	Block_1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_1, Constants, 0x11), _mm_clmulepi64_si128(Block_1, Constants, 0x00)), Block_4);
+
+	// Fold the remaining 16-byte blocks
+	while (Size >= 16)
+	{
+		Block_1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(Block_1, Constants, 0x11), _mm_clmulepi64_si128(Block_1, Constants, 0x00)), _mm_loadu_si128((const __m128i *) Pointer_Bytes));
+		Pointer_Bytes += 16;
+		Size -= 16;
+	}
+
+	// Reduce 128 bits to 64 bits
+	Mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	Block_1 = _mm_xor_si128(_mm_srli_si128(Block_1, 8), _mm_clmulepi64_si128(Block_1, Constants, 0x10));
+	Constants = _mm_loadl_epi64((const __m128i *) Constants_64_Bits);
+	Block_1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(Block_1, Mask), Constants, 0x00), _mm_srli_si128(Block_1, 4));
+
+	// Barrett reduction to 32 bits
+	Constants = _mm_load_si128((const __m128i *) Constants_Barrett);
+	Block_2 = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(Block_1, Mask), Constants, 0x10), Mask);
+	Block_1 = _mm_xor_si128(Block_1, _mm_clmulepi64_si128(Block_2, Constants, 0x00));
+	CRC = _mm_extract_epi32(Block_1, 1);
+
+	return CRCUpdateSlicingBy8(CRC, Pointer_Bytes, Remaining_Bytes_Count);
+}
+#endif
+
+/** Compute the tables and select the fastest implementation when the program starts, so the CRCs can be computed from any thread. */
+__attribute__((constructor)) static void CRCInitialize(void)
+{
+	unsigned int i, j, CRC;
+
+	for (i = 0; i < 256; i++)
+	{
+		CRC = i;
+		for (j = 0; j < 8; j++)
+		{
+			if (CRC & 1) CRC = (CRC >> 1) ^ CRC_POLYNOMIAL;
+			else CRC >>= 1;
+		}
+		CRC_Tables[0][i] = CRC;
+	}
+
+	// Each table adds a null byte to the previous one
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 8; j++) CRC_Tables[j][i] = (CRC_Tables[j - 1][i] >> 8) ^ CRC_Tables[0][CRC_Tables[j - 1][i] & 0xFF];
+	}
+
+	if (CRCSelectImplementation(CRC_IMPLEMENTATION_CARRY_LESS_MULTIPLICATION) != 0) CRCSelectImplementation(CRC_IMPLEMENTATION_SLICING_BY_8);
+}
+
+#ifndef WIN32
+/** Compute the CRC of some sectors.
+ * @param Pointer_Parameter The sectors to compute.
+ * @return Always NULL.
+ */
+static void *CRCSectorsThread(void *Pointer_Parameter)
+{
+	TCRCSectorsJob *Pointer_Job = Pointer_Parameter;
+	unsigned int i, Offset, Size;
+
+	for (i = Pointer_Job->First_Sector; i < Pointer_Job->First_Sector + Pointer_Job->Sectors_Count; i++)
+	{
+		Offset = i * Pointer_Job->Sector_Size;
+		Size = Pointer_Job->Size - Offset;
+		if (Size > Pointer_Job->Sector_Size) Size = Pointer_Job->Sector_Size;
+		Pointer_Job->Pointer_CRCs[i] = CRCCompute(&Pointer_Job->Pointer_Buffer[Offset], Size);
+	}
+	return NULL;
+}
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+unsigned int CRCUpdate(unsigned int CRC, const void *Pointer_Buffer, unsigned int Size)
+{
+	return CRC_Update_Function(CRC, Pointer_Buffer, Size);
+}
+
+unsigned int CRCCompute(const void *Pointer_Buffer, unsigned int Size)
+{
+	return CRC_FINALIZE(CRCUpdate(CRC_INITIAL_VALUE, Pointer_Buffer, Size));
+}
+
+int CRCComputeSectors(const void *Pointer_Buffer, unsigned int Size, unsigned int Sector_Size, unsigned int *Pointer_CRCs, int Threads_Count)
+{
+	unsigned int Sectors_Count, i, Offset, Sector_Bytes_Count;
+	const unsigned char *Pointer_Bytes = Pointer_Buffer;
+	int Result = 0;
+#ifndef WIN32
+	TCRCSectorsJob Jobs[CRC_MAXIMUM_THREADS_COUNT];
+	pthread_t Threads[CRC_MAXIMUM_THREADS_COUNT];
+	int Is_Thread_Created[CRC_MAXIMUM_THREADS_COUNT], j;
+	unsigned int First_Sector = 0;
+#endif
+
+	Sectors_Count = (Size + Sector_Size - 1) / Sector_Size;
+
+#ifndef WIN32
+	if (Threads_Count <= 0) Threads_Count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (Threads_Count > CRC_MAXIMUM_THREADS_COUNT) Threads_Count = CRC_MAXIMUM_THREADS_COUNT;
+	if ((unsigned int) Threads_Count > Sectors_Count) Threads_Count = Sectors_Count;
+
+	if (Threads_Count > 1)
+	{
+		// Give each thread a contiguous range of sectors, the calling thread computes the first range
+		for (j = 0; j < Threads_Count; j++)
+		{
+			Jobs[j].Pointer_Buffer = Pointer_Bytes;
+			Jobs[j].Size = Size;
+			Jobs[j].Sector_Size = Sector_Size;
+			Jobs[j].Pointer_CRCs = Pointer_CRCs;
+			Jobs[j].First_Sector = First_Sector;
+			Jobs[j].Sectors_Count = Sectors_Count / Threads_Count;
+			if ((unsigned int) j < Sectors_Count % Threads_Count) Jobs[j].Sectors_Count++;
+			First_Sector += Jobs[j].Sectors_Count;
+
+			Is_Thread_Created[j] = 0;
+			if (j == 0) continue;
+			if (pthread_create(&Threads[j], NULL, CRCSectorsThread, &Jobs[j]) == 0) Is_Thread_Created[j] = 1;
+			else Result = -1;
+		}
+
+		// Compute the ranges the threads could not be created for too
+		for (j = 0; j < Threads_Count; j++)
+		{
+			if (!Is_Thread_Created[j]) CRCSectorsThread(&Jobs[j]);
+		}
+		for (j = 1; j < Threads_Count; j++)
+		{
+			if (Is_Thread_Created[j]) pthread_join(Threads[j], NULL);
+		}
+		return Result;
+	}
+#else
+	(void) Threads_Count;
+#endif
+
+	for (i = 0; i < Sectors_Count; i++)
+	{
+		Offset = i * Sector_Size;
+		Sector_Bytes_Count = Size - Offset;
+		if (Sector_Bytes_Count > Sector_Size) Sector_Bytes_Count = Sector_Size;
+		Pointer_CRCs[i] = CRCCompute(&Pointer_Bytes[Offset], Sector_Bytes_Count);
+	}
+	return Result;
+}
+
+int CRCSelectImplementation(TCRCImplementation Implementation)
+{
+	switch (Implementation)
+	{
+		case CRC_IMPLEMENTATION_BITWISE:
+			CRC_Update_Function = CRCUpdateBitwise;
+			break;
+
+		case CRC_IMPLEMENTATION_SLICING_BY_8:
+			CRC_Update_Function = CRCUpdateSlicingBy8;
+			break;
+
+		case CRC_IMPLEMENTATION_CARRY_LESS_MULTIPLICATION:
+#ifdef CRC_IS_CARRY_LESS_MULTIPLICATION_AVAILABLE
+			if (!__builtin_cpu_supports("pclmul") || !__builtin_cpu_supports("sse4.1")) return -1;
+			CRC_Update_Function = CRCUpdateCarryLessMultiplication;
+			break;
+#else
+			return -1;
+#endif
+
+		default:
+			return -1;
+	}
+	CRC_Implementation = Implementation;
+	return 0;
+}
+
+TCRCImplementation CRCGetImplementation(void)
+{
+	return CRC_Implementation;
+}
+
+const char *CRCGetImplementationName(TCRCImplementation Implementation)
+{
+	switch (Implementation)
+	{
+		case CRC_IMPLEMENTATION_BITWISE:
+			return "bitwise";
+		case CRC_IMPLEMENTATION_SLICING_BY_8:
+			return "slicing-by-8";
+		case CRC_IMPLEMENTATION_CARRY_LESS_MULTIPLICATION:
+			return "pclmulqdq";
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,77 @@
+/** @file CRC.h
+ * Compute the CRC-32 (IEEE 802.3 polynomial) used by the programmer firmware to protect the exchanged frames and by the journal to identify data.
+ * The fastest implementation the processor supports is selected when the program starts : carry-less multiplication folding (PCLMULQDQ) on x86 processors providing it, slicing-by-8 tables otherwise.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_CRC_H
+#define H_CRC_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The value to start a CRC computation with. */
+#define CRC_INITIAL_VALUE 0xFFFFFFFF
+
+/** Get the final CRC value from the running one.
+ * @param CRC The value returned by the last call to CRCUpdate().
+ */
+#define CRC_FINALIZE(CRC) ((CRC) ^ 0xFFFFFFFF)
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** All ways to compute the CRC, from the slowest to the fastest. */
+typedef enum
+{
+	CRC_IMPLEMENTATION_BITWISE, //!< Process a bit at a time, this is the reference implementation.
+	CRC_IMPLEMENTATION_SLICING_BY_8, //!< Process 8 bytes at a time with 8 lookup tables.
+	CRC_IMPLEMENTATION_CARRY_LESS_MULTIPLICATION, //!< Fold 64 bytes at a time with the x86 PCLMULQDQ instruction.
+	CRC_IMPLEMENTATIONS_COUNT
+} TCRCImplementation;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Add some bytes to a running CRC computation.
+ * @param CRC The current CRC value (use CRC_INITIAL_VALUE for the first bytes).
+ * @param Pointer_Buffer The bytes to add.
+ * @param Size How many bytes to add.
+ * @return The new CRC value.
+ */
+unsigned int CRCUpdate(unsigned int CRC, const void *Pointer_Buffer, unsigned int Size);
+
+/** Compute the CRC-32 of a whole buffer.
+ * @param Pointer_Buffer The data.
+ * @param Size The data size in bytes.
+ * @return The CRC-32 value.
+ */
+unsigned int CRCCompute(const void *Pointer_Buffer, unsigned int Size);
+
+/** Compute the CRC-32 of each sector of a buffer, the sectors being shared among several threads.
+ * @param Pointer_Buffer The data.
+ * @param Size The data size in bytes (the last sector can be smaller than the other ones).
+ * @param Sector_Size The sector size in bytes.
+ * @param Pointer_CRCs On output, contain each sector CRC-32 (the array must have room for all sectors).
+ * @param Threads_Count How many threads to use, 0 to use one thread per processor.
+ * @return 0 if all CRCs were computed, -1 if the threads could not be created (the CRCs are then computed by the calling thread).
+ */
+int CRCComputeSectors(const void *Pointer_Buffer, unsigned int Size, unsigned int Sector_Size, unsigned int *Pointer_CRCs, int Threads_Count);
+
+/** Choose how the next CRCs are computed (the program must not compute CRCs from other threads meanwhile).
+ * @param Implementation The implementation to use.
+ * @return 0 if the implementation was selected, -1 if the processor does not support it.
+ */
+int CRCSelectImplementation(TCRCImplementation Implementation);
+
+/** Tell how the CRCs are computed.
+ * @return The implementation in use.
+ */
+TCRCImplementation CRCGetImplementation(void);
+
+/** Get an implementation name.
+ * @param Implementation The implementation.
+ * @return A static string.
+ */
+const char *CRCGetImplementationName(TCRCImplementation Implementation);
+
+#endif
@@ -0,0 +1,169 @@
+/** @file Cache.c
+ * @see Cache.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "Cache.h"
+#include "Protocol.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Open a file keeping its existing content, or create it.
+ * @param String_File_Name The file path.
+ * @return The opened file, or NULL if the file could not be opened nor created.
+ */
+static FILE *CacheOpenFile(char *String_File_Name)
+{
+	FILE *File;
+
+	File = fopen(String_File_Name, "r+b");
+	if (File == NULL) File = fopen(String_File_Name, "w+b");
+	return File;
+}
+
+/** Load the stored sectors bitmap from the map file.
+ * @param Pointer_Cache The cache, its map file must be opened.
+ * @return 0 if the bitmap was loaded, -1 if the map file could not be read (an error message is displayed).
+ */
+static int CacheLoadMap(TCache *Pointer_Cache)
+{
+	long Size;
+
+	if ((fseek(Pointer_Cache->Map_File, 0, SEEK_END) != 0) || ((Size = ftell(Pointer_Cache->Map_File)) < 0)) goto Error;
+	if (Size == 0) return 0;
+
+	Pointer_Cache->Pointer_Stored_Sectors_Bitmap = malloc(Size);
+	if (Pointer_Cache->Pointer_Stored_Sectors_Bitmap == NULL)
+	{
+		printf("Error : could not allocate the cache map.\n");
+		return -1;
+	}
+	rewind(Pointer_Cache->Map_File);
+	if (fread(Pointer_Cache->Pointer_Stored_Sectors_Bitmap, 1, Size, Pointer_Cache->Map_File) != (size_t) Size) goto Error;
+	Pointer_Cache->Stored_Sectors_Bitmap_Size = Size;
+	return 0;
+
+Error:
+	printf("Error : could not read the cache map file '%s'.\n", Pointer_Cache->String_Map_File_Name);
+	return -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int CacheOpen(TCache *Pointer_Cache, char *String_Directory, unsigned int JEDEC_ID)
+{
+	memset(Pointer_Cache, 0, sizeof(TCache));
+
+	// Build the cache file name (the directory, a separator, 6 hexadecimal digits and the suffix), the map file name is the same with another suffix
+	Pointer_Cache->String_File_Name = malloc(strlen(String_Directory) + 1 + 6 + sizeof(CACHE_FILE_NAME_SUFFIX));
+	Pointer_Cache->String_Map_File_Name = malloc(strlen(String_Directory) + 1 + 6 + sizeof(CACHE_FILE_NAME_SUFFIX) - 1 + sizeof(CACHE_MAP_FILE_NAME_SUFFIX));
+	if ((Pointer_Cache->String_File_Name == NULL) || (Pointer_Cache->String_Map_File_Name == NULL))
+	{
+		printf("Error : could not allocate the cache file name.\n");
+		goto Error;
+	}
+	sprintf(Pointer_Cache->String_File_Name, "%s/%06X%s", String_Directory, JEDEC_ID & 0xFFFFFF, CACHE_FILE_NAME_SUFFIX);
+	sprintf(Pointer_Cache->String_Map_File_Name, "%s%s", Pointer_Cache->String_File_Name, CACHE_MAP_FILE_NAME_SUFFIX);
+
+	// Keep the existing content
+	Pointer_Cache->File = CacheOpenFile(Pointer_Cache->String_File_Name);
+	if (Pointer_Cache->File == NULL)
+	{
+		printf("Error : could not open the cache file '%s'.\n", Pointer_Cache->String_File_Name);
+		goto Error;
+	}
+	Pointer_Cache->Map_File = CacheOpenFile(Pointer_Cache->String_Map_File_Name);
+	if (Pointer_Cache->Map_File == NULL)
+	{
+		printf("Error : could not open the cache map file '%s'.\n", Pointer_Cache->String_Map_File_Name);
+		goto Error;
+	}
+	if (CacheLoadMap(Pointer_Cache) != 0) goto Error;
+
+	return 0;
+
+Error:
+	if (Pointer_Cache->File != NULL) fclose(Pointer_Cache->File);
+	if (Pointer_Cache->Map_File != NULL) fclose(Pointer_Cache->Map_File);
+	free(Pointer_Cache->Pointer_Stored_Sectors_Bitmap);
+	free(Pointer_Cache->String_File_Name);
+	free(Pointer_Cache->String_Map_File_Name);
+	return -1;
+}
+
+int CacheLoad(TCache *Pointer_Cache, unsigned int Address, unsigned int Size, unsigned char *Pointer_Data)
+{
+	size_t Read_Bytes_Count = 0;
+
+	// The file ends after the highest area read so far
+	if (fseek(Pointer_Cache->File, Address, SEEK_SET) == 0) Read_Bytes_Count = fread(Pointer_Data, 1, Size, Pointer_Cache->File);
+	if (ferror(Pointer_Cache->File))
+	{
+		printf("Error : could not read the cache file '%s'.\n", Pointer_Cache->String_File_Name);
+		return -1;
+	}
+	memset(&Pointer_Data[Read_Bytes_Count], 0xFF, Size - Read_Bytes_Count);
+
+	return 0;
+}
+
+int CacheIsSectorStored(TCache *Pointer_Cache, unsigned int Address)
+{
+	unsigned int Sector_Index = Address / PROTOCOL_FLASH_SECTOR_SIZE;
+
+	if (Sector_Index / 8 >= Pointer_Cache->Stored_Sectors_Bitmap_Size) return 0;
+	return (Pointer_Cache->Pointer_Stored_Sectors_Bitmap[Sector_Index / 8] >> (Sector_Index % 8)) & 1;
+}
+
+int CacheStore(TCache *Pointer_Cache, unsigned int Address, unsigned int Size, const unsigned char *Pointer_Data)
+{
+	unsigned int First_Sector_Index, End_Sector_Index, First_Byte_Index, End_Byte_Index, i;
+	unsigned char *Pointer_Bitmap;
+
+	// Store the data before marking it, so an interrupted update never marks meaningless data
+	if ((fseek(Pointer_Cache->File, Address, SEEK_SET) != 0) || (fwrite(Pointer_Data, 1, Size, Pointer_Cache->File) != Size) || (fflush(Pointer_Cache->File) != 0))
+	{
+		printf("Error : could not write to the cache file '%s'.\n", Pointer_Cache->String_File_Name);
+		return -1;
+	}
+
+	// Grow the bitmap if the area goes beyond its end
+	First_Sector_Index = Address / PROTOCOL_FLASH_SECTOR_SIZE;
+	End_Sector_Index = (Address + Size) / PROTOCOL_FLASH_SECTOR_SIZE;
+	First_Byte_Index = First_Sector_Index / 8;
+	End_Byte_Index = (End_Sector_Index + 7) / 8;
+	if (End_Byte_Index > Pointer_Cache->Stored_Sectors_Bitmap_Size)
+	{
+		Pointer_Bitmap = realloc(Pointer_Cache->Pointer_Stored_Sectors_Bitmap, End_Byte_Index);
+		if (Pointer_Bitmap == NULL)
+		{
+			printf("Error : could not allocate the cache map.\n");
+			return -1;
+		}
+		memset(&Pointer_Bitmap[Pointer_Cache->Stored_Sectors_Bitmap_Size], 0, End_Byte_Index - Pointer_Cache->Stored_Sectors_Bitmap_Size);
+		Pointer_Cache->Pointer_Stored_Sectors_Bitmap = Pointer_Bitmap;
+		Pointer_Cache->Stored_Sectors_Bitmap_Size = End_Byte_Index;
+	}
+
+	// Only the bitmap bytes covering the area need to be written
+	for (i = First_Sector_Index; i < End_Sector_Index; i++) Pointer_Cache->Pointer_Stored_Sectors_Bitmap[i / 8] |= 1 << (i % 8);
+	if ((fseek(Pointer_Cache->Map_File, First_Byte_Index, SEEK_SET) != 0) || (fwrite(&Pointer_Cache->Pointer_Stored_Sectors_Bitmap[First_Byte_Index], 1, End_Byte_Index - First_Byte_Index, Pointer_Cache->Map_File) != End_Byte_Index - First_Byte_Index))
+	{
+		printf("Error : could not write to the cache map file '%s'.\n", Pointer_Cache->String_Map_File_Name);
+		return -1;
+	}
+
+	return 0;
+}
+
+void CacheClose(TCache *Pointer_Cache)
+{
+	fclose(Pointer_Cache->File);
+	fclose(Pointer_Cache->Map_File);
+	free(Pointer_Cache->Pointer_Stored_Sectors_Bitmap);
+	free(Pointer_Cache->String_File_Name);
+	free(Pointer_Cache->String_Map_File_Name);
+}
@@ -0,0 +1,74 @@
+/** @file Cache.h
+ * Keep a copy of the previously read chips on the disk, so reading a chip again only transfers the sectors whose content changed.
+ * Each chip model has its own cache file in the cache directory, named after its JEDEC ID. The file holds each sector at its flash address, and a map file holds one bit per sector telling whether the sector was stored, so the sectors that were never read (they hold meaningless data) are never used. A stored sector is used only if its CRC-32 matches the one the programmer computes from the chip, so a cache filled from another board of the same model is still right.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_CACHE_H
+#define H_CACHE_H
+
+#include <stdio.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The cache file name is the JEDEC ID followed by this suffix. */
+#define CACHE_FILE_NAME_SUFFIX ".cache"
+/** The map file name is the cache file name followed by this suffix. */
+#define CACHE_MAP_FILE_NAME_SUFFIX ".map"
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** An opened cache. */
+typedef struct
+{
+	FILE *File; //!< The cache file.
+	char *String_File_Name; //!< The cache file path.
+	FILE *Map_File; //!< The file storing the stored sectors bitmap.
+	char *String_Map_File_Name; //!< The map file path.
+	unsigned char *Pointer_Stored_Sectors_Bitmap; //!< Bit n of byte n / 8 is set when the sector n was stored.
+	unsigned int Stored_Sectors_Bitmap_Size; //!< The bitmap size in bytes, the sectors beyond were never stored.
+} TCache;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Open the cache of a chip model, creating it if needed.
+ * @param Pointer_Cache The cache to initialize.
+ * @param String_Directory The directory containing the cache files (it must exist).
+ * @param JEDEC_ID The chip manufacturer ID (bits 23..16) and device ID (bits 15..0).
+ * @return 0 if the cache was opened, -1 if the cache file or the map file could not be opened or created (an error message is displayed).
+ */
+int CacheOpen(TCache *Pointer_Cache, char *String_Directory, unsigned int JEDEC_ID);
+
+/** Get the cached copy of a flash area.
+ * @param Pointer_Cache The cache.
+ * @param Address The area flash address.
+ * @param Size The area size in bytes.
+ * @param Pointer_Data On output, contain the cached data (0xFF for the bytes past the cache file end).
+ * @return 0 if the data was loaded, -1 if the cache file could not be read (an error message is displayed).
+ */
+int CacheLoad(TCache *Pointer_Cache, unsigned int Address, unsigned int Size, unsigned char *Pointer_Data);
+
+/** Tell whether a sector was stored to the cache.
+ * @param Pointer_Cache The cache.
+ * @param Address The sector flash address.
+ * @return 1 if the sector was stored, 0 if its cached copy holds meaningless data.
+ */
+int CacheIsSectorStored(TCache *Pointer_Cache, unsigned int Address);
+
+/** Update the cached copy of a flash area and mark its sectors as stored.
+ * @param Pointer_Cache The cache.
+ * @param Address The area flash address, it must be sector-aligned.
+ * @param Size The area size in bytes, it must be a multiple of the sector size.
+ * @param Pointer_Data The data read from the chip.
+ * @return 0 if the data was stored, -1 if the cache file or the map file could not be written (an error message is displayed).
+ */
+int CacheStore(TCache *Pointer_Cache, unsigned int Address, unsigned int Size, const unsigned char *Pointer_Data);
+
+/** Close the cache.
+ * @param Pointer_Cache The cache.
+ */
+void CacheClose(TCache *Pointer_Cache);
+
+#endif
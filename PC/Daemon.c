@@ -0,0 +1,865 @@
+/** @file Daemon.c
+ * @see Daemon.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Daemon.h"
+#include "Protocol.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many programmers a daemon can own. */
+#define DAEMON_MAXIMUM_PROGRAMMERS_COUNT 64
+
+/** A job request can't be larger than this amount of bytes. */
+#define DAEMON_MAXIMUM_REQUEST_SIZE 8192
+/** How many command line arguments a job can have. */
+#define DAEMON_MAXIMUM_ARGUMENTS_COUNT 32
+/** How many milliseconds a client can take to send its request. */
+#define DAEMON_REQUEST_TIMEOUT 2000
+/** How many clients can be sending their request at the same time, the next ones wait in the listening socket backlog. */
+#define DAEMON_MAXIMUM_RECEIVING_JOBS_COUNT 16
+
+/** How many milliseconds the event loop can sleep, so that terminated jobs are noticed soon enough. */
+#define DAEMON_EVENT_LOOP_PERIOD 50
+
+/** A frame starts with its type byte followed by its 16-bit little endian payload size. */
+#define DAEMON_FRAME_HEADER_SIZE 3
+/** A frame payload can't be larger. */
+#define DAEMON_MAXIMUM_FRAME_PAYLOAD_SIZE 4096
+
+/** The frame payload is some job output. */
+#define DAEMON_FRAME_TYPE_OUTPUT 0
+/** The frame payload is the job exit status byte, this is the last frame. */
+#define DAEMON_FRAME_TYPE_EXIT_STATUS 1
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A job sent by a client. */
+typedef struct TDaemonJob
+{
+	unsigned int ID; //!< The job number, displayed in the daemon log.
+	int Client_Socket; //!< The connection the job output is sent to, it never blocks.
+	char Request[DAEMON_MAXIMUM_REQUEST_SIZE + 1]; //!< The received request, all strings point to it.
+	unsigned int Request_Size; //!< How many request bytes were received.
+	unsigned long long Request_Deadline; //!< When the whole request must have been received (in milliseconds).
+	char *String_Working_Directory; //!< The client working directory, so relative file names keep their meaning.
+	char *String_Serial_Port_Name; //!< The requested programmer, or DAEMON_ANY_SERIAL_PORT.
+	int Arguments_Count; //!< How many command line arguments the job has.
+	char *Pointer_Arguments[DAEMON_MAXIMUM_ARGUMENTS_COUNT + 1]; //!< The command line arguments, terminated by NULL like argv.
+	unsigned long long Start_Time; //!< When the job started running (in milliseconds).
+	int Output_Pipe; //!< The job output is read from this pipe, -1 when the job process closed it.
+	unsigned char Frame[DAEMON_FRAME_HEADER_SIZE + DAEMON_MAXIMUM_FRAME_PAYLOAD_SIZE]; //!< The frame being sent to the client.
+	unsigned int Frame_Size; //!< The frame size in bytes.
+	unsigned int Frame_Sent_Bytes_Count; //!< How many frame bytes the client socket accepted yet.
+	int Exit_Status; //!< The job exit status, valid once the job process terminated.
+	int Is_Exit_Status_Sent; //!< Set to 1 when the exit status frame is queued.
+	int Is_Client_Gone; //!< Set to 1 when the client closed the connection, the job output is then thrown away.
+	struct TDaemonJob *Pointer_Next_Job; //!< The next queued job.
+} TDaemonJob;
+
+/** A programmer owned by the daemon. */
+typedef struct
+{
+	char *String_Serial_Port_Name; //!< The serial port the programmer is connected to.
+	TUART UART; //!< The serial port, opened for the whole daemon life.
+	pid_t Job_PID; //!< The process running the programmer job, 0 if no process is running.
+	TDaemonJob *Pointer_Job; //!< The running job, NULL if the programmer is idle. The job is kept until its whole output reached the client.
+} TDaemonProgrammer;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** All programmers. */
+static TDaemonProgrammer Daemon_Programmers[DAEMON_MAXIMUM_PROGRAMMERS_COUNT];
+/** How many programmers the daemon owns. */
+static int Daemon_Programmers_Count = 0;
+
+/** The jobs whose request is being received. */
+static TDaemonJob *Pointer_Daemon_Receiving_Jobs = NULL;
+/** How many requests are being received. */
+static int Daemon_Receiving_Jobs_Count = 0;
+
+/** The jobs waiting for their programmer, oldest first. */
+static TDaemonJob *Pointer_Daemon_Queue_Head = NULL;
+/** The last queued job. */
+static TDaemonJob *Pointer_Daemon_Queue_Tail = NULL;
+/** The number given to the next received job. */
+static unsigned int Daemon_Next_Job_ID = 1;
+
+/** Set by the signal handler to stop accepting jobs. */
+static volatile sig_atomic_t Daemon_Is_Exit_Requested = 0;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Stop accepting jobs.
+ * @param Signal_Number The received signal.
+ */
+static void DaemonSignalHandler(int Signal_Number)
+{
+	(void) Signal_Number;
+	Daemon_Is_Exit_Requested = 1;
+}
+
+/** Fill a frame header.
+ * @param Pointer_Frame The frame.
+ * @param Type The frame type.
+ * @param Payload_Size The payload size in bytes.
+ * @return The whole frame size in bytes.
+ */
+static unsigned int DaemonBuildFrameHeader(unsigned char *Pointer_Frame, unsigned char Type, unsigned int Payload_Size)
+{
+	Pointer_Frame[0] = Type;
+	Pointer_Frame[1] = (unsigned char) Payload_Size;
+	Pointer_Frame[2] = (unsigned char) (Payload_Size >> 8);
+	return DAEMON_FRAME_HEADER_SIZE + Payload_Size;
+}
+
+/** Send a message to a client, ignoring clients that went away. Messages are only sent while no job output is pending, so the socket buffer has room for them.
+ * @param Client_Socket The client connection.
+ * @param String_Format The message format, like printf().
+ */
+static void DaemonSendMessage(int Client_Socket, const char *String_Format, ...) __attribute__((format(printf, 2, 3)));
+static void DaemonSendMessage(int Client_Socket, const char *String_Format, ...)
+{
+	unsigned char Frame[DAEMON_FRAME_HEADER_SIZE + 512];
+	va_list Arguments_List;
+	int Length;
+
+	va_start(Arguments_List, String_Format);
+	Length = vsnprintf((char *) &Frame[DAEMON_FRAME_HEADER_SIZE], sizeof(Frame) - DAEMON_FRAME_HEADER_SIZE, String_Format, Arguments_List);
+	va_end(Arguments_List);
+
+	if (Length > (int) (sizeof(Frame) - DAEMON_FRAME_HEADER_SIZE) - 1) Length = sizeof(Frame) - DAEMON_FRAME_HEADER_SIZE - 1;
+	if (write(Client_Socket, Frame, DaemonBuildFrameHeader(Frame, DAEMON_FRAME_TYPE_OUTPUT, Length)) < 0) return; // The job runs even if nobody is watching it
+}
+
+/** Tell a client why its job did not run and close the connection.
+ * @param Client_Socket The client connection.
+ * @param String_Format The message format, like printf().
+ */
+static void DaemonRejectClient(int Client_Socket, const char *String_Format, ...) __attribute__((format(printf, 2, 3)));
+static void DaemonRejectClient(int Client_Socket, const char *String_Format, ...)
+{
+	unsigned char Frame[DAEMON_FRAME_HEADER_SIZE + 1];
+	char String_Message[512];
+	va_list Arguments_List;
+
+	va_start(Arguments_List, String_Format);
+	vsnprintf(String_Message, sizeof(String_Message), String_Format, Arguments_List);
+	va_end(Arguments_List);
+
+	DaemonSendMessage(Client_Socket, "%s", String_Message);
+	Frame[DAEMON_FRAME_HEADER_SIZE] = EXIT_FAILURE;
+	if (write(Client_Socket, Frame, DaemonBuildFrameHeader(Frame, DAEMON_FRAME_TYPE_EXIT_STATUS, 1)) < 0) printf("Warning : the client went away before its job was rejected.\n");
+	close(Client_Socket);
+}
+
+/** Find a programmer from its serial port name.
+ * @param String_Serial_Port_Name The serial port name.
+ * @return The programmer index, or -1 if the daemon does not own this serial port.
+ */
+static int DaemonFindProgrammer(char *String_Serial_Port_Name)
+{
+	int i;
+
+	for (i = 0; i < Daemon_Programmers_Count; i++)
+	{
+		if (strcmp(Daemon_Programmers[i].String_Serial_Port_Name, String_Serial_Port_Name) == 0) return i;
+	}
+	return -1;
+}
+
+/** Remove a job from the list of the jobs whose request is being received.
+ * @param Pointer_Job The job.
+ */
+static void DaemonRemoveReceivingJob(TDaemonJob *Pointer_Job)
+{
+	TDaemonJob **Pointer_Link;
+
+	for (Pointer_Link = &Pointer_Daemon_Receiving_Jobs; *Pointer_Link != Pointer_Job; Pointer_Link = &(*Pointer_Link)->Pointer_Next_Job);
+	*Pointer_Link = Pointer_Job->Pointer_Next_Job;
+	Daemon_Receiving_Jobs_Count--;
+}
+
+/** Accept a client connection, its request is received by the event loop.
+ * @param Listening_Socket The socket clients connect to.
+ */
+static void DaemonAcceptClient(int Listening_Socket)
+{
+	TDaemonJob *Pointer_Job;
+	int Client_Socket;
+
+	Client_Socket = accept(Listening_Socket, NULL, NULL);
+	if (Client_Socket == -1) return;
+
+	// A client that is slow to send its request or to read the job output must not stall the other ones
+	if (fcntl(Client_Socket, F_SETFL, fcntl(Client_Socket, F_GETFL) | O_NONBLOCK) != 0)
+	{
+		printf("Error : could not configure the client connection (%s).\n", strerror(errno));
+		close(Client_Socket);
+		return;
+	}
+
+	Pointer_Job = malloc(sizeof(TDaemonJob));
+	if (Pointer_Job == NULL)
+	{
+		printf("Error : could not allocate a job.\n");
+		DaemonRejectClient(Client_Socket, "Error : the daemon could not allocate the job.\n");
+		return;
+	}
+	Pointer_Job->Client_Socket = Client_Socket;
+	Pointer_Job->Request_Size = 0;
+	Pointer_Job->Request_Deadline = ProtocolGetTime() + DAEMON_REQUEST_TIMEOUT;
+	Pointer_Job->Pointer_Next_Job = Pointer_Daemon_Receiving_Jobs;
+	Pointer_Daemon_Receiving_Jobs = Pointer_Job;
+	Daemon_Receiving_Jobs_Count++;
+}
+
+/** Check a whole job request and queue the job.
+ * @param Pointer_Job The job, it is freed if the request is rejected.
+ */
+static void DaemonQueueJob(TDaemonJob *Pointer_Job)
+{
+	char *Pointer_String, *Pointer_End;
+	int i;
+
+	// Split the request strings, the last one must be terminated or the request was cut
+	Pointer_Job->Request[Pointer_Job->Request_Size] = 0;
+	Pointer_String = Pointer_Job->Request;
+	Pointer_End = &Pointer_Job->Request[Pointer_Job->Request_Size];
+	Pointer_Job->Arguments_Count = -2; // The working directory and the serial port come first
+	while ((Pointer_String < Pointer_End) && (Pointer_Job->Arguments_Count < DAEMON_MAXIMUM_ARGUMENTS_COUNT))
+	{
+		if (Pointer_Job->Arguments_Count == -2) Pointer_Job->String_Working_Directory = Pointer_String;
+		else if (Pointer_Job->Arguments_Count == -1) Pointer_Job->String_Serial_Port_Name = Pointer_String;
+		else Pointer_Job->Pointer_Arguments[Pointer_Job->Arguments_Count] = Pointer_String;
+		Pointer_Job->Arguments_Count++;
+		Pointer_String += strlen(Pointer_String) + 1;
+	}
+	if ((Pointer_Job->Arguments_Count < 1) || (Pointer_String < Pointer_End) || (Pointer_Job->Request[Pointer_Job->Request_Size - 1] != 0))
+	{
+		DaemonRejectClient(Pointer_Job->Client_Socket, "Error : the daemon received an incomplete job.\n");
+		free(Pointer_Job);
+		return;
+	}
+	Pointer_Job->Pointer_Arguments[Pointer_Job->Arguments_Count] = NULL;
+
+	if ((strcmp(Pointer_Job->String_Serial_Port_Name, DAEMON_ANY_SERIAL_PORT) != 0) && (DaemonFindProgrammer(Pointer_Job->String_Serial_Port_Name) < 0))
+	{
+		DaemonRejectClient(Pointer_Job->Client_Socket, "Error : the daemon does not own the serial port '%s'.\n", Pointer_Job->String_Serial_Port_Name);
+		free(Pointer_Job);
+		return;
+	}
+
+	// Queue the job
+	Pointer_Job->ID = Daemon_Next_Job_ID;
+	Daemon_Next_Job_ID++;
+	Pointer_Job->Pointer_Next_Job = NULL;
+	if (Pointer_Daemon_Queue_Tail == NULL) Pointer_Daemon_Queue_Head = Pointer_Job;
+	else Pointer_Daemon_Queue_Tail->Pointer_Next_Job = Pointer_Job;
+	Pointer_Daemon_Queue_Tail = Pointer_Job;
+
+	printf("Job %u queued for %s :", Pointer_Job->ID, Pointer_Job->String_Serial_Port_Name);
+	for (i = 1; i < Pointer_Job->Arguments_Count; i++) printf(" %s", Pointer_Job->Pointer_Arguments[i]);
+	printf("\n");
+	DaemonSendMessage(Pointer_Job->Client_Socket, "Job %u queued.\n", Pointer_Job->ID);
+}
+
+/** Receive the available bytes of a job request, queue the job when the client closed its side of the connection.
+ * @param Pointer_Job The job.
+ */
+static void DaemonReceiveRequest(TDaemonJob *Pointer_Job)
+{
+	ssize_t Read_Bytes_Count;
+
+	while (1)
+	{
+		// Read one byte more than allowed to tell a too large request from a request of the maximum size
+		Read_Bytes_Count = read(Pointer_Job->Client_Socket, &Pointer_Job->Request[Pointer_Job->Request_Size], DAEMON_MAXIMUM_REQUEST_SIZE + 1 - Pointer_Job->Request_Size);
+		if (Read_Bytes_Count > 0)
+		{
+			Pointer_Job->Request_Size += Read_Bytes_Count;
+			if (Pointer_Job->Request_Size <= DAEMON_MAXIMUM_REQUEST_SIZE) continue;
+
+			DaemonRemoveReceivingJob(Pointer_Job);
+			DaemonRejectClient(Pointer_Job->Client_Socket, "Error : the job is larger than %d bytes.\n", DAEMON_MAXIMUM_REQUEST_SIZE);
+			free(Pointer_Job);
+			return;
+		}
+		if ((Read_Bytes_Count < 0) && (errno == EINTR)) continue;
+		if ((Read_Bytes_Count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) return; // Wait for the next bytes
+
+		// The client closed its side of the connection, so the request is complete
+		DaemonRemoveReceivingJob(Pointer_Job);
+		if (Read_Bytes_Count < 0)
+		{
+			close(Pointer_Job->Client_Socket);
+			free(Pointer_Job);
+		}
+		else DaemonQueueJob(Pointer_Job);
+		return;
+	}
+}
+
+/** Reject the requests that were not received in time. */
+static void DaemonCheckRequestsTimeout(void)
+{
+	TDaemonJob *Pointer_Job, *Pointer_Next_Job;
+	unsigned long long Time;
+
+	Time = ProtocolGetTime();
+	for (Pointer_Job = Pointer_Daemon_Receiving_Jobs; Pointer_Job != NULL; Pointer_Job = Pointer_Next_Job)
+	{
+		Pointer_Next_Job = Pointer_Job->Pointer_Next_Job;
+		if (Time < Pointer_Job->Request_Deadline) continue;
+
+		DaemonRemoveReceivingJob(Pointer_Job);
+		DaemonRejectClient(Pointer_Job->Client_Socket, "Error : the daemon did not receive the whole job within %d ms.\n", DAEMON_REQUEST_TIMEOUT);
+		free(Pointer_Job);
+	}
+}
+
+/** Run a job in a child process.
+ * @param Programmer_Index The idle programmer to run the job on.
+ * @param Pointer_Job The job.
+ * @param Listening_Socket The socket clients connect to (the child does not need it).
+ * @param Job_Function The function executing the job.
+ */
+static void DaemonStartJob(int Programmer_Index, TDaemonJob *Pointer_Job, int Listening_Socket, TDaemonJobFunction Job_Function)
+{
+	TDaemonProgrammer *Pointer_Programmer = &Daemon_Programmers[Programmer_Index];
+	int Output_Pipe[2];
+	pid_t PID;
+
+	// Forget the bytes the programmer sent after the previous job terminated
+	tcflush(Pointer_Programmer->UART.File_Descriptor, TCIFLUSH);
+
+	DaemonSendMessage(Pointer_Job->Client_Socket, "Job %u running on %s.\n", Pointer_Job->ID, Pointer_Programmer->String_Serial_Port_Name);
+	fflush(stdout); // Do not let the child output the daemon buffered log
+
+	// The job output is framed by the daemon, so any byte it displays reaches the client unchanged
+	if (pipe(Output_Pipe) != 0) PID = -1;
+	else
+	{
+		PID = fork();
+		if (PID == -1)
+		{
+			close(Output_Pipe[0]);
+			close(Output_Pipe[1]);
+		}
+	}
+	if (PID == -1)
+	{
+		printf("Error : could not start the job %u (%s).\n", Pointer_Job->ID, strerror(errno));
+		DaemonRejectClient(Pointer_Job->Client_Socket, "Error : the daemon could not start the job.\n");
+		free(Pointer_Job);
+		return;
+	}
+
+	// The child sends its output to the daemon
+	if (PID == 0)
+	{
+		close(Listening_Socket);
+		close(Pointer_Job->Client_Socket);
+		close(Output_Pipe[0]);
+		dup2(Output_Pipe[1], STDOUT_FILENO);
+		dup2(Output_Pipe[1], STDERR_FILENO);
+		close(Output_Pipe[1]);
+		setvbuf(stdout, NULL, _IOLBF, 0); // Stream each line as soon as it is displayed
+
+		if (chdir(Pointer_Job->String_Working_Directory) != 0)
+		{
+			printf("Error : could not change to the directory '%s' (%s).\n", Pointer_Job->String_Working_Directory, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		exit(Job_Function(&Pointer_Programmer->UART, Pointer_Programmer->String_Serial_Port_Name, Pointer_Job->Arguments_Count, Pointer_Job->Pointer_Arguments));
+	}
+
+	// The following children must not own the pipe write end, or the daemon would not know when this job output ends
+	close(Output_Pipe[1]);
+	fcntl(Output_Pipe[0], F_SETFL, fcntl(Output_Pipe[0], F_GETFL) | O_NONBLOCK);
+	Pointer_Job->Output_Pipe = Output_Pipe[0];
+	Pointer_Job->Frame_Size = 0;
+	Pointer_Job->Frame_Sent_Bytes_Count = 0;
+	Pointer_Job->Is_Exit_Status_Sent = 0;
+	Pointer_Job->Is_Client_Gone = 0;
+
+	Pointer_Programmer->Job_PID = PID;
+	Pointer_Programmer->Pointer_Job = Pointer_Job;
+	Pointer_Job->Start_Time = ProtocolGetTime();
+	printf("Job %u started on %s.\n", Pointer_Job->ID, Pointer_Programmer->String_Serial_Port_Name);
+}
+
+/** Start the queued jobs whose programmer is idle. A job waiting for a busy programmer does not prevent the following jobs from running.
+ * @param Listening_Socket The socket clients connect to.
+ * @param Job_Function The function executing the jobs.
+ */
+static void DaemonDispatchJobs(int Listening_Socket, TDaemonJobFunction Job_Function)
+{
+	TDaemonJob *Pointer_Job, *Pointer_Previous_Job = NULL, *Pointer_Next_Job;
+	int Programmer_Index, i;
+
+	Pointer_Job = Pointer_Daemon_Queue_Head;
+	while (Pointer_Job != NULL)
+	{
+		Pointer_Next_Job = Pointer_Job->Pointer_Next_Job;
+
+		// Find an idle programmer
+		Programmer_Index = -1;
+		if (strcmp(Pointer_Job->String_Serial_Port_Name, DAEMON_ANY_SERIAL_PORT) == 0)
+		{
+			for (i = 0; i < Daemon_Programmers_Count; i++)
+			{
+				if (Daemon_Programmers[i].Pointer_Job == NULL)
+				{
+					Programmer_Index = i;
+					break;
+				}
+			}
+		}
+		else
+		{
+			i = DaemonFindProgrammer(Pointer_Job->String_Serial_Port_Name);
+			if (Daemon_Programmers[i].Pointer_Job == NULL) Programmer_Index = i;
+		}
+
+		if (Programmer_Index < 0) Pointer_Previous_Job = Pointer_Job;
+		else
+		{
+			// Remove the job from the queue
+			if (Pointer_Previous_Job == NULL) Pointer_Daemon_Queue_Head = Pointer_Next_Job;
+			else Pointer_Previous_Job->Pointer_Next_Job = Pointer_Next_Job;
+			if (Pointer_Daemon_Queue_Tail == Pointer_Job) Pointer_Daemon_Queue_Tail = Pointer_Previous_Job;
+
+			DaemonStartJob(Programmer_Index, Pointer_Job, Listening_Socket, Job_Function);
+		}
+		Pointer_Job = Pointer_Next_Job;
+	}
+}
+
+/** Get the exit status of the terminated job processes. */
+static void DaemonCollectJobs(void)
+{
+	TDaemonProgrammer *Pointer_Programmer;
+	TDaemonJob *Pointer_Job;
+	pid_t PID;
+	int Status, i;
+
+	while (1)
+	{
+		PID = waitpid(-1, &Status, WNOHANG);
+		if (PID <= 0) return;
+
+		for (i = 0; i < Daemon_Programmers_Count; i++)
+		{
+			Pointer_Programmer = &Daemon_Programmers[i];
+			if (Pointer_Programmer->Job_PID != PID) continue;
+
+			Pointer_Job = Pointer_Programmer->Pointer_Job;
+			if (WIFEXITED(Status)) Pointer_Job->Exit_Status = WEXITSTATUS(Status);
+			else Pointer_Job->Exit_Status = EXIT_FAILURE;
+			printf("Job %u terminated on %s with status %d after %.1f s.\n", Pointer_Job->ID, Pointer_Programmer->String_Serial_Port_Name, Pointer_Job->Exit_Status, (ProtocolGetTime() - Pointer_Job->Start_Time) / 1000.0);
+
+			Pointer_Programmer->Job_PID = 0;
+			break;
+		}
+	}
+}
+
+/** Forward the available job output to the client without blocking, then send the exit status once the job terminated. The programmer becomes idle when the client received everything.
+ * @param Pointer_Programmer The programmer running the job.
+ */
+static void DaemonForwardJobOutput(TDaemonProgrammer *Pointer_Programmer)
+{
+	TDaemonJob *Pointer_Job = Pointer_Programmer->Pointer_Job;
+	ssize_t Transferred_Bytes_Count;
+
+	while (1)
+	{
+		// Send the pending frame first
+		if (Pointer_Job->Frame_Sent_Bytes_Count < Pointer_Job->Frame_Size)
+		{
+			Transferred_Bytes_Count = write(Pointer_Job->Client_Socket, &Pointer_Job->Frame[Pointer_Job->Frame_Sent_Bytes_Count], Pointer_Job->Frame_Size - Pointer_Job->Frame_Sent_Bytes_Count);
+			if (Transferred_Bytes_Count > 0) Pointer_Job->Frame_Sent_Bytes_Count += Transferred_Bytes_Count;
+			else if ((Transferred_Bytes_Count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) return;
+			else if ((Transferred_Bytes_Count < 0) && (errno == EINTR)) continue;
+			else
+			{
+				// The job runs even if nobody is watching it, its output is thrown away
+				printf("Warning : the client of the job %u went away before its job terminated.\n", Pointer_Job->ID);
+				Pointer_Job->Frame_Sent_Bytes_Count = Pointer_Job->Frame_Size;
+				Pointer_Job->Is_Client_Gone = 1;
+			}
+			continue;
+		}
+
+		// Get the next output bytes
+		if (Pointer_Job->Output_Pipe != -1)
+		{
+			Transferred_Bytes_Count = read(Pointer_Job->Output_Pipe, &Pointer_Job->Frame[DAEMON_FRAME_HEADER_SIZE], DAEMON_MAXIMUM_FRAME_PAYLOAD_SIZE);
+			if (Transferred_Bytes_Count > 0)
+			{
+				if (Pointer_Job->Is_Client_Gone) continue;
+				Pointer_Job->Frame_Size = DaemonBuildFrameHeader(Pointer_Job->Frame, DAEMON_FRAME_TYPE_OUTPUT, Transferred_Bytes_Count);
+				Pointer_Job->Frame_Sent_Bytes_Count = 0;
+				continue;
+			}
+			if ((Transferred_Bytes_Count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) return;
+			if ((Transferred_Bytes_Count < 0) && (errno == EINTR)) continue;
+
+			// The job process closed its output
+			close(Pointer_Job->Output_Pipe);
+			Pointer_Job->Output_Pipe = -1;
+			continue;
+		}
+
+		// The output is complete, but the exit status is known only when the process is collected
+		if (Pointer_Programmer->Job_PID != 0) return;
+		if (!Pointer_Job->Is_Exit_Status_Sent && !Pointer_Job->Is_Client_Gone)
+		{
+			Pointer_Job->Frame[DAEMON_FRAME_HEADER_SIZE] = (unsigned char) Pointer_Job->Exit_Status;
+			Pointer_Job->Frame_Size = DaemonBuildFrameHeader(Pointer_Job->Frame, DAEMON_FRAME_TYPE_EXIT_STATUS, 1);
+			Pointer_Job->Frame_Sent_Bytes_Count = 0;
+			Pointer_Job->Is_Exit_Status_Sent = 1;
+			continue;
+		}
+
+		close(Pointer_Job->Client_Socket);
+		free(Pointer_Job);
+		Pointer_Programmer->Pointer_Job = NULL;
+		return;
+	}
+}
+
+/** Tell whether a job is running on any programmer.
+ * @return 1 if at least a job is running, 0 if all programmers are idle.
+ */
+static int DaemonIsJobRunning(void)
+{
+	int i;
+
+	for (i = 0; i < Daemon_Programmers_Count; i++)
+	{
+		if (Daemon_Programmers[i].Pointer_Job != NULL) return 1;
+	}
+	return 0;
+}
+
+/** Wait until a client connects, a request is received, a job displays something or a client can receive more output.
+ * @param Listening_Socket The socket clients connect to, -1 to stop accepting clients.
+ */
+static void DaemonWaitForEvents(int Listening_Socket)
+{
+	static struct pollfd Poll_Descriptors[1 + DAEMON_MAXIMUM_RECEIVING_JOBS_COUNT + DAEMON_MAXIMUM_PROGRAMMERS_COUNT];
+	static TDaemonJob *Pointer_Receiving_Jobs[1 + DAEMON_MAXIMUM_RECEIVING_JOBS_COUNT + DAEMON_MAXIMUM_PROGRAMMERS_COUNT];
+	TDaemonJob *Pointer_Job;
+	int Descriptors_Count = 0, i;
+
+	// Let new clients wait in the backlog while too many requests are being received
+	if ((Listening_Socket != -1) && (Daemon_Receiving_Jobs_Count < DAEMON_MAXIMUM_RECEIVING_JOBS_COUNT))
+	{
+		Poll_Descriptors[Descriptors_Count].fd = Listening_Socket;
+		Poll_Descriptors[Descriptors_Count].events = POLLIN;
+		Pointer_Receiving_Jobs[Descriptors_Count] = NULL;
+		Descriptors_Count++;
+	}
+	for (Pointer_Job = Pointer_Daemon_Receiving_Jobs; Pointer_Job != NULL; Pointer_Job = Pointer_Job->Pointer_Next_Job)
+	{
+		Poll_Descriptors[Descriptors_Count].fd = Pointer_Job->Client_Socket;
+		Poll_Descriptors[Descriptors_Count].events = POLLIN;
+		Pointer_Receiving_Jobs[Descriptors_Count] = Pointer_Job;
+		Descriptors_Count++;
+	}
+
+	// Running jobs wait for the client to drain the pending frame, or for more output
+	for (i = 0; i < Daemon_Programmers_Count; i++)
+	{
+		Pointer_Job = Daemon_Programmers[i].Pointer_Job;
+		if (Pointer_Job == NULL) continue;
+
+		if (Pointer_Job->Frame_Sent_Bytes_Count < Pointer_Job->Frame_Size)
+		{
+			Poll_Descriptors[Descriptors_Count].fd = Pointer_Job->Client_Socket;
+			Poll_Descriptors[Descriptors_Count].events = POLLOUT;
+		}
+		else if (Pointer_Job->Output_Pipe != -1)
+		{
+			Poll_Descriptors[Descriptors_Count].fd = Pointer_Job->Output_Pipe;
+			Poll_Descriptors[Descriptors_Count].events = POLLIN;
+		}
+		else continue;
+		Pointer_Receiving_Jobs[Descriptors_Count] = NULL;
+		Descriptors_Count++;
+	}
+
+	if (poll(Poll_Descriptors, Descriptors_Count, DAEMON_EVENT_LOOP_PERIOD) <= 0) return;
+
+	// Receive the requests first, as receiving a request can free its job
+	for (i = 0; i < Descriptors_Count; i++)
+	{
+		if ((Pointer_Receiving_Jobs[i] != NULL) && (Poll_Descriptors[i].revents != 0)) DaemonReceiveRequest(Pointer_Receiving_Jobs[i]);
+	}
+	if ((Listening_Socket != -1) && (Poll_Descriptors[0].fd == Listening_Socket) && (Poll_Descriptors[0].revents & POLLIN)) DaemonAcceptClient(Listening_Socket);
+}
+
+/** Create the socket clients connect to. A socket file left by a daemon that did not terminate properly is replaced.
+ * @param String_Socket_File_Name The socket file.
+ * @param Pointer_Address On output, contain the socket address.
+ * @return The listening socket, or -1 if an error occurred (an error message is displayed).
+ */
+static int DaemonCreateSocket(char *String_Socket_File_Name, struct sockaddr_un *Pointer_Address)
+{
+	int Listening_Socket, Probe_Socket;
+
+	memset(Pointer_Address, 0, sizeof(struct sockaddr_un));
+	Pointer_Address->sun_family = AF_UNIX;
+	if (strlen(String_Socket_File_Name) >= sizeof(Pointer_Address->sun_path))
+	{
+		printf("Error : the socket file name '%s' is too long.\n", String_Socket_File_Name);
+		return -1;
+	}
+	strcpy(Pointer_Address->sun_path, String_Socket_File_Name);
+
+	Listening_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (Listening_Socket == -1)
+	{
+		printf("Error : could not create the socket (%s).\n", strerror(errno));
+		return -1;
+	}
+
+	if (bind(Listening_Socket, (struct sockaddr *) Pointer_Address, sizeof(struct sockaddr_un)) != 0)
+	{
+		// Do not steal the socket of a running daemon
+		if (errno == EADDRINUSE)
+		{
+			Probe_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+			if ((Probe_Socket != -1) && (connect(Probe_Socket, (struct sockaddr *) Pointer_Address, sizeof(struct sockaddr_un)) != 0))
+			{
+				unlink(String_Socket_File_Name);
+				if (bind(Listening_Socket, (struct sockaddr *) Pointer_Address, sizeof(struct sockaddr_un)) == 0) errno = 0;
+			}
+			else errno = EADDRINUSE;
+			if (Probe_Socket != -1) close(Probe_Socket);
+		}
+
+		if (errno != 0)
+		{
+			printf("Error : could not bind the socket to '%s' (%s).\n", String_Socket_File_Name, strerror(errno));
+			close(Listening_Socket);
+			return -1;
+		}
+	}
+
+	if (listen(Listening_Socket, 16) != 0)
+	{
+		printf("Error : could not listen on the socket '%s' (%s).\n", String_Socket_File_Name, strerror(errno));
+		close(Listening_Socket);
+		unlink(String_Socket_File_Name);
+		return -1;
+	}
+	return Listening_Socket;
+}
+
+/** Receive a given amount of bytes from a socket.
+ * @param Socket The socket.
+ * @param Pointer_Buffer On output, contain the received bytes.
+ * @param Size How many bytes to receive.
+ * @return 0 if all bytes were received, -1 if the connection was closed before.
+ */
+static int DaemonReceiveBytes(int Socket, void *Pointer_Buffer, unsigned int Size)
+{
+	ssize_t Read_Bytes_Count;
+	unsigned int Offset = 0;
+
+	while (Offset < Size)
+	{
+		Read_Bytes_Count = read(Socket, (unsigned char *) Pointer_Buffer + Offset, Size - Offset);
+		if ((Read_Bytes_Count < 0) && (errno == EINTR)) continue;
+		if (Read_Bytes_Count <= 0) return -1;
+		Offset += Read_Bytes_Count;
+	}
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int DaemonRun(char *String_Socket_File_Name, char *String_Serial_Port_Names[], int Ports_Count, TDaemonJobFunction Job_Function)
+{
+	struct sockaddr_un Address;
+	struct sigaction Action;
+	int Listening_Socket, i;
+
+	if (Ports_Count > DAEMON_MAXIMUM_PROGRAMMERS_COUNT)
+	{
+		printf("Error : too many serial ports (up to %d are supported).\n", DAEMON_MAXIMUM_PROGRAMMERS_COUNT);
+		return -1;
+	}
+
+	// Open and configure all serial ports once for all
+	for (i = 0; i < Ports_Count; i++)
+	{
+		Daemon_Programmers[i].String_Serial_Port_Name = String_Serial_Port_Names[i];
+		Daemon_Programmers[i].Job_PID = 0;
+		Daemon_Programmers[i].Pointer_Job = NULL;
+		if (UARTOpen(&Daemon_Programmers[i].UART, String_Serial_Port_Names[i]) == 0)
+		{
+			printf("Error : could not open the serial port '%s'.\n", String_Serial_Port_Names[i]);
+			while (Daemon_Programmers_Count > 0)
+			{
+				Daemon_Programmers_Count--;
+				UARTClose(&Daemon_Programmers[Daemon_Programmers_Count].UART);
+			}
+			return -1;
+		}
+		Daemon_Programmers_Count++;
+	}
+
+	Listening_Socket = DaemonCreateSocket(String_Socket_File_Name, &Address);
+	if (Listening_Socket == -1)
+	{
+		for (i = 0; i < Daemon_Programmers_Count; i++) UARTClose(&Daemon_Programmers[i].UART);
+		return -1;
+	}
+
+	// Terminate the running jobs before exiting, and keep running when a client goes away
+	memset(&Action, 0, sizeof(Action));
+	Action.sa_handler = DaemonSignalHandler;
+	sigaction(SIGINT, &Action, NULL);
+	sigaction(SIGTERM, &Action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Daemon listening on '%s' with %d programmer%s.\n", String_Socket_File_Name, Daemon_Programmers_Count, Daemon_Programmers_Count > 1 ? "s" : "");
+	fflush(stdout);
+
+	// Event loop, nothing in it can block
+	while (!Daemon_Is_Exit_Requested || DaemonIsJobRunning())
+	{
+		DaemonWaitForEvents(Daemon_Is_Exit_Requested ? -1 : Listening_Socket);
+		DaemonCheckRequestsTimeout();
+
+		DaemonCollectJobs();
+		for (i = 0; i < Daemon_Programmers_Count; i++)
+		{
+			if (Daemon_Programmers[i].Pointer_Job != NULL) DaemonForwardJobOutput(&Daemon_Programmers[i]);
+		}
+		if (!Daemon_Is_Exit_Requested) DaemonDispatchJobs(Listening_Socket, Job_Function);
+		fflush(stdout);
+	}
+
+	// Tell the clients whose job did not start that it will never run
+	while (Pointer_Daemon_Receiving_Jobs != NULL)
+	{
+		Pointer_Daemon_Queue_Tail = Pointer_Daemon_Receiving_Jobs;
+		DaemonRemoveReceivingJob(Pointer_Daemon_Queue_Tail);
+		DaemonRejectClient(Pointer_Daemon_Queue_Tail->Client_Socket, "Error : the daemon terminated before the job could run.\n");
+		free(Pointer_Daemon_Queue_Tail);
+	}
+	while (Pointer_Daemon_Queue_Head != NULL)
+	{
+		Pointer_Daemon_Queue_Tail = Pointer_Daemon_Queue_Head->Pointer_Next_Job;
+		DaemonRejectClient(Pointer_Daemon_Queue_Head->Client_Socket, "Error : the daemon terminated before the job could run.\n");
+		free(Pointer_Daemon_Queue_Head);
+		Pointer_Daemon_Queue_Head = Pointer_Daemon_Queue_Tail;
+	}
+
+	close(Listening_Socket);
+	unlink(String_Socket_File_Name);
+	for (i = 0; i < Daemon_Programmers_Count; i++) UARTClose(&Daemon_Programmers[i].UART);
+	printf("Daemon terminated.\n");
+	return 0;
+}
+
+int DaemonSubmitJob(char *String_Socket_File_Name, char *String_Serial_Port_Name, int argc, char *argv[])
+{
+	struct sockaddr_un Address;
+	char Request[DAEMON_MAXIMUM_REQUEST_SIZE], *String_Argument;
+	unsigned char Frame[DAEMON_FRAME_HEADER_SIZE + DAEMON_MAXIMUM_FRAME_PAYLOAD_SIZE];
+	unsigned int Size, Length, Offset;
+	ssize_t Transferred_Bytes_Count;
+	int Client_Socket, i;
+
+	// Build the request
+	if (getcwd(Request, sizeof(Request)) == NULL)
+	{
+		printf("Error : could not get the working directory (%s).\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	Size = strlen(Request) + 1;
+	for (i = -1; i < argc; i++)
+	{
+		if (i == -1) String_Argument = String_Serial_Port_Name;
+		else String_Argument = argv[i];
+
+		Length = strlen(String_Argument) + 1;
+		if ((Size + Length > sizeof(Request)) || (i >= DAEMON_MAXIMUM_ARGUMENTS_COUNT))
+		{
+			printf("Error : the job command line is too long.\n");
+			return EXIT_FAILURE;
+		}
+		memcpy(&Request[Size], String_Argument, Length);
+		Size += Length;
+	}
+
+	// Connect to the daemon
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	strncpy(Address.sun_path, String_Socket_File_Name, sizeof(Address.sun_path) - 1);
+	Client_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((Client_Socket == -1) || (connect(Client_Socket, (struct sockaddr *) &Address, sizeof(Address)) != 0))
+	{
+		printf("Error : could not connect to the daemon socket '%s' (%s).\n", String_Socket_File_Name, strerror(errno));
+		if (Client_Socket != -1) close(Client_Socket);
+		return EXIT_FAILURE;
+	}
+
+	// Send the request and tell that it is complete
+	Offset = 0;
+	while (Offset < Size)
+	{
+		Transferred_Bytes_Count = write(Client_Socket, &Request[Offset], Size - Offset);
+		if (Transferred_Bytes_Count <= 0)
+		{
+			printf("Error : could not send the job to the daemon (%s).\n", strerror(errno));
+			close(Client_Socket);
+			return EXIT_FAILURE;
+		}
+		Offset += Transferred_Bytes_Count;
+	}
+	shutdown(Client_Socket, SHUT_WR);
+
+	// Display the job output frames until the exit status one is received
+	while (DaemonReceiveBytes(Client_Socket, Frame, DAEMON_FRAME_HEADER_SIZE) == 0)
+	{
+		Size = Frame[1] | (Frame[2] << 8);
+		if ((Size > DAEMON_MAXIMUM_FRAME_PAYLOAD_SIZE) || (DaemonReceiveBytes(Client_Socket, &Frame[DAEMON_FRAME_HEADER_SIZE], Size) != 0)) break;
+
+		if ((Frame[0] == DAEMON_FRAME_TYPE_EXIT_STATUS) && (Size == 1))
+		{
+			close(Client_Socket);
+			return Frame[DAEMON_FRAME_HEADER_SIZE];
+		}
+		fwrite(&Frame[DAEMON_FRAME_HEADER_SIZE], 1, Size, stdout);
+		fflush(stdout);
+	}
+	close(Client_Socket);
+
+	printf("Error : the daemon closed the connection before the job terminated.\n");
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+/** @file Daemon.h
+ * Keep the programmers serial ports opened and configured in a long-running process, and execute the jobs sent by clients through a Unix domain socket.
+ * Jobs are queued and each one runs in its own child process as soon as its programmer is idle, so programmers are kept busy back to back. The job output (progress lines included) is streamed to the client.
+ * A job request is made of NUL-terminated strings : the client working directory, the requested serial port ("-" for any programmer), then the command line arguments. The client closes its side of the connection once the request is sent, a request that is cut or not received in time is rejected.
+ * The daemon answers with frames made of a type byte, a 16-bit little endian payload size and the payload : output frames carry the job output as is (it can contain any byte), the last frame carries the job exit status byte.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_DAEMON_H
+#define H_DAEMON_H
+
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** Submit the job to the first idle programmer. */
+#define DAEMON_ANY_SERIAL_PORT "-"
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** Execute a job in the child process. The job output goes to the standard output.
+ * @param Pointer_UART The already opened serial port of the programmer the job runs on.
+ * @param String_Serial_Port_Name The serial port name.
+ * @param argc The command line arguments count.
+ * @param argv The command line arguments, the first one being the program name.
+ * @return The job exit status.
+ */
+typedef int (*TDaemonJobFunction)(TUART *Pointer_UART, char *String_Serial_Port_Name, int argc, char *argv[]);
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Open the serial ports and execute the received jobs until the daemon is interrupted (the running jobs are completed first).
+ * @param String_Socket_File_Name The Unix domain socket to create.
+ * @param String_Serial_Port_Names The serial ports the programmers are connected to.
+ * @param Ports_Count How many serial ports are provided.
+ * @param Job_Function The function executing a job.
+ * @return 0 if the daemon terminated normally, -1 if it could not start (an error message is displayed).
+ */
+int DaemonRun(char *String_Socket_File_Name, char *String_Serial_Port_Names[], int Ports_Count, TDaemonJobFunction Job_Function);
+
+/** Send a job to a daemon and display its output until it terminates.
+ * @param String_Socket_File_Name The daemon Unix domain socket.
+ * @param String_Serial_Port_Name The programmer to run the job on, or DAEMON_ANY_SERIAL_PORT.
+ * @param argc The job command line arguments count.
+ * @param argv The job command line arguments, the first one being the program name.
+ * @return The job exit status, or EXIT_FAILURE if the daemon could not be reached (an error message is displayed).
+ */
+int DaemonSubmitJob(char *String_Socket_File_Name, char *String_Serial_Port_Name, int argc, char *argv[]);
+
+#endif
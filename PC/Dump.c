@@ -0,0 +1,311 @@
+/** @file Dump.c
+ * @see Dump.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "Dump.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+
+	/** Tell that the SSSE3 implementation is built. */
+	#define DUMP_IS_SSSE3_AVAILABLE
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The size of the buffer the lines are built in before being written to the file. */
+#define DUMP_OUTPUT_BUFFER_SIZE 65536
+
+/** The longest line : "0x" and the 8-digit address, " - ", each byte as two digits and a space (1-byte words), the ASCII column between '|' and the new line character. */
+#define DUMP_MAXIMUM_LINE_LENGTH (13 + DUMP_MAXIMUM_LINE_SIZE * 3 + DUMP_MAXIMUM_LINE_SIZE + 3)
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** Convert bytes to hexadecimal digits.
+ * @param Pointer_Bytes The bytes to convert.
+ * @param Size How many bytes to convert.
+ * @param Pointer_Digits On output, contain two uppercase digits per byte, the most significant one first (the buffer must have room for one more character).
+ */
+typedef void (*TDumpEncodeFunction)(const unsigned char *Pointer_Bytes, unsigned int Size, char *Pointer_Digits);
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The two digits of each byte value. */
+static char Dump_Digits_Table[256][2];
+
+/** The implementation in use. */
+static TDumpImplementation Dump_Implementation;
+/** The function of the implementation in use. */
+static TDumpEncodeFunction Dump_Encode_Function;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Convert bytes to hexadecimal digits with the C library.
+ * @see TDumpEncodeFunction for the parameters description.
+ */
+static void DumpEncodeSnprintf(const unsigned char *Pointer_Bytes, unsigned int Size, char *Pointer_Digits)
+{
+	while (Size > 0)
+	{
+		snprintf(Pointer_Digits, 3, "%02X", *Pointer_Bytes); // The terminating character is overwritten by the next byte digits
+		Pointer_Bytes++;
+		Pointer_Digits += 2;
+		Size--;
+	}
+}
+
+/** Convert bytes to hexadecimal digits with the digits table.
+ * @see TDumpEncodeFunction for the parameters description.
+ */
+static void DumpEncodeTable(const unsigned char *Pointer_Bytes, unsigned int Size, char *Pointer_Digits)
+{
+	while (Size > 0)
+	{
+		memcpy(Pointer_Digits, Dump_Digits_Table[*Pointer_Bytes], 2);
+		Pointer_Bytes++;
+		Pointer_Digits += 2;
+		Size--;
+	}
+}
+
+#ifdef DUMP_IS_SSSE3_AVAILABLE
+/** Convert 16 bytes at a time to hexadecimal digits : each nibble selects its digit in a 16-character register with PSHUFB, then the high and low nibble digits are interleaved.
+ * @see TDumpEncodeFunction for the parameters description.
+ */
+__attribute__((target("ssse3"))) static void DumpEncodeSSSE3(const unsigned char *Pointer_Bytes, unsigned int Size, char *Pointer_Digits)
+{
+	__m128i Digits, Nibble_Mask, Bytes, High_Nibbles, Low_Nibbles;
+
+	Digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+	Nibble_Mask = _mm_set1_epi8(0x0F);
+
+	while (Size >= 16)
+	{
+		Bytes = _mm_loadu_si128((const __m128i *) Pointer_Bytes);
+		High_Nibbles = _mm_shuffle_epi8(Digits, _mm_and_si128(_mm_srli_epi16(Bytes, 4), Nibble_Mask));
+		Low_Nibbles = _mm_shuffle_epi8(Digits, _mm_and_si128(Bytes, Nibble_Mask));
+		_mm_storeu_si128((__m128i *) Pointer_Digits, _mm_unpacklo_epi8(High_Nibbles, Low_Nibbles));
+		_mm_storeu_si128((__m128i *) &Pointer_Digits[16], _mm_unpackhi_epi8(High_Nibbles, Low_Nibbles));
+		Pointer_Bytes += 16;
+		Pointer_Digits += 32;
+		Size -= 16;
+	}
+
+	DumpEncodeTable(Pointer_Bytes, Size, Pointer_Digits);
+}
+#endif
+
+/** Compute the digits table and select the fastest implementation when the program starts. */
+__attribute__((constructor)) static void DumpInitialize(void)
+{
+	static const char Digits[] = "0123456789ABCDEF";
+	int i;
+
+	for (i = 0; i < 256; i++)
+	{
+		Dump_Digits_Table[i][0] = Digits[i >> 4];
+		Dump_Digits_Table[i][1] = Digits[i & 0x0F];
+	}
+
+	if (DumpSelectImplementation(DUMP_IMPLEMENTATION_SSSE3) != 0) DumpSelectImplementation(DUMP_IMPLEMENTATION_TABLE);
+}
+
+/** Build a dump line.
+ * @param Pointer_Format The layout to use.
+ * @param Address The address of the line first byte.
+ * @param Pointer_Data The line data.
+ * @param Size The line data size in bytes (a multiple of the word size).
+ * @param Pointer_Line On output, contain the line (no more than DUMP_MAXIMUM_LINE_LENGTH characters, not terminated).
+ * @return The line length.
+ */
+static unsigned int DumpBuildLine(const TDumpFormat *Pointer_Format, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size, char *Pointer_Line)
+{
+	unsigned char Address_Bytes[4], Ordered_Bytes[DUMP_MAXIMUM_LINE_SIZE];
+	const unsigned char *Pointer_Ordered_Bytes;
+	char Digits[DUMP_MAXIMUM_LINE_SIZE * 2 + 1], *Pointer_Character = Pointer_Line;
+	unsigned int i, j, Word_Digits_Count;
+
+	// Display the address
+	Address_Bytes[0] = Address >> 24;
+	Address_Bytes[1] = Address >> 16;
+	Address_Bytes[2] = Address >> 8;
+	Address_Bytes[3] = Address;
+	*Pointer_Character++ = '0';
+	*Pointer_Character++ = 'x';
+	DumpEncodeTable(Address_Bytes, sizeof(Address_Bytes), Pointer_Character);
+	Pointer_Character += 8;
+	memcpy(Pointer_Character, " - ", 3);
+	Pointer_Character += 3;
+
+	// Put the most significant byte of each word first, so the digits of the whole line are computed at once
+	if (Pointer_Format->Is_Big_Endian || (Pointer_Format->Word_Size == 1)) Pointer_Ordered_Bytes = Pointer_Data;
+	else
+	{
+		for (i = 0; i < Size; i += Pointer_Format->Word_Size)
+		{
+			for (j = 0; j < Pointer_Format->Word_Size; j++) Ordered_Bytes[i + j] = Pointer_Data[i + Pointer_Format->Word_Size - 1 - j];
+		}
+		Pointer_Ordered_Bytes = Ordered_Bytes;
+	}
+	Dump_Encode_Function(Pointer_Ordered_Bytes, Size, Digits);
+
+	// Separate the words
+	Word_Digits_Count = Pointer_Format->Word_Size * 2;
+	for (i = 0; i < Size * 2; i += Word_Digits_Count)
+	{
+		memcpy(Pointer_Character, &Digits[i], Word_Digits_Count);
+		Pointer_Character += Word_Digits_Count;
+		*Pointer_Character++ = ' ';
+	}
+
+	if (Pointer_Format->Is_ASCII_Column_Displayed)
+	{
+		// Align the column of an incomplete last line with the previous lines one
+		i = (Pointer_Format->Words_Per_Line - Size / Pointer_Format->Word_Size) * (Word_Digits_Count + 1);
+		memset(Pointer_Character, ' ', i);
+		Pointer_Character += i;
+
+		*Pointer_Character++ = '|';
+		for (i = 0; i < Size; i++)
+		{
+			if ((Pointer_Data[i] >= 0x20) && (Pointer_Data[i] < 0x7F)) *Pointer_Character++ = Pointer_Data[i];
+			else *Pointer_Character++ = '.';
+		}
+		*Pointer_Character++ = '|';
+	}
+	*Pointer_Character++ = '\n';
+
+	return Pointer_Character - Pointer_Line;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+void DumpGetDefaultFormat(TDumpFormat *Pointer_Format)
+{
+	Pointer_Format->Word_Size = 4;
+	Pointer_Format->Is_Big_Endian = 0;
+	Pointer_Format->Words_Per_Line = 4;
+	Pointer_Format->Is_ASCII_Column_Displayed = 0;
+}
+
+int DumpParseFormat(TDumpFormat *Pointer_Format, const char *String_Format)
+{
+	const char *Pointer_Character;
+	char *Pointer_End;
+
+	DumpGetDefaultFormat(Pointer_Format);
+
+	// Word size
+	Pointer_Format->Word_Size = strtoul(String_Format, &Pointer_End, 10);
+	if ((Pointer_End == String_Format) || (*Pointer_End != ',')) goto Invalid_Format;
+	if ((Pointer_Format->Word_Size != 1) && (Pointer_Format->Word_Size != 2) && (Pointer_Format->Word_Size != 4) && (Pointer_Format->Word_Size != 8)) goto Invalid_Format;
+	Pointer_Character = Pointer_End + 1;
+
+	// Endianness
+	if (strncmp(Pointer_Character, "little,", 7) == 0) Pointer_Character += 7;
+	else if (strncmp(Pointer_Character, "big,", 4) == 0)
+	{
+		Pointer_Format->Is_Big_Endian = 1;
+		Pointer_Character += 4;
+	}
+	else goto Invalid_Format;
+
+	// Line width
+	Pointer_Format->Words_Per_Line = strtoul(Pointer_Character, &Pointer_End, 10);
+	if ((Pointer_End == Pointer_Character) || (Pointer_Format->Words_Per_Line == 0) || (Pointer_Format->Words_Per_Line * Pointer_Format->Word_Size > DUMP_MAXIMUM_LINE_SIZE)) goto Invalid_Format;
+
+	// ASCII column
+	if (strcmp(Pointer_End, ",ascii") == 0) Pointer_Format->Is_ASCII_Column_Displayed = 1;
+	else if (*Pointer_End != 0) goto Invalid_Format;
+
+	return 0;
+
+Invalid_Format:
+	printf("Error : invalid dump format '%s', it must be \"<Word_Size>,<little|big>,<Words_Per_Line>[,ascii]\" with a 1, 2, 4 or 8-byte word size and up to %d bytes per line.\n", String_Format, DUMP_MAXIMUM_LINE_SIZE);
+	return -1;
+}
+
+int DumpWrite(const TDumpFormat *Pointer_Format, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size, FILE *File)
+{
+	char Buffer[DUMP_OUTPUT_BUFFER_SIZE];
+	unsigned int Buffer_Length = 0, Line_Size, Line_Bytes_Count;
+
+	Line_Size = Pointer_Format->Word_Size * Pointer_Format->Words_Per_Line;
+	Size -= Size % Pointer_Format->Word_Size;
+
+	while (Size > 0)
+	{
+		// Write the buffer only when it can't hold another line, so the file receives big blocks
+		if (Buffer_Length > sizeof(Buffer) - DUMP_MAXIMUM_LINE_LENGTH)
+		{
+			if (fwrite(Buffer, 1, Buffer_Length, File) != Buffer_Length) return -1;
+			Buffer_Length = 0;
+		}
+
+		if (Size < Line_Size) Line_Bytes_Count = Size;
+		else Line_Bytes_Count = Line_Size;
+		Buffer_Length += DumpBuildLine(Pointer_Format, Address, Pointer_Data, Line_Bytes_Count, &Buffer[Buffer_Length]);
+
+		Address += Line_Bytes_Count;
+		Pointer_Data += Line_Bytes_Count;
+		Size -= Line_Bytes_Count;
+	}
+
+	if (fwrite(Buffer, 1, Buffer_Length, File) != Buffer_Length) return -1;
+	return 0;
+}
+
+int DumpSelectImplementation(TDumpImplementation Implementation)
+{
+	switch (Implementation)
+	{
+		case DUMP_IMPLEMENTATION_SNPRINTF:
+			Dump_Encode_Function = DumpEncodeSnprintf;
+			break;
+
+		case DUMP_IMPLEMENTATION_TABLE:
+			Dump_Encode_Function = DumpEncodeTable;
+			break;
+
+		case DUMP_IMPLEMENTATION_SSSE3:
+#ifdef DUMP_IS_SSSE3_AVAILABLE
+			if (!__builtin_cpu_supports("ssse3")) return -1;
+			Dump_Encode_Function = DumpEncodeSSSE3;
+			break;
+#else
+			return -1;
+#endif
+
+		default:
+			return -1;
+	}
+	Dump_Implementation = Implementation;
+	return 0;
+}
+
+TDumpImplementation DumpGetImplementation(void)
+{
+	return Dump_Implementation;
+}
+
+const char *DumpGetImplementationName(TDumpImplementation Implementation)
+{
+	switch (Implementation)
+	{
+		case DUMP_IMPLEMENTATION_SNPRINTF:
+			return "snprintf";
+		case DUMP_IMPLEMENTATION_TABLE:
+			return "table";
+		case DUMP_IMPLEMENTATION_SSSE3:
+			return "ssse3";
+		default:
+			return "unknown";
+	}
+}
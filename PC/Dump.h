@@ -0,0 +1,80 @@
+/** @file Dump.h
+ * Format binary data as an hexadecimal dump : an address, the data words and an optional ASCII column on each line.
+ * The lines are built in a large buffer written to the output file at once, and the hexadecimal digits are computed by the fastest encoder the processor supports : SSSE3 byte shuffles on x86 processors providing them, a lookup table otherwise.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_DUMP_H
+#define H_DUMP_H
+
+#include <stdio.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The biggest line width in bytes. */
+#define DUMP_MAXIMUM_LINE_SIZE 256
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** All ways to compute the hexadecimal digits, from the slowest to the fastest. */
+typedef enum
+{
+	DUMP_IMPLEMENTATION_SNPRINTF, //!< Format each byte with snprintf(), this is the reference implementation.
+	DUMP_IMPLEMENTATION_TABLE, //!< Copy the two digits of each byte from a 256-entry table.
+	DUMP_IMPLEMENTATION_SSSE3, //!< Convert 16 bytes at a time with the x86 PSHUFB instruction.
+	DUMP_IMPLEMENTATIONS_COUNT
+} TDumpImplementation;
+
+/** How the data is laid out. */
+typedef struct
+{
+	unsigned int Word_Size; //!< How many bytes are displayed as a single number (1, 2, 4 or 8).
+	int Is_Big_Endian; //!< Set to 1 if the first byte of a word is the most significant one, 0 if it is the least significant one.
+	unsigned int Words_Per_Line; //!< How many words are displayed on each line.
+	int Is_ASCII_Column_Displayed; //!< Set to 1 to display the line bytes as characters at the end of the line.
+} TDumpFormat;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Get the default format : four 4-byte little endian words per line (the ARM instructions layout), without ASCII column.
+ * @param Pointer_Format On output, contain the default format.
+ */
+void DumpGetDefaultFormat(TDumpFormat *Pointer_Format);
+
+/** Build a format from its textual description "<Word_Size>,<little|big>,<Words_Per_Line>[,ascii]" (for instance "1,little,16,ascii").
+ * @param Pointer_Format On output, contain the format.
+ * @param String_Format The description.
+ * @return 0 if the description is valid, -1 if not (an error message is displayed).
+ */
+int DumpParseFormat(TDumpFormat *Pointer_Format, const char *String_Format);
+
+/** Dump a buffer.
+ * @param Pointer_Format The layout to use.
+ * @param Address The address of the first byte, displayed at the beginning of each line.
+ * @param Pointer_Data The data to display.
+ * @param Size The data size in bytes (the last word is not displayed if it is not complete).
+ * @param File Where to write the dump.
+ * @return 0 if the dump was written, -1 if the file could not be written.
+ */
+int DumpWrite(const TDumpFormat *Pointer_Format, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size, FILE *File);
+
+/** Choose how the next dumps are computed (the program must not dump from other threads meanwhile).
+ * @param Implementation The implementation to use.
+ * @return 0 if the implementation was selected, -1 if the processor does not support it.
+ */
+int DumpSelectImplementation(TDumpImplementation Implementation);
+
+/** Tell how the dumps are computed.
+ * @return The implementation in use.
+ */
+TDumpImplementation DumpGetImplementation(void);
+
+/** Get an implementation name.
+ * @param Implementation The implementation.
+ * @return A static string.
+ */
+const char *DumpGetImplementationName(TDumpImplementation Implementation);
+
+#endif
@@ -0,0 +1,444 @@
+/** @file Gang.c
+ * @see Gang.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Gang.h"
+#include "Image.h"
+#include "Metrics.h"
+#include "Protocol.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many milliseconds to wait between two progress displays. */
+#define GANG_PROGRESS_DISPLAY_PERIOD 500
+
+/** How many milliseconds the event loop can sleep, so that retransmission timeouts are handled soon enough. */
+#define GANG_EVENT_LOOP_PERIOD 100
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A programmer driven by the gang engine. */
+typedef struct
+{
+	char *String_Serial_Port_Name; //!< The serial port the programmer is connected to.
+	TUART UART; //!< The opened serial port.
+	int Is_Serial_Port_Opened; //!< Tell whether the serial port must be closed when the programmer terminates.
+	TProtocolTransfer *Pointer_Transfer; //!< The write command and its data frames.
+	unsigned char Next_Command_Sequence; //!< The serial link next command sequence number.
+	int Is_Output_Watched; //!< Tell whether the event loop is waiting for the serial port to become writable.
+	unsigned int Extent_Index; //!< The image extent being written.
+	unsigned int Written_Bytes_Count; //!< How many bytes of the previous extents were written.
+	unsigned int Retransmitted_Frames_Count; //!< How many frames of the previous extents were sent again.
+	TMetrics Metrics; //!< Where the programmer time goes.
+} TGangProgrammer;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The image to write, shared by all programmers. */
+static TImage Image;
+/** Tell whether the image data is the mapped file itself (binary file) or was decoded from the file (other formats). */
+static int Is_Image_Mapped;
+/** The only extent of a binary file image. */
+static TImageExtent Binary_Image_Extent;
+
+/** The event loop instance. */
+static int File_Descriptor_Epoll;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Stop driving a programmer and release its serial port.
+ * @param Pointer_Programmer The programmer.
+ */
+static void GangTerminateProgrammer(TGangProgrammer *Pointer_Programmer)
+{
+	if (!Pointer_Programmer->Is_Serial_Port_Opened) return;
+
+	epoll_ctl(File_Descriptor_Epoll, EPOLL_CTL_DEL, Pointer_Programmer->UART.File_Descriptor, NULL);
+	MetricsAddUARTStatistics(&Pointer_Programmer->Metrics, &Pointer_Programmer->UART);
+	UARTClose(&Pointer_Programmer->UART);
+	Pointer_Programmer->Is_Serial_Port_Opened = 0;
+}
+
+/** Tell the event loop whether the programmer serial port must be watched for writability or not.
+ * @param Pointer_Programmer The programmer.
+ * @param Is_Output_Watched Set to 1 to be notified when the serial port can accept more data, set to 0 to only be notified about received data.
+ */
+static void GangWatchOutput(TGangProgrammer *Pointer_Programmer, int Is_Output_Watched)
+{
+	struct epoll_event Event;
+
+	if (Pointer_Programmer->Is_Output_Watched == Is_Output_Watched) return;
+
+	Event.events = EPOLLIN;
+	if (Is_Output_Watched) Event.events |= EPOLLOUT;
+	Event.data.ptr = Pointer_Programmer;
+	epoll_ctl(File_Descriptor_Epoll, EPOLL_CTL_MOD, Pointer_Programmer->UART.File_Descriptor, &Event);
+	Pointer_Programmer->Is_Output_Watched = Is_Output_Watched;
+}
+
+/** Queue the write command of the programmer current extent.
+ * @param Pointer_Programmer The programmer.
+ */
+static void GangStartExtent(TGangProgrammer *Pointer_Programmer)
+{
+	TImageExtent *Pointer_Extent;
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size;
+
+	Pointer_Extent = &Image.Pointer_Extents[Pointer_Programmer->Extent_Index];
+	Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_WRITE_FLASH, Pointer_Extent->Address, Pointer_Extent->Size);
+
+	// The image is only read when the data goes to the programmer
+	ProtocolInitializeTransfer(Pointer_Programmer->Pointer_Transfer, &Pointer_Programmer->Next_Command_Sequence, Command, Command_Size, ProtocolGetWriteCommandTimeout(Pointer_Extent->Size), PROTOCOL_DIRECTION_TO_PROGRAMMER, &Image.Pointer_Data[Pointer_Extent->Offset], Pointer_Extent->Size);
+}
+
+/** Send as many queued frame bytes as the serial port can accept without blocking, then go on with the next extent or release the programmer if its transfer is terminated.
+ * @param Pointer_Programmer The programmer.
+ */
+static void GangSendPendingData(TGangProgrammer *Pointer_Programmer)
+{
+	unsigned char *Pointer_Output;
+	unsigned int Pending_Bytes_Count;
+	int Written_Bytes_Count;
+
+	Pending_Bytes_Count = ProtocolGetPendingOutput(Pointer_Programmer->Pointer_Transfer, &Pointer_Output);
+	if (Pending_Bytes_Count > 0)
+	{
+		Written_Bytes_Count = UARTWriteBuffer(&Pointer_Programmer->UART, Pointer_Output, Pending_Bytes_Count);
+		if (Written_Bytes_Count < 0) ProtocolAbortTransfer(Pointer_Programmer->Pointer_Transfer, "could not send data to the serial port");
+		else
+		{
+			ProtocolConsumeOutput(Pointer_Programmer->Pointer_Transfer, Written_Bytes_Count);
+			Pending_Bytes_Count -= Written_Bytes_Count;
+		}
+	}
+
+	if (ProtocolIsTransferTerminated(Pointer_Programmer->Pointer_Transfer))
+	{
+		if ((Pointer_Programmer->Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) && (Pointer_Programmer->Extent_Index + 1 < Image.Extents_Count))
+		{
+			Pointer_Programmer->Written_Bytes_Count += Pointer_Programmer->Pointer_Transfer->Transferred_Bytes_Count;
+			Pointer_Programmer->Retransmitted_Frames_Count += Pointer_Programmer->Pointer_Transfer->Retransmitted_Frames_Count;
+			MetricsAddTransfer(&Pointer_Programmer->Metrics, Pointer_Programmer->Pointer_Transfer);
+			Pointer_Programmer->Extent_Index++;
+			GangStartExtent(Pointer_Programmer);
+			GangWatchOutput(Pointer_Programmer, 1);
+			return;
+		}
+		GangTerminateProgrammer(Pointer_Programmer);
+		return;
+	}
+	GangWatchOutput(Pointer_Programmer, Pending_Bytes_Count > 0);
+}
+
+/** Handle the bytes sent by a programmer.
+ * @param Pointer_Programmer The programmer.
+ */
+static void GangReceiveData(TGangProgrammer *Pointer_Programmer)
+{
+	unsigned char Buffer[4096];
+	int Read_Bytes_Count;
+
+	Read_Bytes_Count = UARTReadBuffer(&Pointer_Programmer->UART, Buffer, sizeof(Buffer));
+	if (Read_Bytes_Count < 0) ProtocolAbortTransfer(Pointer_Programmer->Pointer_Transfer, "the serial port was disconnected");
+	else ProtocolProcessReceivedBytes(Pointer_Programmer->Pointer_Transfer, Buffer, Read_Bytes_Count);
+
+	// Send the frames the received ones triggered
+	GangSendPendingData(Pointer_Programmer);
+}
+
+/** Tell whether a programmer is still being driven.
+ * @param Pointer_Programmer The programmer.
+ * @return 1 if the programmer transfer is still running, 0 if it terminated.
+ */
+static int GangIsProgrammerRunning(TGangProgrammer *Pointer_Programmer)
+{
+	return Pointer_Programmer->Is_Serial_Port_Opened;
+}
+
+/** Display all programmers progress on a single line.
+ * @param Pointer_Programmers The programmers.
+ * @param Programmers_Count How many programmers are driven.
+ */
+static void GangDisplayProgress(TGangProgrammer *Pointer_Programmers, int Programmers_Count)
+{
+	int i;
+	TProtocolTransfer *Pointer_Transfer;
+
+	for (i = 0; i < Programmers_Count; i++)
+	{
+		Pointer_Transfer = Pointer_Programmers[i].Pointer_Transfer;
+		switch (Pointer_Transfer->State)
+		{
+			case PROTOCOL_TRANSFER_STATE_WAIT_COMMAND_ACKNOWLEDGE:
+				printf("%s : erasing  ", Pointer_Programmers[i].String_Serial_Port_Name);
+				break;
+
+			case PROTOCOL_TRANSFER_STATE_TRANSFER_DATA:
+				printf("%s : %3u%%  ", Pointer_Programmers[i].String_Serial_Port_Name, (unsigned int) ((unsigned long long) (Pointer_Programmers[i].Written_Bytes_Count + Pointer_Transfer->Transferred_Bytes_Count) * 100 / Image.Size));
+				break;
+
+			case PROTOCOL_TRANSFER_STATE_SUCCESS:
+				printf("%s : done  ", Pointer_Programmers[i].String_Serial_Port_Name);
+				break;
+
+			case PROTOCOL_TRANSFER_STATE_FAILURE:
+				printf("%s : failed  ", Pointer_Programmers[i].String_Serial_Port_Name);
+				break;
+		}
+	}
+	printf("\r");
+	fflush(stdout);
+}
+
+/** Ask again for the frames that did not come in time.
+ * @param Pointer_Programmers The programmers.
+ * @param Programmers_Count How many programmers are driven.
+ */
+static void GangCheckTimeouts(TGangProgrammer *Pointer_Programmers, int Programmers_Count)
+{
+	int i;
+
+	for (i = 0; i < Programmers_Count; i++)
+	{
+		if (!GangIsProgrammerRunning(&Pointer_Programmers[i])) continue;
+
+		ProtocolProcessTimeout(Pointer_Programmers[i].Pointer_Transfer);
+		GangSendPendingData(&Pointer_Programmers[i]);
+	}
+}
+
+/** Load the image shared by all programmers. A binary file is mapped in memory and used as is, the other formats are decoded from the mapped file.
+ * @param String_File_Name The file to load.
+ * @param Address The address to write a binary file to, or the value to shift the other formats addresses by.
+ * @return 0 if the image was successfully loaded, -1 if an error occurred.
+ */
+static int GangLoadImage(char *String_File_Name, unsigned int Address)
+{
+	int File_Descriptor, Result;
+	struct stat File_Status;
+	unsigned char *Pointer_File_Data;
+	unsigned int File_Size;
+
+	File_Descriptor = open(String_File_Name, O_RDONLY);
+	if (File_Descriptor == -1) return -1;
+
+	if ((fstat(File_Descriptor, &File_Status) == -1) || (File_Status.st_size == 0))
+	{
+		close(File_Descriptor);
+		return -1;
+	}
+	File_Size = File_Status.st_size;
+
+	Pointer_File_Data = mmap(NULL, File_Size, PROT_READ, MAP_PRIVATE, File_Descriptor, 0);
+	close(File_Descriptor); // The mapping stays valid after the file is closed
+	if (Pointer_File_Data == MAP_FAILED) return -1;
+
+	if (ImageGetFormat(Pointer_File_Data, File_Size) == IMAGE_FORMAT_BINARY)
+	{
+		// The image is sent sequentially
+		madvise(Pointer_File_Data, File_Size, MADV_SEQUENTIAL);
+
+		Binary_Image_Extent.Address = Address;
+		Binary_Image_Extent.Offset = 0;
+		Binary_Image_Extent.Size = File_Size;
+		Image.Format = IMAGE_FORMAT_BINARY;
+		Image.Pointer_Data = Pointer_File_Data;
+		Image.Size = File_Size;
+		Image.Pointer_Extents = &Binary_Image_Extent;
+		Image.Extents_Count = 1;
+		Is_Image_Mapped = 1;
+		return 0;
+	}
+
+	Result = ImageParse(&Image, Pointer_File_Data, File_Size, Address);
+	munmap(Pointer_File_Data, File_Size);
+	Is_Image_Mapped = 0;
+	return Result;
+}
+
+/** Release the image loaded by GangLoadImage(). */
+static void GangFreeImage(void)
+{
+	if (Is_Image_Mapped) munmap(Image.Pointer_Data, Image.Size);
+	else ImageFree(&Image);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int GangWriteFlash(char *String_Serial_Port_Names[], int Ports_Count, unsigned int Address, char *String_File_Name, char *String_Metrics_File_Name)
+{
+	TGangProgrammer *Pointer_Programmers, *Pointer_Programmer;
+	TProtocolTransfer *Pointer_Transfer;
+	TMetrics *Pointer_Metrics;
+	struct epoll_event Event, Events[32];
+	int i, Events_Count, Running_Programmers_Count, Failed_Programmers_Count = 0;
+	unsigned long long Start_Time, Last_Display_Time = 0, Load_Start_Time, Load_Time;
+
+	// Load the image once for all programmers
+	Load_Start_Time = ProtocolGetPreciseTime();
+	if (GangLoadImage(String_File_Name, Address) != 0)
+	{
+		printf("Error : could not load the file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	Load_Time = ProtocolGetPreciseTime() - Load_Start_Time;
+
+	File_Descriptor_Epoll = epoll_create1(0);
+	if (File_Descriptor_Epoll == -1)
+	{
+		printf("Error : could not create the event loop (%s).\n", strerror(errno));
+		GangFreeImage();
+		return -1;
+	}
+
+	Pointer_Programmers = calloc(Ports_Count, sizeof(TGangProgrammer));
+	if (Pointer_Programmers == NULL)
+	{
+		printf("Error : could not allocate the programmers.\n");
+		close(File_Descriptor_Epoll);
+		GangFreeImage();
+		return -1;
+	}
+
+	// The transfers embed their frame buffers, they are too large to be allocated with the programmers array on small systems (allocate them all before any serial port is opened, so nothing has to be closed on failure)
+	for (i = 0; i < Ports_Count; i++)
+	{
+		Pointer_Programmers[i].Pointer_Transfer = malloc(sizeof(TProtocolTransfer));
+		Pointer_Programmers[i].Next_Command_Sequence = ProtocolGetInitialCommandSequence();
+		if (Pointer_Programmers[i].Pointer_Transfer == NULL)
+		{
+			printf("Error : could not allocate the programmers.\n");
+			for (i = 0; i < Ports_Count; i++) free(Pointer_Programmers[i].Pointer_Transfer); // The programmers array is zeroed, so the transfers that were not allocated are NULL
+			free(Pointer_Programmers);
+			close(File_Descriptor_Epoll);
+			GangFreeImage();
+			return -1;
+		}
+	}
+
+	// Open all serial ports and queue the write command
+	for (i = 0; i < Ports_Count; i++)
+	{
+		Pointer_Programmer = &Pointer_Programmers[i];
+		Pointer_Programmer->String_Serial_Port_Name = String_Serial_Port_Names[i];
+		MetricsInitialize(&Pointer_Programmer->Metrics, String_Serial_Port_Names[i]);
+		MetricsAddPhase(&Pointer_Programmer->Metrics, METRICS_PHASE_HOST_IO, Load_Time, Image.Size); // All programmers waited for the image
+		GangStartExtent(Pointer_Programmer);
+
+		if (UARTOpen(&Pointer_Programmer->UART, String_Serial_Port_Names[i]) == 0)
+		{
+			ProtocolAbortTransfer(Pointer_Programmer->Pointer_Transfer, "could not open the serial port");
+			continue;
+		}
+		Pointer_Programmer->Is_Serial_Port_Opened = 1;
+
+		// Start with output watching enabled to send the command frame as soon as possible
+		Event.events = EPOLLIN | EPOLLOUT;
+		Event.data.ptr = Pointer_Programmer;
+		epoll_ctl(File_Descriptor_Epoll, EPOLL_CTL_ADD, Pointer_Programmer->UART.File_Descriptor, &Event);
+		Pointer_Programmer->Is_Output_Watched = 1;
+	}
+
+	printf("Writing %u bytes in %u extents to %d programmers...\n", Image.Size, Image.Extents_Count, Ports_Count);
+	Start_Time = ProtocolGetTime();
+
+	// Drive all programmers until they all terminated
+	while (1)
+	{
+		Running_Programmers_Count = 0;
+		for (i = 0; i < Ports_Count; i++)
+		{
+			if (GangIsProgrammerRunning(&Pointer_Programmers[i])) Running_Programmers_Count++;
+		}
+		if (Running_Programmers_Count == 0) break;
+
+		Events_Count = epoll_wait(File_Descriptor_Epoll, Events, sizeof(Events) / sizeof(Events[0]), GANG_EVENT_LOOP_PERIOD);
+		if ((Events_Count < 0) && (errno != EINTR))
+		{
+			printf("Error : the event loop failed (%s).\n", strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < Events_Count; i++)
+		{
+			Pointer_Programmer = Events[i].data.ptr;
+			if (!GangIsProgrammerRunning(Pointer_Programmer)) continue; // The programmer may have been terminated by a previous event of the same batch
+
+			if (Events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) GangReceiveData(Pointer_Programmer);
+			else if (Events[i].events & EPOLLOUT) GangSendPendingData(Pointer_Programmer);
+		}
+
+		GangCheckTimeouts(Pointer_Programmers, Ports_Count);
+
+		if (ProtocolGetTime() - Last_Display_Time >= GANG_PROGRESS_DISPLAY_PERIOD)
+		{
+			GangDisplayProgress(Pointer_Programmers, Ports_Count);
+			Last_Display_Time = ProtocolGetTime();
+		}
+	}
+	GangDisplayProgress(Pointer_Programmers, Ports_Count);
+	printf("\n");
+
+	// Display the results
+	for (i = 0; i < Ports_Count; i++)
+	{
+		Pointer_Programmer = &Pointer_Programmers[i];
+
+		// Make sure the programmers that were still running when the event loop failed release their serial port
+		if (GangIsProgrammerRunning(Pointer_Programmer))
+		{
+			ProtocolAbortTransfer(Pointer_Programmer->Pointer_Transfer, "aborted");
+			GangTerminateProgrammer(Pointer_Programmer);
+		}
+
+		Pointer_Transfer = Pointer_Programmer->Pointer_Transfer;
+		Pointer_Programmer->Written_Bytes_Count += Pointer_Transfer->Transferred_Bytes_Count;
+		Pointer_Programmer->Retransmitted_Frames_Count += Pointer_Transfer->Retransmitted_Frames_Count;
+		MetricsAddTransfer(&Pointer_Programmer->Metrics, Pointer_Transfer);
+		if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) printf("%s : %u bytes written (%u frames sent again).\n", Pointer_Programmer->String_Serial_Port_Name, Pointer_Programmer->Written_Bytes_Count, Pointer_Programmer->Retransmitted_Frames_Count);
+		else
+		{
+			printf("%s : error, %s (%u/%u bytes written).\n", Pointer_Programmer->String_Serial_Port_Name, Pointer_Transfer->String_Error, Pointer_Programmer->Written_Bytes_Count, Image.Size);
+			Failed_Programmers_Count++;
+		}
+		free(Pointer_Programmer->Pointer_Transfer);
+	}
+	printf("%d/%d programmers succeeded in %llu ms.\n", Ports_Count - Failed_Programmers_Count, Ports_Count, ProtocolGetTime() - Start_Time);
+
+	// Gather all programmers metrics to report them together
+	if (String_Metrics_File_Name != NULL)
+	{
+		Pointer_Metrics = malloc(Ports_Count * sizeof(TMetrics));
+		if (Pointer_Metrics == NULL) printf("Error : could not allocate the metrics.\n");
+		else
+		{
+			for (i = 0; i < Ports_Count; i++) Pointer_Metrics[i] = Pointer_Programmers[i].Metrics;
+			MetricsDisplay(Pointer_Metrics, Ports_Count, ProtocolGetPreciseTime() - Load_Start_Time);
+			MetricsWriteJSON(String_Metrics_File_Name, "w", Pointer_Metrics, Ports_Count, ProtocolGetPreciseTime() - Load_Start_Time);
+			free(Pointer_Metrics);
+		}
+	}
+
+	free(Pointer_Programmers);
+	close(File_Descriptor_Epoll);
+	GangFreeImage();
+
+	if (Failed_Programmers_Count > 0) return -1;
+	return 0;
+}
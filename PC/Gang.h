@@ -0,0 +1,21 @@
+/** @file Gang.h
+ * Drive several programmers at the same time from a single process (gang programming). All serial ports are handled by a single event loop and share the same image (a binary file is memory-mapped).
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_GANG_H
+#define H_GANG_H
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Write the same file content to the flash of every specified programmer, all programmers being driven concurrently.
+ * @param String_Serial_Port_Names The serial ports the programmers are connected to.
+ * @param Ports_Count How many serial ports are provided.
+ * @param Address The address to start writing to (binary file) or the value to shift the file addresses by (other file formats).
+ * @param String_File_Name The path of the file containing the data to write.
+ * @param String_Metrics_File_Name The file to store each programmer metrics to (they are displayed too), or NULL to neither display nor store them.
+ * @return 0 if all programmers were successfully written, -1 if at least one of them failed.
+ */
+int GangWriteFlash(char *String_Serial_Port_Names[], int Ports_Count, unsigned int Address, char *String_File_Name, char *String_Metrics_File_Name);
+
+#endif
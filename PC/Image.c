@@ -0,0 +1,732 @@
+/** @file Image.c
+ * @see Image.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Image.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** A record can't contain more bytes (a byte count field can't exceed 255, plus the fields preceding it). */
+#define IMAGE_MAXIMUM_RECORD_SIZE 260
+
+/** How many decoded bytes are allocated at first, the buffer size is doubled each time it becomes full. */
+#define IMAGE_INITIAL_DATA_CAPACITY (64 * 1024)
+
+/** The ELF program header type of a loadable segment. */
+#define IMAGE_ELF_SEGMENT_TYPE_LOAD 1
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** Gather the data found in a file before extents are built. The data is stored in file order, each segment tells where a contiguous address range is located in the data. */
+typedef struct
+{
+	unsigned int Address_Shift; //!< The value added to all file addresses.
+	unsigned char *Pointer_Data; //!< All decoded data bytes.
+	unsigned int Data_Size; //!< How many bytes are decoded.
+	unsigned int Data_Capacity; //!< How many bytes the data buffer can contain.
+	TImageExtent *Pointer_Segments; //!< The contiguous address ranges, in file order.
+	unsigned int Segments_Count; //!< How many segments were found.
+	unsigned int Segments_Capacity; //!< How many segments the segments array can contain.
+} TImageParser;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Append data to the parser, extending the last segment if the data follows it.
+ * @param Pointer_Parser The parser.
+ * @param Address The data address found in the file.
+ * @param Pointer_Data The data.
+ * @param Size The data size in bytes.
+ * @return 0 if the data was added, -1 if an error occurred (an error message is displayed).
+ */
+static int ImageAddData(TImageParser *Pointer_Parser, unsigned long long Address, const unsigned char *Pointer_Data, unsigned int Size)
+{
+	unsigned char *Pointer_New_Data;
+	TImageExtent *Pointer_Segment;
+	unsigned int New_Capacity;
+
+	if (Size == 0) return 0;
+
+	// The protocol addresses are 32-bit wide
+	Address += Pointer_Parser->Address_Shift;
+	if (Address + Size > 0x100000000ULL)
+	{
+		printf("Error : the file contains data located beyond the 4 GB address space.\n");
+		return -1;
+	}
+
+	// Make room for the data
+	if (Pointer_Parser->Data_Size + Size > Pointer_Parser->Data_Capacity)
+	{
+		New_Capacity = Pointer_Parser->Data_Capacity;
+		if (New_Capacity == 0) New_Capacity = IMAGE_INITIAL_DATA_CAPACITY;
+		while (Pointer_Parser->Data_Size + Size > New_Capacity) New_Capacity *= 2;
+
+		Pointer_New_Data = realloc(Pointer_Parser->Pointer_Data, New_Capacity);
+		if (Pointer_New_Data == NULL)
+		{
+			printf("Error : could not allocate memory to store the file data.\n");
+			return -1;
+		}
+		Pointer_Parser->Pointer_Data = Pointer_New_Data;
+		Pointer_Parser->Data_Capacity = New_Capacity;
+	}
+	memcpy(&Pointer_Parser->Pointer_Data[Pointer_Parser->Data_Size], Pointer_Data, Size);
+
+	// Most records directly follow the previous one
+	if (Pointer_Parser->Segments_Count > 0)
+	{
+		Pointer_Segment = &Pointer_Parser->Pointer_Segments[Pointer_Parser->Segments_Count - 1];
+		if ((unsigned long long) Pointer_Segment->Address + Pointer_Segment->Size == Address)
+		{
+			Pointer_Segment->Size += Size;
+			Pointer_Parser->Data_Size += Size;
+			return 0;
+		}
+	}
+
+	// Start a new segment
+	if (Pointer_Parser->Segments_Count == Pointer_Parser->Segments_Capacity)
+	{
+		if (Pointer_Parser->Segments_Capacity == 0) New_Capacity = 64;
+		else New_Capacity = Pointer_Parser->Segments_Capacity * 2;
+
+		Pointer_Segment = realloc(Pointer_Parser->Pointer_Segments, New_Capacity * sizeof(TImageExtent));
+		if (Pointer_Segment == NULL)
+		{
+			printf("Error : could not allocate memory to store the file segments.\n");
+			return -1;
+		}
+		Pointer_Parser->Pointer_Segments = Pointer_Segment;
+		Pointer_Parser->Segments_Capacity = New_Capacity;
+	}
+	Pointer_Segment = &Pointer_Parser->Pointer_Segments[Pointer_Parser->Segments_Count];
+	Pointer_Segment->Address = Address;
+	Pointer_Segment->Offset = Pointer_Parser->Data_Size;
+	Pointer_Segment->Size = Size;
+	Pointer_Parser->Segments_Count++;
+	Pointer_Parser->Data_Size += Size;
+
+	return 0;
+}
+
+/** Convert a hexadecimal digit to its value.
+ * @param Character The digit.
+ * @return The digit value, or -1 if the character is not a hexadecimal digit.
+ */
+static inline int ImageGetDigitValue(unsigned char Character)
+{
+	if ((Character >= '0') && (Character <= '9')) return Character - '0';
+	Character |= 0x20; // Convert to lower case
+	if ((Character >= 'a') && (Character <= 'f')) return Character - 'a' + 10;
+	return -1;
+}
+
+/** Convert the hexadecimal characters of a record to bytes.
+ * @param Pointer_Characters The characters following the record start mark.
+ * @param Characters_Count How many characters to convert.
+ * @param Pointer_Bytes On output, contain the record bytes (must be IMAGE_MAXIMUM_RECORD_SIZE-byte large).
+ * @return How many bytes were decoded, or -1 if the characters are not a valid hexadecimal string.
+ */
+static int ImageDecodeRecord(const unsigned char *Pointer_Characters, unsigned int Characters_Count, unsigned char *Pointer_Bytes)
+{
+	unsigned int i;
+	int High_Digit, Low_Digit;
+
+	if ((Characters_Count % 2 != 0) || (Characters_Count / 2 > IMAGE_MAXIMUM_RECORD_SIZE)) return -1;
+
+	for (i = 0; i < Characters_Count; i += 2)
+	{
+		High_Digit = ImageGetDigitValue(Pointer_Characters[i]);
+		Low_Digit = ImageGetDigitValue(Pointer_Characters[i + 1]);
+		if ((High_Digit < 0) || (Low_Digit < 0)) return -1;
+		*Pointer_Bytes = (High_Digit << 4) | Low_Digit;
+		Pointer_Bytes++;
+	}
+	return Characters_Count / 2;
+}
+
+/** Find the next line of a text file.
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @param Pointer_Offset On input, contain the line beginning offset. On output, contain the following line beginning offset.
+ * @param Pointer_Length On output, contain the line length, trailing spaces and line terminators excluded.
+ * @return The line beginning.
+ */
+static const unsigned char *ImageGetLine(const unsigned char *Pointer_File_Data, unsigned int File_Size, unsigned int *Pointer_Offset, unsigned int *Pointer_Length)
+{
+	const unsigned char *Pointer_Line, *Pointer_End;
+	unsigned int Length;
+
+	Pointer_Line = &Pointer_File_Data[*Pointer_Offset];
+	Pointer_End = memchr(Pointer_Line, '\n', File_Size - *Pointer_Offset);
+	if (Pointer_End == NULL)
+	{
+		Length = File_Size - *Pointer_Offset;
+		*Pointer_Offset = File_Size;
+	}
+	else
+	{
+		Length = Pointer_End - Pointer_Line;
+		*Pointer_Offset += Length + 1;
+	}
+
+	// Handle Windows line terminators and trailing spaces
+	while ((Length > 0) && ((Pointer_Line[Length - 1] == '\r') || (Pointer_Line[Length - 1] == ' ') || (Pointer_Line[Length - 1] == '\t'))) Length--;
+
+	*Pointer_Length = Length;
+	return Pointer_Line;
+}
+
+/** Decode all records of an Intel HEX file.
+ * @param Pointer_Parser The parser.
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @return 0 if the file was successfully decoded, -1 if an error occurred (an error message is displayed).
+ */
+static int ImageParseIntelHex(TImageParser *Pointer_Parser, const unsigned char *Pointer_File_Data, unsigned int File_Size)
+{
+	const unsigned char *Pointer_Line;
+	unsigned char Bytes[IMAGE_MAXIMUM_RECORD_SIZE], Checksum;
+	unsigned int Offset = 0, Line_Number = 0, Length, Base_Address = 0, Address;
+	int Bytes_Count, i;
+
+	while (Offset < File_Size)
+	{
+		Pointer_Line = ImageGetLine(Pointer_File_Data, File_Size, &Offset, &Length);
+		Line_Number++;
+		if (Length == 0) continue;
+
+		// A record is made of a start code, a byte count, an address, a type, the data and a checksum
+		if (Pointer_Line[0] != ':') Bytes_Count = -1;
+		else Bytes_Count = ImageDecodeRecord(&Pointer_Line[1], Length - 1, Bytes);
+		if ((Bytes_Count < 5) || (Bytes_Count != Bytes[0] + 5))
+		{
+			printf("Error : malformed Intel HEX record at line %u.\n", Line_Number);
+			return -1;
+		}
+
+		// All record bytes, checksum included, must sum to zero
+		Checksum = 0;
+		for (i = 0; i < Bytes_Count; i++) Checksum += Bytes[i];
+		if (Checksum != 0)
+		{
+			printf("Error : bad Intel HEX record checksum at line %u.\n", Line_Number);
+			return -1;
+		}
+
+		Address = (Bytes[1] << 8) | Bytes[2];
+		switch (Bytes[3])
+		{
+			// Data
+			case 0x00:
+				if (ImageAddData(Pointer_Parser, (unsigned long long) Base_Address + Address, &Bytes[4], Bytes[0]) != 0) return -1;
+				break;
+
+			// End of file
+			case 0x01:
+				return 0;
+
+			// Extended segment address
+			case 0x02:
+				if (Bytes[0] != 2) goto Bad_Address_Record;
+				Base_Address = ((Bytes[4] << 8) | Bytes[5]) << 4;
+				break;
+
+			// Extended linear address
+			case 0x04:
+				if (Bytes[0] != 2) goto Bad_Address_Record;
+				Base_Address = (unsigned int) ((Bytes[4] << 8) | Bytes[5]) << 16;
+				break;
+
+			// Start segment address and start linear address are meaningless for a flash chip
+			case 0x03:
+			case 0x05:
+				break;
+
+			default:
+				printf("Error : unknown Intel HEX record type %02X at line %u.\n", Bytes[3], Line_Number);
+				return -1;
+		}
+	}
+	return 0;
+
+Bad_Address_Record:
+	printf("Error : malformed Intel HEX address record at line %u.\n", Line_Number);
+	return -1;
+}
+
+/** Decode all records of a Motorola S-record file.
+ * @param Pointer_Parser The parser.
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @return 0 if the file was successfully decoded, -1 if an error occurred (an error message is displayed).
+ */
+static int ImageParseMotorolaSRecord(TImageParser *Pointer_Parser, const unsigned char *Pointer_File_Data, unsigned int File_Size)
+{
+	const unsigned char *Pointer_Line;
+	unsigned char Bytes[IMAGE_MAXIMUM_RECORD_SIZE], Checksum;
+	unsigned int Offset = 0, Line_Number = 0, Length, Address, Address_Size;
+	int Bytes_Count, i;
+
+	while (Offset < File_Size)
+	{
+		Pointer_Line = ImageGetLine(Pointer_File_Data, File_Size, &Offset, &Length);
+		Line_Number++;
+		if (Length == 0) continue;
+
+		// A record is made of a start code, a type, a byte count, an address, the data and a checksum
+		if ((Length < 2) || (Pointer_Line[0] != 'S')) Bytes_Count = -1;
+		else Bytes_Count = ImageDecodeRecord(&Pointer_Line[2], Length - 2, Bytes);
+		if ((Bytes_Count < 3) || (Bytes_Count != Bytes[0] + 1))
+		{
+			printf("Error : malformed S-record at line %u.\n", Line_Number);
+			return -1;
+		}
+
+		// The checksum is the one's complement of the sum of all other bytes
+		Checksum = 0;
+		for (i = 0; i < Bytes_Count; i++) Checksum += Bytes[i];
+		if (Checksum != 0xFF)
+		{
+			printf("Error : bad S-record checksum at line %u.\n", Line_Number);
+			return -1;
+		}
+
+		switch (Pointer_Line[1])
+		{
+			// Data with a 16-bit, 24-bit or 32-bit address
+			case '1':
+			case '2':
+			case '3':
+				Address_Size = Pointer_Line[1] - '1' + 2;
+				if ((unsigned int) Bytes_Count < Address_Size + 2)
+				{
+					printf("Error : malformed S-record at line %u.\n", Line_Number);
+					return -1;
+				}
+				Address = 0;
+				for (i = 1; i <= (int) Address_Size; i++) Address = (Address << 8) | Bytes[i];
+				if (ImageAddData(Pointer_Parser, Address, &Bytes[Address_Size + 1], Bytes_Count - Address_Size - 2) != 0) return -1;
+				break;
+
+			// End of file
+			case '7':
+			case '8':
+			case '9':
+				return 0;
+
+			// Header and records count
+			case '0':
+			case '5':
+			case '6':
+				break;
+
+			default:
+				printf("Error : unknown S-record type S%c at line %u.\n", Pointer_Line[1], Line_Number);
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/** Read an ELF file field.
+ * @param Pointer_Field The field first byte.
+ * @param Size The field size in bytes.
+ * @param Is_Big_Endian Set to 1 if the file is big endian, set to 0 if it is little endian.
+ * @return The field value.
+ */
+static unsigned long long ImageReadELFField(const unsigned char *Pointer_Field, unsigned int Size, int Is_Big_Endian)
+{
+	unsigned long long Value = 0;
+	unsigned int i;
+
+	for (i = 0; i < Size; i++)
+	{
+		if (Is_Big_Endian) Value = (Value << 8) | Pointer_Field[i];
+		else Value |= (unsigned long long) Pointer_Field[i] << (8 * i);
+	}
+	return Value;
+}
+
+/** Extract the loadable segments of an ELF file. Each segment is written at its physical address.
+ * @param Pointer_Parser The parser.
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @return 0 if the file was successfully decoded, -1 if an error occurred (an error message is displayed).
+ */
+static int ImageParseELF(TImageParser *Pointer_Parser, const unsigned char *Pointer_File_Data, unsigned int File_Size)
+{
+	const unsigned char *Pointer_Program_Header;
+	unsigned long long Program_Headers_Offset, Segment_Offset, Segment_Size, Segment_Address;
+	unsigned int Program_Header_Size, Program_Headers_Count, i;
+	int Is_64_Bit, Is_Big_Endian;
+
+	// The file header layout depends on the file class
+	if (File_Size < 64)
+	{
+		printf("Error : the ELF file is truncated.\n");
+		return -1;
+	}
+	Is_64_Bit = (Pointer_File_Data[4] == 2);
+	Is_Big_Endian = (Pointer_File_Data[5] == 2);
+	if (Is_64_Bit)
+	{
+		Program_Headers_Offset = ImageReadELFField(&Pointer_File_Data[32], 8, Is_Big_Endian);
+		Program_Header_Size = ImageReadELFField(&Pointer_File_Data[54], 2, Is_Big_Endian);
+		Program_Headers_Count = ImageReadELFField(&Pointer_File_Data[56], 2, Is_Big_Endian);
+	}
+	else
+	{
+		Program_Headers_Offset = ImageReadELFField(&Pointer_File_Data[28], 4, Is_Big_Endian);
+		Program_Header_Size = ImageReadELFField(&Pointer_File_Data[42], 2, Is_Big_Endian);
+		Program_Headers_Count = ImageReadELFField(&Pointer_File_Data[44], 2, Is_Big_Endian);
+	}
+	if ((Program_Header_Size < (Is_64_Bit ? 56U : 32U)) || (Program_Headers_Offset + (unsigned long long) Program_Header_Size * Program_Headers_Count > File_Size))
+	{
+		printf("Error : the ELF file program headers are malformed.\n");
+		return -1;
+	}
+
+	for (i = 0; i < Program_Headers_Count; i++)
+	{
+		Pointer_Program_Header = &Pointer_File_Data[Program_Headers_Offset + i * Program_Header_Size];
+		if (ImageReadELFField(Pointer_Program_Header, 4, Is_Big_Endian) != IMAGE_ELF_SEGMENT_TYPE_LOAD) continue;
+
+		// The physical address is where the segment is stored, the virtual address is where it runs from
+		if (Is_64_Bit)
+		{
+			Segment_Offset = ImageReadELFField(&Pointer_Program_Header[8], 8, Is_Big_Endian);
+			Segment_Address = ImageReadELFField(&Pointer_Program_Header[24], 8, Is_Big_Endian);
+			Segment_Size = ImageReadELFField(&Pointer_Program_Header[32], 8, Is_Big_Endian);
+		}
+		else
+		{
+			Segment_Offset = ImageReadELFField(&Pointer_Program_Header[4], 4, Is_Big_Endian);
+			Segment_Address = ImageReadELFField(&Pointer_Program_Header[12], 4, Is_Big_Endian);
+			Segment_Size = ImageReadELFField(&Pointer_Program_Header[16], 4, Is_Big_Endian);
+		}
+
+		// Only the bytes stored in the file are written, the zero-initialized part of the segment is cleared at run time
+		if ((Segment_Offset > File_Size) || (Segment_Size > File_Size - Segment_Offset))
+		{
+			printf("Error : the ELF file segment %u is truncated.\n", i);
+			return -1;
+		}
+		if (Segment_Address >= 0x100000000ULL)
+		{
+			printf("Error : the ELF file segment %u is located beyond the 4 GB address space.\n", i);
+			return -1;
+		}
+		if (ImageAddData(Pointer_Parser, Segment_Address, &Pointer_File_Data[Segment_Offset], Segment_Size) != 0) return -1;
+	}
+	return 0;
+}
+
+/** Sort segments by increasing address.
+ * @param Pointer_Segment_1 The first segment.
+ * @param Pointer_Segment_2 The second segment.
+ * @return A negative value if the first segment comes first, a positive value if it comes last.
+ */
+static int ImageCompareSegments(const void *Pointer_Segment_1, const void *Pointer_Segment_2)
+{
+	unsigned int Address_1, Address_2;
+
+	Address_1 = ((const TImageExtent *) Pointer_Segment_1)->Address;
+	Address_2 = ((const TImageExtent *) Pointer_Segment_2)->Address;
+	if (Address_1 < Address_2) return -1;
+	if (Address_1 > Address_2) return 1;
+	return 0;
+}
+
+/** Gather the parsed segments into extents. Segments sharing a flash sector are merged and the bytes between them are set to the erased flash value, so a sector is erased only once.
+ * @param Pointer_Parser The parser.
+ * @param Pointer_Image On output, contain the extents and their data.
+ * @return 0 if the extents were built, -1 if an error occurred (an error message is displayed).
+ */
+static int ImageBuildExtents(TImageParser *Pointer_Parser, TImage *Pointer_Image)
+{
+	TImageExtent *Pointer_Segment, *Pointer_Extent = NULL;
+	unsigned long long Segment_End, Extent_End = 0;
+	unsigned int i;
+
+	qsort(Pointer_Parser->Pointer_Segments, Pointer_Parser->Segments_Count, sizeof(TImageExtent), ImageCompareSegments);
+
+	// There can't be more extents than segments
+	Pointer_Image->Pointer_Extents = malloc(Pointer_Parser->Segments_Count * sizeof(TImageExtent) + 1);
+	if (Pointer_Image->Pointer_Extents == NULL)
+	{
+		printf("Error : could not allocate memory to store the image extents.\n");
+		return -1;
+	}
+
+	// Compute the extents address ranges
+	for (i = 0; i < Pointer_Parser->Segments_Count; i++)
+	{
+		Pointer_Segment = &Pointer_Parser->Pointer_Segments[i];
+		Segment_End = (unsigned long long) Pointer_Segment->Address + Pointer_Segment->Size;
+
+		if ((Pointer_Extent != NULL) && (Pointer_Segment->Address < Extent_End))
+		{
+			printf("Error : the file contains several values for the address 0x%08X.\n", Pointer_Segment->Address);
+			return -1;
+		}
+
+		// Extend the current extent if the segment follows it or shares its last sector
+		if ((Pointer_Extent != NULL) && ((Pointer_Segment->Address == Extent_End) || (Pointer_Segment->Address / IMAGE_FLASH_SECTOR_SIZE == (Extent_End - 1) / IMAGE_FLASH_SECTOR_SIZE)))
+		{
+			Pointer_Extent->Size = Segment_End - Pointer_Extent->Address;
+		}
+		else
+		{
+			if (Pointer_Extent == NULL) Pointer_Extent = Pointer_Image->Pointer_Extents;
+			else Pointer_Extent++;
+			Pointer_Extent->Address = Pointer_Segment->Address;
+			Pointer_Extent->Offset = Pointer_Image->Size;
+			Pointer_Extent->Size = Pointer_Segment->Size;
+			Pointer_Image->Extents_Count++;
+		}
+		Pointer_Image->Size = Pointer_Extent->Offset + Pointer_Extent->Size;
+		Extent_End = Segment_End;
+	}
+
+	// The bytes not provided by the file are left erased
+	Pointer_Image->Pointer_Data = malloc(Pointer_Image->Size + 1);
+	if (Pointer_Image->Pointer_Data == NULL)
+	{
+		printf("Error : could not allocate memory to store the image data.\n");
+		return -1;
+	}
+	memset(Pointer_Image->Pointer_Data, 0xFF, Pointer_Image->Size);
+
+	// Copy each segment to its extent
+	Pointer_Extent = Pointer_Image->Pointer_Extents;
+	for (i = 0; i < Pointer_Parser->Segments_Count; i++)
+	{
+		Pointer_Segment = &Pointer_Parser->Pointer_Segments[i];
+		while (Pointer_Segment->Address - Pointer_Extent->Address >= Pointer_Extent->Size) Pointer_Extent++;
+		memcpy(&Pointer_Image->Pointer_Data[Pointer_Extent->Offset + Pointer_Segment->Address - Pointer_Extent->Address], &Pointer_Parser->Pointer_Data[Pointer_Segment->Offset], Pointer_Segment->Size);
+	}
+	return 0;
+}
+
+/** Make an image of a binary file.
+ * @param Pointer_Image The image to fill.
+ * @param Pointer_Data The file content, the image takes its ownership.
+ * @param Size The file size in bytes.
+ * @param Address The address to write the file content to.
+ * @return 0 if the image was built, -1 if the data does not fit in the address space (an error message is displayed).
+ */
+static int ImageSetBinaryData(TImage *Pointer_Image, unsigned char *Pointer_Data, unsigned int Size, unsigned int Address)
+{
+	if ((unsigned long long) Address + Size > 0x100000000ULL)
+	{
+		printf("Error : the file does not fit in the 4 GB address space.\n");
+		free(Pointer_Data);
+		return -1;
+	}
+
+	Pointer_Image->Pointer_Data = Pointer_Data;
+	Pointer_Image->Size = Size;
+	Pointer_Image->Pointer_Extents = malloc(sizeof(TImageExtent));
+	if (Pointer_Image->Pointer_Extents == NULL)
+	{
+		printf("Error : could not allocate memory to store the image extents.\n");
+		ImageFree(Pointer_Image);
+		return -1;
+	}
+
+	// An empty file has nothing to write
+	if (Size > 0)
+	{
+		Pointer_Image->Pointer_Extents[0].Address = Address;
+		Pointer_Image->Pointer_Extents[0].Offset = 0;
+		Pointer_Image->Pointer_Extents[0].Size = Size;
+		Pointer_Image->Extents_Count = 1;
+	}
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+TImageFormat ImageGetFormat(const unsigned char *Pointer_File_Data, unsigned int File_Size)
+{
+	unsigned int i;
+
+	if ((File_Size >= 4) && (memcmp(Pointer_File_Data, "\x7F" "ELF", 4) == 0)) return IMAGE_FORMAT_ELF;
+
+	// Text formats are recognized by their first record start mark, a binary file is very unlikely to be made of hexadecimal characters only
+	if ((File_Size < 2) || ((Pointer_File_Data[0] != ':') && ((Pointer_File_Data[0] != 'S') || (Pointer_File_Data[1] < '0') || (Pointer_File_Data[1] > '9')))) return IMAGE_FORMAT_BINARY;
+	for (i = 1; (i < File_Size) && (Pointer_File_Data[i] != '\r') && (Pointer_File_Data[i] != '\n'); i++)
+	{
+		if (ImageGetDigitValue(Pointer_File_Data[i]) < 0) return IMAGE_FORMAT_BINARY;
+	}
+
+	if (Pointer_File_Data[0] == ':') return IMAGE_FORMAT_INTEL_HEX;
+	return IMAGE_FORMAT_MOTOROLA_S_RECORD;
+}
+
+int ImageParse(TImage *Pointer_Image, const unsigned char *Pointer_File_Data, unsigned int File_Size, unsigned int Address)
+{
+	TImageParser Parser;
+	unsigned char *Pointer_Data;
+	int Result;
+
+	memset(Pointer_Image, 0, sizeof(TImage));
+	Pointer_Image->Format = ImageGetFormat(Pointer_File_Data, File_Size);
+
+	if (Pointer_Image->Format == IMAGE_FORMAT_BINARY)
+	{
+		Pointer_Data = malloc(File_Size + 1);
+		if (Pointer_Data == NULL)
+		{
+			printf("Error : could not allocate memory to store the image data.\n");
+			return -1;
+		}
+		memcpy(Pointer_Data, Pointer_File_Data, File_Size);
+		return ImageSetBinaryData(Pointer_Image, Pointer_Data, File_Size, Address);
+	}
+
+	memset(&Parser, 0, sizeof(Parser));
+	Parser.Address_Shift = Address;
+	switch (Pointer_Image->Format)
+	{
+		case IMAGE_FORMAT_INTEL_HEX:
+			Result = ImageParseIntelHex(&Parser, Pointer_File_Data, File_Size);
+			break;
+
+		case IMAGE_FORMAT_MOTOROLA_S_RECORD:
+			Result = ImageParseMotorolaSRecord(&Parser, Pointer_File_Data, File_Size);
+			break;
+
+		default:
+			Result = ImageParseELF(&Parser, Pointer_File_Data, File_Size);
+			break;
+	}
+
+	if ((Result == 0) && (Parser.Segments_Count == 0))
+	{
+		printf("Error : the file does not contain any data to write.\n");
+		Result = -1;
+	}
+	if (Result == 0) Result = ImageBuildExtents(&Parser, Pointer_Image);
+
+	free(Parser.Pointer_Data);
+	free(Parser.Pointer_Segments);
+	if (Result != 0) ImageFree(Pointer_Image);
+	return Result;
+}
+
+int ImageLoad(TImage *Pointer_Image, char *String_File_Name, unsigned int Address)
+{
+	FILE *File;
+	unsigned char *Pointer_File_Data;
+	long Size;
+	int Result;
+
+	// Load the whole file
+	File = fopen(String_File_Name, "rb");
+	if (File == NULL)
+	{
+		printf("Error : could not open the file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	if ((fseek(File, 0, SEEK_END) != 0) || ((Size = ftell(File)) < 0) || (Size > 0xFFFFFFFFL))
+	{
+		printf("Error : could not get the file '%s' size.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+	rewind(File);
+
+	Pointer_File_Data = malloc(Size + 1); // Make sure an empty file does not make malloc() return NULL
+	if (Pointer_File_Data == NULL)
+	{
+		printf("Error : could not allocate memory to load the file '%s'.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+	if (fread(Pointer_File_Data, 1, Size, File) != (size_t) Size)
+	{
+		printf("Error : could not read the file '%s'.\n", String_File_Name);
+		free(Pointer_File_Data);
+		fclose(File);
+		return -1;
+	}
+	fclose(File);
+
+	// A binary file is used as is, avoid copying it
+	if (ImageGetFormat(Pointer_File_Data, Size) == IMAGE_FORMAT_BINARY)
+	{
+		memset(Pointer_Image, 0, sizeof(TImage));
+		return ImageSetBinaryData(Pointer_Image, Pointer_File_Data, Size, Address);
+	}
+
+	Result = ImageParse(Pointer_Image, Pointer_File_Data, Size, Address);
+	free(Pointer_File_Data);
+	return Result;
+}
+
+int ImageClip(TImage *Pointer_Image, unsigned int Address, unsigned int Size)
+{
+	TImageExtent *Pointer_Extent;
+	unsigned char *Pointer_Data;
+	unsigned long long Start, End, Range_End;
+	unsigned int i, Extents_Count = 0, Data_Size = 0;
+
+	Pointer_Data = malloc(Pointer_Image->Size + 1);
+	if (Pointer_Data == NULL)
+	{
+		printf("Error : could not allocate memory to store the image data.\n");
+		return -1;
+	}
+
+	// Compact the extents intersecting the range, the extents array can be updated in place as it can only shrink
+	Range_End = (unsigned long long) Address + Size;
+	for (i = 0; i < Pointer_Image->Extents_Count; i++)
+	{
+		Pointer_Extent = &Pointer_Image->Pointer_Extents[i];
+		Start = Pointer_Extent->Address;
+		End = Start + Pointer_Extent->Size;
+		if (Start < Address) Start = Address;
+		if (End > Range_End) End = Range_End;
+		if (Start >= End) continue;
+
+		memcpy(&Pointer_Data[Data_Size], &Pointer_Image->Pointer_Data[Pointer_Extent->Offset + Start - Pointer_Extent->Address], End - Start);
+		Pointer_Image->Pointer_Extents[Extents_Count].Address = Start;
+		Pointer_Image->Pointer_Extents[Extents_Count].Offset = Data_Size;
+		Pointer_Image->Pointer_Extents[Extents_Count].Size = End - Start;
+		Extents_Count++;
+		Data_Size += End - Start;
+	}
+
+	free(Pointer_Image->Pointer_Data);
+	Pointer_Image->Pointer_Data = Pointer_Data;
+	Pointer_Image->Size = Data_Size;
+	Pointer_Image->Extents_Count = Extents_Count;
+	return 0;
+}
+
+TImageExtent *ImageFindExtent(TImage *Pointer_Image, unsigned int Offset)
+{
+	unsigned int i;
+
+	for (i = 0; i < Pointer_Image->Extents_Count; i++)
+	{
+		if (Offset - Pointer_Image->Pointer_Extents[i].Offset < Pointer_Image->Pointer_Extents[i].Size) return &Pointer_Image->Pointer_Extents[i];
+	}
+	return NULL;
+}
+
+void ImageFree(TImage *Pointer_Image)
+{
+	free(Pointer_Image->Pointer_Data);
+	free(Pointer_Image->Pointer_Extents);
+	memset(Pointer_Image, 0, sizeof(TImage));
+}
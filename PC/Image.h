@@ -0,0 +1,92 @@
+/** @file Image.h
+ * Load the data to write to the flash from a flat binary, Intel HEX, Motorola S-record or ELF file.
+ * The data is split in extents : contiguous address ranges that never share a flash sector with another extent, so that writing an extent erases only the sectors it covers and does not wipe a previously written extent.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_IMAGE_H
+#define H_IMAGE_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The flash sector size in bytes (the programmer erases whole sectors). */
+#define IMAGE_FLASH_SECTOR_SIZE 4096
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** All supported file formats. */
+typedef enum
+{
+	IMAGE_FORMAT_BINARY, //!< Raw data written at the address provided by the user.
+	IMAGE_FORMAT_INTEL_HEX, //!< Intel HEX records.
+	IMAGE_FORMAT_MOTOROLA_S_RECORD, //!< Motorola S-records (S19, S28 or S37).
+	IMAGE_FORMAT_ELF //!< The loadable segments of a 32-bit or 64-bit ELF file.
+} TImageFormat;
+
+/** A contiguous range of data to write. */
+typedef struct
+{
+	unsigned int Address; //!< The flash address of the first byte.
+	unsigned int Offset; //!< The offset of the first byte in the image data.
+	unsigned int Size; //!< The extent size in bytes.
+} TImageExtent;
+
+/** A loaded image. */
+typedef struct
+{
+	TImageFormat Format; //!< The file format the image was loaded from.
+	unsigned char *Pointer_Data; //!< All extents data, stored one after the other by increasing address.
+	unsigned int Size; //!< The data size in bytes (this is the sum of all extents size).
+	TImageExtent *Pointer_Extents; //!< The extents, sorted by increasing address.
+	unsigned int Extents_Count; //!< How many extents the image contains.
+} TImage;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Guess a file format from its content.
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @return The file format, IMAGE_FORMAT_BINARY if the content is not recognized.
+ */
+TImageFormat ImageGetFormat(const unsigned char *Pointer_File_Data, unsigned int File_Size);
+
+/** Build an image from a file content already loaded in memory.
+ * @param Pointer_Image On output, contain the image. It must be freed with ImageFree().
+ * @param Pointer_File_Data The file content.
+ * @param File_Size The file size in bytes.
+ * @param Address A binary file is written at this address, the other formats addresses are shifted by this value.
+ * @return 0 if the image was successfully built, -1 if the file content is malformed (an error message is displayed).
+ */
+int ImageParse(TImage *Pointer_Image, const unsigned char *Pointer_File_Data, unsigned int File_Size, unsigned int Address);
+
+/** Load an image from a file.
+ * @param Pointer_Image On output, contain the image. It must be freed with ImageFree().
+ * @param String_File_Name The file to load.
+ * @param Address A binary file is written at this address, the other formats addresses are shifted by this value.
+ * @return 0 if the image was successfully loaded, -1 if an error occurred (an error message is displayed).
+ */
+int ImageLoad(TImage *Pointer_Image, char *String_File_Name, unsigned int Address);
+
+/** Keep only the image data located in an address range.
+ * @param Pointer_Image The image.
+ * @param Address The range first byte address.
+ * @param Size The range size in bytes.
+ * @return 0 if the image was clipped (it can end up without any extent), -1 if an error occurred (an error message is displayed).
+ */
+int ImageClip(TImage *Pointer_Image, unsigned int Address, unsigned int Size);
+
+/** Find the extent containing an image data byte.
+ * @param Pointer_Image The image.
+ * @param Offset The data byte offset in the image data.
+ * @return The extent, or NULL if the offset is beyond the image data.
+ */
+TImageExtent *ImageFindExtent(TImage *Pointer_Image, unsigned int Offset);
+
+/** Release the resources allocated by ImageParse() or ImageLoad().
+ * @param Pointer_Image The image.
+ */
+void ImageFree(TImage *Pointer_Image);
+
+#endif
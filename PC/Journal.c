@@ -0,0 +1,137 @@
+/** @file Journal.c
+ * @see Journal.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "CRC.h"
+#include "Journal.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Load the last checkpoint of an existing journal.
+ * @param Pointer_Journal The journal, its Address and Size fields must be set.
+ * @param Operation The command the journal must relate to.
+ * @return 0 if the journal describes the same transfer, -1 if the journal could not be read or if it describes another transfer.
+ */
+static int JournalLoad(TJournal *Pointer_Journal, char Operation)
+{
+	FILE *File;
+	char Journal_Operation;
+	unsigned int Address, Size, Offset, Checkpoint_Size, CRC;
+
+	File = fopen(Pointer_Journal->String_File_Name, "r");
+	if (File == NULL)
+	{
+		printf("Error : could not open the journal '%s'.\n", Pointer_Journal->String_File_Name);
+		return -1;
+	}
+
+	// Make sure the journal was created by the same command
+	if ((fscanf(File, "%c %X %u\n", &Journal_Operation, &Address, &Size) != 3) || (Journal_Operation != Operation) || (Address != Pointer_Journal->Address) || (Size != Pointer_Journal->Size))
+	{
+		printf("Error : the journal '%s' does not describe this transfer.\n", Pointer_Journal->String_File_Name);
+		fclose(File);
+		return -1;
+	}
+
+	// Keep the last complete checkpoint (a line can be partially written if the program was killed while writing it)
+	while (fscanf(File, "%X %u %X\n", &Offset, &Checkpoint_Size, &CRC) == 3)
+	{
+		if ((Offset > Size) || (Checkpoint_Size > Size - Offset)) break;
+
+		Pointer_Journal->Checkpoint_Offset = Offset;
+		Pointer_Journal->Checkpoint_Size = Checkpoint_Size;
+		Pointer_Journal->Checkpoint_CRC = CRC;
+	}
+
+	fclose(File);
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int JournalOpen(TJournal *Pointer_Journal, char *String_Data_File_Name, char Operation, unsigned int Address, unsigned int Size, int Is_Resume_Requested)
+{
+	memset(Pointer_Journal, 0, sizeof(TJournal));
+	Pointer_Journal->Address = Address;
+	Pointer_Journal->Size = Size;
+
+	// Build the journal file name
+	Pointer_Journal->String_File_Name = malloc(strlen(String_Data_File_Name) + sizeof(JOURNAL_FILE_NAME_SUFFIX));
+	if (Pointer_Journal->String_File_Name == NULL)
+	{
+		printf("Error : could not allocate the journal file name.\n");
+		return -1;
+	}
+	strcpy(Pointer_Journal->String_File_Name, String_Data_File_Name);
+	strcat(Pointer_Journal->String_File_Name, JOURNAL_FILE_NAME_SUFFIX);
+
+	if (Is_Resume_Requested && (JournalLoad(Pointer_Journal, Operation) != 0))
+	{
+		free(Pointer_Journal->String_File_Name);
+		return -1;
+	}
+
+	// Start a new file containing only what is needed, this also gets rid of a partially written last line
+	Pointer_Journal->File = fopen(Pointer_Journal->String_File_Name, "w");
+	if (Pointer_Journal->File == NULL)
+	{
+		printf("Error : could not create the journal '%s'.\n", Pointer_Journal->String_File_Name);
+		free(Pointer_Journal->String_File_Name);
+		return -1;
+	}
+	fprintf(Pointer_Journal->File, "%c %08X %u\n", Operation, Address, Size);
+	if (Pointer_Journal->Checkpoint_Size > 0) fprintf(Pointer_Journal->File, "%08X %u %08X\n", Pointer_Journal->Checkpoint_Offset, Pointer_Journal->Checkpoint_Size, Pointer_Journal->Checkpoint_CRC);
+	fflush(Pointer_Journal->File);
+
+	return 0;
+}
+
+unsigned int JournalGetResumeOffset(TJournal *Pointer_Journal)
+{
+	return Pointer_Journal->Checkpoint_Offset + Pointer_Journal->Checkpoint_Size;
+}
+
+int JournalIsLastCheckpointValid(TJournal *Pointer_Journal, const unsigned char *Pointer_Data)
+{
+	if (Pointer_Journal->Checkpoint_Size == 0) return 1;
+	if (CRCCompute(&Pointer_Data[Pointer_Journal->Checkpoint_Offset], Pointer_Journal->Checkpoint_Size) == Pointer_Journal->Checkpoint_CRC) return 1;
+	return 0;
+}
+
+void JournalDiscardLastCheckpoint(TJournal *Pointer_Journal)
+{
+	Pointer_Journal->Checkpoint_Size = 0;
+}
+
+unsigned int JournalGetCheckpointEnd(unsigned int Offset, unsigned int Address, unsigned int End_Offset)
+{
+	unsigned int End;
+
+	// Align the checkpoint end on the flash address
+	End = Offset + JOURNAL_CHECKPOINT_SIZE - Address % JOURNAL_CHECKPOINT_SIZE;
+
+	if (End > End_Offset) return End_Offset;
+	return End;
+}
+
+void JournalAddCheckpoint(TJournal *Pointer_Journal, unsigned int Offset, unsigned int Size, unsigned int CRC)
+{
+	Pointer_Journal->Checkpoint_Offset = Offset;
+	Pointer_Journal->Checkpoint_Size = Size;
+	Pointer_Journal->Checkpoint_CRC = CRC;
+
+	// Make sure the checkpoint survives a program crash
+	fprintf(Pointer_Journal->File, "%08X %u %08X\n", Offset, Size, Pointer_Journal->Checkpoint_CRC);
+	fflush(Pointer_Journal->File);
+}
+
+void JournalClose(TJournal *Pointer_Journal, int Is_Transfer_Completed)
+{
+	fclose(Pointer_Journal->File);
+	if (Is_Transfer_Completed) remove(Pointer_Journal->String_File_Name);
+	free(Pointer_Journal->String_File_Name);
+}
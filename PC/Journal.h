@@ -0,0 +1,89 @@
+/** @file Journal.h
+ * Remember which parts of a long read or write were completed, so an interrupted transfer can be resumed instead of restarted from the beginning.
+ * The journal is a small text file stored next to the data file. Its first line describes the transfer, each following line is a checkpoint made of a data offset, a size and the CRC-32 of the data.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_JOURNAL_H
+#define H_JOURNAL_H
+
+#include <stdio.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** How many bytes each checkpoint covers at most (must be a multiple of the flash sector size, so that a resumed write does not erase already written data). */
+#define JOURNAL_CHECKPOINT_SIZE (64 * 1024)
+
+/** The journal file name is the data file name followed by this suffix. */
+#define JOURNAL_FILE_NAME_SUFFIX ".journal"
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** An opened journal. */
+typedef struct
+{
+	FILE *File; //!< The journal file.
+	char *String_File_Name; //!< The journal file path.
+	unsigned int Address; //!< The flash address of the first data byte.
+	unsigned int Size; //!< The whole transfer size in bytes.
+	unsigned int Checkpoint_Offset; //!< The data offset of the last checkpoint.
+	unsigned int Checkpoint_Size; //!< The last checkpoint size in bytes (0 if there is no checkpoint yet).
+	unsigned int Checkpoint_CRC; //!< The CRC-32 of the last checkpoint data.
+} TJournal;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Open the journal associated to a data file.
+ * @param Pointer_Journal The journal to initialize.
+ * @param String_Data_File_Name The file the transfer reads from or writes to.
+ * @param Operation The command the journal relates to ('r' or 'w').
+ * @param Address The flash address of the first data byte.
+ * @param Size The whole transfer size in bytes.
+ * @param Is_Resume_Requested Set to 1 to load the existing journal (it must describe the same transfer), set to 0 to start a new journal.
+ * @return 0 if the journal was opened, -1 if the journal could not be created or if the existing journal does not describe this transfer.
+ */
+int JournalOpen(TJournal *Pointer_Journal, char *String_Data_File_Name, char Operation, unsigned int Address, unsigned int Size, int Is_Resume_Requested);
+
+/** Tell where the transfer can continue from.
+ * @param Pointer_Journal The journal.
+ * @return The data offset following the last checkpoint.
+ */
+unsigned int JournalGetResumeOffset(TJournal *Pointer_Journal);
+
+/** Make sure the last checkpoint data has not changed.
+ * @param Pointer_Journal The journal.
+ * @param Pointer_Data The whole transfer data (the checkpoint data is located at the checkpoint offset).
+ * @return 1 if there is no checkpoint or if the checkpoint data CRC matches, 0 if the data changed.
+ */
+int JournalIsLastCheckpointValid(TJournal *Pointer_Journal, const unsigned char *Pointer_Data);
+
+/** Forget the last checkpoint because its data turned out to be wrong. The transfer will resume from the last checkpoint beginning.
+ * @param Pointer_Journal The journal.
+ */
+void JournalDiscardLastCheckpoint(TJournal *Pointer_Journal);
+
+/** Compute where the checkpoint following a data offset ends. Checkpoints end on flash addresses multiple of JOURNAL_CHECKPOINT_SIZE and never go past the end of the contiguous data they belong to.
+ * @param Offset The checkpoint beginning data offset.
+ * @param Address The flash address of the checkpoint beginning.
+ * @param End_Offset The data offset following the last contiguous data byte.
+ * @return The checkpoint end data offset.
+ */
+unsigned int JournalGetCheckpointEnd(unsigned int Offset, unsigned int Address, unsigned int End_Offset);
+
+/** Record that some data was successfully transferred. The checkpoint is written to the disk immediately.
+ * @param Pointer_Journal The journal.
+ * @param Offset The checkpoint data offset.
+ * @param Size The checkpoint size in bytes.
+ * @param CRC The CRC-32 of the checkpoint data.
+ */
+void JournalAddCheckpoint(TJournal *Pointer_Journal, unsigned int Offset, unsigned int Size, unsigned int CRC);
+
+/** Close the journal.
+ * @param Pointer_Journal The journal.
+ * @param Is_Transfer_Completed Set to 1 to remove the journal file because there is nothing left to resume, set to 0 to keep it.
+ */
+void JournalClose(TJournal *Pointer_Journal, int Is_Transfer_Completed);
+
+#endif
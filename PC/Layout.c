@@ -0,0 +1,153 @@
+/** @file Layout.c
+ * @see Layout.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "Layout.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The descriptor starts with this value, stored at offset 0x10. */
+#define LAYOUT_DESCRIPTOR_SIGNATURE 0x0FF0A55A
+
+/** How many regions the descriptor region section tells about. */
+#define LAYOUT_DESCRIPTOR_REGIONS_COUNT 5
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The descriptor regions name, in the FLREG registers order. */
+static const char *String_Descriptor_Region_Names[LAYOUT_DESCRIPTOR_REGIONS_COUNT] =
+{
+	"descriptor",
+	"bios",
+	"me",
+	"gbe",
+	"pd"
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Read a little endian 32-bit descriptor field.
+ * @param Pointer_Field The field first byte.
+ * @return The field value.
+ */
+static unsigned int LayoutReadDoubleWord(const unsigned char *Pointer_Field)
+{
+	return Pointer_Field[0] | (Pointer_Field[1] << 8) | (Pointer_Field[2] << 16) | ((unsigned int) Pointer_Field[3] << 24);
+}
+
+/** Append a region to a layout.
+ * @param Pointer_Layout The layout.
+ * @param String_Name The region name.
+ * @param Address The region first byte address.
+ * @param Size The region size in bytes.
+ * @return 0 if the region was added, -1 if the layout is full.
+ */
+static int LayoutAddRegion(TLayout *Pointer_Layout, const char *String_Name, unsigned int Address, unsigned int Size)
+{
+	TLayoutRegion *Pointer_Region;
+
+	if (Pointer_Layout->Regions_Count == LAYOUT_MAXIMUM_REGIONS_COUNT) return -1;
+
+	Pointer_Region = &Pointer_Layout->Regions[Pointer_Layout->Regions_Count];
+	strncpy(Pointer_Region->String_Name, String_Name, sizeof(Pointer_Region->String_Name) - 1);
+	Pointer_Region->String_Name[sizeof(Pointer_Region->String_Name) - 1] = 0;
+	Pointer_Region->Address = Address;
+	Pointer_Region->Size = Size;
+	Pointer_Layout->Regions_Count++;
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+unsigned int LayoutGetDescriptorSize(const unsigned char *Pointer_Data, unsigned int Size)
+{
+	unsigned int Flash_Map_0;
+
+	if ((Size < 0x18) || (LayoutReadDoubleWord(&Pointer_Data[0x10]) != LAYOUT_DESCRIPTOR_SIGNATURE)) return 0;
+
+	// FLMAP0 tells where the region section is located (FRBA field, in 16-byte units)
+	Flash_Map_0 = LayoutReadDoubleWord(&Pointer_Data[0x14]);
+	return (((Flash_Map_0 >> 16) & 0xFF) << 4) + LAYOUT_DESCRIPTOR_REGIONS_COUNT * 4;
+}
+
+int LayoutParseDescriptor(TLayout *Pointer_Layout, const unsigned char *Pointer_Data, unsigned int Size)
+{
+	unsigned int Descriptor_Size, Regions_Base_Offset, Region, Base, Limit, i;
+
+	memset(Pointer_Layout, 0, sizeof(TLayout));
+
+	Descriptor_Size = LayoutGetDescriptorSize(Pointer_Data, Size);
+	if ((Descriptor_Size == 0) || (Descriptor_Size > Size)) return -1;
+	Regions_Base_Offset = Descriptor_Size - LAYOUT_DESCRIPTOR_REGIONS_COUNT * 4;
+
+	// Each FLREG register contains the region base and limit in 4 KB units
+	for (i = 0; i < LAYOUT_DESCRIPTOR_REGIONS_COUNT; i++)
+	{
+		Region = LayoutReadDoubleWord(&Pointer_Data[Regions_Base_Offset + i * 4]);
+		Base = (Region & 0x7FFF) << 12;
+		Limit = (((Region >> 16) & 0x7FFF) << 12) | 0xFFF;
+		if (Limit < Base) continue; // The region is not used
+
+		LayoutAddRegion(Pointer_Layout, String_Descriptor_Region_Names[i], Base, Limit - Base + 1);
+	}
+	return 0;
+}
+
+int LayoutLoadFile(TLayout *Pointer_Layout, char *String_File_Name)
+{
+	FILE *File;
+	char String_Line[256], String_Name[LAYOUT_MAXIMUM_REGION_NAME_SIZE];
+	unsigned int Start, End, Line_Number = 0;
+
+	memset(Pointer_Layout, 0, sizeof(TLayout));
+
+	File = fopen(String_File_Name, "r");
+	if (File == NULL)
+	{
+		printf("Error : could not open the layout file '%s'.\n", String_File_Name);
+		return -1;
+	}
+
+	while (fgets(String_Line, sizeof(String_Line), File) != NULL)
+	{
+		Line_Number++;
+
+		// Skip empty lines and comments
+		if (sscanf(String_Line, " %1s", String_Name) != 1) continue;
+		if (String_Name[0] == '#') continue;
+
+		if ((sscanf(String_Line, " %x : %x %31s", &Start, &End, String_Name) != 3) || (End < Start))
+		{
+			printf("Error : malformed layout file region at line %u.\n", Line_Number);
+			fclose(File);
+			return -1;
+		}
+		if (LayoutAddRegion(Pointer_Layout, String_Name, Start, End - Start + 1) != 0)
+		{
+			printf("Error : the layout file contains more than %d regions.\n", LAYOUT_MAXIMUM_REGIONS_COUNT);
+			fclose(File);
+			return -1;
+		}
+	}
+
+	fclose(File);
+	return 0;
+}
+
+TLayoutRegion *LayoutFindRegion(TLayout *Pointer_Layout, char *String_Name)
+{
+	unsigned int i;
+
+	for (i = 0; i < Pointer_Layout->Regions_Count; i++)
+	{
+		if (strcasecmp(Pointer_Layout->Regions[i].String_Name, String_Name) == 0) return &Pointer_Layout->Regions[i];
+	}
+	return NULL;
+}
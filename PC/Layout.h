@@ -0,0 +1,71 @@
+/** @file Layout.h
+ * Split the flash in named regions, so that a single region can be read or written without touching the others.
+ * The regions can be retrieved from the Intel Flash Descriptor found at the beginning of PC BIOS chips, or from a layout file made of "<Start(hex)>:<End(hex)> <Name>" lines.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_LAYOUT_H
+#define H_LAYOUT_H
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** How many regions a layout can contain. */
+#define LAYOUT_MAXIMUM_REGIONS_COUNT 32
+
+/** How many characters a region name can contain, terminating zero included. */
+#define LAYOUT_MAXIMUM_REGION_NAME_SIZE 32
+
+/** The Intel Flash Descriptor is located in the first flash sector. */
+#define LAYOUT_DESCRIPTOR_SIZE 4096
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** A flash region. */
+typedef struct
+{
+	char String_Name[LAYOUT_MAXIMUM_REGION_NAME_SIZE]; //!< The region name.
+	unsigned int Address; //!< The region first byte address.
+	unsigned int Size; //!< The region size in bytes.
+} TLayoutRegion;
+
+/** All regions of a flash. */
+typedef struct
+{
+	TLayoutRegion Regions[LAYOUT_MAXIMUM_REGIONS_COUNT]; //!< The regions, in the order they were found.
+	unsigned int Regions_Count; //!< How many regions the layout contains.
+} TLayout;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Tell how many bytes an Intel Flash Descriptor needs to be parsed, that is up to the end of its region section.
+ * @param Pointer_Data The flash first bytes.
+ * @param Size How many bytes are provided.
+ * @return The descriptor size in bytes, or 0 if the data does not start with a flash descriptor signature.
+ */
+unsigned int LayoutGetDescriptorSize(const unsigned char *Pointer_Data, unsigned int Size);
+
+/** Retrieve the regions from an Intel Flash Descriptor. Only the used regions among descriptor, bios, me, gbe and pd are kept.
+ * @param Pointer_Layout On output, contain the regions.
+ * @param Pointer_Data The flash first bytes.
+ * @param Size How many bytes are provided (LAYOUT_DESCRIPTOR_SIZE bytes are enough).
+ * @return 0 if the regions were retrieved, -1 if the data does not start with a flash descriptor signature or if it stops before the descriptor region section end.
+ */
+int LayoutParseDescriptor(TLayout *Pointer_Layout, const unsigned char *Pointer_Data, unsigned int Size);
+
+/** Retrieve the regions from a layout file.
+ * @param Pointer_Layout On output, contain the regions.
+ * @param String_File_Name The layout file.
+ * @return 0 if the regions were retrieved, -1 if an error occurred (an error message is displayed).
+ */
+int LayoutLoadFile(TLayout *Pointer_Layout, char *String_File_Name);
+
+/** Find a region from its name (the case is not significant).
+ * @param Pointer_Layout The layout.
+ * @param String_Name The region name.
+ * @return The region, or NULL if the layout does not contain such a region.
+ */
+TLayoutRegion *LayoutFindRegion(TLayout *Pointer_Layout, char *String_Name);
+
+#endif
@@ -2,290 +2,1867 @@
  * Really simple flash chip programmer.
  * @author Adrien RICCIARDI
  */
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "Cache.h"
+#include "CRC.h"
+#include "Daemon.h"
+#include "Dump.h"
+#include "Gang.h"
+#include "Image.h"
+#include "Journal.h"
+#include "Layout.h"
+#include "Manifest.h"
+#include "Metrics.h"
+#include "Pipeline.h"
+#include "Probe.h"
+#include "Protocol.h"
+#include "Trace.h"
 #include "UART.h"
 
 //-------------------------------------------------------------------------------------------------
 // Private constants
 //-------------------------------------------------------------------------------------------------
-/** Read the whole flash starting from address 0. */
-#define COMMAND_READ_FLASH 0x10
-/** Write the whole flash starting from address 0. */
-#define COMMAND_WRITE_FLASH 0x20
-/** Tell that the microcontroller is ready for another task. */
-#define COMMAND_MICROCONTROLLER_READY 0x42
-
 /** The flash memory total size in bytes. */
 #define FLASH_TOTAL_SIZE (32 * 1024 * 1024)
 
+/** How many programmers can be driven at the same time. */
+#define MAXIMUM_SERIAL_PORTS_COUNT 64
+
+/** How many command line arguments a job sent to the daemon can have. */
+#define MAXIMUM_JOB_ARGUMENTS_COUNT 26
+/** How many job command line arguments the program name, the forwarded options and the serial port can take. */
+#define MAXIMUM_JOB_OPTIONS_ARGUMENTS_COUNT 18
+
+/** How many round trips the probe command measures for each frame size by default. */
+#define DEFAULT_PROBE_ITERATIONS_COUNT 100
+
+/** How often the production mode asks the programmer for the inserted and removed chips (in milliseconds). */
+#define PRODUCTION_POLLING_PERIOD 100
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A command a manifest can contain. */
+typedef struct
+{
+	char Command; //!< The command letter.
+	int Minimum_Parameters_Count; //!< How many parameters the command needs.
+	int Maximum_Parameters_Count; //!< How many parameters the command accepts.
+} TBatchCommand;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The serial port the programmer is connected to. */
+static TUART UART;
+/** Tell whether the user asked for the serial port low latency mode. */
+static int Is_Low_Latency_Requested = 0;
+/** Tell whether the user asked the programmer to read each page back right after writing it. */
+static int Is_Page_Verification_Requested = 0;
+/** The directory the previously read chips are cached to (--cache option). */
+static char *String_Cache_Directory = NULL;
+/** How the 'd' command lays the data out (--dump-format option), NULL to use the default format. */
+static char *String_Dump_Format = NULL;
+/** The commands a manifest can contain (the production mode never ends and a manifest can't execute another one). */
+static const TBatchCommand Batch_Commands[] =
+{
+	{'d', 2, 2},
+	{'r', 3, 3},
+	{'w', 2, 2},
+	{'v', 2, 2},
+	{'l', 0, 0},
+	{'R', 2, 2},
+	{'W', 2, 2},
+	{'c', 1, 1},
+	{'s', 0, 0},
+	{'p', 0, 1},
+	{'f', 3, 4},
+	{'k', 1, 1}
+};
+/** The image of the next manifest operation, loaded while the current operation is executed. */
+static TManifestPreparation Manifest_Preparation;
+
+/** The file the exchanged bytes are recorded to (--trace option). */
+static char *String_Trace_File_Name = NULL;
+/** The first command sequence number (--sequence option), NULL to start from a random one. */
+static char *String_Command_Sequence = NULL;
+/** The recorded session. */
+static TTrace Trace;
+/** The file the SPI clock calibrated on this station is stored to (--spi-clock option). */
+static char *String_SPI_Clock_File_Name = NULL;
+/** Tell whether the serial port is in low latency mode. */
+static int Is_Low_Latency_Enabled = 0;
+/** The command being executed (it is too large to be put on the stack). */
+static TProtocolTransfer Transfer;
+/** The serial link next command sequence number. */
+static unsigned char Next_Command_Sequence;
+/** The progress line prefix of the command being executed. */
+static const char *String_Progress_Message;
+/** How many bytes the command being executed transfers. */
+static unsigned int Progress_Total_Bytes_Count;
+
+/** Store the data, keep the journal up to date and display the progress without slowing down the transfer. */
+static TPipeline Pipeline;
+/** The data offset the pipeline of the command being executed started from. */
+static unsigned int Pipeline_Start_Offset;
+
+/** The journal of the read or write being executed. */
+static TJournal Journal;
+/** Tell whether the command being executed must update the journal. */
+static int Is_Journal_Enabled = 0;
+/** The data offset the command being executed started from (it is not 0 when a transfer is resumed). */
+static unsigned int Journal_Transfer_Offset;
+/** The contiguous data the command being executed belongs to. */
+static TImageExtent Journal_Extent;
+/** The whole read or written data. */
+static unsigned char *Pointer_Journal_Data;
+/** The file the read data is stored to as soon as a checkpoint is reached, NULL when writing. */
+static FILE *Journal_Output_File;
+/** The output file location the next data will be written to, or -1 if it is unknown (the file is seeked only when needed, so it can be a pipe). */
+static long Journal_Output_File_Offset;
+/** The data offset of the checkpoint being computed. */
+static unsigned int Journal_Checkpoint_Offset;
+/** The running CRC of the checkpoint being computed. */
+static unsigned int Journal_Checkpoint_CRC;
+
+/** The layout file provided by the user, or NULL to use the flash descriptor. */
+static char *String_Layout_File_Name = NULL;
+
+/** Where the time goes while executing the command. */
+static TMetrics Metrics;
+/** The file to store the metrics to, or NULL to neither display nor store them. */
+static char *String_Metrics_File_Name = NULL;
+/** The executed command, stored with the metrics. */
+static char *String_Metrics_Command;
+/** When the program started (in microseconds). */
+static unsigned long long Program_Start_Time;
+/** Tell whether the command completed successfully (the program can exit from many places when an error occurs). */
+static int Is_Command_Successful = 0;
+
+/** The socket to listen to for jobs when running as a daemon, NULL otherwise. */
+static char *String_Daemon_Socket_File_Name = NULL;
+/** The daemon socket to send the command to as a job, NULL to execute the command directly. */
+static char *String_Job_Socket_File_Name = NULL;
+/** The serial port already opened by the daemon when the program executes a job, NULL when the program opens the serial port itself. */
+static TUART *Pointer_Daemon_UART = NULL;
+/** The name of the serial port opened by the daemon. */
+static char *String_Daemon_Serial_Port_Name;
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
 /** Close the previously opened UART on program exit. */
 static void ExitCloseUART(void)
 {
-	UARTClose();
+	UARTClose(&UART);
+}
+
+/** Store the last recorded bytes on program exit. */
+static void ExitCloseTrace(void)
+{
+	UARTSetTrace(&UART, NULL);
+	if (TraceClose(&Trace) != 0) printf("Error : some exchanged bytes could not be written to the trace file.\n");
+}
+
+/** Display and store the metrics on program exit (the UART must still be opened). */
+static void ExitReportMetrics(void)
+{
+	MetricsAddUARTStatistics(&Metrics, &UART);
+	if (!Is_Command_Successful) Metrics.Is_Successful = 0;
+	
+	MetricsDisplay(&Metrics, 1, ProtocolGetPreciseTime() - Program_Start_Time);
+	MetricsWriteJSON(String_Metrics_File_Name, String_Metrics_Command, &Metrics, 1, ProtocolGetPreciseTime() - Program_Start_Time);
+}
+
+/** Load an image.
+ * @param Pointer_Image On output, contain the image. It must be freed with ImageFree().
+ * @param String_File_Name The file to load.
+ * @param Address A binary file is written at this address, the other formats addresses are shifted by this value.
+ * @return 0 if the image was loaded, -1 if an error occurred (an error message is displayed).
+ */
+static int LoadImage(TImage *Pointer_Image, char *String_File_Name, unsigned int Address)
+{
+	unsigned long long Start_Time;
+	
+	Start_Time = ProtocolGetPreciseTime();
+	if (ManifestTakeImage(&Manifest_Preparation, String_File_Name, Address, Pointer_Image) != 0) // A batch may have loaded the image while the previous operation was executed
+	{
+		if (ImageLoad(Pointer_Image, String_File_Name, Address) != 0) return -1;
+	}
+	MetricsAddPhase(&Metrics, METRICS_PHASE_HOST_IO, ProtocolGetPreciseTime() - Start_Time, Pointer_Image->Size);
+	return 0;
+}
+
+/** Tell whether a journal checkpoint ends at a data offset. Checkpoints end on flash addresses multiple of JOURNAL_CHECKPOINT_SIZE and at the end of the contiguous data they belong to.
+ * @param Offset The data offset.
+ * @return 1 if a checkpoint ends at this offset, 0 if not.
+ */
+static int IsCheckpointEnd(unsigned int Offset)
+{
+	if (Offset == Journal_Extent.Offset + Journal_Extent.Size) return 1;
+	if ((Journal_Extent.Address + Offset - Journal_Extent.Offset) % JOURNAL_CHECKPOINT_SIZE == 0) return 1;
+	return 0;
+}
+
+/** Store a block of read data to the output file (this is the pipeline first stage).
+ * @see TPipelineStageFunction for the parameters description.
+ */
+static int StoreBlock(unsigned int Offset, unsigned int Size)
+{
+	if (!Is_Journal_Enabled || (Journal_Output_File == NULL)) return 0;
+	
+	// Pipes can't be seeked, so seek only when the data is not contiguous
+	if ((long) Offset != Journal_Output_File_Offset)
+	{
+		if (fseek(Journal_Output_File, Offset, SEEK_SET) != 0) goto Exit_Error;
+	}
+	if (fwrite(&Pointer_Journal_Data[Offset], 1, Size, Journal_Output_File) != Size) goto Exit_Error;
+	Journal_Output_File_Offset = Offset + Size;
+	
+	// The data must be safely stored before the journal tells it is
+	if (IsCheckpointEnd(Offset + Size) && (fflush(Journal_Output_File) != 0)) goto Exit_Error;
+	return 0;
+	
+Exit_Error:
+	printf("\nError : could not write the read data to the output file.\n");
+	return -1;
+}
+
+/** Add a checkpoint to the journal each time a checkpoint-sized data chunk is completed, and display the transfer progress on a single line (this is the pipeline second stage, the block is already stored).
+ * @see TPipelineStageFunction for the parameters description.
+ */
+static int HashBlock(unsigned int Offset, unsigned int Size)
+{
+	unsigned int End = Offset + Size;
+	
+	if (Is_Journal_Enabled)
+	{
+		Journal_Checkpoint_CRC = CRCUpdate(Journal_Checkpoint_CRC, &Pointer_Journal_Data[Offset], Size);
+		if (IsCheckpointEnd(End))
+		{
+			JournalAddCheckpoint(&Journal, Journal_Checkpoint_Offset, End - Journal_Checkpoint_Offset, CRC_FINALIZE(Journal_Checkpoint_CRC));
+			Journal_Checkpoint_Offset = End;
+			Journal_Checkpoint_CRC = CRC_INITIAL_VALUE;
+		}
+	}
+	
+	if (String_Progress_Message != NULL)
+	{
+		printf("%s bytes : %u/%u\r", String_Progress_Message, End - Pipeline_Start_Offset, Progress_Total_Bytes_Count);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/** Give the acknowledged data to the pipeline. This is called by the transfer loop, so it never waits for the pipeline stages.
+ * @param Transferred_Bytes_Count How many bytes were transferred up to now.
+ * @param Total_Bytes_Count How many bytes have to be transferred.
+ */
+static void PublishProgress(unsigned int Transferred_Bytes_Count, unsigned int Total_Bytes_Count)
+{
+	(void) Total_Bytes_Count;
+	
+	// The stage displayed the error, stop the transfer so ExecuteCommand() stops the stages before failing
+	if (PipelineIsFailed(&Pipeline))
+	{
+		ProtocolAbortTransfer(&Transfer, "the transferred data could not be handled");
+		return;
+	}
+	PipelinePublish(&Pipeline, Pipeline_Start_Offset + Transferred_Bytes_Count);
 }
 
-/** Find the size in bytes of the specified file.
- * @param File The file to retrieve the size.
- * @return The file size in bytes.
+/** Execute a command and its data phase.
+ * @param Pointer_Command The command payload.
+ * @param Command_Size The command payload size in bytes.
+ * @param Command_Timeout How many milliseconds the programmer can take to execute the command.
+ * @param Direction Which way the data goes.
+ * @param Pointer_Data The data to send or the buffer to fill.
+ * @param Data_Size The data size in bytes.
+ * @param String_Progress The progress line prefix, or NULL to hide the progress.
+ * @return 0 if the programmer executed the command, -1 if an error occurred (an error message is displayed).
+ * @note The journal, if enabled, is kept up to date with the transferred data.
  */
-static unsigned int GetFileSize(FILE *File)
+static int ExecuteCommand(unsigned char *Pointer_Command, unsigned int Command_Size, unsigned int Command_Timeout, TProtocolDirection Direction, unsigned char *Pointer_Data, unsigned int Data_Size, const char *String_Progress)
 {
-	unsigned int Size;
+	int Result, Is_Pipeline_Enabled;
+	unsigned int Address = 0;
+	
+	String_Progress_Message = String_Progress;
+	Progress_Total_Bytes_Count = Data_Size;
+	
+	// Journal offsets are relative to the whole data
+	Pipeline_Start_Offset = 0;
+	if (Is_Journal_Enabled)
+	{
+		Pipeline_Start_Offset = Journal_Transfer_Offset;
+		Address = Journal_Extent.Address + Journal_Transfer_Offset - Journal_Extent.Offset;
+		Journal_Checkpoint_Offset = Journal_Transfer_Offset;
+		Journal_Checkpoint_CRC = CRC_INITIAL_VALUE;
+	}
+	
+	// Store the data, compute the checkpoints and display the progress on other threads
+	Is_Pipeline_Enabled = Is_Journal_Enabled || (String_Progress != NULL);
+	if (Is_Pipeline_Enabled && (PipelineStart(&Pipeline, Address, Pipeline_Start_Offset, Pipeline_Start_Offset + Data_Size, StoreBlock, HashBlock) != 0)) return -1;
 	
-	// Go to the file end
-	fseek(File, 0, SEEK_END);
+	ProtocolInitializeTransfer(&Transfer, &Next_Command_Sequence, Pointer_Command, Command_Size, Command_Timeout, Direction, Pointer_Data, Data_Size);
+	if (Is_Pipeline_Enabled) Result = ProtocolRunTransfer(&UART, &Transfer, PublishProgress);
+	else Result = ProtocolRunTransfer(&UART, &Transfer, NULL);
+	MetricsAddTransfer(&Metrics, &Transfer);
 	
-	// Get the size
-	Size = ftell(File);
+	// Even if the transfer failed, the acknowledged data is stored and journaled so the transfer can be resumed
+	if (Is_Pipeline_Enabled)
+	{
+		if (PipelineStop(&Pipeline, Pipeline_Start_Offset + Transfer.Transferred_Bytes_Count) != 0) return -1;
+		MetricsAddPhase(&Metrics, METRICS_PHASE_HOST_IO, Pipeline.Storage_Time + Pipeline.Hashing_Time, (Is_Journal_Enabled && (Journal_Output_File != NULL)) ? Transfer.Transferred_Bytes_Count : 0);
+	}
+	if (String_Progress != NULL) printf("\n");
 	
-	// Return to the file beginning
-	rewind(File);
+	// Tell about the link quality
+	if ((Transfer.Retransmitted_Frames_Count > 0) || (Transfer.Corrupted_Frames_Count > 0)) printf("Warning : %u corrupted frames received, %u frames sent again.\n", Transfer.Corrupted_Frames_Count, Transfer.Retransmitted_Frames_Count);
 	
-	return Size;
+	if (Result != 0)
+	{
+		printf("Error : %s (%u/%u bytes transferred).\n", Transfer.String_Error, Transfer.Transferred_Bytes_Count, Data_Size);
+		return -1;
+	}
+	return 0;
 }
 
-/** Dump the flash content.
+/** Dump the flash content to the standard output.
  * @param Address The address to start reading from.
- * @param Instructions_Count How many instructions to read.
+ * @param Words_Count How many words to read (the word size is given by the --dump-format option, 4 bytes by default).
+ * @return 0 if the dump was displayed, -1 if an error occurred (an error message is displayed).
  */
-static void CommandDumpFlash(unsigned int Address, unsigned int Instructions_Count)
+static int CommandDumpFlash(unsigned int Address, unsigned int Words_Count)
 {
-	unsigned int Instruction, i, Instructions_To_Read, Bytes_Count;
+	TDumpFormat Format;
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], *Pointer_Buffer;
+	unsigned int Bytes_Count, Command_Size;
+	
+	if (String_Dump_Format == NULL) DumpGetDefaultFormat(&Format);
+	else if (DumpParseFormat(&Format, String_Dump_Format) != 0) return -1;
+	
+	// Receive all words at once
+	Bytes_Count = Words_Count * Format.Word_Size;
+	Pointer_Buffer = malloc(Bytes_Count + 1);
+	if (Pointer_Buffer == NULL)
+	{
+		printf("Error : could not allocate memory to store the read data.\n");
+		return -1;
+	}
+	Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_READ_FLASH, Address, Bytes_Count);
+	if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Pointer_Buffer, Bytes_Count, NULL) != 0) goto Exit_Error;
+	
+	if (DumpWrite(&Format, Address, Pointer_Buffer, Bytes_Count, stdout) != 0)
+	{
+		printf("Error : could not write the dump to the standard output.\n");
+		goto Exit_Error;
+	}
 	
-	// Send the read command
-	UARTWriteByte(COMMAND_READ_FLASH);
+	free(Pointer_Buffer);
+	return 0;
 	
-	// Send the address
-	UARTWriteByte(Address >> 24);
-	UARTWriteByte(Address >> 16);
-	UARTWriteByte(Address >> 8);
-	UARTWriteByte(Address);
+Exit_Error:
+	free(Pointer_Buffer);
+	return -1;
+}
+
+/** Read the flash content, transferring only the sectors whose content differs from the cached copy of the chip. The programmer tells the chip ID and the CRC of each sector, then the sectors containing the requested data are taken from the cache or read, and the cache is updated.
+ * @param Address The address to start reading from.
+ * @param Bytes_Count How many bytes to read.
+ * @param String_File_Name The read data will be stored in this file.
+ * @return 0 if the data was read and stored, -1 if an error occurred (an error message is displayed).
+ */
+static int ReadFlashWithCache(unsigned int Address, unsigned int Bytes_Count, char *String_File_Name)
+{
+	TCache Cache;
+	FILE *File;
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], Result[PROTOCOL_SECTORS_CRC_RESULT_SIZE], *Pointer_Buffer;
+	unsigned int First_Address, Sectors_Count, *Pointer_Programmer_CRCs, *Pointer_Cached_CRCs, JEDEC_ID = 0, Computed_Sectors_Count, Run_Start, Run_End, Transferred_Sectors_Count = 0, Command_Size, i, j;
+	int Return_Value = -1;
 	
-	// Send the number of bytes to read
-	Bytes_Count = Instructions_Count * 4; // 4 bytes per instruction
-	UARTWriteByte(Bytes_Count >> 24);
-	UARTWriteByte(Bytes_Count >> 16);
-	UARTWriteByte(Bytes_Count >> 8);
-	UARTWriteByte(Bytes_Count);
+	// The cache works on whole sectors
+	First_Address = Address & ~(PROTOCOL_FLASH_SECTOR_SIZE - 1);
+	Sectors_Count = (Address + Bytes_Count - First_Address + PROTOCOL_FLASH_SECTOR_SIZE - 1) / PROTOCOL_FLASH_SECTOR_SIZE;
+	Pointer_Buffer = malloc(Sectors_Count * PROTOCOL_FLASH_SECTOR_SIZE + 1);
+	Pointer_Programmer_CRCs = malloc((Sectors_Count + 1) * sizeof(unsigned int));
+	Pointer_Cached_CRCs = malloc((Sectors_Count + 1) * sizeof(unsigned int));
+	if ((Pointer_Buffer == NULL) || (Pointer_Programmer_CRCs == NULL) || (Pointer_Cached_CRCs == NULL))
+	{
+		printf("Error : could not allocate memory to store the read data.\n");
+		goto Exit;
+	}
 	
-	// Dump the flash four ARM instructions at a time
-	while (Instructions_Count > 0)
+	// Get the CRC of all sectors, a few sectors at a time
+	printf("Computing sectors CRC...\n");
+	for (i = 0; i < Sectors_Count; i += Computed_Sectors_Count)
 	{
-		// Display the address
-		printf("0x%08X - ", Address);
-		
-		// Display 4 instructions on the same line
-		if (Instructions_Count < 4) Instructions_To_Read = Instructions_Count; // Allow to exit the loop even if a non-multiple of 4 number of instructions are requested
-		else Instructions_To_Read = 4;
-		for (i = 0; i < Instructions_To_Read; i++)
-		{
-			// Receive the instruction (the byte order is reversed as the ARM is little endian)
-			Instruction = UARTReadByte();
-			Instruction |= UARTReadByte() << 8;
-			Instruction |= UARTReadByte() << 16;
-			Instruction |= UARTReadByte() << 24;
+		Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_READ_SECTORS_CRC, First_Address + i * PROTOCOL_FLASH_SECTOR_SIZE, Sectors_Count - i);
+		if (ExecuteCommand(Command, Command_Size, PROTOCOL_SECTORS_CRC_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Result, sizeof(Result), NULL) != 0) goto Exit;
 		
-			// Display it
-			printf("%08X ", Instruction);
+		JEDEC_ID = ProtocolGetDoubleWord(Result);
+		Computed_Sectors_Count = ProtocolGetDoubleWord(&Result[4]);
+		if ((Computed_Sectors_Count == 0) || (Computed_Sectors_Count > PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT) || (Computed_Sectors_Count > Sectors_Count - i))
+		{
+			printf("Error : the programmer sent an invalid sectors CRC result.\n");
+			goto Exit;
 		}
-		printf("\n");
+		for (j = 0; j < Computed_Sectors_Count; j++) Pointer_Programmer_CRCs[i + j] = ProtocolGetDoubleWord(&Result[8 + j * 4]);
+	}
+	
+	// Find the sectors that did not change since they were cached
+	if (CacheOpen(&Cache, String_Cache_Directory, JEDEC_ID) != 0) goto Exit;
+	if (CacheLoad(&Cache, First_Address, Sectors_Count * PROTOCOL_FLASH_SECTOR_SIZE, Pointer_Buffer) != 0) goto Exit_Close_Cache;
+	CRCComputeSectors(Pointer_Buffer, Sectors_Count * PROTOCOL_FLASH_SECTOR_SIZE, PROTOCOL_FLASH_SECTOR_SIZE, Pointer_Cached_CRCs, 0);
+	
+	// A sector that was never stored must be read even if its meaningless cached copy has the right CRC
+	for (i = 0; i < Sectors_Count; i++)
+	{
+		if (!CacheIsSectorStored(&Cache, First_Address + i * PROTOCOL_FLASH_SECTOR_SIZE)) Pointer_Cached_CRCs[i] = ~Pointer_Programmer_CRCs[i];
+	}
+	
+	// Read each run of changed sectors with a single command
+	printf("Reading data...\n");
+	Run_Start = 0;
+	while (Run_Start < Sectors_Count)
+	{
+		if (Pointer_Cached_CRCs[Run_Start] == Pointer_Programmer_CRCs[Run_Start])
+		{
+			Run_Start++;
+			continue;
+		}
+		Run_End = Run_Start + 1;
+		while ((Run_End < Sectors_Count) && (Pointer_Cached_CRCs[Run_End] != Pointer_Programmer_CRCs[Run_End])) Run_End++;
 		
-		Address += 16;
-		Instructions_Count -= Instructions_To_Read;
+		Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_READ_FLASH, First_Address + Run_Start * PROTOCOL_FLASH_SECTOR_SIZE, (Run_End - Run_Start) * PROTOCOL_FLASH_SECTOR_SIZE);
+		if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, &Pointer_Buffer[Run_Start * PROTOCOL_FLASH_SECTOR_SIZE], (Run_End - Run_Start) * PROTOCOL_FLASH_SECTOR_SIZE, "Read") != 0) goto Exit_Close_Cache;
+		if (CacheStore(&Cache, First_Address + Run_Start * PROTOCOL_FLASH_SECTOR_SIZE, (Run_End - Run_Start) * PROTOCOL_FLASH_SECTOR_SIZE, &Pointer_Buffer[Run_Start * PROTOCOL_FLASH_SECTOR_SIZE]) != 0) goto Exit_Close_Cache;
+		Transferred_Sectors_Count += Run_End - Run_Start;
+		Run_Start = Run_End;
+	}
+	CacheClose(&Cache);
+	printf("%u of %u sectors taken from the cache.\n", Sectors_Count - Transferred_Sectors_Count, Sectors_Count);
+	
+	// The read sectors must match the CRCs too, unless the chip content changed meanwhile
+	CRCComputeSectors(Pointer_Buffer, Sectors_Count * PROTOCOL_FLASH_SECTOR_SIZE, PROTOCOL_FLASH_SECTOR_SIZE, Pointer_Cached_CRCs, 0);
+	for (i = 0; i < Sectors_Count; i++)
+	{
+		if (Pointer_Cached_CRCs[i] != Pointer_Programmer_CRCs[i]) printf("Warning : the sector at address 0x%08X changed while it was read.\n", First_Address + i * PROTOCOL_FLASH_SECTOR_SIZE);
+	}
+	
+	// Store only the requested data
+	File = fopen(String_File_Name, "wb");
+	if (File == NULL)
+	{
+		printf("Error : could not create the file '%s'.\n", String_File_Name);
+		goto Exit;
 	}
+	if (fwrite(&Pointer_Buffer[Address - First_Address], 1, Bytes_Count, File) != Bytes_Count) printf("Error : could not write the read data to the output file.\n");
+	else Return_Value = 0;
+	fclose(File);
+	goto Exit;
+	
+Exit_Close_Cache:
+	CacheClose(&Cache);
+	
+Exit:
+	free(Pointer_Cached_CRCs);
+	free(Pointer_Programmer_CRCs);
+	free(Pointer_Buffer);
+	return Return_Value;
 }
 
 /** Read the flash content.
  * @param Address The address to start reading from.
  * @param Bytes_Count How many bytes to read.
  * @param String_File_Name The read data will be stored in this file.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted read from its last checkpoint.
+ * @return 0 if the data was read and stored, -1 if an error occurred (an error message is displayed and the journal is kept to resume the read).
  */
-static void CommandReadFlash(unsigned int Address, unsigned int Bytes_Count, char *String_File_Name)
+static int CommandReadFlash(unsigned int Address, unsigned int Bytes_Count, char *String_File_Name, int Is_Resume_Requested)
 {
 	FILE *File;
-	unsigned int i;
-	unsigned char Byte;
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], *Pointer_Buffer;
+	unsigned int Command_Size, Offset;
+	int Result = 0;
 	
-	// Try to open the file
-	File = fopen(String_File_Name, "wb");
+	// The cache replaces the journal, only the changed sectors are read again
+	if ((String_Cache_Directory != NULL) && !Is_Resume_Requested) return ReadFlashWithCache(Address, Bytes_Count, String_File_Name);
+	
+	if (JournalOpen(&Journal, String_File_Name, 'r', Address, Bytes_Count, Is_Resume_Requested) != 0) return -1;
+	
+	// Try to open the file (keep the already read data when resuming)
+	if (Is_Resume_Requested) File = fopen(String_File_Name, "r+b");
+	else File = fopen(String_File_Name, "wb");
 	if (File == NULL)
 	{
 		printf("Error : could not create the file '%s'.\n", String_File_Name);
-		exit(EXIT_FAILURE);
+		JournalClose(&Journal, 0);
+		return -1;
 	}
 	
-	// Send the read command
-	UARTWriteByte(COMMAND_READ_FLASH);
-	
-	// Send the address
-	UARTWriteByte(Address >> 24);
-	UARTWriteByte(Address >> 16);
-	UARTWriteByte(Address >> 8);
-	UARTWriteByte(Address);
+	Pointer_Buffer = malloc(Bytes_Count + 1);
+	if (Pointer_Buffer == NULL)
+	{
+		printf("Error : could not allocate memory to store the read data.\n");
+		JournalClose(&Journal, 0);
+		fclose(File);
+		return -1;
+	}
 	
-	// Send the instructions count
-	UARTWriteByte(Bytes_Count >> 24);
-	UARTWriteByte(Bytes_Count >> 16);
-	UARTWriteByte(Bytes_Count >> 8);
-	UARTWriteByte(Bytes_Count);
+	// Make sure the last data stored to the file is the data the journal tells about
+	if (Is_Resume_Requested && (Journal.Checkpoint_Size > 0))
+	{
+		if ((fseek(File, Journal.Checkpoint_Offset, SEEK_SET) != 0) || (fread(&Pointer_Buffer[Journal.Checkpoint_Offset], 1, Journal.Checkpoint_Size, File) != Journal.Checkpoint_Size) || !JournalIsLastCheckpointValid(&Journal, Pointer_Buffer))
+		{
+			printf("Warning : the last checkpoint data is corrupted in the file, it will be read again.\n");
+			JournalDiscardLastCheckpoint(&Journal);
+		}
+	}
+	Offset = JournalGetResumeOffset(&Journal);
+	if (Offset > 0) printf("Resuming from offset 0x%08X.\n", Offset);
 	
+	// Receive the data, storing it each time a checkpoint is reached
 	printf("Reading data...\n");
+	Is_Journal_Enabled = 1;
+	Journal_Transfer_Offset = Offset;
+	Journal_Extent.Address = Address;
+	Journal_Extent.Offset = 0;
+	Journal_Extent.Size = Bytes_Count;
+	Pointer_Journal_Data = Pointer_Buffer;
+	Journal_Output_File = File;
+	if (Is_Resume_Requested) Journal_Output_File_Offset = -1;
+	else Journal_Output_File_Offset = 0;
+	if (Offset < Bytes_Count)
+	{
+		Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_READ_FLASH, Address + Offset, Bytes_Count - Offset);
+		Result = ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, &Pointer_Buffer[Offset], Bytes_Count - Offset, "Read");
+	}
+	Is_Journal_Enabled = 0;
+	JournalClose(&Journal, Result == 0); // Keep the journal to resume a failed read
+	
+	free(Pointer_Buffer);
+	fclose(File);
+	return Result;
+}
+
+/** Tell where an extent is located when an image is made of several extents.
+ * @param Pointer_Image The image.
+ * @param Extent_Index The extent index.
+ * @param Offset The data offset the extent transfer starts from.
+ */
+static void DisplayExtent(TImage *Pointer_Image, unsigned int Extent_Index, unsigned int Offset)
+{
+	TImageExtent *Pointer_Extent;
+	
+	if (Pointer_Image->Extents_Count < 2) return;
 	
-	// Receive the data
-	for (i = 0; i < Bytes_Count; i++)
+	Pointer_Extent = &Pointer_Image->Pointer_Extents[Extent_Index];
+	printf("Extent %u/%u : %u bytes at 0x%08X.\n", Extent_Index + 1, Pointer_Image->Extents_Count, Pointer_Extent->Offset + Pointer_Extent->Size - Offset, Pointer_Extent->Address + Offset - Pointer_Extent->Offset);
+}
+
+/** Display the pages the last write could not program.
+ * @param Failed_Pages_Count How many pages failed, as told by the last data acknowledge.
+ * @return 0 if the failures were displayed, -1 if the firmware can't report them (an error message is displayed).
+ */
+static int DisplayWriteFailures(unsigned int Failed_Pages_Count)
+{
+	unsigned char Command = PROTOCOL_COMMAND_READ_WRITE_FAILURES, Failures[PROTOCOL_WRITE_FAILURES_SIZE];
+	unsigned int Listed_Failures_Count, Chips_Mask, i, j;
+	
+	if (ExecuteCommand(&Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Failures, sizeof(Failures), NULL) != 0) return -1;
+	
+	// The programmer remembers only the first failures
+	Listed_Failures_Count = ProtocolGetDoubleWord(Failures);
+	if (Listed_Failures_Count > PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT) Listed_Failures_Count = PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT;
+	for (i = 0; i < Listed_Failures_Count; i++)
 	{
-		Byte = UARTReadByte();
-		if (fwrite(&Byte, 1, 1, File) != 1)
+		printf("Page 0x%08X could not be programmed on chips", ProtocolGetDoubleWord(&Failures[4 + i * 8]));
+		Chips_Mask = ProtocolGetDoubleWord(&Failures[8 + i * 8]);
+		for (j = 0; j < 8; j++)
 		{
-			printf("Error : could not write the byte %d.\n", i);
-			break;
+			if (Chips_Mask & (1 << j)) printf(" %u", j);
 		}
-
-		printf("Read bytes : %u/%u\r", i + 1, Bytes_Count);
+		printf(".\n");
 	}
-	
-	printf("\n");
-	fclose(File);
+	if (Failed_Pages_Count > Listed_Failures_Count) printf("%u more pages could not be programmed.\n", Failed_Pages_Count - Listed_Failures_Count);
+	return 0;
 }
 
-/** Write data to the flash memory.
- * @param Address The address to start writing to.
- * @param String_File_Name The path of the file containing the data to write.
+/** Write all extents of an image to the flash memory. When --verify-pages is used, the programmer reads each page back right after writing it, and the failed pages are displayed.
+ * @param Pointer_Image The image.
+ * @param String_File_Name The path of the file the image was loaded from (the journal is stored next to it), or NULL not to journal the write.
+ * @param Address The address identifying the write in the journal.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted write from its last checkpoint.
+ * @param Pointer_Failed_Chips_Mask On output, contain the mask of the chips some pages could not be programmed to (always 0 when the pages are not read back).
+ * @return 0 if the whole image was transferred, -1 if an error occurred (an error message is displayed and the journal is kept to resume the write).
  */
-static void CommandWriteFlash(unsigned int Address, char *String_File_Name)
+static int WriteImage(TImage *Pointer_Image, char *String_File_Name, unsigned int Address, int Is_Resume_Requested, unsigned int *Pointer_Failed_Chips_Mask)
 {
-	FILE *File;
-	unsigned int Bytes_Count, i;
-	unsigned char Byte;
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size, Offset, Extent_End, Failed_Chips_Mask = 0, Failed_Pages_Count, i;
+	TImageExtent *Pointer_Extent;
 	
-	// Try to open the file
-	File = fopen(String_File_Name, "rb");
-	if (File == NULL)
+	// Without journal, the whole image is written
+	Offset = 0;
+	if (String_File_Name != NULL)
 	{
-		printf("Error : could not open the file '%s'.\n", String_File_Name);
-		exit(EXIT_FAILURE);
+		if (JournalOpen(&Journal, String_File_Name, 'w', Address, Pointer_Image->Size, Is_Resume_Requested) != 0) return -1;
+		
+		// Make sure the last checkpoint is really in the flash
+		if (Is_Resume_Requested && (Journal.Checkpoint_Size > 0))
+		{
+			if (!JournalIsLastCheckpointValid(&Journal, Pointer_Image->Pointer_Data))
+			{
+				printf("Error : the file content changed since the write was interrupted, write it again without resuming.\n");
+				JournalClose(&Journal, 0);
+				return -1;
+			}
+			
+			// A checkpoint never spans several extents
+			printf("Verifying the last checkpoint...\n");
+			Pointer_Extent = ImageFindExtent(Pointer_Image, Journal.Checkpoint_Offset);
+			Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_VERIFY_FLASH, Pointer_Extent->Address + Journal.Checkpoint_Offset - Pointer_Extent->Offset, Journal.Checkpoint_Size);
+			if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_TO_PROGRAMMER, &Pointer_Image->Pointer_Data[Journal.Checkpoint_Offset], Journal.Checkpoint_Size, NULL) != 0)
+			{
+				JournalClose(&Journal, 0);
+				return -1;
+			}
+			if ((Transfer.Acknowledge_Payload_Size > 0) && (Transfer.Acknowledge_Payload[0] != 0))
+			{
+				printf("Warning : the last checkpoint data is not in the flash, it will be written again.\n");
+				JournalDiscardLastCheckpoint(&Journal);
+			}
+		}
+		Offset = JournalGetResumeOffset(&Journal);
+		if (Offset > 0) printf("Resuming from offset 0x%08X.\n", Offset);
+		Is_Journal_Enabled = 1;
 	}
 	
-	// Get the file size
-	Bytes_Count = GetFileSize(File);
+	// Each extent is written by its own command, so the sectors between extents are neither erased nor written
+	printf("Erasing blocks and writing data...\n");
+	Pointer_Journal_Data = Pointer_Image->Pointer_Data;
+	Journal_Output_File = NULL;
+	for (i = 0; i < Pointer_Image->Extents_Count; i++)
+	{
+		Pointer_Extent = &Pointer_Image->Pointer_Extents[i];
+		Extent_End = Pointer_Extent->Offset + Pointer_Extent->Size;
+		if (Offset >= Extent_End) continue; // This extent was written before the transfer was interrupted
+		DisplayExtent(Pointer_Image, i, Offset);
+		
+		// The programmer acknowledges the command once the sectors are erased
+		Journal_Transfer_Offset = Offset;
+		Journal_Extent = *Pointer_Extent;
+		Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_WRITE_FLASH, Pointer_Extent->Address + Offset - Pointer_Extent->Offset, Extent_End - Offset);
+		if (Is_Page_Verification_Requested)
+		{
+			Command[Command_Size] = PROTOCOL_WRITE_FLAG_VERIFY_PAGES;
+			Command_Size++;
+		}
+		if (ExecuteCommand(Command, Command_Size, ProtocolGetWriteCommandTimeout(Extent_End - Offset), PROTOCOL_DIRECTION_TO_PROGRAMMER, &Pointer_Image->Pointer_Data[Offset], Extent_End - Offset, "Written") != 0) goto Exit_Error;
+		Offset = Extent_End;
+		
+		// The last data acknowledge tells about all pages of the extent
+		if (Is_Page_Verification_Requested)
+		{
+			if (Transfer.Acknowledge_Payload_Size < 3)
+			{
+				printf("Error : the programmer firmware does not read the pages back.\n");
+				goto Exit_Error;
+			}
+			Failed_Chips_Mask |= Transfer.Acknowledge_Payload[0];
+			Failed_Pages_Count = (Transfer.Acknowledge_Payload[1] << 8) | Transfer.Acknowledge_Payload[2];
+			if ((Failed_Pages_Count > 0) && (DisplayWriteFailures(Failed_Pages_Count) != 0)) goto Exit_Error;
+		}
+	}
+	if (Is_Journal_Enabled)
+	{
+		Is_Journal_Enabled = 0;
+		JournalClose(&Journal, 1);
+	}
 	
-	// Send the write command
-	UARTWriteByte(COMMAND_WRITE_FLASH);
+	*Pointer_Failed_Chips_Mask = Failed_Chips_Mask;
+	return 0;
 	
-	// Send the address
-	UARTWriteByte(Address >> 24);
-	UARTWriteByte(Address >> 16);
-	UARTWriteByte(Address >> 8);
-	UARTWriteByte(Address);
+Exit_Error:
+	if (Is_Journal_Enabled)
+	{
+		Is_Journal_Enabled = 0;
+		JournalClose(&Journal, 0);
+	}
+	return -1;
+}
+
+/** Write data to the flash memory.
+ * @param Address The address to start writing to (binary file) or the value to shift the file addresses by (other file formats).
+ * @param String_File_Name The path of the file containing the data to write.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted write from its last checkpoint.
+ * @return 0 if all pages were programmed, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandWriteFlash(unsigned int Address, char *String_File_Name, int Is_Resume_Requested)
+{
+	TImage Image;
+	unsigned int Failed_Chips_Mask;
+	int Result;
 	
-	// Send the bytes count
-	UARTWriteByte(Bytes_Count >> 24);
-	UARTWriteByte(Bytes_Count >> 16);
-	UARTWriteByte(Bytes_Count >> 8);
-	UARTWriteByte(Bytes_Count);
+	if (LoadImage(&Image, String_File_Name, Address) != 0) return -1;
+	Result = WriteImage(&Image, String_File_Name, Address, Is_Resume_Requested, &Failed_Chips_Mask);
+	ImageFree(&Image);
+	if (Result != 0) return -1;
 	
-	printf("Erasing blocks...\n");
-	if (UARTReadByte() != COMMAND_MICROCONTROLLER_READY) printf("Warning : the microcontroller did not send the expected \"ready\" code.\n");
+	if (Failed_Chips_Mask != 0)
+	{
+		printf("Error : some pages could not be programmed.\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** Compare the flash content of all selected chips with an image.
+ * @param Pointer_Image The expected data.
+ * @param Pointer_Failed_Chips_Mask On output, contain the mask of the chips whose content differs from the image.
+ * @return 0 if the whole image was compared, -1 if an error occurred (an error message is displayed).
+ */
+static int VerifyImage(TImage *Pointer_Image, unsigned int *Pointer_Failed_Chips_Mask)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size, Failed_Chips_Mask = 0, i;
+	TImageExtent *Pointer_Extent;
 	
 	// Send the data
-	printf("Writing data...\n");
-	for (i = 0; i < Bytes_Count; i++)
+	printf("Verifying data...\n");
+	for (i = 0; i < Pointer_Image->Extents_Count; i++)
 	{
-		// Wait for the microcontroller to become ready
-		if (UARTReadByte() != COMMAND_MICROCONTROLLER_READY) printf("Warning : the microcontroller did not send the expected \"ready\" code.\n");
+		Pointer_Extent = &Pointer_Image->Pointer_Extents[i];
+		DisplayExtent(Pointer_Image, i, Pointer_Extent->Offset);
 		
-		// Read a byte
-		if (fread(&Byte, 1, 1, File) == 1) UARTWriteByte(Byte); // Send it
-		else
-		{
-			printf("Error : could not read the %u byte of the file.\n", i);
-			break;
-		}
-
-		printf("Written bytes : %u/%u\r", i + 1, Bytes_Count);
+		Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_VERIFY_FLASH, Pointer_Extent->Address, Pointer_Extent->Size);
+		if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_TO_PROGRAMMER, &Pointer_Image->Pointer_Data[Pointer_Extent->Offset], Pointer_Extent->Size, "Verified") != 0) return -1;
+		
+		// Each data block acknowledge contains the chips that failed up to this block, so the last one tells the extent result
+		if (Transfer.Acknowledge_Payload_Size > 0) Failed_Chips_Mask |= Transfer.Acknowledge_Payload[0];
 	}
 	
-	printf("\n");
-	fclose(File);
+	*Pointer_Failed_Chips_Mask = Failed_Chips_Mask;
+	return 0;
 }
 
-//-------------------------------------------------------------------------------------------------
-// Entry point
-//-------------------------------------------------------------------------------------------------
-int main(int argc, char *argv[])
+/** Compare the flash content of all selected chips with a file.
+ * @param Address The address to start comparing from (binary file) or the value to shift the file addresses by (other file formats).
+ * @param String_File_Name The path of the file containing the expected data.
+ * @return 0 if all chips contain the expected data, -1 if at least one chip differs or if an error occurred.
+ */
+static int CommandVerifyFlash(unsigned int Address, char *String_File_Name)
 {
-	char *String_Serial_Port_Name, *String_Command;
-	unsigned int Address, Count;
+	unsigned int Failed_Chips_Mask, i;
+	TImage Image;
+	int Result;
 	
-	// Check parameters
-	if (argc < 3)
+	if (LoadImage(&Image, String_File_Name, Address) != 0) return -1;
+	Result = VerifyImage(&Image, &Failed_Chips_Mask);
+	ImageFree(&Image);
+	if (Result != 0) return -1;
+	
+	// Display each chip result
+	if (Failed_Chips_Mask == 0)
 	{
-		printf("Error : bad parameters.\n"
-			"Usage : %s Serial_Port Command [Command parameters]\n"
-			"Available commands :\n"
-			"  d <Address(hex)> <Instructions_Count>        Dump Instructions_Count 4-byte instructions from the specified address.\n"
-			"  r <Address(hex)> <Bytes_Count> <File_Name>   Read Bytes_Count bytes from the specified address and store them in the specified File_Name.\n"
-			"  w <Address(hex)> <File_Name>                 Write the File_Name content at the specified address.\n", argv[0]);
-		return EXIT_FAILURE;
+		printf("All selected chips contain the expected data.\n");
+		return 0;
 	}
-	String_Serial_Port_Name = argv[1];
-	String_Command = argv[2];
+	for (i = 0; i < 8; i++)
+	{
+		if (Failed_Chips_Mask & (1 << i)) printf("Chip %u content differs from the file.\n", i);
+	}
+	return -1;
+}
+
+/** Retrieve the flash regions from the layout file if the user provided one, or from the flash descriptor.
+ * @param Pointer_Layout On output, contain the regions.
+ * @return 0 if the regions were retrieved, -1 if an error occurred (an error message is displayed).
+ */
+static int LoadLayout(TLayout *Pointer_Layout)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], Descriptor[LAYOUT_DESCRIPTOR_SIZE];
+	unsigned int Command_Size;
 	
-	// Open the serial port
-	printf("Initializing serial port... ");
-	fflush(stdout);
-	if (UARTOpen(String_Serial_Port_Name) == 0)
+	if (String_Layout_File_Name != NULL) return LayoutLoadFile(Pointer_Layout, String_Layout_File_Name);
+	
+	Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_READ_FLASH, 0, sizeof(Descriptor));
+	if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Descriptor, sizeof(Descriptor), NULL) != 0) return -1;
+	if (LayoutParseDescriptor(Pointer_Layout, Descriptor, sizeof(Descriptor)) != 0)
 	{
-		printf("Error : could not open the serial port '%s'.\n", String_Serial_Port_Name);
-		return EXIT_FAILURE;
+		printf("Error : the flash does not contain an Intel Flash Descriptor, use --layout to describe its regions.\n");
+		return -1;
 	}
-	atexit(ExitCloseUART);
-	printf("done.\n");
+	return 0;
+}
+
+/** Find a region from its name.
+ * @param Pointer_Layout The layout.
+ * @param String_Region_Name The region name.
+ * @return The region, or NULL if the layout does not contain the region (an error message is displayed).
+ */
+static TLayoutRegion *FindRegion(TLayout *Pointer_Layout, char *String_Region_Name)
+{
+	TLayoutRegion *Pointer_Region;
+	unsigned int i;
 	
-	// Execute the right command
-	switch (*String_Command)
+	Pointer_Region = LayoutFindRegion(Pointer_Layout, String_Region_Name);
+	if (Pointer_Region == NULL)
 	{
-		case 'd':
-			if (argc != 5) printf("Error : missing parameters.\n");
-			else
-			{
-				// Convert parameters
-				sscanf(argv[3], "%X", &Address);
-				Count = atoi(argv[4]);
-				CommandDumpFlash(Address, Count);
-			}
-			break;
-			
-		case 'r':
-			if (argc != 6) printf("Error : missing parameters.\n");
-			else
-			{
-				// Convert parameters
-				sscanf(argv[3], "%X", &Address);
-				Count = atoi(argv[4]);
-				CommandReadFlash(Address, Count, argv[5]);
-			}
-			break;
-			
-		case 'w':
-			if (argc != 5) printf("Error : missing parameters.\n");
-			else
-			{
-				// Convert parameters
-				sscanf(argv[3], "%X", &Address);
-				CommandWriteFlash(Address, argv[4]);
-			}
-			break;
-			
-		default:
-			printf("Error : unknown command.\n");
-			return EXIT_FAILURE;
+		printf("Error : there is no '%s' region, available regions are :", String_Region_Name);
+		for (i = 0; i < Pointer_Layout->Regions_Count; i++) printf(" %s", Pointer_Layout->Regions[i].String_Name);
+		printf(".\n");
 	}
+	return Pointer_Region;
+}
+
+/** Display the flash regions.
+ * @return 0 if the regions were displayed, -1 if they can't be retrieved (an error message is displayed).
+ */
+static int CommandListRegions(void)
+{
+	TLayout Layout;
+	TLayoutRegion *Pointer_Region;
+	unsigned int i;
 	
-	return EXIT_SUCCESS;
+	if (LoadLayout(&Layout) != 0) return -1;
+	for (i = 0; i < Layout.Regions_Count; i++)
+	{
+		Pointer_Region = &Layout.Regions[i];
+		printf("%-12s 0x%08X-0x%08X (%u KB)\n", Pointer_Region->String_Name, Pointer_Region->Address, Pointer_Region->Address + Pointer_Region->Size - 1, Pointer_Region->Size / 1024);
+	}
+	return 0;
+}
+
+/** Read a single flash region.
+ * @param String_Region_Name The region name.
+ * @param String_File_Name The region content will be stored in this file.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted read from its last checkpoint.
+ * @return 0 if the region was read and stored, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandReadRegion(char *String_Region_Name, char *String_File_Name, int Is_Resume_Requested)
+{
+	TLayout Layout;
+	TLayoutRegion *Pointer_Region;
+	
+	if (LoadLayout(&Layout) != 0) return -1;
+	Pointer_Region = FindRegion(&Layout, String_Region_Name);
+	if (Pointer_Region == NULL) return -1;
+	printf("Region '%s' is located at 0x%08X (%u bytes).\n", Pointer_Region->String_Name, Pointer_Region->Address, Pointer_Region->Size);
+	
+	return CommandReadFlash(Pointer_Region->Address, Pointer_Region->Size, String_File_Name, Is_Resume_Requested);
+}
+
+/** Write a single flash region from a whole flash image, leaving the other regions untouched.
+ * @param String_Region_Name The region name.
+ * @param String_File_Name The whole flash image.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted write from its last checkpoint.
+ * @return 0 if all region pages were programmed, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandWriteRegion(char *String_Region_Name, char *String_File_Name, int Is_Resume_Requested)
+{
+	TImage Image;
+	TLayout Image_Layout, Flash_Layout;
+	TLayoutRegion *Pointer_Region, *Pointer_Flash_Region;
+	unsigned int Descriptor_Size, Failed_Chips_Mask;
+	
+	if (LoadImage(&Image, String_File_Name, 0) != 0) return -1;
+	
+	if (String_Layout_File_Name != NULL)
+	{
+		if (LoadLayout(&Image_Layout) != 0) goto Exit_Error;
+		Pointer_Region = FindRegion(&Image_Layout, String_Region_Name);
+		if (Pointer_Region == NULL) goto Exit_Error;
+	}
+	else
+	{
+		// The region location comes from the image descriptor, the file must provide it up to the region section end
+		if ((Image.Extents_Count == 0) || (Image.Pointer_Extents[0].Address != 0)) Descriptor_Size = 0;
+		else Descriptor_Size = LayoutGetDescriptorSize(Image.Pointer_Data, Image.Pointer_Extents[0].Size);
+		if (Descriptor_Size == 0)
+		{
+			printf("Error : the file does not contain an Intel Flash Descriptor, use --layout to describe its regions.\n");
+			goto Exit_Error;
+		}
+		if (LayoutParseDescriptor(&Image_Layout, Image.Pointer_Data, Image.Pointer_Extents[0].Size) != 0)
+		{
+			printf("Error : the file Intel Flash Descriptor region section ends at 0x%08X but the file data starting at address 0 stops at 0x%08X, use --layout to describe its regions.\n", Descriptor_Size - 1, Image.Pointer_Extents[0].Size - 1);
+			goto Exit_Error;
+		}
+		Pointer_Region = FindRegion(&Image_Layout, String_Region_Name);
+		if (Pointer_Region == NULL) goto Exit_Error;
+		
+		// Writing the region at a place the flash uses for something else would make the flash content inconsistent
+		if (LoadLayout(&Flash_Layout) != 0) goto Exit_Error;
+		Pointer_Flash_Region = LayoutFindRegion(&Flash_Layout, String_Region_Name);
+		if ((Pointer_Flash_Region == NULL) || (Pointer_Flash_Region->Address != Pointer_Region->Address) || (Pointer_Flash_Region->Size != Pointer_Region->Size))
+		{
+			printf("Error : the flash and the file do not locate the '%s' region at the same place, write the whole file instead.\n", Pointer_Region->String_Name);
+			goto Exit_Error;
+		}
+	}
+	printf("Region '%s' is located at 0x%08X (%u bytes).\n", Pointer_Region->String_Name, Pointer_Region->Address, Pointer_Region->Size);
+	
+	if (ImageClip(&Image, Pointer_Region->Address, Pointer_Region->Size) != 0) goto Exit_Error;
+	if (Image.Extents_Count == 0)
+	{
+		printf("Error : the file does not contain any data for the '%s' region.\n", Pointer_Region->String_Name);
+		goto Exit_Error;
+	}
+	if (WriteImage(&Image, String_File_Name, Pointer_Region->Address, Is_Resume_Requested, &Failed_Chips_Mask) != 0) goto Exit_Error;
+	if (Failed_Chips_Mask != 0)
+	{
+		printf("Error : some pages could not be programmed.\n");
+		goto Exit_Error;
+	}
+	ImageFree(&Image);
+	return 0;
+	
+Exit_Error:
+	ImageFree(&Image);
+	return -1;
+}
+
+/** Choose the chips the next commands apply to.
+ * @param Chips_Mask Bit n set means that chip n is selected.
+ * @param Pointer_Selected_Chips_Mask On output, contain the mask of the chips really selected.
+ * @return 0 if the programmer selected the chips, -1 if an error occurred (an error message is displayed).
+ */
+static int SelectChips(unsigned int Chips_Mask, unsigned int *Pointer_Selected_Chips_Mask)
+{
+	unsigned char Command[2];
+	
+	Command[0] = PROTOCOL_COMMAND_SELECT_CHIPS;
+	Command[1] = Chips_Mask;
+	if (ExecuteCommand(Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_NONE, NULL, 0, NULL) != 0) return -1;
+	if (Transfer.Acknowledge_Payload_Size > 0) *Pointer_Selected_Chips_Mask = Transfer.Acknowledge_Payload[0];
+	else *Pointer_Selected_Chips_Mask = 0;
+	return 0;
+}
+
+/** Choose the chips the next commands apply to. Erase and write commands program all selected chips at the same time.
+ * @param Chips_Mask Bit n set means that chip n is selected.
+ * @return 0 if the programmer selected the chips, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandSelectChips(unsigned int Chips_Mask)
+{
+	unsigned int Selected_Chips_Mask, i;
+	
+	if (SelectChips(Chips_Mask, &Selected_Chips_Mask) != 0) return -1;
+	
+	printf("Selected chips :");
+	for (i = 0; i < 8; i++)
+	{
+		if (Selected_Chips_Mask & (1 << i)) printf(" %u", i);
+	}
+	if (Selected_Chips_Mask == 0) printf(" none");
+	printf(".\n");
+	
+	if (Selected_Chips_Mask != Chips_Mask) printf("Warning : some of the requested chips are not connected to the programmer.\n");
+	return 0;
+}
+
+/** Display where the programmer time went since the previous statistics command (the programmer clears its statistics each time they are read).
+ * @return 0 if the statistics were displayed, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandReadStatistics(void)
+{
+	static const char *String_Time_Names[] =
+	{
+		"SPI transfers",
+		"UART transmission wait",
+		"UART reception wait",
+		"Flash status polling"
+	};
+	unsigned char Command = PROTOCOL_COMMAND_READ_STATISTICS, Statistics[PROTOCOL_STATISTICS_SIZE];
+	unsigned int Timer_Frequency, i;
+	
+	if (ExecuteCommand(&Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Statistics, sizeof(Statistics), NULL) != 0) return -1;
+	
+	// A null timer frequency means that the firmware does not measure times
+	Timer_Frequency = ProtocolGetDoubleWord(Statistics);
+	if (Timer_Frequency == 0) printf("The firmware was built without statistics, only the UART overruns are counted.\n");
+	else
+	{
+		for (i = 0; i < sizeof(String_Time_Names) / sizeof(String_Time_Names[0]); i++) printf("%-22s : %.3f ms\n", String_Time_Names[i], ProtocolGetDoubleWord(&Statistics[4 + i * 4]) * 1000.0 / Timer_Frequency);
+		printf("%-22s : %u\n", "Erase cycles", ProtocolGetDoubleWord(&Statistics[20]));
+		printf("%-22s : %u\n", "Page program cycles", ProtocolGetDoubleWord(&Statistics[24]));
+	}
+	printf("%-22s : %u\n", "UART overruns", ProtocolGetDoubleWord(&Statistics[28]));
+	return 0;
+}
+
+/** Measure the serial link latency and throughput with various frame and window sizes. When the low latency mode is enabled, the link is measured without it first to tell the improvement.
+ * @param Iterations_Count How many round trips are measured for each frame size.
+ * @return 0 if the link was measured, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandProbe(unsigned int Iterations_Count)
+{
+	static TProbeReport Report_Default, Report; // Too large to be put on the stack
+	
+	if (Is_Low_Latency_Enabled)
+	{
+		UARTSetLowLatency(&UART, 0);
+		printf("Without low latency mode :\n");
+		if (ProbeMeasure(&UART, &Next_Command_Sequence, Iterations_Count, &Report_Default) != 0) return -1;
+		ProbeDisplayReport(&Report_Default);
+		
+		UARTSetLowLatency(&UART, 1);
+		printf("\nWith low latency mode :\n");
+	}
+	
+	if (ProbeMeasure(&UART, &Next_Command_Sequence, Iterations_Count, &Report) != 0) return -1;
+	ProbeDisplayReport(&Report);
+	
+	if (Is_Low_Latency_Enabled)
+	{
+		printf("\nLow latency mode improvement :\n");
+		ProbeDisplayImprovement(&Report_Default, &Report);
+	}
+	return 0;
+}
+
+/** Find the fastest SPI clock the selected chips sustain, display the result of each tried clock and store the selected frequency to the --spi-clock file.
+ * @param Address The address of a sector the calibration can erase.
+ * @return 0 if a clock was selected, -1 if no clock works or if an error occurred (an error message is displayed).
+ */
+static int CommandCalibrateSPIClock(unsigned int Address)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], Result[PROTOCOL_SPI_CALIBRATION_RESULT_SIZE];
+	unsigned int Command_Size, Frequency, Failed_Chips_Mask, Failed_Reads_Count, i, j;
+	FILE *Pointer_File;
+	
+	Command_Size = ProtocolBuildSPIClockCommand(Command, PROTOCOL_COMMAND_CALIBRATE_SPI_CLOCK, Address);
+	if (ExecuteCommand(Command, Command_Size, PROTOCOL_SPI_CALIBRATION_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Result, sizeof(Result), NULL) != 0) return -1;
+	
+	for (i = 0; i < PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT; i++)
+	{
+		printf("%6.3f MHz : ", ProtocolGetDoubleWord(&Result[4 + i * 12]) / 1e6);
+		Failed_Chips_Mask = ProtocolGetDoubleWord(&Result[8 + i * 12]);
+		Failed_Reads_Count = ProtocolGetDoubleWord(&Result[12 + i * 12]);
+		if (Failed_Reads_Count == PROTOCOL_SPI_CALIBRATION_CLOCK_SKIPPED) printf("not tried\n");
+		else if (Failed_Chips_Mask == 0) printf("passed\n");
+		else
+		{
+			printf("%u failed reads on chips", Failed_Reads_Count);
+			for (j = 0; j < 8; j++)
+			{
+				if (Failed_Chips_Mask & (1 << j)) printf(" %u", j);
+			}
+			printf("\n");
+		}
+	}
+	
+	Frequency = ProtocolGetDoubleWord(Result);
+	if (Frequency == 0)
+	{
+		printf("Error : no SPI clock works, check the chips wiring.\n");
+		return -1;
+	}
+	printf("Selected SPI clock : %.3f MHz.\n", Frequency / 1e6);
+	
+	// Let the next sessions on this station use the same clock
+	if (String_SPI_Clock_File_Name == NULL) return 0;
+	Pointer_File = fopen(String_SPI_Clock_File_Name, "w");
+	if (Pointer_File == NULL)
+	{
+		printf("Error : could not create the file '%s'.\n", String_SPI_Clock_File_Name);
+		return -1;
+	}
+	fprintf(Pointer_File, "%u\n", Frequency);
+	fclose(Pointer_File);
+	return 0;
+}
+
+/** Make the programmer use the SPI clock stored to the --spi-clock file by a previous calibration. Nothing is done if the file does not exist yet.
+ * @return 0 if the clock was applied or if there is no file yet, -1 if the file is invalid or if an error occurred (an error message is displayed).
+ */
+static int ApplyCalibratedSPIClock(void)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size, Frequency;
+	FILE *Pointer_File;
+	int Is_Frequency_Valid;
+	
+	Pointer_File = fopen(String_SPI_Clock_File_Name, "r");
+	if (Pointer_File == NULL) return 0;
+	Is_Frequency_Valid = (fscanf(Pointer_File, "%u", &Frequency) == 1) && (Frequency > 0);
+	fclose(Pointer_File);
+	if (!Is_Frequency_Valid)
+	{
+		printf("Error : the SPI clock file '%s' does not contain a frequency.\n", String_SPI_Clock_File_Name);
+		return -1;
+	}
+	
+	Command_Size = ProtocolBuildSPIClockCommand(Command, PROTOCOL_COMMAND_SET_SPI_CLOCK, Frequency);
+	if (ExecuteCommand(Command, Command_Size, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_NONE, NULL, 0, NULL) != 0) return -1;
+	if (Transfer.Acknowledge_Payload_Size < 4)
+	{
+		printf("Error : the programmer firmware can't change the SPI clock.\n");
+		return -1;
+	}
+	printf("Using the %.3f MHz SPI clock calibrated on this station.\n", ProtocolGetDoubleWord(Transfer.Acknowledge_Payload) / 1e6);
+	return 0;
+}
+
+/** Convert a string of hexadecimal digits to bytes (two digits per byte, the first byte first).
+ * @param String_Hexadecimal The string to convert.
+ * @param Pointer_Bytes On output, contain the bytes.
+ * @param Maximum_Bytes_Count How many bytes the output buffer can contain.
+ * @return How many bytes were converted, or -1 if the string is not made of hexadecimal digit pairs or if it is too long.
+ */
+static int ConvertHexadecimalBytes(char *String_Hexadecimal, unsigned char *Pointer_Bytes, unsigned int Maximum_Bytes_Count)
+{
+	unsigned int Bytes_Count = 0, Byte;
+	
+	while (*String_Hexadecimal != 0)
+	{
+		if ((Bytes_Count >= Maximum_Bytes_Count) || !isxdigit((unsigned char) String_Hexadecimal[0]) || !isxdigit((unsigned char) String_Hexadecimal[1])) return -1;
+		sscanf(String_Hexadecimal, "%2X", &Byte);
+		Pointer_Bytes[Bytes_Count] = Byte;
+		Bytes_Count++;
+		String_Hexadecimal += 2;
+	}
+	return Bytes_Count;
+}
+
+/** Display the addresses a byte pattern is stored at. The programmer searches the flash itself, so only the match addresses go through the serial link.
+ * @param Address The address to start searching from.
+ * @param Bytes_Count How many bytes to search.
+ * @param String_Pattern The searched bytes as hexadecimal digits.
+ * @param String_Mask Only the bits set in the mask are compared (hexadecimal digits, as long as the pattern), NULL to compare all bits.
+ * @return 0 if the whole area was searched, -1 if an error occurred (an error message is displayed).
+ */
+static int CommandSearchFlash(unsigned int Address, unsigned int Bytes_Count, char *String_Pattern, char *String_Mask)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE], Result[PROTOCOL_SEARCH_RESULT_SIZE];
+	unsigned int End_Address, Next_Address, Matches_Count, Total_Matches_Count = 0, Command_Size, i;
+	int Pattern_Size;
+	
+	// Build the command (the pattern and the mask follow the address and bytes count parameters)
+	Pattern_Size = ConvertHexadecimalBytes(String_Pattern, &Command[10], PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE);
+	if (Pattern_Size <= 0)
+	{
+		printf("Error : the pattern must be made of 1 to %d bytes written as hexadecimal digit pairs.\n", PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE);
+		return -1;
+	}
+	if (String_Mask == NULL) memset(&Command[10 + Pattern_Size], 0xFF, Pattern_Size);
+	else if (ConvertHexadecimalBytes(String_Mask, &Command[10 + Pattern_Size], Pattern_Size) != Pattern_Size)
+	{
+		printf("Error : the mask must be as long as the pattern and written as hexadecimal digit pairs.\n");
+		return -1;
+	}
+	Command[9] = Pattern_Size;
+	Command_Size = 10 + 2 * Pattern_Size;
+	
+	// The programmer stops searching when its matches list is full, so continue from where it stopped
+	End_Address = Address + Bytes_Count;
+	while (Address < End_Address)
+	{
+		ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_SEARCH_FLASH, Address, End_Address - Address);
+		if (ExecuteCommand(Command, Command_Size, ProtocolGetSearchCommandTimeout(End_Address - Address), PROTOCOL_DIRECTION_FROM_PROGRAMMER, Result, sizeof(Result), NULL) != 0) return -1;
+		
+		Next_Address = ProtocolGetDoubleWord(Result);
+		Matches_Count = ProtocolGetDoubleWord(&Result[4]);
+		if ((Next_Address <= Address) || (Next_Address > End_Address) || (Matches_Count > PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT))
+		{
+			printf("Error : the programmer sent an invalid search result.\n");
+			return -1;
+		}
+		
+		for (i = 0; i < Matches_Count; i++) printf("0x%08X\n", ProtocolGetDoubleWord(&Result[8 + i * 4]));
+		Total_Matches_Count += Matches_Count;
+		Address = Next_Address;
+	}
+	
+	printf("%u matches found.\n", Total_Matches_Count);
+	return 0;
+}
+
+/** Make the programmer probe its sockets and tell which chips were inserted or removed since the previous call.
+ * @param Pointer_Available_Chips_Mask On output, contain the mask of the chips currently available.
+ * @param Pointer_Inserted_Chips_Mask On output, contain the mask of the inserted chips.
+ * @param Pointer_Removed_Chips_Mask On output, contain the mask of the removed chips.
+ * @return 0 if the chips events were read, -1 if the firmware can't report them or if an error occurred (an error message is displayed).
+ */
+static int ReadChipsEvents(unsigned int *Pointer_Available_Chips_Mask, unsigned int *Pointer_Inserted_Chips_Mask, unsigned int *Pointer_Removed_Chips_Mask)
+{
+	unsigned char Command = PROTOCOL_COMMAND_READ_CHIPS_EVENTS;
+	
+	if (ExecuteCommand(&Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_NONE, NULL, 0, NULL) != 0) return -1;
+	if (Transfer.Acknowledge_Payload_Size < 3)
+	{
+		printf("Error : the programmer firmware does not report the chips insertion.\n");
+		return -1;
+	}
+	
+	*Pointer_Available_Chips_Mask = Transfer.Acknowledge_Payload[0];
+	*Pointer_Inserted_Chips_Mask = Transfer.Acknowledge_Payload[1];
+	*Pointer_Removed_Chips_Mask = Transfer.Acknowledge_Payload[2];
+	return 0;
+}
+
+/** Program and verify the same image in each chip inserted in the programmer sockets, without restarting the programmer or this program between chips. The chips inserted at the same time are programmed together.
+ * @param Address The address to start writing to (binary file) or the value to shift the file addresses by (other file formats).
+ * @param String_File_Name The path of the file containing the data to write, it is loaded only once.
+ * @param Chips_Count Stop after this amount of chips has been programmed, 0 to continue until the program is stopped.
+ * @return 0 if all chips were successfully programmed, -1 if at least one chip failed or if an error occurred.
+ */
+static int CommandProduction(unsigned int Address, char *String_File_Name, unsigned int Chips_Count)
+{
+	TImage Image;
+	unsigned int Available_Chips_Mask, Inserted_Chips_Mask, Removed_Chips_Mask, Selected_Chips_Mask, Failed_Chips_Mask, Programmed_Chips_Count = 0, Failed_Chips_Count = 0, i;
+	int Is_First_Probe = 1;
+	
+	if (LoadImage(&Image, String_File_Name, Address) != 0) return -1;
+	printf("Production mode : each chip inserted in a socket is programmed and verified, then can be removed.\n");
+	
+	while ((Chips_Count == 0) || (Programmed_Chips_Count < Chips_Count))
+	{
+		if (ReadChipsEvents(&Available_Chips_Mask, &Inserted_Chips_Mask, &Removed_Chips_Mask) != 0) goto Exit_Error;
+		
+		// The chips already inserted when the production starts are programmed too
+		if (Is_First_Probe)
+		{
+			Inserted_Chips_Mask = Available_Chips_Mask;
+			Is_First_Probe = 0;
+		}
+		
+		for (i = 0; i < 8; i++)
+		{
+			if (Removed_Chips_Mask & (1 << i)) printf("Chip %u removed.\n", i);
+		}
+		
+		// A chip inserted then removed before the probe is gone
+		Inserted_Chips_Mask &= Available_Chips_Mask;
+		if (Inserted_Chips_Mask == 0)
+		{
+			fflush(stdout);
+			usleep(PRODUCTION_POLLING_PERIOD * 1000);
+			continue;
+		}
+		
+		// Program all new chips at the same time
+		for (i = 0; i < 8; i++)
+		{
+			if (Inserted_Chips_Mask & (1 << i)) printf("Chip %u inserted.\n", i);
+		}
+		if (SelectChips(Inserted_Chips_Mask, &Selected_Chips_Mask) != 0) goto Exit_Error;
+		if (WriteImage(&Image, NULL, Address, 0, &Failed_Chips_Mask) != 0) goto Exit_Error; // Each chip is programmed from scratch, so there is nothing to resume and no journal to write
+		if (!Is_Page_Verification_Requested && (VerifyImage(&Image, &Failed_Chips_Mask) != 0)) goto Exit_Error; // The pages were not read back while they were written
+		
+		for (i = 0; i < 8; i++)
+		{
+			if (!(Inserted_Chips_Mask & (1 << i))) continue;
+			
+			if (Failed_Chips_Mask & (1 << i))
+			{
+				printf("Chip %u : FAILED, remove it.\n", i);
+				Failed_Chips_Count++;
+			}
+			else printf("Chip %u : OK, remove it.\n", i);
+			Programmed_Chips_Count++;
+		}
+		printf("%u chips programmed, %u failed.\n", Programmed_Chips_Count, Failed_Chips_Count);
+	}
+	ImageFree(&Image);
+	
+	if (Failed_Chips_Count > 0) return -1;
+	return 0;
+	
+Exit_Error:
+	ImageFree(&Image);
+	return -1;
+}
+
+static int ExecuteProgrammerCommand(int Arguments_Count, char *String_Arguments[], int Is_Resume_Requested);
+
+/** Load the file the next manifest operation needs while the current operation is executed.
+ * @param Pointer_Operation The operation about to be executed.
+ * @param Pointer_Next_Operation The operation following it.
+ */
+static void PrepareNextOperation(TManifestOperation *Pointer_Operation, TManifestOperation *Pointer_Next_Operation)
+{
+	char *String_File_Name;
+	unsigned int Address = 0;
+	
+	// Only the writes and the verifications load a file
+	switch (Pointer_Next_Operation->String_Arguments[0][0])
+	{
+		case 'w':
+		case 'v':
+			sscanf(Pointer_Next_Operation->String_Arguments[1], "%X", &Address);
+			String_File_Name = Pointer_Next_Operation->String_Arguments[2];
+			break;
+			
+		case 'W':
+			String_File_Name = Pointer_Next_Operation->String_Arguments[2];
+			break;
+			
+		default:
+			return;
+	}
+	
+	// The file can't be loaded before the current operation has finished reading it from the flash
+	if ((Pointer_Operation->String_Arguments[0][0] == 'r') && (strcmp(Pointer_Operation->String_Arguments[3], String_File_Name) == 0)) return;
+	if ((Pointer_Operation->String_Arguments[0][0] == 'R') && (strcmp(Pointer_Operation->String_Arguments[2], String_File_Name) == 0)) return;
+	
+	ManifestPrepareImage(&Manifest_Preparation, String_File_Name, Address);
+}
+
+/** Execute all operations of a manifest file in this session, stopping at the first failing operation.
+ * @param String_Manifest_File_Name The manifest file.
+ * @return 0 if all operations succeeded, -1 if the manifest is invalid or if an operation failed.
+ */
+static int CommandBatch(char *String_Manifest_File_Name)
+{
+	TManifest Manifest;
+	TManifestOperation *Pointer_Operation;
+	unsigned int i, j;
+	int k, Parameters_Count;
+	
+	if (ManifestLoad(&Manifest, String_Manifest_File_Name) != 0) return -1;
+	
+	// Check all operations before executing the first one, so a mistake does not stop the batch halfway
+	for (i = 0; i < Manifest.Operations_Count; i++)
+	{
+		Pointer_Operation = &Manifest.Pointer_Operations[i];
+		for (j = 0; j < sizeof(Batch_Commands) / sizeof(Batch_Commands[0]); j++)
+		{
+			if ((Pointer_Operation->String_Arguments[0][0] == Batch_Commands[j].Command) && (Pointer_Operation->String_Arguments[0][1] == 0)) break;
+		}
+		if (j == sizeof(Batch_Commands) / sizeof(Batch_Commands[0]))
+		{
+			printf("Error : the manifest line %u command '%s' is unknown or can't be used in a manifest.\n", Pointer_Operation->Line_Number, Pointer_Operation->String_Arguments[0]);
+			ManifestFree(&Manifest);
+			return -1;
+		}
+		
+		Parameters_Count = Pointer_Operation->Arguments_Count - 1;
+		if ((Parameters_Count < Batch_Commands[j].Minimum_Parameters_Count) || (Parameters_Count > Batch_Commands[j].Maximum_Parameters_Count))
+		{
+			if (Batch_Commands[j].Minimum_Parameters_Count == Batch_Commands[j].Maximum_Parameters_Count) printf("Error : the manifest line %u '%s' command has %d parameters instead of %d.\n", Pointer_Operation->Line_Number, Pointer_Operation->String_Arguments[0], Parameters_Count, Batch_Commands[j].Minimum_Parameters_Count);
+			else printf("Error : the manifest line %u '%s' command has %d parameters instead of %d to %d.\n", Pointer_Operation->Line_Number, Pointer_Operation->String_Arguments[0], Parameters_Count, Batch_Commands[j].Minimum_Parameters_Count, Batch_Commands[j].Maximum_Parameters_Count);
+			ManifestFree(&Manifest);
+			return -1;
+		}
+	}
+	
+	for (i = 0; i < Manifest.Operations_Count; i++)
+	{
+		Pointer_Operation = &Manifest.Pointer_Operations[i];
+		printf("Operation %u/%u (line %u) :", i + 1, Manifest.Operations_Count, Pointer_Operation->Line_Number);
+		for (k = 0; k < Pointer_Operation->Arguments_Count; k++) printf(" %s", Pointer_Operation->String_Arguments[k]);
+		printf("\n");
+		
+		if (i + 1 < Manifest.Operations_Count) PrepareNextOperation(Pointer_Operation, &Manifest.Pointer_Operations[i + 1]);
+		if (ExecuteProgrammerCommand(Pointer_Operation->Arguments_Count, Pointer_Operation->String_Arguments, 0) != 0)
+		{
+			printf("Error : the batch stopped at the manifest line %u.\n", Pointer_Operation->Line_Number);
+			ManifestDiscardImage(&Manifest_Preparation);
+			ManifestFree(&Manifest);
+			return -1;
+		}
+	}
+	printf("All %u operations succeeded.\n", Manifest.Operations_Count);
+	
+	ManifestDiscardImage(&Manifest_Preparation);
+	ManifestFree(&Manifest);
+	return 0;
+}
+
+/** Execute a command on the programmer connected to the opened serial port.
+ * @param Arguments_Count How many words the command contains.
+ * @param String_Arguments The command letter followed by its parameters.
+ * @param Is_Resume_Requested Set to 1 to continue an interrupted read or write from its last checkpoint.
+ * @return 0 if the command succeeded, -1 if it failed.
+ */
+static int ExecuteProgrammerCommand(int Arguments_Count, char *String_Arguments[], int Is_Resume_Requested)
+{
+	unsigned int Address, Count;
+	
+	switch (String_Arguments[0][0])
+	{
+		case 'd':
+			if (Arguments_Count != 3) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				Count = atoi(String_Arguments[2]);
+				if (CommandDumpFlash(Address, Count) != 0) return -1;
+			}
+			break;
+			
+		case 'r':
+			if (Arguments_Count != 4) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				Count = atoi(String_Arguments[2]);
+				if (CommandReadFlash(Address, Count, String_Arguments[3], Is_Resume_Requested) != 0) return -1;
+			}
+			break;
+			
+		case 'w':
+			if (Arguments_Count != 3) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				if (CommandWriteFlash(Address, String_Arguments[2], Is_Resume_Requested) != 0) return -1;
+			}
+			break;
+			
+		case 'v':
+			if (Arguments_Count != 3) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				if (CommandVerifyFlash(Address, String_Arguments[2]) != 0) return -1;
+			}
+			break;
+			
+		case 'l':
+			if (CommandListRegions() != 0) return -1;
+			break;
+			
+		case 'R':
+			if (Arguments_Count != 3) printf("Error : missing parameters.\n");
+			else if (CommandReadRegion(String_Arguments[1], String_Arguments[2], Is_Resume_Requested) != 0) return -1;
+			break;
+			
+		case 'W':
+			if (Arguments_Count != 3) printf("Error : missing parameters.\n");
+			else if (CommandWriteRegion(String_Arguments[1], String_Arguments[2], Is_Resume_Requested) != 0) return -1;
+			break;
+			
+		case 'c':
+			if (Arguments_Count != 2) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Count);
+				if (CommandSelectChips(Count) != 0) return -1;
+			}
+			break;
+			
+		case 's':
+			if (CommandReadStatistics() != 0) return -1;
+			break;
+			
+		case 'p':
+			if (Arguments_Count > 2) printf("Error : too many parameters.\n");
+			else
+			{
+				// Convert parameters
+				if (Arguments_Count == 2) Count = atoi(String_Arguments[1]);
+				else Count = DEFAULT_PROBE_ITERATIONS_COUNT;
+				if (Count == 0) printf("Error : the iterations count must be greater than 0.\n");
+				else if (CommandProbe(Count) != 0) return -1;
+			}
+			break;
+			
+		case 'f':
+			if ((Arguments_Count != 4) && (Arguments_Count != 5)) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				Count = atoi(String_Arguments[2]);
+				if (Arguments_Count == 5)
+				{
+					if (CommandSearchFlash(Address, Count, String_Arguments[3], String_Arguments[4]) != 0) return -1;
+				}
+				else if (CommandSearchFlash(Address, Count, String_Arguments[3], NULL) != 0) return -1;
+			}
+			break;
+			
+		case 'k':
+			if (Arguments_Count != 2) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				if (CommandCalibrateSPIClock(Address) != 0) return -1;
+			}
+			break;
+			
+		case 'P':
+			if ((Arguments_Count != 3) && (Arguments_Count != 4)) printf("Error : missing parameters.\n");
+			else
+			{
+				// Convert parameters
+				sscanf(String_Arguments[1], "%X", &Address);
+				if (Arguments_Count == 4) Count = atoi(String_Arguments[3]);
+				else Count = 0;
+				if (CommandProduction(Address, String_Arguments[2], Count) != 0) return -1;
+			}
+			break;
+			
+		case 'm':
+			if (Arguments_Count != 2) printf("Error : missing parameters.\n");
+			else if (Is_Resume_Requested)
+			{
+				printf("Error : --resume can't be used with the 'm' command.\n");
+				return -1;
+			}
+			else if (CommandBatch(String_Arguments[1]) != 0) return -1;
+			break;
+			
+		default:
+			printf("Error : unknown command.\n");
+			return -1;
+	}
+	
+	return 0;
+}
+
+/** Split a comma-separated serial ports list.
+ * @param String_Serial_Ports The list, it is modified.
+ * @param String_Serial_Port_Names On output, contain the serial port names.
+ * @return The serial ports count, or -1 if the list is invalid (an error message is displayed).
+ */
+static int SplitSerialPorts(char *String_Serial_Ports, char *String_Serial_Port_Names[])
+{
+	char *String_Serial_Port_Name;
+	int Serial_Ports_Count = 0;
+	
+	String_Serial_Port_Name = strtok(String_Serial_Ports, ",");
+	while (String_Serial_Port_Name != NULL)
+	{
+		if (Serial_Ports_Count == MAXIMUM_SERIAL_PORTS_COUNT)
+		{
+			printf("Error : too many serial ports (up to %d are supported).\n", MAXIMUM_SERIAL_PORTS_COUNT);
+			return -1;
+		}
+		String_Serial_Port_Names[Serial_Ports_Count] = String_Serial_Port_Name;
+		Serial_Ports_Count++;
+		String_Serial_Port_Name = strtok(NULL, ",");
+	}
+	if (Serial_Ports_Count == 0)
+	{
+		printf("Error : no serial port provided.\n");
+		return -1;
+	}
+	return Serial_Ports_Count;
+}
+
+/** Send the command to the daemon instead of executing it. The options are forwarded with the command.
+ * @param String_Program_Name The program name.
+ * @param String_Serial_Port_Name The programmer to run the job on, or DAEMON_ANY_SERIAL_PORT.
+ * @param Is_Resume_Requested Set to 1 to forward the --resume option.
+ * @param Command_Arguments_Count The command and its parameters count.
+ * @param String_Command_Arguments The command and its parameters.
+ * @return The job exit status.
+ */
+static int SubmitJob(char *String_Program_Name, char *String_Serial_Port_Name, int Is_Resume_Requested, int Command_Arguments_Count, char *String_Command_Arguments[])
+{
+	char *String_Job_Arguments[MAXIMUM_JOB_ARGUMENTS_COUNT];
+	int Job_Arguments_Count = 0, i;
+	
+	if (Command_Arguments_Count > MAXIMUM_JOB_ARGUMENTS_COUNT - MAXIMUM_JOB_OPTIONS_ARGUMENTS_COUNT)
+	{
+		printf("Error : too many command parameters.\n");
+		return EXIT_FAILURE;
+	}
+	
+	// Rebuild the command line the daemon will execute
+	String_Job_Arguments[Job_Arguments_Count++] = String_Program_Name;
+	if (Is_Resume_Requested) String_Job_Arguments[Job_Arguments_Count++] = "--resume";
+	if (Is_Page_Verification_Requested) String_Job_Arguments[Job_Arguments_Count++] = "--verify-pages";
+	if (String_Layout_File_Name != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--layout";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Layout_File_Name;
+	}
+	if (String_Metrics_File_Name != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--metrics";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Metrics_File_Name;
+	}
+	if (String_Cache_Directory != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--cache";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Cache_Directory;
+	}
+	if (String_Dump_Format != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--dump-format";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Dump_Format;
+	}
+	if (String_SPI_Clock_File_Name != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--spi-clock";
+		String_Job_Arguments[Job_Arguments_Count++] = String_SPI_Clock_File_Name;
+	}
+	if (String_Trace_File_Name != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--trace";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Trace_File_Name;
+	}
+	if (String_Command_Sequence != NULL)
+	{
+		String_Job_Arguments[Job_Arguments_Count++] = "--sequence";
+		String_Job_Arguments[Job_Arguments_Count++] = String_Command_Sequence;
+	}
+	String_Job_Arguments[Job_Arguments_Count++] = String_Serial_Port_Name;
+	for (i = 0; i < Command_Arguments_Count; i++) String_Job_Arguments[Job_Arguments_Count++] = String_Command_Arguments[i];
+	
+	return DaemonSubmitJob(String_Job_Socket_File_Name, String_Serial_Port_Name, Job_Arguments_Count, String_Job_Arguments);
+}
+
+static int ExecuteJob(TUART *Pointer_UART, char *String_Serial_Port_Name, int argc, char *argv[]);
+
+/** Parse the command line and execute the command.
+ * @param argc The command line arguments count.
+ * @param argv The command line arguments.
+ * @return The program exit status.
+ */
+static int ExecuteCommandLine(int argc, char *argv[])
+{
+	char *String_Serial_Port_Name, *String_Command, *String_Serial_Port_Names[MAXIMUM_SERIAL_PORTS_COUNT], *String_Program_Name = argv[0];
+	unsigned int Address;
+	int Serial_Ports_Count, Is_Resume_Requested = 0;
+	
+	// Handle the options
+	while (argc > 1)
+	{
+		if (strcmp(argv[1], "--resume") == 0) Is_Resume_Requested = 1;
+		else if (strcmp(argv[1], "--verify-pages") == 0) Is_Page_Verification_Requested = 1;
+		else if ((strcmp(argv[1], "--layout") == 0) && (argc > 2))
+		{
+			String_Layout_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--metrics") == 0) && (argc > 2))
+		{
+			String_Metrics_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--cache") == 0) && (argc > 2))
+		{
+			String_Cache_Directory = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--dump-format") == 0) && (argc > 2))
+		{
+			String_Dump_Format = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--spi-clock") == 0) && (argc > 2))
+		{
+			String_SPI_Clock_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--trace") == 0) && (argc > 2))
+		{
+			String_Trace_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--sequence") == 0) && (argc > 2))
+		{
+			String_Command_Sequence = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--low-latency") == 0) && (Pointer_Daemon_UART == NULL)) Is_Low_Latency_Requested = 1;
+		else if ((strcmp(argv[1], "--daemon") == 0) && (argc > 2) && (Pointer_Daemon_UART == NULL))
+		{
+			String_Daemon_Socket_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else if ((strcmp(argv[1], "--job") == 0) && (argc > 2) && (Pointer_Daemon_UART == NULL))
+		{
+			String_Job_Socket_File_Name = argv[2];
+			argv++;
+			argc--;
+		}
+		else break;
+		argv++;
+		argc--;
+	}
+	
+	// Keep the programmers serial ports opened and execute the jobs sent with --job
+	if ((String_Daemon_Socket_File_Name != NULL) && (argc == 2))
+	{
+		Serial_Ports_Count = SplitSerialPorts(argv[1], String_Serial_Port_Names);
+		if (Serial_Ports_Count < 0) return EXIT_FAILURE;
+		if (DaemonRun(String_Daemon_Socket_File_Name, String_Serial_Port_Names, Serial_Ports_Count, ExecuteJob) != 0) return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+	
+	// Check parameters
+	if ((argc < 3) || (String_Daemon_Socket_File_Name != NULL))
+	{
+		printf("Error : bad parameters.\n"
+			"Usage : %s [--resume] [--verify-pages] [--layout Layout_File] [--metrics JSON_File] [--cache Directory] [--dump-format Format] [--spi-clock SPI_Clock_File] [--trace Trace_File] [--sequence Number] [--low-latency] [--job Socket_File] Serial_Port[,Serial_Port...] Command [Command parameters]\n"
+			"        %s --daemon Socket_File Serial_Port[,Serial_Port...]\n"
+			"Available commands :\n"
+			"  d <Address(hex)> <Words_Count>               Dump Words_Count words from the specified address (4-byte little endian words by default, like ARM instructions).\n"
+			"  r <Address(hex)> <Bytes_Count> <File_Name>   Read Bytes_Count bytes from the specified address and store them in the specified File_Name.\n"
+			"  w <Address(hex)> <File_Name>                 Write the File_Name content at the specified address.\n"
+			"  v <Address(hex)> <File_Name>                 Compare the content of each selected chip with File_Name, starting from the specified address.\n"
+			"File_Name can be a flat binary, an Intel HEX, a Motorola S-record or an ELF file. The last three are written at their own addresses shifted by Address (use 0 to keep them), only the sectors containing data are erased.\n"
+			"  l                                            List the flash regions.\n"
+			"  R <Region_Name> <File_Name>                  Read the specified region and store it in File_Name.\n"
+			"  W <Region_Name> <File_Name>                  Write the specified region from the whole flash image File_Name, the other regions are left untouched.\n"
+			"  c <Chips_Mask(hex)>                          Select the chips the next commands apply to (bit n set selects chip n). Writes program all selected chips at the same time.\n"
+			"  s                                            Display where the programmer time went since the previous 's' command (SPI, UART and flash waits, erase and program cycles).\n"
+			"  p [Iterations_Count]                         Probe the serial link : round-trip latency histogram of each frame size (Iterations_Count round trips, default %d) and throughput of each frame size and window pair.\n"
+			"  f <Address(hex)> <Bytes_Count> <Pattern(hex)> [Mask(hex)]\n"
+			"                                               Display the addresses of the Bytes_Count bytes starting from Address the pattern is found at (up to %d bytes, written as hexadecimal digit pairs like 55AA). Only the bits set in the mask are compared.\n"
+			"  k <Address(hex)>                             Find the fastest SPI clock the selected chips and their wiring sustain, by programming and reading back a pattern at each clock in the sector containing Address (its content is lost).\n"
+			"  P <Address(hex)> <File_Name> [Chips_Count]   Production mode : write and verify File_Name in each chip inserted in a socket, until Chips_Count chips are programmed (default : until the program is stopped).\n"
+			"  m <Manifest_File>                            Execute the operations listed in Manifest_File in a single session, stopping at the first failing one. Each line contains a command and its parameters (any command but 'm' and 'P'), '#' starts a comment. The next write or verification file is loaded while the current operation is executed.\n"
+			"Regions are described by the flash Intel Flash Descriptor (descriptor, bios, me, gbe and pd regions) or by the --layout file, made of \"<Start(hex)>:<End(hex)> <Name>\" lines.\n"
+			"When several comma-separated serial ports are provided, the 'w' command programs all of them at the same time.\n"
+			"Reads and writes keep a journal of the completed parts next to File_Name, use --resume to continue an interrupted read or write from its last checkpoint.\n"
+			"--verify-pages makes the programmer read each written page back right after programming it, program it again or erase its sector and write it again if it differs, then tell which pages failed. The production mode then does not verify the chips afterwards.\n"
+			"--cache keeps a copy of each read chip model in Directory, the 'r' and 'R' commands then ask the programmer for the CRC of each sector and transfer only the sectors that differ from the copy (--resume ignores the cache).\n"
+			"--dump-format changes the 'd' command layout, Format being \"<Word_Size>,<little|big>,<Words_Per_Line>[,ascii]\" (the default is \"4,little,4\", use \"1,little,16,ascii\" for a classic hexadecimal and ASCII dump).\n"
+			"--spi-clock makes the 'k' command store the calibrated SPI clock to SPI_Clock_File, and the other commands use the clock stored there (the station keeps running at its own maximum SPI speed).\n"
+			"--trace records the bytes exchanged with the programmer and when they were exchanged to Trace_File, the Replay program can then play the programmer side of the session again to compare host builds.\n"
+			"--sequence starts the command sequence numbers from Number instead of a random value, Replay tells which Number makes the host send the same frames as the recorded session.\n"
+			"--metrics displays where the time went (host file handling, command execution and sectors erasing, data transfer, waiting for the programmer, serial port system calls) and stores it to JSON_File.\n"
+			"--low-latency makes the serial port driver hand the received bytes over as soon as they arrive (USB serial adapters gather them up to 16 ms by default), the 'p' command then tells the improvement.\n"
+			"--daemon keeps the serial ports opened and executes the jobs sent with --job through Socket_File, each programmer running its queued jobs back to back. A job Serial_Port can be '%s' to run it on the first idle programmer.\n", String_Program_Name, String_Program_Name, DEFAULT_PROBE_ITERATIONS_COUNT, PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE, DAEMON_ANY_SERIAL_PORT);
+		return EXIT_FAILURE;
+	}
+	String_Command = argv[2];
+	String_Metrics_Command = String_Command;
+	
+	// Split the serial ports list
+	Serial_Ports_Count = SplitSerialPorts(argv[1], String_Serial_Port_Names);
+	if (Serial_Ports_Count < 0) return EXIT_FAILURE;
+	
+	// Let the daemon execute the command
+	if (String_Job_Socket_File_Name != NULL)
+	{
+		if (Serial_Ports_Count > 1)
+		{
+			printf("Error : a job runs on a single programmer, use '%s' to run it on the first idle one.\n", DAEMON_ANY_SERIAL_PORT);
+			return EXIT_FAILURE;
+		}
+		return SubmitJob(String_Program_Name, String_Serial_Port_Names[0], Is_Resume_Requested, argc - 2, &argv[2]);
+	}
+	
+	// Drive all programmers concurrently when several serial ports are provided
+	if (Serial_Ports_Count > 1)
+	{
+		if ((*String_Command != 'w') || (argc != 5))
+		{
+			printf("Error : only the 'w' command can be used with several serial ports.\n");
+			return EXIT_FAILURE;
+		}
+		if (Is_Resume_Requested || Is_Page_Verification_Requested || (String_SPI_Clock_File_Name != NULL) || (String_Trace_File_Name != NULL))
+		{
+			printf("Error : --resume, --verify-pages, --spi-clock and --trace can't be used with several serial ports.\n");
+			return EXIT_FAILURE;
+		}
+		sscanf(argv[3], "%X", &Address);
+		if (GangWriteFlash(String_Serial_Port_Names, Serial_Ports_Count, Address, argv[4], String_Metrics_File_Name) != 0) return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+	String_Serial_Port_Name = String_Serial_Port_Names[0];
+	
+	// The daemon owns the serial port when executing a job
+	if (Pointer_Daemon_UART != NULL)
+	{
+		UART = *Pointer_Daemon_UART;
+		String_Serial_Port_Name = String_Daemon_Serial_Port_Name;
+	}
+	else
+	{
+		// Open the serial port
+		printf("Initializing serial port... ");
+		fflush(stdout);
+		if (UARTOpen(&UART, String_Serial_Port_Name) == 0)
+		{
+			printf("Error : could not open the serial port '%s'.\n", String_Serial_Port_Name);
+			return EXIT_FAILURE;
+		}
+		atexit(ExitCloseUART);
+		printf("done.\n");
+		
+		if (Is_Low_Latency_Requested)
+		{
+			if (UARTSetLowLatency(&UART, 1) == 0) Is_Low_Latency_Enabled = 1;
+			else printf("Warning : the serial port driver does not support the low latency mode.\n");
+		}
+	}
+	
+	// Record the session from the first exchanged byte, the trace is closed before the UART
+	if (String_Trace_File_Name != NULL)
+	{
+		if (TraceCreate(&Trace, String_Trace_File_Name) != 0)
+		{
+			printf("Error : could not create the trace file '%s'.\n", String_Trace_File_Name);
+			return EXIT_FAILURE;
+		}
+		UARTSetTrace(&UART, &Trace);
+		atexit(ExitCloseTrace);
+	}
+	
+	// Send the same frames as a recorded session
+	if (String_Command_Sequence != NULL) Next_Command_Sequence = atoi(String_Command_Sequence);
+	else Next_Command_Sequence = ProtocolGetInitialCommandSequence();
+	
+	// Report the metrics before the UART is closed (exit handlers are called in reverse order of registration)
+	MetricsInitialize(&Metrics, String_Serial_Port_Name);
+	if (String_Metrics_File_Name != NULL) atexit(ExitReportMetrics);
+	
+	// The calibration starts from the programmer current clock
+	if ((String_SPI_Clock_File_Name != NULL) && (*String_Command != 'k') && (ApplyCalibratedSPIClock() != 0)) return EXIT_FAILURE;
+	
+	// Execute the right command
+	if (ExecuteProgrammerCommand(argc - 2, &argv[2], Is_Resume_Requested) != 0) return EXIT_FAILURE;
+	
+	Is_Command_Successful = 1;
+	return EXIT_SUCCESS;
+}
+
+/** Execute a job sent to the daemon, in the daemon child process.
+ * @see TDaemonJobFunction for the parameters description.
+ */
+static int ExecuteJob(TUART *Pointer_UART, char *String_Serial_Port_Name, int argc, char *argv[])
+{
+	// Forget the daemon options, the job brings its own ones
+	String_Daemon_Socket_File_Name = NULL;
+	String_Layout_File_Name = NULL;
+	String_Metrics_File_Name = NULL;
+	String_Cache_Directory = NULL;
+	String_Dump_Format = NULL;
+	String_SPI_Clock_File_Name = NULL;
+	String_Trace_File_Name = NULL;
+	String_Command_Sequence = NULL;
+	Is_Page_Verification_Requested = 0;
+	
+	Pointer_Daemon_UART = Pointer_UART;
+	String_Daemon_Serial_Port_Name = String_Serial_Port_Name;
+	Program_Start_Time = ProtocolGetPreciseTime();
+	return ExecuteCommandLine(argc, argv);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	Program_Start_Time = ProtocolGetPreciseTime();
+	return ExecuteCommandLine(argc, argv);
 }
@@ -0,0 +1,165 @@
+/** @file Manifest.c
+ * @see Manifest.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Manifest.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Load an image.
+ * @param Pointer_Parameter The preparation.
+ * @return Always NULL.
+ */
+static void *ManifestPreparationThread(void *Pointer_Parameter)
+{
+	TManifestPreparation *Pointer_Preparation = Pointer_Parameter;
+
+	Pointer_Preparation->Result = ImageLoad(&Pointer_Preparation->Image, Pointer_Preparation->String_File_Name, Pointer_Preparation->Address);
+	return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int ManifestLoad(TManifest *Pointer_Manifest, char *String_File_Name)
+{
+	FILE *File;
+	long Size;
+	char *Pointer_Character;
+	unsigned int Lines_Count = 1, Line_Number = 0;
+	TManifestOperation *Pointer_Operation;
+
+	memset(Pointer_Manifest, 0, sizeof(TManifest));
+
+	// Load the whole file
+	File = fopen(String_File_Name, "rb");
+	if (File == NULL)
+	{
+		printf("Error : could not open the manifest file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	if ((fseek(File, 0, SEEK_END) != 0) || ((Size = ftell(File)) < 0))
+	{
+		printf("Error : could not get the manifest file '%s' size.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+	rewind(File);
+	Pointer_Manifest->Pointer_Text = malloc(Size + 1);
+	if (Pointer_Manifest->Pointer_Text == NULL)
+	{
+		printf("Error : could not allocate memory to load the manifest file '%s'.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+	if (fread(Pointer_Manifest->Pointer_Text, 1, Size, File) != (size_t) Size)
+	{
+		printf("Error : could not read the manifest file '%s'.\n", String_File_Name);
+		fclose(File);
+		ManifestFree(Pointer_Manifest);
+		return -1;
+	}
+	fclose(File);
+	Pointer_Manifest->Pointer_Text[Size] = 0;
+
+	// There are no more operations than lines
+	for (Pointer_Character = Pointer_Manifest->Pointer_Text; *Pointer_Character != 0; Pointer_Character++)
+	{
+		if (*Pointer_Character == '\n') Lines_Count++;
+	}
+	Pointer_Manifest->Pointer_Operations = malloc(Lines_Count * sizeof(TManifestOperation));
+	if (Pointer_Manifest->Pointer_Operations == NULL)
+	{
+		printf("Error : could not allocate memory to store the manifest operations.\n");
+		ManifestFree(Pointer_Manifest);
+		return -1;
+	}
+
+	// Split the lines into words, the separators being replaced by string terminating characters
+	Pointer_Character = Pointer_Manifest->Pointer_Text;
+	while (*Pointer_Character != 0)
+	{
+		Line_Number++;
+		Pointer_Operation = &Pointer_Manifest->Pointer_Operations[Pointer_Manifest->Operations_Count];
+		Pointer_Operation->Line_Number = Line_Number;
+		Pointer_Operation->Arguments_Count = 0;
+
+		while ((*Pointer_Character != 0) && (*Pointer_Character != '\n'))
+		{
+			// Skip the separators (a Windows end of line is a separator too)
+			if ((*Pointer_Character == ' ') || (*Pointer_Character == '\t') || (*Pointer_Character == '\r'))
+			{
+				*Pointer_Character = 0;
+				Pointer_Character++;
+				continue;
+			}
+
+			// Ignore the comment up to the end of the line
+			if (*Pointer_Character == '#')
+			{
+				while ((*Pointer_Character != 0) && (*Pointer_Character != '\n')) Pointer_Character++;
+				break;
+			}
+
+			if (Pointer_Operation->Arguments_Count == MANIFEST_MAXIMUM_ARGUMENTS_COUNT)
+			{
+				printf("Error : the manifest line %u contains more than %d words.\n", Line_Number, MANIFEST_MAXIMUM_ARGUMENTS_COUNT);
+				ManifestFree(Pointer_Manifest);
+				return -1;
+			}
+			Pointer_Operation->String_Arguments[Pointer_Operation->Arguments_Count] = Pointer_Character;
+			Pointer_Operation->Arguments_Count++;
+			while ((*Pointer_Character != 0) && (*Pointer_Character != '\n') && (*Pointer_Character != ' ') && (*Pointer_Character != '\t') && (*Pointer_Character != '\r') && (*Pointer_Character != '#')) Pointer_Character++;
+		}
+
+		// Terminate the last word of the line
+		if (*Pointer_Character == '\n')
+		{
+			*Pointer_Character = 0;
+			Pointer_Character++;
+		}
+		if (Pointer_Operation->Arguments_Count > 0) Pointer_Manifest->Operations_Count++;
+	}
+
+	return 0;
+}
+
+void ManifestFree(TManifest *Pointer_Manifest)
+{
+	free(Pointer_Manifest->Pointer_Operations);
+	free(Pointer_Manifest->Pointer_Text);
+}
+
+void ManifestPrepareImage(TManifestPreparation *Pointer_Preparation, char *String_File_Name, unsigned int Address)
+{
+	ManifestDiscardImage(Pointer_Preparation);
+
+	Pointer_Preparation->String_File_Name = String_File_Name;
+	Pointer_Preparation->Address = Address;
+	if (pthread_create(&Pointer_Preparation->Thread, NULL, ManifestPreparationThread, Pointer_Preparation) == 0) Pointer_Preparation->Is_Started = 1; // The image will be loaded when it is needed if the thread can't be created
+}
+
+int ManifestTakeImage(TManifestPreparation *Pointer_Preparation, char *String_File_Name, unsigned int Address, TImage *Pointer_Image)
+{
+	if (!Pointer_Preparation->Is_Started || (strcmp(Pointer_Preparation->String_File_Name, String_File_Name) != 0) || (Pointer_Preparation->Address != Address)) return -1;
+
+	pthread_join(Pointer_Preparation->Thread, NULL);
+	Pointer_Preparation->Is_Started = 0;
+	if (Pointer_Preparation->Result != 0) return -1;
+
+	*Pointer_Image = Pointer_Preparation->Image;
+	return 0;
+}
+
+void ManifestDiscardImage(TManifestPreparation *Pointer_Preparation)
+{
+	if (!Pointer_Preparation->Is_Started) return;
+
+	pthread_join(Pointer_Preparation->Thread, NULL);
+	Pointer_Preparation->Is_Started = 0;
+	if (Pointer_Preparation->Result == 0) ImageFree(&Pointer_Preparation->Image);
+}
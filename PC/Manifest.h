@@ -0,0 +1,85 @@
+/** @file Manifest.h
+ * Describe several programmer operations in a text file, so they are executed in a single session.
+ * Each line contains an operation : a command letter and its parameters, like on the command line, separated by spaces or tabs (so file names can't contain spaces). Empty lines and text following a '#' are ignored.
+ * The next operation image can be loaded by another thread while the current operation is executed, so the serial link does not wait for the disk and the file parsing between operations.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_MANIFEST_H
+#define H_MANIFEST_H
+
+#include <pthread.h>
+#include "Image.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** How many words (the command and its parameters) an operation can contain. */
+#define MANIFEST_MAXIMUM_ARGUMENTS_COUNT 8
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** A manifest line. */
+typedef struct
+{
+	unsigned int Line_Number; //!< The line the operation comes from, starting from 1.
+	int Arguments_Count; //!< How many words the operation contains (at least one).
+	char *String_Arguments[MANIFEST_MAXIMUM_ARGUMENTS_COUNT]; //!< The command followed by its parameters.
+} TManifestOperation;
+
+/** A loaded manifest. */
+typedef struct
+{
+	char *Pointer_Text; //!< The file content, the operations words point to it.
+	TManifestOperation *Pointer_Operations; //!< All operations in file order.
+	unsigned int Operations_Count; //!< How many operations the manifest contains.
+} TManifest;
+
+/** An image loaded in advance. */
+typedef struct
+{
+	pthread_t Thread; //!< The thread loading the image.
+	int Is_Started; //!< Tell whether an image is being loaded or was loaded and not taken yet.
+	char *String_File_Name; //!< The loaded file.
+	unsigned int Address; //!< The address given to ImageLoad().
+	TImage Image; //!< The loaded image.
+	int Result; //!< The value ImageLoad() returned.
+} TManifestPreparation;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Load a manifest file.
+ * @param Pointer_Manifest On output, contain the operations. It must be freed with ManifestFree().
+ * @param String_File_Name The manifest file.
+ * @return 0 if the manifest was loaded, -1 if the file could not be read or if a line contains too many words (an error message is displayed).
+ */
+int ManifestLoad(TManifest *Pointer_Manifest, char *String_File_Name);
+
+/** Release the resources allocated by ManifestLoad().
+ * @param Pointer_Manifest The manifest.
+ */
+void ManifestFree(TManifest *Pointer_Manifest);
+
+/** Start loading an image on another thread. An image loaded before and not taken is discarded.
+ * @param Pointer_Preparation The preparation to start.
+ * @param String_File_Name The file to load (the string must stay valid until the image is taken or discarded).
+ * @param Address The address to give to ImageLoad().
+ */
+void ManifestPrepareImage(TManifestPreparation *Pointer_Preparation, char *String_File_Name, unsigned int Address);
+
+/** Get the image loaded in advance, waiting for the loading to finish.
+ * @param Pointer_Preparation The preparation.
+ * @param String_File_Name The needed file.
+ * @param Address The address the needed image is loaded at.
+ * @param Pointer_Image On output, contain the image if it was loaded (it must be freed with ImageFree()).
+ * @return 0 if the image was loaded, -1 if the loaded image is not the needed one or if it could not be loaded (the caller must load the image itself).
+ */
+int ManifestTakeImage(TManifestPreparation *Pointer_Preparation, char *String_File_Name, unsigned int Address, TImage *Pointer_Image);
+
+/** Wait for the image being loaded and free it.
+ * @param Pointer_Preparation The preparation.
+ */
+void ManifestDiscardImage(TManifestPreparation *Pointer_Preparation);
+
+#endif
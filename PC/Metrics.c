@@ -0,0 +1,172 @@
+/** @file Metrics.c
+ * @see Metrics.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <string.h>
+#include "Metrics.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The phase names used in the summary. */
+static const char *String_Phase_Names[METRICS_PHASES_COUNT] =
+{
+	"host I/O",
+	"command",
+	"erase",
+	"transfer"
+};
+
+/** The phase names used in the JSON file. */
+static const char *String_Phase_JSON_Names[METRICS_PHASES_COUNT] =
+{
+	"host_io",
+	"command",
+	"erase",
+	"transfer"
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Compute a throughput.
+ * @param Bytes_Count How many bytes were handled.
+ * @param Time How many microseconds it took.
+ * @return The throughput in bytes per second (0 if the duration is 0).
+ */
+static double MetricsGetThroughput(unsigned long long Bytes_Count, unsigned long long Time)
+{
+	if (Time == 0) return 0;
+	return Bytes_Count * 1000000.0 / Time;
+}
+
+/** Write a JSON string, escaping the characters that need it.
+ * @param File The JSON file.
+ * @param String The string to write.
+ */
+static void MetricsWriteJSONString(FILE *File, const char *String)
+{
+	fputc('"', File);
+	while (*String != 0)
+	{
+		if ((*String == '"') || (*String == '\\')) fprintf(File, "\\%c", *String);
+		else if ((unsigned char) *String < 0x20) fprintf(File, "\\u%04X", *String);
+		else fputc(*String, File);
+		String++;
+	}
+	fputc('"', File);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+void MetricsInitialize(TMetrics *Pointer_Metrics, char *String_Serial_Port_Name)
+{
+	memset(Pointer_Metrics, 0, sizeof(TMetrics));
+	Pointer_Metrics->String_Serial_Port_Name = String_Serial_Port_Name;
+	Pointer_Metrics->Is_Successful = 1;
+}
+
+void MetricsAddPhase(TMetrics *Pointer_Metrics, TMetricsPhase Phase, unsigned long long Time, unsigned long long Bytes_Count)
+{
+	Pointer_Metrics->Phases[Phase].Time += Time;
+	Pointer_Metrics->Phases[Phase].Bytes_Count += Bytes_Count;
+}
+
+void MetricsAddTransfer(TMetrics *Pointer_Metrics, TProtocolTransfer *Pointer_Transfer)
+{
+	TMetricsPhase Command_Phase;
+
+	// A write command is acknowledged once the sectors are erased
+	if (Pointer_Transfer->Command[0] == PROTOCOL_COMMAND_WRITE_FLASH) Command_Phase = METRICS_PHASE_ERASE;
+	else Command_Phase = METRICS_PHASE_COMMAND;
+	Pointer_Metrics->Phases[Command_Phase].Time += Pointer_Transfer->Command_Acknowledge_Time - Pointer_Transfer->Start_Time;
+
+	Pointer_Metrics->Phases[METRICS_PHASE_TRANSFER].Time += Pointer_Transfer->End_Time - Pointer_Transfer->Command_Acknowledge_Time;
+	Pointer_Metrics->Phases[METRICS_PHASE_TRANSFER].Bytes_Count += Pointer_Transfer->Transferred_Bytes_Count;
+	Pointer_Metrics->Stall_Time += Pointer_Transfer->Stall_Time;
+
+	Pointer_Metrics->Commands_Count++;
+	Pointer_Metrics->Retransmitted_Frames_Count += Pointer_Transfer->Retransmitted_Frames_Count;
+	Pointer_Metrics->Corrupted_Frames_Count += Pointer_Transfer->Corrupted_Frames_Count;
+	if (Pointer_Transfer->State != PROTOCOL_TRANSFER_STATE_SUCCESS) Pointer_Metrics->Is_Successful = 0;
+}
+
+void MetricsAddUARTStatistics(TMetrics *Pointer_Metrics, TUART *Pointer_UART)
+{
+	Pointer_Metrics->Read_Calls_Count += Pointer_UART->Read_Calls_Count;
+	Pointer_Metrics->Write_Calls_Count += Pointer_UART->Write_Calls_Count;
+	Pointer_Metrics->Wait_Calls_Count += Pointer_UART->Wait_Calls_Count;
+}
+
+void MetricsDisplay(TMetrics *Pointer_Metrics, unsigned int Programmers_Count, unsigned long long Total_Time)
+{
+	unsigned int i, Phase;
+	TMetricsPhaseStatistics *Pointer_Phase;
+
+	for (i = 0; i < Programmers_Count; i++)
+	{
+		printf("Metrics for %s (%s) :\n", Pointer_Metrics->String_Serial_Port_Name, Pointer_Metrics->Is_Successful ? "success" : "failure");
+		for (Phase = 0; Phase < METRICS_PHASES_COUNT; Phase++)
+		{
+			Pointer_Phase = &Pointer_Metrics->Phases[Phase];
+			printf("  %-10s : %10.1f ms", String_Phase_Names[Phase], Pointer_Phase->Time / 1000.0);
+			if (Pointer_Phase->Bytes_Count > 0) printf(", %llu bytes, %.0f bytes/s", Pointer_Phase->Bytes_Count, MetricsGetThroughput(Pointer_Phase->Bytes_Count, Pointer_Phase->Time));
+			if (Phase == METRICS_PHASE_TRANSFER) printf(", %.1f ms waiting for the programmer", Pointer_Metrics->Stall_Time / 1000.0);
+			printf("\n");
+		}
+		printf("  %-10s : %u commands, %u frames sent again, %u corrupted frames received\n", "link", Pointer_Metrics->Commands_Count, Pointer_Metrics->Retransmitted_Frames_Count, Pointer_Metrics->Corrupted_Frames_Count);
+		printf("  %-10s : %u read, %u write, %u wait\n", "syscalls", Pointer_Metrics->Read_Calls_Count, Pointer_Metrics->Write_Calls_Count, Pointer_Metrics->Wait_Calls_Count);
+		Pointer_Metrics++;
+	}
+	printf("Total time : %.1f ms.\n", Total_Time / 1000.0);
+}
+
+int MetricsWriteJSON(char *String_File_Name, char *String_Command, TMetrics *Pointer_Metrics, unsigned int Programmers_Count, unsigned long long Total_Time)
+{
+	FILE *File;
+	unsigned int i, Phase;
+	int Is_Successful = 1;
+	TMetricsPhaseStatistics *Pointer_Phase;
+
+	File = fopen(String_File_Name, "w");
+	if (File == NULL)
+	{
+		printf("Error : could not create the metrics file '%s'.\n", String_File_Name);
+		return -1;
+	}
+
+	for (i = 0; i < Programmers_Count; i++)
+	{
+		if (!Pointer_Metrics[i].Is_Successful) Is_Successful = 0;
+	}
+
+	fprintf(File, "{\n  \"command\": ");
+	MetricsWriteJSONString(File, String_Command);
+	fprintf(File, ",\n  \"success\": %s,\n  \"total_ms\": %.3f,\n  \"programmers\": [", Is_Successful ? "true" : "false", Total_Time / 1000.0);
+
+	for (i = 0; i < Programmers_Count; i++)
+	{
+		fprintf(File, "%s\n    {\n      \"serial_port\": ", i == 0 ? "" : ",");
+		MetricsWriteJSONString(File, Pointer_Metrics->String_Serial_Port_Name);
+		fprintf(File, ",\n      \"success\": %s,\n      \"phases\": {", Pointer_Metrics->Is_Successful ? "true" : "false");
+		for (Phase = 0; Phase < METRICS_PHASES_COUNT; Phase++)
+		{
+			Pointer_Phase = &Pointer_Metrics->Phases[Phase];
+			fprintf(File, "%s\n        \"%s\": { \"ms\": %.3f, \"bytes\": %llu, \"bytes_per_second\": %.0f }", Phase == 0 ? "" : ",", String_Phase_JSON_Names[Phase], Pointer_Phase->Time / 1000.0, Pointer_Phase->Bytes_Count, MetricsGetThroughput(Pointer_Phase->Bytes_Count, Pointer_Phase->Time));
+		}
+		fprintf(File, "\n      },\n      \"stall_ms\": %.3f,\n", Pointer_Metrics->Stall_Time / 1000.0);
+		fprintf(File, "      \"commands\": %u,\n      \"retransmitted_frames\": %u,\n      \"corrupted_frames\": %u,\n", Pointer_Metrics->Commands_Count, Pointer_Metrics->Retransmitted_Frames_Count, Pointer_Metrics->Corrupted_Frames_Count);
+		fprintf(File, "      \"syscalls\": { \"read\": %u, \"write\": %u, \"wait\": %u }\n    }", Pointer_Metrics->Read_Calls_Count, Pointer_Metrics->Write_Calls_Count, Pointer_Metrics->Wait_Calls_Count);
+		Pointer_Metrics++;
+	}
+	fprintf(File, "\n  ]\n}\n");
+
+	if (fclose(File) != 0)
+	{
+		printf("Error : could not write the metrics file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	return 0;
+}
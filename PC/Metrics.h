@@ -0,0 +1,93 @@
+/** @file Metrics.h
+ * Measure where the time goes during a command : host file handling, command execution by the programmer (sectors erasing for a write), data transfer, time spent waiting for the programmer and serial port system calls.
+ * The measures can be displayed as a summary and stored to a JSON file for monitoring tools.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_METRICS_H
+#define H_METRICS_H
+
+#include "Protocol.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** All measured phases. */
+typedef enum
+{
+	METRICS_PHASE_HOST_IO, //!< Loading and decoding files, storing the read data and the journal checkpoints (the storing part runs on other threads, during the transfer phase).
+	METRICS_PHASE_COMMAND, //!< Waiting for the programmer to acknowledge a command other than a write.
+	METRICS_PHASE_ERASE, //!< Waiting for the programmer to acknowledge a write command, which erases the sectors before answering.
+	METRICS_PHASE_TRANSFER, //!< Sending or receiving the data frames (the programmer writes the flash pages while receiving them).
+	METRICS_PHASES_COUNT
+} TMetricsPhase;
+
+/** The measures of a single phase. */
+typedef struct
+{
+	unsigned long long Time; //!< The phase cumulated duration in microseconds.
+	unsigned long long Bytes_Count; //!< How many bytes the phase handled.
+} TMetricsPhaseStatistics;
+
+/** All measures of a programmer. */
+typedef struct
+{
+	char *String_Serial_Port_Name; //!< The serial port the programmer is connected to.
+	int Is_Successful; //!< Tell whether all commands succeeded.
+	TMetricsPhaseStatistics Phases[METRICS_PHASES_COUNT]; //!< Each phase measures.
+	unsigned long long Stall_Time; //!< How many microseconds the transfer phase spent with nothing to send, waiting for the programmer.
+	unsigned int Commands_Count; //!< How many commands were executed.
+	unsigned int Retransmitted_Frames_Count; //!< How many frames had to be sent again.
+	unsigned int Corrupted_Frames_Count; //!< How many corrupted frames were received.
+	unsigned int Read_Calls_Count; //!< How many serial port read system calls were issued.
+	unsigned int Write_Calls_Count; //!< How many serial port write system calls were issued.
+	unsigned int Wait_Calls_Count; //!< How many times the program waited for the serial port (the gang programming event loop waits for all serial ports at once, so it is not accounted).
+} TMetrics;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Start measuring a programmer.
+ * @param Pointer_Metrics The measures to clear.
+ * @param String_Serial_Port_Name The serial port the programmer is connected to.
+ */
+void MetricsInitialize(TMetrics *Pointer_Metrics, char *String_Serial_Port_Name);
+
+/** Account for a terminated phase.
+ * @param Pointer_Metrics The measures.
+ * @param Phase The phase.
+ * @param Time The phase duration in microseconds (see ProtocolGetPreciseTime()).
+ * @param Bytes_Count How many bytes the phase handled.
+ */
+void MetricsAddPhase(TMetrics *Pointer_Metrics, TMetricsPhase Phase, unsigned long long Time, unsigned long long Bytes_Count);
+
+/** Account for a terminated transfer (command phase, transfer phase and link quality).
+ * @param Pointer_Metrics The measures.
+ * @param Pointer_Transfer The transfer.
+ */
+void MetricsAddTransfer(TMetrics *Pointer_Metrics, TProtocolTransfer *Pointer_Transfer);
+
+/** Retrieve the system calls count of the programmer serial port.
+ * @param Pointer_Metrics The measures.
+ * @param Pointer_UART The serial port.
+ */
+void MetricsAddUARTStatistics(TMetrics *Pointer_Metrics, TUART *Pointer_UART);
+
+/** Display the measures of several programmers.
+ * @param Pointer_Metrics The programmers measures.
+ * @param Programmers_Count How many programmers were measured.
+ * @param Total_Time The whole program duration in microseconds.
+ */
+void MetricsDisplay(TMetrics *Pointer_Metrics, unsigned int Programmers_Count, unsigned long long Total_Time);
+
+/** Store the measures of several programmers to a JSON file.
+ * @param String_File_Name The file to create.
+ * @param String_Command The executed command.
+ * @param Pointer_Metrics The programmers measures.
+ * @param Programmers_Count How many programmers were measured.
+ * @param Total_Time The whole program duration in microseconds.
+ * @return 0 if the file was successfully written, -1 if an error occurred (an error message is displayed).
+ */
+int MetricsWriteJSON(char *String_File_Name, char *String_Command, TMetrics *Pointer_Metrics, unsigned int Programmers_Count, unsigned long long Total_Time);
+
+#endif
@@ -0,0 +1,220 @@
+/** @file Pipeline.c
+ * @see Pipeline.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <string.h>
+#include "Pipeline.h"
+#include "Protocol.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Prepare an empty ring.
+ * @param Pointer_Ring The ring to initialize.
+ */
+static void PipelineInitializeRing(TPipelineRing *Pointer_Ring)
+{
+	Pointer_Ring->Write_Index = 0;
+	Pointer_Ring->Read_Index = 0;
+	sem_init(&Pointer_Ring->Used_Slots_Count, 0, 0);
+	sem_init(&Pointer_Ring->Free_Slots_Count, 0, PIPELINE_RING_SIZE);
+}
+
+/** Release the ring resources.
+ * @param Pointer_Ring The ring.
+ */
+static void PipelineDestroyRing(TPipelineRing *Pointer_Ring)
+{
+	sem_destroy(&Pointer_Ring->Used_Slots_Count);
+	sem_destroy(&Pointer_Ring->Free_Slots_Count);
+}
+
+/** Add a block to a ring. The semaphores make the block and its data visible to the consumer.
+ * @param Pointer_Ring The ring.
+ * @param Offset The block data offset.
+ * @param Size The block size in bytes (0 to tell that there are no more blocks).
+ * @param Is_Blocking Set to 1 to wait for the consumer to make room if the ring is full, set to 0 to return immediately.
+ * @return 0 if the block was added, -1 if the ring is full.
+ */
+static int PipelinePushBlock(TPipelineRing *Pointer_Ring, unsigned int Offset, unsigned int Size, int Is_Blocking)
+{
+	if (Is_Blocking)
+	{
+		while (sem_wait(&Pointer_Ring->Free_Slots_Count) != 0); // Only interrupted by signals
+	}
+	else if (sem_trywait(&Pointer_Ring->Free_Slots_Count) != 0) return -1;
+
+	Pointer_Ring->Offsets[Pointer_Ring->Write_Index] = Offset;
+	Pointer_Ring->Sizes[Pointer_Ring->Write_Index] = Size;
+	Pointer_Ring->Write_Index = (Pointer_Ring->Write_Index + 1) % PIPELINE_RING_SIZE;
+	sem_post(&Pointer_Ring->Used_Slots_Count);
+	return 0;
+}
+
+/** Take the oldest block of a ring, waiting for the producer if the ring is empty.
+ * @param Pointer_Ring The ring.
+ * @param Pointer_Offset On output, contain the block data offset.
+ * @return The block size in bytes, 0 if there are no more blocks.
+ */
+static unsigned int PipelinePopBlock(TPipelineRing *Pointer_Ring, unsigned int *Pointer_Offset)
+{
+	unsigned int Size;
+
+	while (sem_wait(&Pointer_Ring->Used_Slots_Count) != 0);
+
+	*Pointer_Offset = Pointer_Ring->Offsets[Pointer_Ring->Read_Index];
+	Size = Pointer_Ring->Sizes[Pointer_Ring->Read_Index];
+	Pointer_Ring->Read_Index = (Pointer_Ring->Read_Index + 1) % PIPELINE_RING_SIZE;
+	sem_post(&Pointer_Ring->Free_Slots_Count);
+	return Size;
+}
+
+/** Handle a block in a stage, unless a stage already failed (the block is then only consumed so the producer never waits forever).
+ * @param Pointer_Pipeline The pipeline.
+ * @param Stage_Function The stage.
+ * @param Offset The block data offset.
+ * @param Size The block size in bytes.
+ * @return How many microseconds the stage was busy.
+ */
+static unsigned long long PipelineHandleBlock(TPipeline *Pointer_Pipeline, TPipelineStageFunction Stage_Function, unsigned int Offset, unsigned int Size)
+{
+	unsigned long long Start_Time;
+
+	if (atomic_load(&Pointer_Pipeline->Is_Failed)) return 0;
+
+	Start_Time = ProtocolGetPreciseTime();
+	if (Stage_Function(Offset, Size) != 0) atomic_store(&Pointer_Pipeline->Is_Failed, 1);
+	return ProtocolGetPreciseTime() - Start_Time;
+}
+
+/** Run the first stage, then give the blocks to the second stage.
+ * @param Pointer_Parameter The pipeline.
+ * @return Always NULL.
+ */
+static void *PipelineStorageThread(void *Pointer_Parameter)
+{
+	TPipeline *Pointer_Pipeline = Pointer_Parameter;
+	unsigned int Offset, Size;
+
+	do
+	{
+		Size = PipelinePopBlock(&Pointer_Pipeline->Storage_Ring, &Offset);
+		if (Size > 0) Pointer_Pipeline->Storage_Time += PipelineHandleBlock(Pointer_Pipeline, Pointer_Pipeline->Storage_Function, Offset, Size);
+		PipelinePushBlock(&Pointer_Pipeline->Hashing_Ring, Offset, Size, 1);
+	} while (Size > 0);
+
+	return NULL;
+}
+
+/** Run the second stage.
+ * @param Pointer_Parameter The pipeline.
+ * @return Always NULL.
+ */
+static void *PipelineHashingThread(void *Pointer_Parameter)
+{
+	TPipeline *Pointer_Pipeline = Pointer_Parameter;
+	unsigned int Offset, Size;
+
+	while (1)
+	{
+		Size = PipelinePopBlock(&Pointer_Pipeline->Hashing_Ring, &Offset);
+		if (Size == 0) break;
+		Pointer_Pipeline->Hashing_Time += PipelineHandleBlock(Pointer_Pipeline, Pointer_Pipeline->Hashing_Function, Offset, Size);
+	}
+
+	return NULL;
+}
+
+/** Publish the blocks transferred up to now.
+ * @param Pointer_Pipeline The pipeline.
+ * @param Transferred_Offset The offset following the last transferred data byte.
+ * @param Is_Last_Block_Partial Set to 1 to publish the last block even if it is not complete (the transfer is terminated).
+ * @param Is_Blocking Set to 1 to wait for room in the ring, set to 0 to stop publishing when the ring is full.
+ */
+static void PipelinePublishBlocks(TPipeline *Pointer_Pipeline, unsigned int Transferred_Offset, int Is_Last_Block_Partial, int Is_Blocking)
+{
+	unsigned int Block_End;
+
+	while (Pointer_Pipeline->Published_Offset < Transferred_Offset)
+	{
+		// Blocks end on flash sector boundaries
+		Block_End = Pointer_Pipeline->Published_Offset + PIPELINE_BLOCK_SIZE - (Pointer_Pipeline->Address + Pointer_Pipeline->Published_Offset - Pointer_Pipeline->Start_Offset) % PIPELINE_BLOCK_SIZE;
+		if (Block_End > Pointer_Pipeline->End_Offset) Block_End = Pointer_Pipeline->End_Offset;
+		if (Block_End > Transferred_Offset)
+		{
+			if (!Is_Last_Block_Partial) return;
+			Block_End = Transferred_Offset;
+		}
+
+		if (PipelinePushBlock(&Pointer_Pipeline->Storage_Ring, Pointer_Pipeline->Published_Offset, Block_End - Pointer_Pipeline->Published_Offset, Is_Blocking) != 0) return;
+		Pointer_Pipeline->Published_Offset = Block_End;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int PipelineStart(TPipeline *Pointer_Pipeline, unsigned int Address, unsigned int Start_Offset, unsigned int End_Offset, TPipelineStageFunction Storage_Function, TPipelineStageFunction Hashing_Function)
+{
+	int Result;
+
+	Pointer_Pipeline->Address = Address;
+	Pointer_Pipeline->Start_Offset = Start_Offset;
+	Pointer_Pipeline->End_Offset = End_Offset;
+	Pointer_Pipeline->Storage_Function = Storage_Function;
+	Pointer_Pipeline->Hashing_Function = Hashing_Function;
+	Pointer_Pipeline->Published_Offset = Start_Offset;
+	atomic_init(&Pointer_Pipeline->Is_Failed, 0);
+	Pointer_Pipeline->Storage_Time = 0;
+	Pointer_Pipeline->Hashing_Time = 0;
+	PipelineInitializeRing(&Pointer_Pipeline->Storage_Ring);
+	PipelineInitializeRing(&Pointer_Pipeline->Hashing_Ring);
+
+	Result = pthread_create(&Pointer_Pipeline->Hashing_Thread, NULL, PipelineHashingThread, Pointer_Pipeline);
+	if (Result != 0)
+	{
+		printf("Error : could not create the hashing thread (%s).\n", strerror(Result));
+		PipelineDestroyRing(&Pointer_Pipeline->Storage_Ring);
+		PipelineDestroyRing(&Pointer_Pipeline->Hashing_Ring);
+		return -1;
+	}
+
+	Result = pthread_create(&Pointer_Pipeline->Storage_Thread, NULL, PipelineStorageThread, Pointer_Pipeline);
+	if (Result != 0)
+	{
+		printf("Error : could not create the storage thread (%s).\n", strerror(Result));
+		PipelinePushBlock(&Pointer_Pipeline->Hashing_Ring, 0, 0, 1);
+		pthread_join(Pointer_Pipeline->Hashing_Thread, NULL);
+		PipelineDestroyRing(&Pointer_Pipeline->Storage_Ring);
+		PipelineDestroyRing(&Pointer_Pipeline->Hashing_Ring);
+		return -1;
+	}
+
+	return 0;
+}
+
+void PipelinePublish(TPipeline *Pointer_Pipeline, unsigned int Transferred_Offset)
+{
+	PipelinePublishBlocks(Pointer_Pipeline, Transferred_Offset, 0, 0);
+}
+
+int PipelineIsFailed(TPipeline *Pointer_Pipeline)
+{
+	return atomic_load(&Pointer_Pipeline->Is_Failed);
+}
+
+int PipelineStop(TPipeline *Pointer_Pipeline, unsigned int Transferred_Offset)
+{
+	// Tell the stages that there are no more blocks once the remaining ones are handled
+	PipelinePublishBlocks(Pointer_Pipeline, Transferred_Offset, 1, 1);
+	PipelinePushBlock(&Pointer_Pipeline->Storage_Ring, 0, 0, 1);
+
+	pthread_join(Pointer_Pipeline->Storage_Thread, NULL);
+	pthread_join(Pointer_Pipeline->Hashing_Thread, NULL);
+	PipelineDestroyRing(&Pointer_Pipeline->Storage_Ring);
+	PipelineDestroyRing(&Pointer_Pipeline->Hashing_Ring);
+
+	if (atomic_load(&Pointer_Pipeline->Is_Failed)) return -1;
+	return 0;
+}
@@ -0,0 +1,98 @@
+/** @file Pipeline.h
+ * Handle the transferred data on other threads, so the thread driving the serial port never waits for the disk or the terminal.
+ * The transport thread publishes the acknowledged data as sector-sized blocks. A storage thread handles each block first (writing it to the output file), then a hashing thread handles it (computing checkpoints CRC, displaying the progress).
+ * The stages are connected by single-producer single-consumer rings. Each ring index is only accessed by one thread, and two semaphores count the used and free slots (the transport thread only tries to take a free slot, so it never waits for the stages). Only the block locations go through the rings, the data stays in the transfer buffer.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_PIPELINE_H
+#define H_PIPELINE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** Blocks end on flash addresses multiple of this size (the flash sector size). */
+#define PIPELINE_BLOCK_SIZE 4096
+
+/** How many blocks a ring can contain. */
+#define PIPELINE_RING_SIZE 256
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** Handle a block in a pipeline stage.
+ * @param Offset The block data offset.
+ * @param Size The block size in bytes.
+ * @return 0 if the block was handled, -1 if an error occurred (an error message is displayed and the pipeline stops handling blocks).
+ */
+typedef int (*TPipelineStageFunction)(unsigned int Offset, unsigned int Size);
+
+/** Blocks waiting to be handled by the next stage. */
+typedef struct
+{
+	unsigned int Offsets[PIPELINE_RING_SIZE]; //!< The blocks data offset.
+	unsigned int Sizes[PIPELINE_RING_SIZE]; //!< The blocks size, 0 meaning that there are no more blocks.
+	unsigned int Write_Index; //!< Where the producer adds the next block (only the producer accesses it).
+	unsigned int Read_Index; //!< Where the consumer takes the next block (only the consumer accesses it).
+	sem_t Used_Slots_Count; //!< How many blocks can be taken.
+	sem_t Free_Slots_Count; //!< How many blocks can be added.
+} TPipelineRing;
+
+/** A running pipeline. */
+typedef struct
+{
+	// Parameters
+	unsigned int Address; //!< The flash address of the first data byte.
+	unsigned int Start_Offset; //!< The first data byte offset.
+	unsigned int End_Offset; //!< The offset following the last data byte.
+	TPipelineStageFunction Storage_Function; //!< The first stage.
+	TPipelineStageFunction Hashing_Function; //!< The second stage.
+
+	// State
+	unsigned int Published_Offset; //!< The data offset following the last published block (only the transport thread accesses it).
+	TPipelineRing Storage_Ring; //!< The blocks the storage thread must handle.
+	TPipelineRing Hashing_Ring; //!< The blocks the hashing thread must handle.
+	pthread_t Storage_Thread; //!< Run the first stage.
+	pthread_t Hashing_Thread; //!< Run the second stage.
+	atomic_int Is_Failed; //!< Tell whether a stage failed.
+	unsigned long long Storage_Time; //!< How many microseconds the storage stage was busy (only valid when the pipeline is stopped).
+	unsigned long long Hashing_Time; //!< How many microseconds the hashing stage was busy (only valid when the pipeline is stopped).
+} TPipeline;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Start the stages threads.
+ * @param Pointer_Pipeline The pipeline to initialize.
+ * @param Address The flash address of the first data byte, the blocks are aligned on it.
+ * @param Start_Offset The first data byte offset.
+ * @param End_Offset The offset following the last data byte.
+ * @param Storage_Function The first stage.
+ * @param Hashing_Function The second stage.
+ * @return 0 if the pipeline was started, -1 if an error occurred (an error message is displayed).
+ */
+int PipelineStart(TPipeline *Pointer_Pipeline, unsigned int Address, unsigned int Start_Offset, unsigned int End_Offset, TPipelineStageFunction Storage_Function, TPipelineStageFunction Hashing_Function);
+
+/** Give the blocks completed up to now to the stages. This function never blocks, the blocks that do not fit in the ring are published by a next call.
+ * @param Pointer_Pipeline The pipeline.
+ * @param Transferred_Offset The offset following the last transferred data byte.
+ */
+void PipelinePublish(TPipeline *Pointer_Pipeline, unsigned int Transferred_Offset);
+
+/** Tell whether a stage failed.
+ * @param Pointer_Pipeline The pipeline.
+ * @return 1 if a stage failed, 0 if not.
+ */
+int PipelineIsFailed(TPipeline *Pointer_Pipeline);
+
+/** Publish the remaining blocks, then wait for the stages to handle all of them.
+ * @param Pointer_Pipeline The pipeline.
+ * @param Transferred_Offset The offset following the last transferred data byte (it is less than the end offset if the transfer failed).
+ * @return 0 if all blocks were handled, -1 if a stage failed.
+ */
+int PipelineStop(TPipeline *Pointer_Pipeline, unsigned int Transferred_Offset);
+
+#endif
@@ -0,0 +1,251 @@
+/** @file Probe.c
+ * @see Probe.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Probe.h"
+#include "Protocol.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many bytes each throughput measure transfers. */
+#define PROBE_THROUGHPUT_BYTES_COUNT 16384
+
+/** The upper bound of the first latency histogram bucket in microseconds, each following bucket bound is twice the previous one. */
+#define PROBE_HISTOGRAM_FIRST_BOUND 500u
+
+/** A frame size and window size pair is worth using if it reaches this percentage of the fastest pair throughput. */
+#define PROBE_SUFFICIENT_THROUGHPUT_PERCENTAGE 95
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The probed frame sizes, the largest one is the programmer buffer size. */
+static const unsigned int Probe_Block_Sizes[PROBE_BLOCK_SIZES_COUNT] = {16, 64, 256, 1024, 4096};
+/** The probed window sizes. */
+static const unsigned int Probe_Window_Sizes[PROBE_WINDOW_SIZES_COUNT] = {1, 2, 4, 8, 16};
+
+/** The ping being executed (it is too large to be put on the stack). */
+static TProtocolTransfer Probe_Transfer;
+/** Receive the ping data. */
+static unsigned char Probe_Buffer[PROBE_THROUGHPUT_BYTES_COUNT];
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Make the programmer send generated data and check it.
+ * @param Pointer_UART The serial port the programmer is connected to.
+ * @param Pointer_Next_Command_Sequence The serial link next command sequence number.
+ * @param Bytes_Count How many bytes to receive.
+ * @param Block_Size The data frames size.
+ * @param Window_Size How many data frames the programmer can send in a row.
+ * @return How many microseconds elapsed between the command was queued and the last data frame was received, or -1 if an error occurred (an error message is displayed).
+ */
+static long long ProbePing(TUART *Pointer_UART, unsigned char *Pointer_Next_Command_Sequence, unsigned int Bytes_Count, unsigned int Block_Size, unsigned int Window_Size)
+{
+	unsigned char Command[8];
+	unsigned int i;
+
+	Command[0] = PROTOCOL_COMMAND_PING;
+	Command[1] = Bytes_Count >> 24;
+	Command[2] = Bytes_Count >> 16;
+	Command[3] = Bytes_Count >> 8;
+	Command[4] = Bytes_Count;
+	Command[5] = Block_Size >> 8;
+	Command[6] = Block_Size;
+	Command[7] = Window_Size;
+
+	ProtocolInitializeTransfer(&Probe_Transfer, Pointer_Next_Command_Sequence, Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Probe_Buffer, Bytes_Count);
+	Probe_Transfer.Block_Size = Block_Size;
+	if (ProtocolRunTransfer(Pointer_UART, &Probe_Transfer, NULL) != 0)
+	{
+		printf("Error : %s (the programmer firmware may not support the ping command).\n", Probe_Transfer.String_Error);
+		return -1;
+	}
+
+	// The programmer echoes the parameters it uses, they must be the requested ones for the measure to be meaningful
+	if ((Probe_Transfer.Acknowledge_Payload_Size != 7) || (((unsigned int) Probe_Transfer.Acknowledge_Payload[4] << 8 | Probe_Transfer.Acknowledge_Payload[5]) != Block_Size) || (Probe_Transfer.Acknowledge_Payload[6] != Window_Size))
+	{
+		printf("Error : the programmer does not support %u-byte frames with a window of %u.\n", Block_Size, Window_Size);
+		return -1;
+	}
+
+	for (i = 0; i < Bytes_Count; i++)
+	{
+		if (Probe_Buffer[i] != (unsigned char) (i % Block_Size))
+		{
+			printf("Error : the ping data is corrupted at offset %u.\n", i);
+			return -1;
+		}
+	}
+
+	return Probe_Transfer.End_Time - Probe_Transfer.Start_Time;
+}
+
+/** Compare two latencies, for qsort().
+ * @param Pointer_A The first latency.
+ * @param Pointer_B The second latency.
+ * @return A negative value if the first latency is shorter, a positive value if it is longer, 0 if both are the same.
+ */
+static int ProbeCompareLatencies(const void *Pointer_A, const void *Pointer_B)
+{
+	unsigned int A = *(const unsigned int *) Pointer_A, B = *(const unsigned int *) Pointer_B;
+
+	if (A < B) return -1;
+	if (A > B) return 1;
+	return 0;
+}
+
+/** Find the fastest frame size and window size pair.
+ * @param Pointer_Report The measures.
+ * @param Pointer_Block_Size_Index On output, contain the fastest pair frame size index.
+ * @param Pointer_Window_Size_Index On output, contain the fastest pair window size index.
+ * @return The fastest pair throughput in bytes per second.
+ */
+static double ProbeFindFastest(TProbeReport *Pointer_Report, int *Pointer_Block_Size_Index, int *Pointer_Window_Size_Index)
+{
+	int i, j;
+
+	*Pointer_Block_Size_Index = 0;
+	*Pointer_Window_Size_Index = 0;
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++)
+	{
+		for (j = 0; j < PROBE_WINDOW_SIZES_COUNT; j++)
+		{
+			if (Pointer_Report->Throughputs[i][j] > Pointer_Report->Throughputs[*Pointer_Block_Size_Index][*Pointer_Window_Size_Index])
+			{
+				*Pointer_Block_Size_Index = i;
+				*Pointer_Window_Size_Index = j;
+			}
+		}
+	}
+	return Pointer_Report->Throughputs[*Pointer_Block_Size_Index][*Pointer_Window_Size_Index];
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int ProbeMeasure(TUART *Pointer_UART, unsigned char *Pointer_Next_Command_Sequence, unsigned int Iterations_Count, TProbeReport *Pointer_Report)
+{
+	unsigned int *Pointer_Latencies, i, j, Bound;
+	long long Duration;
+	TProbeLatency *Pointer_Latency;
+
+	Pointer_Latencies = malloc(Iterations_Count * sizeof(unsigned int));
+	if (Pointer_Latencies == NULL)
+	{
+		printf("Error : could not allocate memory to store the latencies.\n");
+		return -1;
+	}
+
+	// Single frames round trip
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++)
+	{
+		printf("Measuring the latency of %u-byte frames...\r", Probe_Block_Sizes[i]);
+		fflush(stdout);
+
+		// The first ping pays for the programmer and the serial adapter being idle
+		if (ProbePing(Pointer_UART, Pointer_Next_Command_Sequence, Probe_Block_Sizes[i], Probe_Block_Sizes[i], 1) < 0) goto Exit_Error;
+		for (j = 0; j < Iterations_Count; j++)
+		{
+			Duration = ProbePing(Pointer_UART, Pointer_Next_Command_Sequence, Probe_Block_Sizes[i], Probe_Block_Sizes[i], 1);
+			if (Duration < 0) goto Exit_Error;
+			Pointer_Latencies[j] = Duration;
+		}
+
+		qsort(Pointer_Latencies, Iterations_Count, sizeof(unsigned int), ProbeCompareLatencies);
+		Pointer_Latency = &Pointer_Report->Latencies[i];
+		Pointer_Latency->Minimum = Pointer_Latencies[0];
+		Pointer_Latency->Median = Pointer_Latencies[Iterations_Count / 2];
+		Pointer_Latency->Percentile_99 = Pointer_Latencies[Iterations_Count * 99 / 100];
+		Pointer_Latency->Maximum = Pointer_Latencies[Iterations_Count - 1];
+
+		for (j = 0; j < PROBE_HISTOGRAM_BUCKETS_COUNT; j++) Pointer_Latency->Histogram[j] = 0;
+		for (j = 0; j < Iterations_Count; j++)
+		{
+			Bound = 0;
+			while ((Bound < PROBE_HISTOGRAM_BUCKETS_COUNT - 1) && (Pointer_Latencies[j] >= (PROBE_HISTOGRAM_FIRST_BOUND << Bound))) Bound++;
+			Pointer_Latency->Histogram[Bound]++;
+		}
+	}
+
+	// Sustained throughput
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++)
+	{
+		for (j = 0; j < PROBE_WINDOW_SIZES_COUNT; j++)
+		{
+			printf("Measuring the throughput of %u-byte frames with a window of %u...\r", Probe_Block_Sizes[i], Probe_Window_Sizes[j]);
+			fflush(stdout);
+
+			Duration = ProbePing(Pointer_UART, Pointer_Next_Command_Sequence, PROBE_THROUGHPUT_BYTES_COUNT, Probe_Block_Sizes[i], Probe_Window_Sizes[j]);
+			if (Duration < 0) goto Exit_Error;
+			Pointer_Report->Throughputs[i][j] = PROBE_THROUGHPUT_BYTES_COUNT * 1000000.0 / Duration;
+		}
+	}
+	printf("%70s\r", "");
+
+	free(Pointer_Latencies);
+	return 0;
+
+Exit_Error:
+	free(Pointer_Latencies);
+	return -1;
+}
+
+void ProbeDisplayReport(TProbeReport *Pointer_Report)
+{
+	int i, j, Block_Size_Index, Window_Size_Index;
+	double Fastest_Throughput;
+	TProbeLatency *Pointer_Latency;
+
+	printf("Round-trip latency (ms) :\n");
+	printf("%6s %8s %8s %8s %8s |", "Frame", "Minimum", "Median", "99 %", "Maximum");
+	for (i = 0; i < PROBE_HISTOGRAM_BUCKETS_COUNT - 1; i++) printf(" <%-5g", PROBE_HISTOGRAM_FIRST_BOUND * (1 << i) / 1000.0);
+	printf(" >=%g\n", PROBE_HISTOGRAM_FIRST_BOUND * (1 << (PROBE_HISTOGRAM_BUCKETS_COUNT - 2)) / 1000.0);
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++)
+	{
+		Pointer_Latency = &Pointer_Report->Latencies[i];
+		printf("%6u %8.3f %8.3f %8.3f %8.3f |", Probe_Block_Sizes[i], Pointer_Latency->Minimum / 1000.0, Pointer_Latency->Median / 1000.0, Pointer_Latency->Percentile_99 / 1000.0, Pointer_Latency->Maximum / 1000.0);
+		for (j = 0; j < PROBE_HISTOGRAM_BUCKETS_COUNT; j++) printf(" %6u", Pointer_Latency->Histogram[j]);
+		printf("\n");
+	}
+
+	printf("\nThroughput (KB/s) :\n");
+	printf("%6s", "Frame");
+	for (j = 0; j < PROBE_WINDOW_SIZES_COUNT; j++) printf("  window %-2u", Probe_Window_Sizes[j]);
+	printf("\n");
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++)
+	{
+		printf("%6u", Probe_Block_Sizes[i]);
+		for (j = 0; j < PROBE_WINDOW_SIZES_COUNT; j++) printf(" %10.1f", Pointer_Report->Throughputs[i][j] / 1024);
+		printf("\n");
+	}
+
+	// A smaller window reaching almost the same throughput is more tolerant to lost frames
+	Fastest_Throughput = ProbeFindFastest(Pointer_Report, &Block_Size_Index, &Window_Size_Index);
+	printf("\nFastest : %u-byte frames with a window of %u (%.1f KB/s).\n", Probe_Block_Sizes[Block_Size_Index], Probe_Window_Sizes[Window_Size_Index], Fastest_Throughput / 1024);
+	for (j = 0; j < Window_Size_Index; j++)
+	{
+		if (Pointer_Report->Throughputs[Block_Size_Index][j] * 100 >= Fastest_Throughput * PROBE_SUFFICIENT_THROUGHPUT_PERCENTAGE)
+		{
+			printf("A window of %u reaches %d %% of this throughput with the same frames.\n", Probe_Window_Sizes[j], (int) (Pointer_Report->Throughputs[Block_Size_Index][j] * 100 / Fastest_Throughput));
+			break;
+		}
+	}
+}
+
+void ProbeDisplayImprovement(TProbeReport *Pointer_Report_Before, TProbeReport *Pointer_Report_After)
+{
+	int i, Block_Size_Index, Window_Size_Index;
+	double Throughput_Before, Throughput_After;
+
+	printf("Median latency (ms) :\n");
+	printf("%6s %8s %8s %8s\n", "Frame", "Before", "After", "Speedup");
+	for (i = 0; i < PROBE_BLOCK_SIZES_COUNT; i++) printf("%6u %8.3f %8.3f %7.2fx\n", Probe_Block_Sizes[i], Pointer_Report_Before->Latencies[i].Median / 1000.0, Pointer_Report_After->Latencies[i].Median / 1000.0, (double) Pointer_Report_Before->Latencies[i].Median / Pointer_Report_After->Latencies[i].Median);
+
+	Throughput_Before = ProbeFindFastest(Pointer_Report_Before, &Block_Size_Index, &Window_Size_Index);
+	Throughput_After = ProbeFindFastest(Pointer_Report_After, &Block_Size_Index, &Window_Size_Index);
+	printf("Fastest throughput : %.1f KB/s before, %.1f KB/s after (%.2fx).\n", Throughput_Before / 1024, Throughput_After / 1024, Throughput_After / Throughput_Before);
+}
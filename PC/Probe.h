@@ -0,0 +1,64 @@
+/** @file Probe.h
+ * Characterize the serial link between the PC and the programmer with the ping command : the round-trip latency histogram of single frames of various sizes, then the throughput of each frame size and window size pair.
+ * This tells which frame size and window suit a serial adapter model, and how much its low latency mode helps.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_PROBE_H
+#define H_PROBE_H
+
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** How many frame sizes are probed. */
+#define PROBE_BLOCK_SIZES_COUNT 5
+/** How many window sizes are probed. */
+#define PROBE_WINDOW_SIZES_COUNT 5
+/** How many latency histogram buckets there are. */
+#define PROBE_HISTOGRAM_BUCKETS_COUNT 8
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** The round-trip latency of a frame size. */
+typedef struct
+{
+	unsigned int Minimum; //!< The shortest round trip in microseconds.
+	unsigned int Median; //!< The median round trip in microseconds.
+	unsigned int Percentile_99; //!< 99 % of the round trips are shorter than this value in microseconds.
+	unsigned int Maximum; //!< The longest round trip in microseconds.
+	unsigned int Histogram[PROBE_HISTOGRAM_BUCKETS_COUNT]; //!< How many round trips took less than 0.5 ms, 1 ms, 2 ms... up to 32 ms, the last bucket counting the longer ones.
+} TProbeLatency;
+
+/** All measures of a serial link. */
+typedef struct
+{
+	TProbeLatency Latencies[PROBE_BLOCK_SIZES_COUNT]; //!< The latency of each frame size.
+	double Throughputs[PROBE_BLOCK_SIZES_COUNT][PROBE_WINDOW_SIZES_COUNT]; //!< The throughput in bytes per second of each frame size and window size pair.
+} TProbeReport;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Measure the serial link.
+ * @param Pointer_UART The serial port the programmer is connected to.
+ * @param Pointer_Next_Command_Sequence The serial link next command sequence number (see ProtocolInitializeTransfer()).
+ * @param Iterations_Count How many round trips are measured for each frame size.
+ * @param Pointer_Report On output, contain the measures.
+ * @return 0 if the link was measured, -1 if the programmer did not answer correctly (an error message is displayed).
+ */
+int ProbeMeasure(TUART *Pointer_UART, unsigned char *Pointer_Next_Command_Sequence, unsigned int Iterations_Count, TProbeReport *Pointer_Report);
+
+/** Display the measures and the fastest frame size and window size pair.
+ * @param Pointer_Report The measures.
+ */
+void ProbeDisplayReport(TProbeReport *Pointer_Report);
+
+/** Display how much faster a link became after its settings were changed.
+ * @param Pointer_Report_Before The measures made with the previous settings.
+ * @param Pointer_Report_After The measures made with the new settings.
+ */
+void ProbeDisplayImprovement(TProbeReport *Pointer_Report_Before, TProbeReport *Pointer_Report_After);
+
+#endif
@@ -0,0 +1,403 @@
+/** @file Programmer.c
+ * @see Programmer.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "Programmer.h"
+#include "Protocol.h"
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The largest flash the programmer can drive (in bytes). */
+#define PROGRAMMER_MAXIMUM_FLASH_SIZE (32 * 1024 * 1024)
+
+/** How many bytes each erase command handles. Large areas are split so the progress is reported while they are erased. */
+#define PROGRAMMER_ERASE_BLOCK_SIZE (64 * 1024)
+
+/** How many milliseconds ProgrammerWait() waits for the serial port at most, so that the protocol timeouts are handled soon enough. */
+#define PROGRAMMER_WAIT_PERIOD 100
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A programmer session. */
+struct TProgrammer
+{
+	TUART UART; //!< The serial port the programmer is connected to.
+	TProtocolTransfer Transfer; //!< The command being executed.
+	unsigned char Next_Command_Sequence; //!< The serial link next command sequence number.
+	TProgrammerStatus Status; //!< The running or last operation state.
+	int Is_Serial_Port_Failed; //!< Tell whether the transfer failed because the serial port could not be used anymore.
+	TProgrammerProgressCallback Progress_Callback; //!< Called when some data is acknowledged, can be NULL.
+	TProgrammerCompletionCallback Completion_Callback; //!< Called when an operation terminates, can be NULL.
+	void *Pointer_User_Data; //!< Given to the callbacks.
+	unsigned int Completed_Bytes_Count; //!< How many bytes the previous commands of the operation processed (an erase is made of several commands).
+	unsigned int Erase_Address; //!< The address of the next sectors to erase.
+	unsigned int Erase_Block_Size; //!< How many bytes the running erase command handles.
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Check that a new operation can be started on an area.
+ * @param Pointer_Programmer The session.
+ * @param Address The area start address.
+ * @param Size The area size in bytes.
+ * @return PROGRAMMER_ERROR_NONE if the operation can be started, an error code if not.
+ */
+static TProgrammerError ProgrammerCheckArea(TProgrammer *Pointer_Programmer, unsigned int Address, unsigned int Size)
+{
+	if (Pointer_Programmer->Status.Operation != PROGRAMMER_OPERATION_NONE) return PROGRAMMER_ERROR_BUSY;
+	if ((Size == 0) || (Address >= PROGRAMMER_MAXIMUM_FLASH_SIZE) || (Size > PROGRAMMER_MAXIMUM_FLASH_SIZE - Address)) return PROGRAMMER_ERROR_BAD_PARAMETER;
+	return PROGRAMMER_ERROR_NONE;
+}
+
+/** Reset the session state for a new operation.
+ * @param Pointer_Programmer The session.
+ * @param Operation The operation to start.
+ * @param Total_Bytes_Count How many bytes the operation processes.
+ */
+static void ProgrammerBeginOperation(TProgrammer *Pointer_Programmer, TProgrammerOperation Operation, unsigned int Total_Bytes_Count)
+{
+	memset(&Pointer_Programmer->Status, 0, sizeof(Pointer_Programmer->Status));
+	Pointer_Programmer->Status.Operation = Operation;
+	Pointer_Programmer->Status.Total_Bytes_Count = Total_Bytes_Count;
+	Pointer_Programmer->Completed_Bytes_Count = 0;
+}
+
+/** Queue a command taking an address and a bytes count.
+ * @param Pointer_Programmer The session.
+ * @param Command_Code The command to execute.
+ * @param Address The address parameter.
+ * @param Command_Timeout How many milliseconds the programmer can take to execute the command.
+ * @param Direction Which way the data goes.
+ * @param Pointer_Data The data to send or the buffer to fill, it is used as is during the whole transfer.
+ * @param Size The data size in bytes.
+ */
+static void ProgrammerStartTransfer(TProgrammer *Pointer_Programmer, unsigned char Command_Code, unsigned int Address, unsigned int Command_Timeout, TProtocolDirection Direction, unsigned char *Pointer_Data, unsigned int Size)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size;
+
+	Command_Size = ProtocolBuildAddressCommand(Command, Command_Code, Address, Size);
+	ProtocolInitializeTransfer(&Pointer_Programmer->Transfer, &Pointer_Programmer->Next_Command_Sequence, Command, Command_Size, Command_Timeout, Direction, Pointer_Data, Size);
+	Pointer_Programmer->Is_Serial_Port_Failed = 0;
+}
+
+/** Queue the command erasing the next sectors of an erase operation.
+ * @param Pointer_Programmer The session.
+ */
+static void ProgrammerStartEraseBlock(TProgrammer *Pointer_Programmer)
+{
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE];
+	unsigned int Command_Size, Size;
+
+	Size = Pointer_Programmer->Status.Total_Bytes_Count - Pointer_Programmer->Completed_Bytes_Count;
+	if (Size > PROGRAMMER_ERASE_BLOCK_SIZE) Size = PROGRAMMER_ERASE_BLOCK_SIZE;
+
+	// The command has no data phase, the programmer acknowledges it when the sectors are erased
+	Command_Size = ProtocolBuildAddressCommand(Command, PROTOCOL_COMMAND_ERASE_FLASH, Pointer_Programmer->Erase_Address, Size);
+	ProtocolInitializeTransfer(&Pointer_Programmer->Transfer, &Pointer_Programmer->Next_Command_Sequence, Command, Command_Size, ProtocolGetWriteCommandTimeout(Size), PROTOCOL_DIRECTION_NONE, NULL, 0);
+	Pointer_Programmer->Is_Serial_Port_Failed = 0;
+	Pointer_Programmer->Erase_Address += Size;
+	Pointer_Programmer->Erase_Block_Size = Size;
+}
+
+/** Tell the caller how many bytes the operation processed, if this count changed.
+ * @param Pointer_Programmer The session.
+ */
+static void ProgrammerReportProgress(TProgrammer *Pointer_Programmer)
+{
+	unsigned int Transferred_Bytes_Count;
+
+	Transferred_Bytes_Count = Pointer_Programmer->Completed_Bytes_Count + Pointer_Programmer->Transfer.Transferred_Bytes_Count;
+	if (Transferred_Bytes_Count == Pointer_Programmer->Status.Transferred_Bytes_Count) return;
+
+	Pointer_Programmer->Status.Transferred_Bytes_Count = Transferred_Bytes_Count;
+	if (Pointer_Programmer->Progress_Callback != NULL) Pointer_Programmer->Progress_Callback(Pointer_Programmer, Transferred_Bytes_Count, Pointer_Programmer->Status.Total_Bytes_Count, Pointer_Programmer->Pointer_User_Data);
+}
+
+/** Terminate the running operation and tell the caller.
+ * @param Pointer_Programmer The session.
+ * @param Error The operation result.
+ */
+static void ProgrammerCompleteOperation(TProgrammer *Pointer_Programmer, TProgrammerError Error)
+{
+	Pointer_Programmer->Status.Operation = PROGRAMMER_OPERATION_NONE;
+	Pointer_Programmer->Status.Error = Error;
+	if (Pointer_Programmer->Completion_Callback != NULL) Pointer_Programmer->Completion_Callback(Pointer_Programmer, Error, Pointer_Programmer->Pointer_User_Data);
+}
+
+/** Retrieve the terminated transfer results, then go on with the next command of the operation or terminate the operation.
+ * @param Pointer_Programmer The session.
+ */
+static void ProgrammerHandleTerminatedTransfer(TProgrammer *Pointer_Programmer)
+{
+	TProtocolTransfer *Pointer_Transfer = &Pointer_Programmer->Transfer;
+
+	Pointer_Programmer->Status.Retransmitted_Frames_Count += Pointer_Transfer->Retransmitted_Frames_Count;
+	Pointer_Programmer->Status.Corrupted_Frames_Count += Pointer_Transfer->Corrupted_Frames_Count;
+
+	if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_FAILURE)
+	{
+		if (Pointer_Programmer->Is_Serial_Port_Failed) ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_SERIAL_PORT);
+		else if (Pointer_Transfer->Rejection_Reason != 0) ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_COMMAND_REJECTED);
+		else ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_NO_ANSWER);
+		return;
+	}
+
+	switch (Pointer_Programmer->Status.Operation)
+	{
+		case PROGRAMMER_OPERATION_VERIFY:
+			// Each data block acknowledge contains the chips that failed up to this block, so the last one tells the result
+			if (Pointer_Transfer->Acknowledge_Payload_Size > 0) Pointer_Programmer->Status.Failed_Chips_Mask = Pointer_Transfer->Acknowledge_Payload[0];
+			if (Pointer_Programmer->Status.Failed_Chips_Mask != 0)
+			{
+				ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_VERIFY_MISMATCH);
+				return;
+			}
+			break;
+
+		case PROGRAMMER_OPERATION_SELECT_CHIPS:
+			if (Pointer_Transfer->Acknowledge_Payload_Size > 0) Pointer_Programmer->Status.Selected_Chips_Mask = Pointer_Transfer->Acknowledge_Payload[0];
+			break;
+
+		case PROGRAMMER_OPERATION_ERASE:
+			// The erase command has no data phase, so the progress is only known when the command is acknowledged
+			Pointer_Programmer->Completed_Bytes_Count += Pointer_Programmer->Erase_Block_Size;
+			ProgrammerReportProgress(Pointer_Programmer);
+			if (Pointer_Programmer->Completed_Bytes_Count < Pointer_Programmer->Status.Total_Bytes_Count)
+			{
+				ProgrammerStartEraseBlock(Pointer_Programmer);
+				return;
+			}
+			break;
+
+		default:
+			break;
+	}
+	ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_NONE);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+TProgrammerError ProgrammerOpen(TProgrammer **Pointer_Pointer_Programmer, char *String_Serial_Port_Name)
+{
+	TProgrammer *Pointer_Programmer;
+
+	// The session embeds the transfer frame buffers, it is too large to be put on the caller stack
+	Pointer_Programmer = calloc(1, sizeof(TProgrammer));
+	if (Pointer_Programmer == NULL) return PROGRAMMER_ERROR_OUT_OF_MEMORY;
+
+	if (UARTOpen(&Pointer_Programmer->UART, String_Serial_Port_Name) == 0)
+	{
+		free(Pointer_Programmer);
+		return PROGRAMMER_ERROR_SERIAL_PORT;
+	}
+	Pointer_Programmer->Next_Command_Sequence = ProtocolGetInitialCommandSequence();
+
+	*Pointer_Pointer_Programmer = Pointer_Programmer;
+	return PROGRAMMER_ERROR_NONE;
+}
+
+void ProgrammerClose(TProgrammer *Pointer_Programmer)
+{
+	UARTClose(&Pointer_Programmer->UART);
+	free(Pointer_Programmer);
+}
+
+void ProgrammerSetCallbacks(TProgrammer *Pointer_Programmer, TProgrammerProgressCallback Progress_Callback, TProgrammerCompletionCallback Completion_Callback, void *Pointer_User_Data)
+{
+	Pointer_Programmer->Progress_Callback = Progress_Callback;
+	Pointer_Programmer->Completion_Callback = Completion_Callback;
+	Pointer_Programmer->Pointer_User_Data = Pointer_User_Data;
+}
+
+TProgrammerError ProgrammerStartRead(TProgrammer *Pointer_Programmer, unsigned int Address, unsigned char *Pointer_Buffer, unsigned int Size)
+{
+	TProgrammerError Error;
+
+	Error = ProgrammerCheckArea(Pointer_Programmer, Address, Size);
+	if (Error != PROGRAMMER_ERROR_NONE) return Error;
+	if (Pointer_Buffer == NULL) return PROGRAMMER_ERROR_BAD_PARAMETER;
+
+	ProgrammerBeginOperation(Pointer_Programmer, PROGRAMMER_OPERATION_READ, Size);
+	ProgrammerStartTransfer(Pointer_Programmer, PROTOCOL_COMMAND_READ_FLASH, Address, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_FROM_PROGRAMMER, Pointer_Buffer, Size);
+	return PROGRAMMER_ERROR_NONE;
+}
+
+TProgrammerError ProgrammerStartWrite(TProgrammer *Pointer_Programmer, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size)
+{
+	TProgrammerError Error;
+
+	Error = ProgrammerCheckArea(Pointer_Programmer, Address, Size);
+	if (Error != PROGRAMMER_ERROR_NONE) return Error;
+	if (Pointer_Data == NULL) return PROGRAMMER_ERROR_BAD_PARAMETER;
+
+	// The transfer only reads the data when sending it to the programmer
+	ProgrammerBeginOperation(Pointer_Programmer, PROGRAMMER_OPERATION_WRITE, Size);
+	ProgrammerStartTransfer(Pointer_Programmer, PROTOCOL_COMMAND_WRITE_FLASH, Address, ProtocolGetWriteCommandTimeout(Size), PROTOCOL_DIRECTION_TO_PROGRAMMER, (unsigned char *) Pointer_Data, Size);
+	return PROGRAMMER_ERROR_NONE;
+}
+
+TProgrammerError ProgrammerStartVerify(TProgrammer *Pointer_Programmer, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size)
+{
+	TProgrammerError Error;
+
+	Error = ProgrammerCheckArea(Pointer_Programmer, Address, Size);
+	if (Error != PROGRAMMER_ERROR_NONE) return Error;
+	if (Pointer_Data == NULL) return PROGRAMMER_ERROR_BAD_PARAMETER;
+
+	ProgrammerBeginOperation(Pointer_Programmer, PROGRAMMER_OPERATION_VERIFY, Size);
+	ProgrammerStartTransfer(Pointer_Programmer, PROTOCOL_COMMAND_VERIFY_FLASH, Address, PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_TO_PROGRAMMER, (unsigned char *) Pointer_Data, Size);
+	return PROGRAMMER_ERROR_NONE;
+}
+
+TProgrammerError ProgrammerStartErase(TProgrammer *Pointer_Programmer, unsigned int Address, unsigned int Size)
+{
+	TProgrammerError Error;
+	unsigned int End_Address;
+
+	Error = ProgrammerCheckArea(Pointer_Programmer, Address, Size);
+	if (Error != PROGRAMMER_ERROR_NONE) return Error;
+
+	// Erase whole sectors
+	End_Address = (Address + Size + PROTOCOL_FLASH_SECTOR_SIZE - 1) & ~(PROTOCOL_FLASH_SECTOR_SIZE - 1);
+	Address &= ~(PROTOCOL_FLASH_SECTOR_SIZE - 1);
+
+	ProgrammerBeginOperation(Pointer_Programmer, PROGRAMMER_OPERATION_ERASE, End_Address - Address);
+	Pointer_Programmer->Erase_Address = Address;
+	ProgrammerStartEraseBlock(Pointer_Programmer);
+	return PROGRAMMER_ERROR_NONE;
+}
+
+TProgrammerError ProgrammerStartSelectChips(TProgrammer *Pointer_Programmer, unsigned int Chips_Mask)
+{
+	unsigned char Command[2];
+
+	if (Pointer_Programmer->Status.Operation != PROGRAMMER_OPERATION_NONE) return PROGRAMMER_ERROR_BUSY;
+	if (Chips_Mask > 0xFF) return PROGRAMMER_ERROR_BAD_PARAMETER;
+
+	ProgrammerBeginOperation(Pointer_Programmer, PROGRAMMER_OPERATION_SELECT_CHIPS, 0);
+	Command[0] = PROTOCOL_COMMAND_SELECT_CHIPS;
+	Command[1] = Chips_Mask;
+	ProtocolInitializeTransfer(&Pointer_Programmer->Transfer, &Pointer_Programmer->Next_Command_Sequence, Command, sizeof(Command), PROTOCOL_COMMAND_TIMEOUT, PROTOCOL_DIRECTION_NONE, NULL, 0);
+	Pointer_Programmer->Is_Serial_Port_Failed = 0;
+	return PROGRAMMER_ERROR_NONE;
+}
+
+int ProgrammerProcess(TProgrammer *Pointer_Programmer, int Timeout)
+{
+	TProtocolTransfer *Pointer_Transfer = &Pointer_Programmer->Transfer;
+	unsigned char Buffer[4096], *Pointer_Output;
+	unsigned int Pending_Bytes_Count;
+	int Result;
+
+	if (Pointer_Programmer->Status.Operation == PROGRAMMER_OPERATION_NONE) return 0;
+
+	// Send as much data as possible
+	Pending_Bytes_Count = ProtocolGetPendingOutput(Pointer_Transfer, &Pointer_Output);
+	if (Pending_Bytes_Count > 0)
+	{
+		Result = UARTWriteBuffer(&Pointer_Programmer->UART, Pointer_Output, Pending_Bytes_Count);
+		if (Result < 0)
+		{
+			ProtocolAbortTransfer(Pointer_Transfer, "could not send data to the serial port");
+			Pointer_Programmer->Is_Serial_Port_Failed = 1;
+		}
+		else
+		{
+			ProtocolConsumeOutput(Pointer_Transfer, Result);
+			Pending_Bytes_Count -= Result;
+		}
+	}
+
+	// Handle the programmer answer
+	if (!ProtocolIsTransferTerminated(Pointer_Transfer))
+	{
+		if (Timeout > 0) UARTWaitForEvents(&Pointer_Programmer->UART, Pending_Bytes_Count > 0, Timeout);
+		Result = UARTReadBuffer(&Pointer_Programmer->UART, Buffer, sizeof(Buffer));
+		if (Result < 0)
+		{
+			ProtocolAbortTransfer(Pointer_Transfer, "the serial port was disconnected");
+			Pointer_Programmer->Is_Serial_Port_Failed = 1;
+		}
+		else
+		{
+			ProtocolProcessReceivedBytes(Pointer_Transfer, Buffer, Result);
+			ProtocolProcessTimeout(Pointer_Transfer);
+		}
+	}
+
+	// Tell the caller about the progress
+	ProgrammerReportProgress(Pointer_Programmer);
+
+	if (ProtocolIsTransferTerminated(Pointer_Transfer)) ProgrammerHandleTerminatedTransfer(Pointer_Programmer);
+	if (Pointer_Programmer->Status.Operation == PROGRAMMER_OPERATION_NONE) return 0;
+	return 1;
+}
+
+TProgrammerError ProgrammerWait(TProgrammer *Pointer_Programmer)
+{
+	while (ProgrammerProcess(Pointer_Programmer, PROGRAMMER_WAIT_PERIOD));
+	return Pointer_Programmer->Status.Error;
+}
+
+void ProgrammerCancel(TProgrammer *Pointer_Programmer)
+{
+	if (Pointer_Programmer->Status.Operation == PROGRAMMER_OPERATION_NONE) return;
+
+	ProtocolAbortTransfer(&Pointer_Programmer->Transfer, "canceled");
+	ProgrammerCompleteOperation(Pointer_Programmer, PROGRAMMER_ERROR_CANCELED);
+}
+
+void ProgrammerGetStatus(TProgrammer *Pointer_Programmer, TProgrammerStatus *Pointer_Status)
+{
+	*Pointer_Status = Pointer_Programmer->Status;
+}
+
+#ifndef WIN32
+int ProgrammerGetFileDescriptor(TProgrammer *Pointer_Programmer)
+{
+	return Pointer_Programmer->UART.File_Descriptor;
+}
+#endif
+
+int ProgrammerIsOutputPending(TProgrammer *Pointer_Programmer)
+{
+	unsigned char *Pointer_Output;
+
+	if (Pointer_Programmer->Status.Operation == PROGRAMMER_OPERATION_NONE) return 0;
+	if (ProtocolGetPendingOutput(&Pointer_Programmer->Transfer, &Pointer_Output) > 0) return 1;
+	return 0;
+}
+
+const char *ProgrammerGetErrorString(TProgrammerError Error)
+{
+	switch (Error)
+	{
+		case PROGRAMMER_ERROR_NONE:
+			return "success";
+		case PROGRAMMER_ERROR_BAD_PARAMETER:
+			return "bad parameter";
+		case PROGRAMMER_ERROR_OUT_OF_MEMORY:
+			return "not enough memory";
+		case PROGRAMMER_ERROR_SERIAL_PORT:
+			return "the serial port could not be used";
+		case PROGRAMMER_ERROR_BUSY:
+			return "another operation is running";
+		case PROGRAMMER_ERROR_NO_ANSWER:
+			return "the programmer stopped answering";
+		case PROGRAMMER_ERROR_VERIFY_MISMATCH:
+			return "the flash content differs from the expected data";
+		case PROGRAMMER_ERROR_CANCELED:
+			return "the operation was canceled";
+		case PROGRAMMER_ERROR_COMMAND_REJECTED:
+			return "the programmer firmware does not support or can't execute the operation";
+	}
+	return "unknown error";
+}
@@ -0,0 +1,185 @@
+/** @file Programmer.h
+ * Drive a programmer from another program without spawning the command line tool. This is the API of the libprogrammer static and shared libraries (see "make library").
+ * Each session owns a serial port. Operations are started without blocking, then the session is advanced by calling ProgrammerProcess() (from the caller event loop, see ProgrammerGetFileDescriptor()) or ProgrammerWait() until the operation terminates. Progress and completion are reported through callbacks, and every failure is reported with an error code.
+ * The data buffers provided by the caller are used as is to send or receive the data (nothing is copied), so they must stay valid until the operation terminates.
+ * A session must be used by a single thread at a time. Sessions do not share any state (each one numbers the commands of its own serial link), so different sessions can be driven by different threads.
+ * The libraries export only the functions declared here, the modules they are built from keep their symbols private so they can't clash with the caller ones.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_PROGRAMMER_H
+#define H_PROGRAMMER_H
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** Why an operation failed. */
+typedef enum
+{
+	PROGRAMMER_ERROR_NONE, //!< The operation succeeded.
+	PROGRAMMER_ERROR_BAD_PARAMETER, //!< A parameter is invalid (null buffer, empty or too large area...).
+	PROGRAMMER_ERROR_OUT_OF_MEMORY, //!< The session could not be allocated.
+	PROGRAMMER_ERROR_SERIAL_PORT, //!< The serial port could not be opened, or it was disconnected.
+	PROGRAMMER_ERROR_BUSY, //!< Another operation is running on this session.
+	PROGRAMMER_ERROR_NO_ANSWER, //!< The programmer stopped answering or receiving data.
+	PROGRAMMER_ERROR_VERIFY_MISMATCH, //!< At least one selected chip content differs from the provided data (see the Failed_Chips_Mask status field).
+	PROGRAMMER_ERROR_CANCELED, //!< The operation was canceled by ProgrammerCancel().
+	PROGRAMMER_ERROR_COMMAND_REJECTED //!< The programmer firmware does not support the operation command or can't execute it.
+} TProgrammerError;
+
+/** All operations a session can execute. */
+typedef enum
+{
+	PROGRAMMER_OPERATION_NONE, //!< No operation is running.
+	PROGRAMMER_OPERATION_READ, //!< Read the flash content to a buffer.
+	PROGRAMMER_OPERATION_WRITE, //!< Erase the sectors the data is written to, then write the data.
+	PROGRAMMER_OPERATION_VERIFY, //!< Compare the flash content of every selected chip with a buffer.
+	PROGRAMMER_OPERATION_ERASE, //!< Erase sectors.
+	PROGRAMMER_OPERATION_SELECT_CHIPS //!< Choose the chips the next operations apply to.
+} TProgrammerOperation;
+
+/** The state of the last started operation. */
+typedef struct
+{
+	TProgrammerOperation Operation; //!< The running operation, or PROGRAMMER_OPERATION_NONE when the last one terminated.
+	TProgrammerError Error; //!< The last operation result (meaningless while the operation is running).
+	unsigned int Transferred_Bytes_Count; //!< How many bytes were read, written, verified or erased.
+	unsigned int Total_Bytes_Count; //!< How many bytes the operation processes.
+	unsigned int Failed_Chips_Mask; //!< The chips whose content differs when verifying (bit n set means that chip n failed).
+	unsigned int Selected_Chips_Mask; //!< The chips the programmer really selected (the requested ones that are connected).
+	unsigned int Retransmitted_Frames_Count; //!< How many frames had to be sent again because of a link error.
+	unsigned int Corrupted_Frames_Count; //!< How many corrupted frames were received.
+} TProgrammerStatus;
+
+/** A programmer session (the content is private). */
+typedef struct TProgrammer TProgrammer;
+
+/** Called each time some data is acknowledged by the programmer.
+ * @param Pointer_Programmer The session.
+ * @param Transferred_Bytes_Count How many bytes were processed up to now.
+ * @param Total_Bytes_Count How many bytes the operation processes.
+ * @param Pointer_User_Data The value given to ProgrammerSetCallbacks().
+ */
+typedef void (*TProgrammerProgressCallback)(TProgrammer *Pointer_Programmer, unsigned int Transferred_Bytes_Count, unsigned int Total_Bytes_Count, void *Pointer_User_Data);
+
+/** Called once when an operation terminates. A new operation can be started from the callback.
+ * @param Pointer_Programmer The session.
+ * @param Error The operation result.
+ * @param Pointer_User_Data The value given to ProgrammerSetCallbacks().
+ */
+typedef void (*TProgrammerCompletionCallback)(TProgrammer *Pointer_Programmer, TProgrammerError Error, void *Pointer_User_Data);
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+// The libraries are built with hidden symbols, only these functions are visible
+#pragma GCC visibility push(default)
+
+/** Open the serial port a programmer is connected to.
+ * @param Pointer_Pointer_Programmer On output, contain the session. It must be released with ProgrammerClose().
+ * @param String_Serial_Port_Name The serial port device.
+ * @return PROGRAMMER_ERROR_NONE if the session was created, an error code if not.
+ */
+TProgrammerError ProgrammerOpen(TProgrammer **Pointer_Pointer_Programmer, char *String_Serial_Port_Name);
+
+/** Close the serial port and release the session. A running operation is abandoned (its completion callback is not called).
+ * @param Pointer_Programmer The session.
+ */
+void ProgrammerClose(TProgrammer *Pointer_Programmer);
+
+/** Choose the functions notified about the session operations.
+ * @param Pointer_Programmer The session.
+ * @param Progress_Callback Called when some data is acknowledged, can be NULL.
+ * @param Completion_Callback Called when an operation terminates, can be NULL.
+ * @param Pointer_User_Data Given as is to the callbacks.
+ */
+void ProgrammerSetCallbacks(TProgrammer *Pointer_Programmer, TProgrammerProgressCallback Progress_Callback, TProgrammerCompletionCallback Completion_Callback, void *Pointer_User_Data);
+
+/** Start reading the flash.
+ * @param Pointer_Programmer The session.
+ * @param Address The address to start reading from.
+ * @param Pointer_Buffer On output, contain the read data.
+ * @param Size How many bytes to read.
+ * @return PROGRAMMER_ERROR_NONE if the operation started, an error code if not.
+ */
+TProgrammerError ProgrammerStartRead(TProgrammer *Pointer_Programmer, unsigned int Address, unsigned char *Pointer_Buffer, unsigned int Size);
+
+/** Start writing data to the flash. The programmer erases the sectors containing the data first.
+ * @param Pointer_Programmer The session.
+ * @param Address The address to start writing to.
+ * @param Pointer_Data The data to write.
+ * @param Size How many bytes to write.
+ * @return PROGRAMMER_ERROR_NONE if the operation started, an error code if not.
+ */
+TProgrammerError ProgrammerStartWrite(TProgrammer *Pointer_Programmer, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size);
+
+/** Start comparing the flash content of every selected chip with some data.
+ * @param Pointer_Programmer The session.
+ * @param Address The address to start comparing from.
+ * @param Pointer_Data The expected data.
+ * @param Size How many bytes to compare.
+ * @return PROGRAMMER_ERROR_NONE if the operation started, an error code if not.
+ */
+TProgrammerError ProgrammerStartVerify(TProgrammer *Pointer_Programmer, unsigned int Address, const unsigned char *Pointer_Data, unsigned int Size);
+
+/** Start erasing all sectors overlapping an area. The programmer erases the sectors by itself, no data is sent.
+ * @param Pointer_Programmer The session.
+ * @param Address The area start address.
+ * @param Size The area size in bytes.
+ * @return PROGRAMMER_ERROR_NONE if the operation started, an error code if not.
+ */
+TProgrammerError ProgrammerStartErase(TProgrammer *Pointer_Programmer, unsigned int Address, unsigned int Size);
+
+/** Start choosing the chips the next operations apply to. Writes and erases program all selected chips at the same time.
+ * @param Pointer_Programmer The session.
+ * @param Chips_Mask Bit n set selects chip n.
+ * @return PROGRAMMER_ERROR_NONE if the operation started, an error code if not.
+ */
+TProgrammerError ProgrammerStartSelectChips(TProgrammer *Pointer_Programmer, unsigned int Chips_Mask);
+
+/** Exchange data with the programmer, waiting at most the specified time for it to answer.
+ * @param Pointer_Programmer The session.
+ * @param Timeout How many milliseconds to wait for the serial port at most (0 not to block).
+ * @return 1 if the operation is still running, 0 if no operation is running anymore.
+ */
+int ProgrammerProcess(TProgrammer *Pointer_Programmer, int Timeout);
+
+/** Process the running operation until it terminates.
+ * @param Pointer_Programmer The session.
+ * @return The operation result.
+ */
+TProgrammerError ProgrammerWait(TProgrammer *Pointer_Programmer);
+
+/** Stop the running operation. The programmer may still be executing the command, so the session should be closed when the operation was a write or an erase.
+ * @param Pointer_Programmer The session.
+ */
+void ProgrammerCancel(TProgrammer *Pointer_Programmer);
+
+/** Retrieve the running or last operation state.
+ * @param Pointer_Programmer The session.
+ * @param Pointer_Status On output, contain the operation state.
+ */
+void ProgrammerGetStatus(TProgrammer *Pointer_Programmer, TProgrammerStatus *Pointer_Status);
+
+#ifndef WIN32
+/** Get the serial port file descriptor, to wait for it in the caller event loop (call ProgrammerProcess() with a null timeout when it is readable, or writable if ProgrammerIsOutputPending() tells so, and at least every 100 ms to handle the protocol timeouts).
+ * @param Pointer_Programmer The session.
+ * @return The file descriptor.
+ */
+int ProgrammerGetFileDescriptor(TProgrammer *Pointer_Programmer);
+#endif
+
+/** Tell whether some bytes are waiting for the serial port to accept them.
+ * @param Pointer_Programmer The session.
+ * @return 1 if the caller must wait for the serial port to be writable, 0 if not.
+ */
+int ProgrammerIsOutputPending(TProgrammer *Pointer_Programmer);
+
+/** Describe an error code.
+ * @param Error The error code.
+ * @return A static string.
+ */
+const char *ProgrammerGetErrorString(TProgrammerError Error);
+
+#pragma GCC visibility pop
+
+#endif
@@ -0,0 +1,613 @@
+/** @file Protocol.c
+ * @see Protocol.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "CRC.h"
+#include "Protocol.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The parser is looking for a frame marker. */
+#define PROTOCOL_PARSER_STATE_WAIT_MARKER 0
+/** The parser is receiving the type, sequence number and payload length. */
+#define PROTOCOL_PARSER_STATE_RECEIVE_HEADER 1
+/** The parser is receiving the payload. */
+#define PROTOCOL_PARSER_STATE_RECEIVE_PAYLOAD 2
+/** The parser is receiving the CRC. */
+#define PROTOCOL_PARSER_STATE_RECEIVE_CRC 3
+
+/** The parser needs more bytes. */
+#define PROTOCOL_PARSER_RESULT_INCOMPLETE 0
+/** A valid frame was received. */
+#define PROTOCOL_PARSER_RESULT_FRAME_RECEIVED 1
+/** A corrupted frame was received. */
+#define PROTOCOL_PARSER_RESULT_FRAME_CORRUPTED 2
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Feed the parser with a byte.
+ * @param Pointer_Parser The parser.
+ * @param Byte The received byte.
+ * @return PROTOCOL_PARSER_RESULT_INCOMPLETE if the frame is not complete yet, PROTOCOL_PARSER_RESULT_FRAME_RECEIVED if a valid frame is available in the parser or PROTOCOL_PARSER_RESULT_FRAME_CORRUPTED if the frame is corrupted.
+ */
+static int ProtocolParseByte(TProtocolFrameParser *Pointer_Parser, unsigned char Byte)
+{
+	switch (Pointer_Parser->State)
+	{
+		case PROTOCOL_PARSER_STATE_WAIT_MARKER:
+			if (Byte == PROTOCOL_FRAME_MARKER)
+			{
+				Pointer_Parser->State = PROTOCOL_PARSER_STATE_RECEIVE_HEADER;
+				Pointer_Parser->Received_Bytes_Count = 0;
+				Pointer_Parser->CRC = CRC_INITIAL_VALUE;
+				Pointer_Parser->Payload_Size = 0;
+			}
+			break;
+
+		case PROTOCOL_PARSER_STATE_RECEIVE_HEADER:
+			Pointer_Parser->CRC = CRCUpdate(Pointer_Parser->CRC, &Byte, 1);
+			switch (Pointer_Parser->Received_Bytes_Count)
+			{
+				case 0:
+					Pointer_Parser->Type = Byte;
+					break;
+				case 1:
+					Pointer_Parser->Sequence = Byte;
+					break;
+				default:
+					Pointer_Parser->Payload_Size = (Pointer_Parser->Payload_Size << 8) | Byte;
+					break;
+			}
+			Pointer_Parser->Received_Bytes_Count++;
+
+			// Wait for the whole header
+			if (Pointer_Parser->Received_Bytes_Count < PROTOCOL_FRAME_HEADER_SIZE - 1) break;
+
+			// A corrupted length can't be trusted to receive the payload
+			if (Pointer_Parser->Payload_Size > PROTOCOL_MAXIMUM_PAYLOAD_SIZE)
+			{
+				Pointer_Parser->State = PROTOCOL_PARSER_STATE_WAIT_MARKER;
+				return PROTOCOL_PARSER_RESULT_FRAME_CORRUPTED;
+			}
+
+			Pointer_Parser->Received_Bytes_Count = 0;
+			if (Pointer_Parser->Payload_Size > 0) Pointer_Parser->State = PROTOCOL_PARSER_STATE_RECEIVE_PAYLOAD;
+			else
+			{
+				Pointer_Parser->State = PROTOCOL_PARSER_STATE_RECEIVE_CRC;
+				Pointer_Parser->Received_CRC = 0;
+			}
+			break;
+
+		case PROTOCOL_PARSER_STATE_RECEIVE_PAYLOAD:
+			Pointer_Parser->Payload[Pointer_Parser->Received_Bytes_Count] = Byte;
+			Pointer_Parser->Received_Bytes_Count++;
+			if (Pointer_Parser->Received_Bytes_Count == Pointer_Parser->Payload_Size)
+			{
+				Pointer_Parser->CRC = CRCUpdate(Pointer_Parser->CRC, Pointer_Parser->Payload, Pointer_Parser->Payload_Size);
+				Pointer_Parser->State = PROTOCOL_PARSER_STATE_RECEIVE_CRC;
+				Pointer_Parser->Received_Bytes_Count = 0;
+				Pointer_Parser->Received_CRC = 0;
+			}
+			break;
+
+		case PROTOCOL_PARSER_STATE_RECEIVE_CRC:
+			Pointer_Parser->Received_CRC = (Pointer_Parser->Received_CRC << 8) | Byte;
+			Pointer_Parser->Received_Bytes_Count++;
+			if (Pointer_Parser->Received_Bytes_Count == PROTOCOL_FRAME_CRC_SIZE)
+			{
+				Pointer_Parser->State = PROTOCOL_PARSER_STATE_WAIT_MARKER;
+				if (Pointer_Parser->Received_CRC != CRC_FINALIZE(Pointer_Parser->CRC)) return PROTOCOL_PARSER_RESULT_FRAME_CORRUPTED;
+				return PROTOCOL_PARSER_RESULT_FRAME_RECEIVED;
+			}
+			break;
+	}
+
+	return PROTOCOL_PARSER_RESULT_INCOMPLETE;
+}
+
+/** Go to another transfer step, remembering when the command and data phases terminated.
+ * @param Pointer_Transfer The transfer.
+ * @param State The new step.
+ */
+static void ProtocolSetState(TProtocolTransfer *Pointer_Transfer, TProtocolTransferState State)
+{
+	unsigned long long Time;
+
+	Time = ProtocolGetPreciseTime();
+	if (State == PROTOCOL_TRANSFER_STATE_TRANSFER_DATA)
+	{
+		Pointer_Transfer->Command_Acknowledge_Time = Time;
+		if (Pointer_Transfer->Output_Buffer_Start == Pointer_Transfer->Output_Buffer_End) Pointer_Transfer->Stall_Start_Time = Time;
+	}
+	else if ((State == PROTOCOL_TRANSFER_STATE_SUCCESS) || (State == PROTOCOL_TRANSFER_STATE_FAILURE))
+	{
+		if (Pointer_Transfer->Command_Acknowledge_Time == 0) Pointer_Transfer->Command_Acknowledge_Time = Time;
+		if (Pointer_Transfer->Stall_Start_Time != 0)
+		{
+			Pointer_Transfer->Stall_Time += Time - Pointer_Transfer->Stall_Start_Time;
+			Pointer_Transfer->Stall_Start_Time = 0;
+		}
+		Pointer_Transfer->End_Time = Time;
+	}
+	Pointer_Transfer->State = State;
+}
+
+/** Append a frame to the output queue.
+ * @param Pointer_Transfer The transfer.
+ * @param Type The frame type.
+ * @param Sequence The frame sequence number.
+ * @param Pointer_Payload The payload (can be NULL if Payload_Size is 0).
+ * @param Payload_Size The payload size in bytes.
+ */
+static void ProtocolQueueFrame(TProtocolTransfer *Pointer_Transfer, unsigned char Type, unsigned char Sequence, const unsigned char *Pointer_Payload, unsigned int Payload_Size)
+{
+	unsigned char *Pointer_Frame;
+	unsigned int CRC, Frame_Size;
+
+	// The host has something to send again
+	if (Pointer_Transfer->Stall_Start_Time != 0)
+	{
+		Pointer_Transfer->Stall_Time += ProtocolGetPreciseTime() - Pointer_Transfer->Stall_Start_Time;
+		Pointer_Transfer->Stall_Start_Time = 0;
+	}
+
+	// Move the pending bytes to the buffer beginning if there is not enough room left at the end
+	Frame_Size = PROTOCOL_FRAME_HEADER_SIZE + Payload_Size + PROTOCOL_FRAME_CRC_SIZE;
+	if (Pointer_Transfer->Output_Buffer_End + Frame_Size > PROTOCOL_OUTPUT_BUFFER_SIZE)
+	{
+		memmove(Pointer_Transfer->Output_Buffer, &Pointer_Transfer->Output_Buffer[Pointer_Transfer->Output_Buffer_Start], Pointer_Transfer->Output_Buffer_End - Pointer_Transfer->Output_Buffer_Start);
+		Pointer_Transfer->Output_Buffer_End -= Pointer_Transfer->Output_Buffer_Start;
+		Pointer_Transfer->Output_Buffer_Start = 0;
+
+		// The programmer does not read the data anymore, the frame can't be queued
+		if (Pointer_Transfer->Output_Buffer_End + Frame_Size > PROTOCOL_OUTPUT_BUFFER_SIZE)
+		{
+			ProtocolAbortTransfer(Pointer_Transfer, "the programmer does not receive data anymore");
+			return;
+		}
+	}
+	Pointer_Frame = &Pointer_Transfer->Output_Buffer[Pointer_Transfer->Output_Buffer_End];
+
+	// Build the header
+	Pointer_Frame[0] = PROTOCOL_FRAME_MARKER;
+	Pointer_Frame[1] = Type;
+	Pointer_Frame[2] = Sequence;
+	Pointer_Frame[3] = Payload_Size >> 8;
+	Pointer_Frame[4] = Payload_Size;
+	if (Payload_Size > 0) memcpy(&Pointer_Frame[PROTOCOL_FRAME_HEADER_SIZE], Pointer_Payload, Payload_Size);
+
+	// Append the CRC (the marker is not part of it)
+	CRC = CRCCompute(&Pointer_Frame[1], PROTOCOL_FRAME_HEADER_SIZE - 1 + Payload_Size);
+	Pointer_Frame[PROTOCOL_FRAME_HEADER_SIZE + Payload_Size] = CRC >> 24;
+	Pointer_Frame[PROTOCOL_FRAME_HEADER_SIZE + Payload_Size + 1] = CRC >> 16;
+	Pointer_Frame[PROTOCOL_FRAME_HEADER_SIZE + Payload_Size + 2] = CRC >> 8;
+	Pointer_Frame[PROTOCOL_FRAME_HEADER_SIZE + Payload_Size + 3] = CRC;
+
+	Pointer_Transfer->Output_Buffer_End += Frame_Size;
+}
+
+/** Get the size of a data block.
+ * @param Pointer_Transfer The transfer.
+ * @param Offset The block offset in the data.
+ * @return The block size in bytes.
+ */
+static unsigned int ProtocolGetBlockSize(TProtocolTransfer *Pointer_Transfer, unsigned int Offset)
+{
+	if (Pointer_Transfer->Data_Size - Offset < Pointer_Transfer->Block_Size) return Pointer_Transfer->Data_Size - Offset;
+	return Pointer_Transfer->Block_Size;
+}
+
+/** Queue as many data frames as the window allows.
+ * @param Pointer_Transfer The transfer.
+ */
+static void ProtocolFillWindow(TProtocolTransfer *Pointer_Transfer)
+{
+	unsigned int Block_Size;
+
+	while ((Pointer_Transfer->Next_Offset < Pointer_Transfer->Data_Size) && ((unsigned char) (Pointer_Transfer->Next_Sequence - Pointer_Transfer->Sequence) < Pointer_Transfer->Window_Size))
+	{
+		Block_Size = ProtocolGetBlockSize(Pointer_Transfer, Pointer_Transfer->Next_Offset);
+		ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_DATA, Pointer_Transfer->Next_Sequence, &Pointer_Transfer->Pointer_Data[Pointer_Transfer->Next_Offset], Block_Size);
+		Pointer_Transfer->Next_Offset += Block_Size;
+		Pointer_Transfer->Next_Sequence++;
+	}
+}
+
+/** Mark the oldest data frames as received by the other side.
+ * @param Pointer_Transfer The transfer.
+ * @param Frames_Count How many frames were acknowledged.
+ */
+static void ProtocolAcknowledgeFrames(TProtocolTransfer *Pointer_Transfer, unsigned int Frames_Count)
+{
+	while (Frames_Count > 0)
+	{
+		Pointer_Transfer->Transferred_Bytes_Count += ProtocolGetBlockSize(Pointer_Transfer, Pointer_Transfer->Transferred_Bytes_Count);
+		Pointer_Transfer->Sequence++;
+		Frames_Count--;
+	}
+	Pointer_Transfer->Retries_Count = 0;
+	Pointer_Transfer->Deadline = ProtocolGetTime() + PROTOCOL_FRAME_TIMEOUT;
+}
+
+/** Send the data frames again, starting from the oldest one that was not acknowledged.
+ * @param Pointer_Transfer The transfer.
+ */
+static void ProtocolRewindWindow(TProtocolTransfer *Pointer_Transfer)
+{
+	Pointer_Transfer->Next_Sequence = Pointer_Transfer->Sequence;
+	Pointer_Transfer->Next_Offset = Pointer_Transfer->Transferred_Bytes_Count;
+	ProtocolFillWindow(Pointer_Transfer);
+}
+
+/** Take the appropriate action when the expected frame did not come or came corrupted.
+ * @param Pointer_Transfer The transfer.
+ */
+static void ProtocolRetry(TProtocolTransfer *Pointer_Transfer)
+{
+	Pointer_Transfer->Retries_Count++;
+	if (Pointer_Transfer->Retries_Count > PROTOCOL_MAXIMUM_RETRIES_COUNT)
+	{
+		ProtocolAbortTransfer(Pointer_Transfer, "the programmer stopped answering");
+		return;
+	}
+	Pointer_Transfer->Retransmitted_Frames_Count++;
+
+	if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_WAIT_COMMAND_ACKNOWLEDGE)
+	{
+		ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_COMMAND, Pointer_Transfer->Command_Sequence, Pointer_Transfer->Command, Pointer_Transfer->Command_Size);
+		Pointer_Transfer->Deadline = ProtocolGetTime() + Pointer_Transfer->Command_Timeout;
+		return;
+	}
+
+	if (Pointer_Transfer->Direction == PROTOCOL_DIRECTION_TO_PROGRAMMER) ProtocolRewindWindow(Pointer_Transfer);
+	else
+	{
+		// Ask the programmer to send the frames again starting from the expected one
+		ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE, Pointer_Transfer->Sequence, NULL, 0);
+		Pointer_Transfer->Is_Negative_Acknowledge_Sent = 1;
+		Pointer_Transfer->Unexpected_Sequence = Pointer_Transfer->Sequence;
+	}
+	Pointer_Transfer->Deadline = ProtocolGetTime() + PROTOCOL_FRAME_TIMEOUT;
+}
+
+/** Ask the programmer to send the data frames again when the expected one is missing. All frames following a lost one are unexpected too (and a corrupted length can split a frame into many corrupted ones), so the missing frame is asked only once. The programmer sends increasing sequence numbers until it is asked for a frame again, so a sequence number that does not increase tells that the frames were sent again but the missing one was lost again, it is asked again without waiting for the timeout. The header of a corrupted data frame is used too, as it is much less likely to be corrupted than the payload and a wrong guess only makes the programmer send some frames again.
+ * @param Pointer_Transfer The transfer, its parser containing the unexpected or corrupted frame.
+ */
+static void ProtocolRequestMissingFrame(TProtocolTransfer *Pointer_Transfer)
+{
+	TProtocolFrameParser *Pointer_Parser = &Pointer_Transfer->Parser;
+
+	if (!Pointer_Transfer->Is_Negative_Acknowledge_Sent) ProtocolRetry(Pointer_Transfer);
+	else if ((Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_DATA) && ((unsigned char) (Pointer_Parser->Sequence - Pointer_Transfer->Sequence) <= (unsigned char) (Pointer_Transfer->Unexpected_Sequence - Pointer_Transfer->Sequence))) ProtocolRetry(Pointer_Transfer);
+	if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_DATA) Pointer_Transfer->Unexpected_Sequence = Pointer_Parser->Sequence;
+}
+
+/** Keep the acknowledge payload as the command result.
+ * @param Pointer_Transfer The transfer.
+ * @param Pointer_Parser The parser containing the acknowledge frame.
+ */
+static void ProtocolStoreAcknowledgePayload(TProtocolTransfer *Pointer_Transfer, TProtocolFrameParser *Pointer_Parser)
+{
+	unsigned int Size;
+
+	Size = Pointer_Parser->Payload_Size;
+	if (Size > PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE) Size = PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE;
+	memcpy(Pointer_Transfer->Acknowledge_Payload, Pointer_Parser->Payload, Size);
+	Pointer_Transfer->Acknowledge_Payload_Size = Size;
+}
+
+/** Handle a valid frame sent by the programmer.
+ * @param Pointer_Transfer The transfer.
+ */
+static void ProtocolProcessFrame(TProtocolTransfer *Pointer_Transfer)
+{
+	TProtocolFrameParser *Pointer_Parser = &Pointer_Transfer->Parser;
+	unsigned int Block_Size, Frames_Count;
+
+	switch (Pointer_Transfer->State)
+	{
+		case PROTOCOL_TRANSFER_STATE_WAIT_COMMAND_ACKNOWLEDGE:
+			if (Pointer_Parser->Sequence != Pointer_Transfer->Command_Sequence) break; // Ignore the late frames of a previous command
+
+			if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE)
+			{
+				// Sending a rejected command again would be rejected again
+				if (Pointer_Parser->Payload_Size == 0) ProtocolRetry(Pointer_Transfer);
+				else
+				{
+					Pointer_Transfer->Rejection_Reason = Pointer_Parser->Payload[0];
+					if (Pointer_Transfer->Rejection_Reason == PROTOCOL_COMMAND_REJECTION_UNSUPPORTED) ProtocolAbortTransfer(Pointer_Transfer, "the programmer firmware does not support this command");
+					else ProtocolAbortTransfer(Pointer_Transfer, "the programmer can't execute this command with these parameters or with the selected chips");
+				}
+			}
+			else if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_ACKNOWLEDGE)
+			{
+				ProtocolStoreAcknowledgePayload(Pointer_Transfer, Pointer_Parser);
+				Pointer_Transfer->Retries_Count = 0;
+
+				// Start the data phase
+				if ((Pointer_Transfer->Direction == PROTOCOL_DIRECTION_NONE) || (Pointer_Transfer->Data_Size == 0))
+				{
+					ProtocolSetState(Pointer_Transfer, PROTOCOL_TRANSFER_STATE_SUCCESS);
+					break;
+				}
+				ProtocolSetState(Pointer_Transfer, PROTOCOL_TRANSFER_STATE_TRANSFER_DATA);
+				Pointer_Transfer->Sequence = 0;
+				Pointer_Transfer->Deadline = ProtocolGetTime() + PROTOCOL_FRAME_TIMEOUT;
+				if (Pointer_Transfer->Direction == PROTOCOL_DIRECTION_TO_PROGRAMMER)
+				{
+					// The programmer tells how many frames it can receive in a row
+					if (Pointer_Transfer->Acknowledge_Payload_Size > 0) Pointer_Transfer->Window_Size = Pointer_Transfer->Acknowledge_Payload[0];
+					if (Pointer_Transfer->Window_Size == 0) Pointer_Transfer->Window_Size = 1;
+					if (Pointer_Transfer->Window_Size > PROTOCOL_MAXIMUM_WINDOW_SIZE) Pointer_Transfer->Window_Size = PROTOCOL_MAXIMUM_WINDOW_SIZE;
+					ProtocolRewindWindow(Pointer_Transfer);
+				}
+			}
+			break;
+
+		case PROTOCOL_TRANSFER_STATE_TRANSFER_DATA:
+			// Sending data
+			if (Pointer_Transfer->Direction == PROTOCOL_DIRECTION_TO_PROGRAMMER)
+			{
+				// Find how many frames the programmer tells it received (an acknowledge includes the acknowledged frame, a negative acknowledge only the frames preceding the requested one)
+				if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_ACKNOWLEDGE) Frames_Count = (unsigned char) (Pointer_Parser->Sequence - Pointer_Transfer->Sequence + 1);
+				else if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE) Frames_Count = (unsigned char) (Pointer_Parser->Sequence - Pointer_Transfer->Sequence);
+				else break;
+				if (Frames_Count > (unsigned char) (Pointer_Transfer->Next_Sequence - Pointer_Transfer->Sequence)) break; // Ignore the acknowledges of frames that were already acknowledged
+
+				if (Frames_Count > 0) ProtocolAcknowledgeFrames(Pointer_Transfer, Frames_Count);
+
+				if (Pointer_Parser->Type == PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE) ProtocolRetry(Pointer_Transfer);
+				else
+				{
+					ProtocolStoreAcknowledgePayload(Pointer_Transfer, Pointer_Parser);
+					if (Pointer_Transfer->Transferred_Bytes_Count == Pointer_Transfer->Data_Size) ProtocolSetState(Pointer_Transfer, PROTOCOL_TRANSFER_STATE_SUCCESS);
+					else ProtocolFillWindow(Pointer_Transfer);
+				}
+			}
+			// Receiving data
+			else
+			{
+				if (Pointer_Parser->Type != PROTOCOL_FRAME_TYPE_DATA) break;
+
+				// The programmer did not receive the acknowledge in time and sent already received frames again, tell it again what was received
+				if ((unsigned char) (Pointer_Transfer->Sequence - Pointer_Parser->Sequence - 1) < PROTOCOL_MAXIMUM_WINDOW_SIZE)
+				{
+					ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_ACKNOWLEDGE, Pointer_Transfer->Sequence - 1, NULL, 0);
+					break;
+				}
+
+				Block_Size = ProtocolGetBlockSize(Pointer_Transfer, Pointer_Transfer->Transferred_Bytes_Count);
+				if ((Pointer_Parser->Sequence != Pointer_Transfer->Sequence) || (Pointer_Parser->Payload_Size != Block_Size))
+				{
+					ProtocolRequestMissingFrame(Pointer_Transfer);
+					break;
+				}
+
+				// Keep the data and acknowledge it
+				memcpy(&Pointer_Transfer->Pointer_Data[Pointer_Transfer->Transferred_Bytes_Count], Pointer_Parser->Payload, Block_Size);
+				ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_ACKNOWLEDGE, Pointer_Parser->Sequence, NULL, 0);
+				ProtocolAcknowledgeFrames(Pointer_Transfer, 1);
+				Pointer_Transfer->Is_Negative_Acknowledge_Sent = 0;
+
+				if (Pointer_Transfer->Transferred_Bytes_Count == Pointer_Transfer->Data_Size) ProtocolSetState(Pointer_Transfer, PROTOCOL_TRANSFER_STATE_SUCCESS);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+unsigned long long ProtocolGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000ULL + Time.tv_nsec / 1000000;
+}
+
+unsigned long long ProtocolGetPreciseTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000ULL + Time.tv_nsec / 1000;
+}
+
+unsigned int ProtocolBuildAddressCommand(unsigned char *Pointer_Command, unsigned char Command_Code, unsigned int Address, unsigned int Bytes_Count)
+{
+	Pointer_Command[0] = Command_Code;
+	Pointer_Command[1] = Address >> 24;
+	Pointer_Command[2] = Address >> 16;
+	Pointer_Command[3] = Address >> 8;
+	Pointer_Command[4] = Address;
+	Pointer_Command[5] = Bytes_Count >> 24;
+	Pointer_Command[6] = Bytes_Count >> 16;
+	Pointer_Command[7] = Bytes_Count >> 8;
+	Pointer_Command[8] = Bytes_Count;
+	return 9;
+}
+
+unsigned int ProtocolBuildSPIClockCommand(unsigned char *Pointer_Command, unsigned char Command_Code, unsigned int Parameter)
+{
+	Pointer_Command[0] = Command_Code;
+	Pointer_Command[1] = Parameter >> 24;
+	Pointer_Command[2] = Parameter >> 16;
+	Pointer_Command[3] = Parameter >> 8;
+	Pointer_Command[4] = Parameter;
+	return 5;
+}
+
+unsigned int ProtocolGetDoubleWord(const unsigned char *Pointer_Bytes)
+{
+	return ((unsigned int) Pointer_Bytes[0] << 24) | (Pointer_Bytes[1] << 16) | (Pointer_Bytes[2] << 8) | Pointer_Bytes[3];
+}
+
+unsigned int ProtocolGetWriteCommandTimeout(unsigned int Bytes_Count)
+{
+	unsigned int Sectors_Count;
+
+	Sectors_Count = (Bytes_Count + PROTOCOL_FLASH_SECTOR_SIZE - 1) / PROTOCOL_FLASH_SECTOR_SIZE;
+	return PROTOCOL_ERASE_BASE_TIMEOUT + Sectors_Count * PROTOCOL_SECTOR_ERASE_TIMEOUT;
+}
+
+unsigned int ProtocolGetSearchCommandTimeout(unsigned int Bytes_Count)
+{
+	return PROTOCOL_COMMAND_TIMEOUT + Bytes_Count / PROTOCOL_SEARCH_MINIMUM_SPEED;
+}
+
+unsigned char ProtocolGetInitialCommandSequence(void)
+{
+	struct timespec Time;
+
+	// The nanoseconds vary on each program run, and reading the clock does not change any shared state (unlike rand())
+	clock_gettime(CLOCK_REALTIME, &Time);
+	return (unsigned char) (Time.tv_nsec ^ (Time.tv_nsec >> 8) ^ (Time.tv_nsec >> 16));
+}
+
+void ProtocolInitializeTransfer(TProtocolTransfer *Pointer_Transfer, unsigned char *Pointer_Next_Command_Sequence, const unsigned char *Pointer_Command, unsigned int Command_Size, unsigned int Command_Timeout, TProtocolDirection Direction, unsigned char *Pointer_Data, unsigned int Data_Size)
+{
+	memset(Pointer_Transfer, 0, sizeof(TProtocolTransfer));
+	memcpy(Pointer_Transfer->Command, Pointer_Command, Command_Size);
+	Pointer_Transfer->Command_Size = Command_Size;
+	Pointer_Transfer->Command_Timeout = Command_Timeout;
+	Pointer_Transfer->Direction = Direction;
+	Pointer_Transfer->Pointer_Data = Pointer_Data;
+	Pointer_Transfer->Data_Size = Data_Size;
+	if (Direction == PROTOCOL_DIRECTION_TO_PROGRAMMER) Pointer_Transfer->Block_Size = PROTOCOL_WRITE_BLOCK_SIZE;
+	else Pointer_Transfer->Block_Size = PROTOCOL_READ_BLOCK_SIZE;
+	Pointer_Transfer->Parser.State = PROTOCOL_PARSER_STATE_WAIT_MARKER;
+	Pointer_Transfer->Start_Time = ProtocolGetPreciseTime();
+
+	// Send the command
+	Pointer_Transfer->Command_Sequence = *Pointer_Next_Command_Sequence;
+	(*Pointer_Next_Command_Sequence)++;
+	Pointer_Transfer->State = PROTOCOL_TRANSFER_STATE_WAIT_COMMAND_ACKNOWLEDGE;
+	ProtocolQueueFrame(Pointer_Transfer, PROTOCOL_FRAME_TYPE_COMMAND, Pointer_Transfer->Command_Sequence, Pointer_Transfer->Command, Command_Size);
+	Pointer_Transfer->Deadline = ProtocolGetTime() + Command_Timeout;
+}
+
+void ProtocolProcessReceivedBytes(TProtocolTransfer *Pointer_Transfer, const unsigned char *Pointer_Bytes, unsigned int Bytes_Count)
+{
+	unsigned int i;
+
+	for (i = 0; i < Bytes_Count; i++)
+	{
+		if ((Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) || (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_FAILURE)) return;
+
+		switch (ProtocolParseByte(&Pointer_Transfer->Parser, Pointer_Bytes[i]))
+		{
+			case PROTOCOL_PARSER_RESULT_FRAME_RECEIVED:
+				ProtocolProcessFrame(Pointer_Transfer);
+				break;
+
+			case PROTOCOL_PARSER_RESULT_FRAME_CORRUPTED:
+				Pointer_Transfer->Corrupted_Frames_Count++;
+				// The command acknowledge comes only once the command has been executed, so wait for the timeout rather than making the programmer execute the command again. A lost data acknowledge is covered by the following one, which acknowledges all previous frames too
+				if ((Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_TRANSFER_DATA) && (Pointer_Transfer->Direction == PROTOCOL_DIRECTION_FROM_PROGRAMMER)) ProtocolRequestMissingFrame(Pointer_Transfer);
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+void ProtocolProcessTimeout(TProtocolTransfer *Pointer_Transfer)
+{
+	if ((Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) || (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_FAILURE)) return;
+	if (ProtocolGetTime() < Pointer_Transfer->Deadline) return;
+
+	// Start again from a clean parser state, the partially received frame is lost anyway
+	Pointer_Transfer->Parser.State = PROTOCOL_PARSER_STATE_WAIT_MARKER;
+	ProtocolRetry(Pointer_Transfer);
+}
+
+unsigned int ProtocolGetPendingOutput(TProtocolTransfer *Pointer_Transfer, unsigned char **Pointer_Pointer_Output)
+{
+	*Pointer_Pointer_Output = &Pointer_Transfer->Output_Buffer[Pointer_Transfer->Output_Buffer_Start];
+	return Pointer_Transfer->Output_Buffer_End - Pointer_Transfer->Output_Buffer_Start;
+}
+
+void ProtocolConsumeOutput(TProtocolTransfer *Pointer_Transfer, unsigned int Sent_Bytes_Count)
+{
+	Pointer_Transfer->Output_Buffer_Start += Sent_Bytes_Count;
+
+	// Rewind the buffer when it is empty
+	if (Pointer_Transfer->Output_Buffer_Start == Pointer_Transfer->Output_Buffer_End)
+	{
+		Pointer_Transfer->Output_Buffer_Start = 0;
+		Pointer_Transfer->Output_Buffer_End = 0;
+
+		// Nothing can be sent until the programmer answers
+		if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_TRANSFER_DATA) Pointer_Transfer->Stall_Start_Time = ProtocolGetPreciseTime();
+	}
+}
+
+void ProtocolAbortTransfer(TProtocolTransfer *Pointer_Transfer, const char *String_Error)
+{
+	if (Pointer_Transfer->State != PROTOCOL_TRANSFER_STATE_FAILURE) ProtocolSetState(Pointer_Transfer, PROTOCOL_TRANSFER_STATE_FAILURE);
+	Pointer_Transfer->String_Error = String_Error;
+}
+
+int ProtocolIsTransferTerminated(TProtocolTransfer *Pointer_Transfer)
+{
+	if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_FAILURE) return 1;
+	if ((Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) && (Pointer_Transfer->Output_Buffer_Start == Pointer_Transfer->Output_Buffer_End)) return 1; // Make sure the last acknowledge is sent
+	return 0;
+}
+
+int ProtocolRunTransfer(TUART *Pointer_UART, TProtocolTransfer *Pointer_Transfer, TProtocolProgressCallback Progress_Callback)
+{
+	unsigned char Buffer[4096], *Pointer_Output;
+	unsigned int Pending_Bytes_Count, Last_Transferred_Bytes_Count = 0;
+	int Result;
+
+	while (!ProtocolIsTransferTerminated(Pointer_Transfer))
+	{
+		// Send as much data as possible
+		Pending_Bytes_Count = ProtocolGetPendingOutput(Pointer_Transfer, &Pointer_Output);
+		if (Pending_Bytes_Count > 0)
+		{
+			Result = UARTWriteBuffer(Pointer_UART, Pointer_Output, Pending_Bytes_Count);
+			if (Result < 0)
+			{
+				ProtocolAbortTransfer(Pointer_Transfer, "could not send data to the serial port");
+				break;
+			}
+			ProtocolConsumeOutput(Pointer_Transfer, Result);
+			Pending_Bytes_Count -= Result;
+		}
+
+		// Wait for the programmer to answer
+		UARTWaitForEvents(Pointer_UART, Pending_Bytes_Count > 0, 100);
+		Result = UARTReadBuffer(Pointer_UART, Buffer, sizeof(Buffer));
+		if (Result < 0)
+		{
+			ProtocolAbortTransfer(Pointer_Transfer, "the serial port was disconnected");
+			break;
+		}
+		ProtocolProcessReceivedBytes(Pointer_Transfer, Buffer, Result);
+		ProtocolProcessTimeout(Pointer_Transfer);
+
+		// Tell the caller about the progress
+		if ((Progress_Callback != NULL) && (Pointer_Transfer->Transferred_Bytes_Count != Last_Transferred_Bytes_Count))
+		{
+			Progress_Callback(Pointer_Transfer->Transferred_Bytes_Count, Pointer_Transfer->Data_Size);
+			Last_Transferred_Bytes_Count = Pointer_Transfer->Transferred_Bytes_Count;
+		}
+	}
+
+	if (Pointer_Transfer->State == PROTOCOL_TRANSFER_STATE_SUCCESS) return 0;
+	return -1;
+}
@@ -0,0 +1,326 @@
+/** @file Protocol.h
+ * Exchange frames with the programmer firmware. Each frame is made of a marker byte, a type, a sequence number, a payload length, the payload and a CRC-32 of all these fields except the marker.
+ * Every frame is acknowledged by the receiver, and a corrupted frame is negatively acknowledged so that only this frame is sent again.
+ * Several data frames are sent in a row without waiting for their acknowledge (up to the receiver reception credits), so the serial adapter latency is paid once per window instead of once per frame. An acknowledge tells that all frames up to the acknowledged one were received, a negative acknowledge makes the sender go back to the requested frame.
+ * The codes and sizes defined here must be kept synchronized with the microcontroller ones.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_PROTOCOL_H
+#define H_PROTOCOL_H
+
+#include "UART.h"
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** Read a flash area. The parameters are the area address (32-bit) and size (32-bit), the data is sent in PROTOCOL_READ_BLOCK_SIZE-byte data frames. */
+#define PROTOCOL_COMMAND_READ_FLASH 0x10
+/** Erase and program a flash area. The parameters are the area address (32-bit) and size (32-bit), an optional flags byte can follow them (see PROTOCOL_WRITE_FLAG_VERIFY_PAGES). The data is sent in PROTOCOL_WRITE_BLOCK_SIZE-byte data frames. */
+#define PROTOCOL_COMMAND_WRITE_FLASH 0x20
+/** Compare the flash content of every selected chip with data sent by the PC. */
+#define PROTOCOL_COMMAND_VERIFY_FLASH 0x30
+/** Choose which chips (among the ones connected to the programmer) the next commands apply to. */
+#define PROTOCOL_COMMAND_SELECT_CHIPS 0x40
+/** Retrieve where the programmer time went since the previous statistics command (the statistics are sent in a single data frame). */
+#define PROTOCOL_COMMAND_READ_STATISTICS 0x50
+/** Make the programmer send generated data without accessing the flash, to measure the serial link. The parameters are the bytes count (32-bit), the data frames size (16-bit) and the window size (8-bit), all big endian. The acknowledge echoes the parameters the programmer really uses, then each data frame contains the bytes 0, 1, 2... */
+#define PROTOCOL_COMMAND_PING 0x60
+/** Make the programmer probe its chip sockets. The acknowledge contains the mask of the available chips, the mask of the chips inserted and the mask of the chips removed since the previous command. */
+#define PROTOCOL_COMMAND_READ_CHIPS_EVENTS 0x70
+/** Make the programmer find the addresses a byte pattern is stored at. The parameters are the address (32-bit), the bytes count (32-bit), the pattern size (8-bit), the pattern and the mask (only the bits set in the mask are compared). The command is acknowledged when the search ends, then the result is sent in a single data frame (see PROTOCOL_SEARCH_RESULT_SIZE). */
+#define PROTOCOL_COMMAND_SEARCH_FLASH 0x80
+/** Retrieve the pages the last write with the PROTOCOL_WRITE_FLAG_VERIFY_PAGES flag could not program (they are sent in a single data frame, see PROTOCOL_WRITE_FAILURES_SIZE). */
+#define PROTOCOL_COMMAND_READ_WRITE_FAILURES 0x90
+/** Make the programmer find the fastest SPI clock the selected chips and their wiring sustain, by programming and reading back a pattern at each clock. The parameter is the address of a sector the calibration can erase (32-bit). The programmer keeps using the selected clock. The command is acknowledged when the calibration ends, then the result is sent in a single data frame (see PROTOCOL_SPI_CALIBRATION_RESULT_SIZE). */
+#define PROTOCOL_COMMAND_CALIBRATE_SPI_CLOCK 0xA0
+/** Make the programmer use the fastest SPI clock that is not faster than the provided frequency in Hz (32-bit). The acknowledge contains the frequency really used (32-bit). */
+#define PROTOCOL_COMMAND_SET_SPI_CLOCK 0xB0
+/** Make the programmer compute the CRC-32 of consecutive flash sectors. The parameters are the first sector address (32-bit) and the sectors count (32-bit), up to PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT sectors are computed. The command is acknowledged when all CRCs are computed, then the result is sent in a single data frame (see PROTOCOL_SECTORS_CRC_RESULT_SIZE). */
+#define PROTOCOL_COMMAND_READ_SECTORS_CRC 0xC0
+/** Erase the flash sectors containing an area. The parameters are the area address (32-bit) and size (32-bit), the command is acknowledged when all sectors are erased (see ProtocolGetWriteCommandTimeout()). */
+#define PROTOCOL_COMMAND_ERASE_FLASH 0xD0
+
+/** The byte starting every frame. */
+#define PROTOCOL_FRAME_MARKER 0x7E
+
+/** A command sent by the PC, the first payload byte is the command code and the following ones are the command parameters. */
+#define PROTOCOL_FRAME_TYPE_COMMAND 0x01
+/** A block of data, sent by the PC when writing and by the microcontroller when reading. */
+#define PROTOCOL_FRAME_TYPE_DATA 0x02
+/** The frame having the same sequence number was successfully received (the payload can contain the command result). */
+#define PROTOCOL_FRAME_TYPE_ACKNOWLEDGE 0x03
+/** The frame having the same sequence number was corrupted and must be sent again. */
+#define PROTOCOL_FRAME_TYPE_NEGATIVE_ACKNOWLEDGE 0x04
+
+/** The payload of a negative acknowledge answering a command with an unknown code (a negative acknowledge without payload asks for the frame again). */
+#define PROTOCOL_COMMAND_REJECTION_UNSUPPORTED 0x01
+/** The payload of a negative acknowledge answering a command that can't be executed with its parameters or with the selected chips. */
+#define PROTOCOL_COMMAND_REJECTION_INVALID 0x02
+
+/** The size of the frame marker, type, sequence number and payload length fields. */
+#define PROTOCOL_FRAME_HEADER_SIZE 5
+/** The size of the frame CRC. */
+#define PROTOCOL_FRAME_CRC_SIZE 4
+
+/** How many bytes the PC sends in each data frame (a flash page is programmed per frame). */
+#define PROTOCOL_WRITE_BLOCK_SIZE 256
+/** How many bytes the microcontroller sends in each data frame. */
+#define PROTOCOL_READ_BLOCK_SIZE 1024
+
+/** The largest amount of data frames that can wait for their acknowledge, whatever the credits the programmer grants or the window a ping asks for. */
+#define PROTOCOL_MAXIMUM_WINDOW_SIZE 32
+
+/** The largest payload a frame can contain. */
+#define PROTOCOL_MAXIMUM_PAYLOAD_SIZE 4096
+/** The size of the statistics data : the timer frequency, the SPI transfer, UART transmission wait, UART reception wait and flash status polling times, the erase and page program cycles counts and the UART overruns count, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_STATISTICS_SIZE 32
+
+/** The write command flags byte bit telling the programmer to read each page back right after programming it, programming again or erasing again the chips whose content differs. Each data acknowledge then contains the mask of the chips that could not be programmed and the failed pages count (16-bit big endian). */
+#define PROTOCOL_WRITE_FLAG_VERIFY_PAGES 0x01
+/** How many failed pages the programmer remembers during a write. */
+#define PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT 16
+/** The size of the write failures data : the failed pages count, then the address and the mask of the failed chips of the first PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT failed pages, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_WRITE_FAILURES_SIZE (4 + PROTOCOL_MAXIMUM_WRITE_FAILURES_COUNT * 8)
+
+/** How many SPI clock frequencies the calibration tries. */
+#define PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT 8
+/** The size of a SPI clock calibration result : the selected clock frequency in Hz (0 if no clock works), then the frequency, the mask of the failed chips and the failed reads count of each tried clock from the fastest one, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SPI_CALIBRATION_RESULT_SIZE (4 + PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT * 12)
+/** The failed reads count of a clock the calibration did not try because a slower clock already failed. */
+#define PROTOCOL_SPI_CALIBRATION_CLOCK_SKIPPED 0xFFFFFFFF
+
+/** How many sectors CRC a sectors CRC command result can contain. */
+#define PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT 32
+/** The size of a sectors CRC command result : the JEDEC ID of the read chip (manufacturer ID in bits 23..16, device ID in bits 15..0), the computed sectors count and PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT sector CRC-32 values, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SECTORS_CRC_RESULT_SIZE (8 + PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT * 4)
+
+/** The largest pattern the search command can look for. */
+#define PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE 32
+/** How many match addresses a search command result can contain. */
+#define PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT 64
+/** The size of a search command result : the address the search stopped at (the search must be continued from there if it is not the searched area end), the matches count and PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT match addresses, all stored as 32-bit big endian numbers. */
+#define PROTOCOL_SEARCH_RESULT_SIZE (8 + PROTOCOL_MAXIMUM_SEARCH_MATCHES_COUNT * 4)
+
+/** The maximum size of a command frame payload (the search command is the largest one). */
+#define PROTOCOL_MAXIMUM_COMMAND_SIZE (10 + 2 * PROTOCOL_MAXIMUM_SEARCH_PATTERN_SIZE)
+/** The maximum size of an acknowledge frame payload. */
+#define PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE 8
+
+/** How many bytes can wait to be sent to the programmer. */
+#define PROTOCOL_OUTPUT_BUFFER_SIZE 16384
+
+/** How many milliseconds to wait for a data frame or a data frame acknowledge before asking for a retransmission. */
+#define PROTOCOL_FRAME_TIMEOUT 1000
+/** How many milliseconds to wait for the acknowledge of a command that does not take time to execute. */
+#define PROTOCOL_COMMAND_TIMEOUT 1000
+/** How many milliseconds the programmer can take to start erasing, whatever the erased size. */
+#define PROTOCOL_ERASE_BASE_TIMEOUT 10000
+/** How many milliseconds the programmer can take to erase each flash sector (the slowest supported chip datasheet value). */
+#define PROTOCOL_SECTOR_ERASE_TIMEOUT 400
+/** How many bytes the programmer searches per millisecond at least (this is a pessimistic value, the search is bounded by the flash read speed). */
+#define PROTOCOL_SEARCH_MINIMUM_SPEED 100
+/** How many milliseconds the programmer can take to calibrate the SPI clock (a sector is erased at each clock). */
+#define PROTOCOL_SPI_CALIBRATION_TIMEOUT (PROTOCOL_ERASE_BASE_TIMEOUT + PROTOCOL_SPI_CALIBRATION_CLOCKS_COUNT * PROTOCOL_SECTOR_ERASE_TIMEOUT)
+/** How many milliseconds the programmer can take to read a sector and compute its CRC (the CRC is slow to compute on the microcontroller). */
+#define PROTOCOL_SECTOR_CRC_TIMEOUT 100
+/** How many milliseconds the programmer can take to acknowledge a sectors CRC command. */
+#define PROTOCOL_SECTORS_CRC_TIMEOUT (PROTOCOL_COMMAND_TIMEOUT + PROTOCOL_MAXIMUM_SECTORS_CRC_COUNT * PROTOCOL_SECTOR_CRC_TIMEOUT)
+/** The smallest erasable flash area in bytes. */
+#define PROTOCOL_FLASH_SECTOR_SIZE 4096
+
+/** How many consecutive retransmissions are allowed before giving up. */
+#define PROTOCOL_MAXIMUM_RETRIES_COUNT 16
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** Which way the data goes after the command has been acknowledged. */
+typedef enum
+{
+	PROTOCOL_DIRECTION_NONE, //!< The command has no data phase.
+	PROTOCOL_DIRECTION_TO_PROGRAMMER, //!< The PC sends data frames (write, verify).
+	PROTOCOL_DIRECTION_FROM_PROGRAMMER //!< The programmer sends data frames (read).
+} TProtocolDirection;
+
+/** All the steps of a transfer. */
+typedef enum
+{
+	PROTOCOL_TRANSFER_STATE_WAIT_COMMAND_ACKNOWLEDGE, //!< The command was sent, the programmer is executing it (this can take a long time when sectors are erased).
+	PROTOCOL_TRANSFER_STATE_TRANSFER_DATA, //!< The data frames are being exchanged.
+	PROTOCOL_TRANSFER_STATE_SUCCESS, //!< The command and all data were acknowledged.
+	PROTOCOL_TRANSFER_STATE_FAILURE //!< The programmer did not answer correctly, the reason is stored in String_Error.
+} TProtocolTransferState;
+
+/** Rebuild frames from the received bytes. */
+typedef struct
+{
+	int State; //!< Which field is being received.
+	unsigned int Received_Bytes_Count; //!< How many bytes of the current field were received.
+	unsigned char Type; //!< The frame type.
+	unsigned char Sequence; //!< The frame sequence number.
+	unsigned int Payload_Size; //!< The payload size in bytes.
+	unsigned char Payload[PROTOCOL_MAXIMUM_PAYLOAD_SIZE]; //!< The payload.
+	unsigned int CRC; //!< The running CRC of the frame.
+	unsigned int Received_CRC; //!< The CRC sent with the frame.
+} TProtocolFrameParser;
+
+/** A command and its data phase. The transfer does not do any input/output by itself, it is fed with the received bytes and provides the bytes to send, so it can be driven by a blocking loop as well as by an event loop handling many serial ports. */
+typedef struct
+{
+	// Parameters
+	unsigned char Command[PROTOCOL_MAXIMUM_COMMAND_SIZE]; //!< The command frame payload.
+	unsigned int Command_Size; //!< The command size in bytes.
+	unsigned int Command_Timeout; //!< How many milliseconds the programmer can take to execute the command.
+	TProtocolDirection Direction; //!< Which way the data goes.
+	unsigned char *Pointer_Data; //!< The data to send or the buffer to fill.
+	unsigned int Data_Size; //!< The data size in bytes.
+	unsigned int Block_Size; //!< The data frames size, set according to the direction but it can be changed before the transfer runs (the ping command frames size is chosen by the PC).
+
+	// Results
+	TProtocolTransferState State; //!< The current step.
+	const char *String_Error; //!< The reason of the failure when State is PROTOCOL_TRANSFER_STATE_FAILURE.
+	unsigned char Rejection_Reason; //!< PROTOCOL_COMMAND_REJECTION_UNSUPPORTED or PROTOCOL_COMMAND_REJECTION_INVALID if the programmer rejected the command, 0 if it did not.
+	unsigned int Transferred_Bytes_Count; //!< How many data bytes were acknowledged.
+	unsigned char Acknowledge_Payload[PROTOCOL_MAXIMUM_ACKNOWLEDGE_PAYLOAD_SIZE]; //!< The last received acknowledge payload (the command result).
+	unsigned int Acknowledge_Payload_Size; //!< The last received acknowledge payload size in bytes.
+	unsigned int Retransmitted_Frames_Count; //!< How many frames had to be sent again.
+	unsigned int Corrupted_Frames_Count; //!< How many corrupted frames were received.
+	unsigned long long Start_Time; //!< When the command was queued (in microseconds, see ProtocolGetPreciseTime()).
+	unsigned long long Command_Acknowledge_Time; //!< When the command acknowledge was received (in microseconds).
+	unsigned long long End_Time; //!< When the transfer terminated (in microseconds).
+	unsigned long long Stall_Time; //!< How many microseconds the data phase spent with nothing to send, waiting for the programmer.
+
+	// Internal state
+	TProtocolFrameParser Parser; //!< Rebuild the frames sent by the programmer.
+	unsigned char Output_Buffer[PROTOCOL_OUTPUT_BUFFER_SIZE]; //!< The bytes waiting to be sent.
+	unsigned int Output_Buffer_Start; //!< The first byte to send.
+	unsigned int Output_Buffer_End; //!< The location following the last byte to send.
+	unsigned char Command_Sequence; //!< The command frame sequence number.
+	unsigned char Sequence; //!< The sequence number of the oldest data frame waiting for its acknowledge when sending, of the expected data frame when receiving.
+	unsigned char Next_Sequence; //!< The sequence number of the next data frame to send.
+	unsigned int Next_Offset; //!< The data offset of the next data frame to send.
+	unsigned int Window_Size; //!< How many data frames can be sent without being acknowledged.
+	int Is_Negative_Acknowledge_Sent; //!< Tell whether the missing data frame was already requested.
+	unsigned char Unexpected_Sequence; //!< The sequence number of the last unexpected data frame received since the missing frame was requested.
+	unsigned int Retries_Count; //!< How many times in a row the same frame was sent again.
+	unsigned long long Deadline; //!< When the expected frame is considered lost.
+	unsigned long long Stall_Start_Time; //!< When the output became empty during the data phase, 0 if there is something to send.
+} TProtocolTransfer;
+
+/** Called each time some data bytes are acknowledged.
+ * @param Transferred_Bytes_Count How many bytes were transferred up to now.
+ * @param Total_Bytes_Count How many bytes have to be transferred.
+ */
+typedef void (*TProtocolProgressCallback)(unsigned int Transferred_Bytes_Count, unsigned int Total_Bytes_Count);
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Get a millisecond timestamp suitable to compute durations.
+ * @return The current monotonic time in milliseconds.
+ */
+unsigned long long ProtocolGetTime(void);
+
+/** Get a microsecond timestamp suitable to measure short durations.
+ * @return The current monotonic time in microseconds.
+ */
+unsigned long long ProtocolGetPreciseTime(void);
+
+/** Build the payload of a command taking an address and a bytes count.
+ * @param Pointer_Command On output, contain the command payload (must be at least 9-byte large).
+ * @param Command_Code The command to execute.
+ * @param Address The address parameter.
+ * @param Bytes_Count The bytes count parameter.
+ * @return The command payload size in bytes.
+ */
+unsigned int ProtocolBuildAddressCommand(unsigned char *Pointer_Command, unsigned char Command_Code, unsigned int Address, unsigned int Bytes_Count);
+
+/** Build the payload of a SPI clock command, which takes a single 32-bit parameter.
+ * @param Pointer_Command On output, contain the command payload (must be at least 5-byte large).
+ * @param Command_Code PROTOCOL_COMMAND_CALIBRATE_SPI_CLOCK or PROTOCOL_COMMAND_SET_SPI_CLOCK.
+ * @param Parameter The address of a sector the calibration can erase, or the frequency to use in Hz.
+ * @return The command payload size in bytes.
+ */
+unsigned int ProtocolBuildSPIClockCommand(unsigned char *Pointer_Command, unsigned char Command_Code, unsigned int Parameter);
+
+/** Compute how long the programmer can take to acknowledge a write command, which erases all sectors before answering.
+ * @param Bytes_Count How many bytes will be written.
+ * @return The command timeout in milliseconds.
+ */
+unsigned int ProtocolGetWriteCommandTimeout(unsigned int Bytes_Count);
+
+/** Compute how long the programmer can take to acknowledge a search command, which searches the whole area before answering.
+ * @param Bytes_Count How many bytes will be searched.
+ * @return The command timeout in milliseconds.
+ */
+unsigned int ProtocolGetSearchCommandTimeout(unsigned int Bytes_Count);
+
+/** Choose the first command sequence number of a serial link. It differs on each program run, so the programmer can't mistake the first command for a command a previous run left unfinished. A link can also start from a known value, so a recorded session can be played again (see Replay.c).
+ * @return The sequence number of the link first command.
+ */
+unsigned char ProtocolGetInitialCommandSequence(void);
+
+/** Extract a 32-bit number stored in big endian.
+ * @param Pointer_Bytes The number location.
+ * @return The 32-bit number.
+ */
+unsigned int ProtocolGetDoubleWord(const unsigned char *Pointer_Bytes);
+
+/** Prepare a transfer and queue its command frame.
+ * @param Pointer_Transfer The transfer to initialize.
+ * @param Pointer_Next_Command_Sequence The next command sequence number of the serial link the transfer uses, it is given to the command then incremented. Each link owns its number, so transfers on different links can be prepared by different threads.
+ * @param Pointer_Command The command payload.
+ * @param Command_Size The command payload size (up to PROTOCOL_MAXIMUM_COMMAND_SIZE bytes).
+ * @param Command_Timeout How many milliseconds the programmer can take to execute the command.
+ * @param Direction Which way the data goes.
+ * @param Pointer_Data The data to send or the buffer to fill (can be NULL if there is no data phase).
+ * @param Data_Size The data size in bytes.
+ */
+void ProtocolInitializeTransfer(TProtocolTransfer *Pointer_Transfer, unsigned char *Pointer_Next_Command_Sequence, const unsigned char *Pointer_Command, unsigned int Command_Size, unsigned int Command_Timeout, TProtocolDirection Direction, unsigned char *Pointer_Data, unsigned int Data_Size);
+
+/** Feed the transfer with bytes received from the programmer.
+ * @param Pointer_Transfer The transfer.
+ * @param Pointer_Bytes The received bytes.
+ * @param Bytes_Count How many bytes were received.
+ */
+void ProtocolProcessReceivedBytes(TProtocolTransfer *Pointer_Transfer, const unsigned char *Pointer_Bytes, unsigned int Bytes_Count);
+
+/** Ask again for the expected frame if it did not come in time. Must be called periodically.
+ * @param Pointer_Transfer The transfer.
+ */
+void ProtocolProcessTimeout(TProtocolTransfer *Pointer_Transfer);
+
+/** Tell how many bytes are waiting to be sent to the programmer.
+ * @param Pointer_Transfer The transfer.
+ * @param Pointer_Pointer_Output On output, contain the address of the first byte to send.
+ * @return How many bytes must be sent.
+ */
+unsigned int ProtocolGetPendingOutput(TProtocolTransfer *Pointer_Transfer, unsigned char **Pointer_Pointer_Output);
+
+/** Remove the bytes sent to the programmer from the output queue.
+ * @param Pointer_Transfer The transfer.
+ * @param Sent_Bytes_Count How many bytes were sent.
+ */
+void ProtocolConsumeOutput(TProtocolTransfer *Pointer_Transfer, unsigned int Sent_Bytes_Count);
+
+/** Stop the transfer because of an external error.
+ * @param Pointer_Transfer The transfer.
+ * @param String_Error The failure reason.
+ */
+void ProtocolAbortTransfer(TProtocolTransfer *Pointer_Transfer, const char *String_Error);
+
+/** Tell whether the transfer is terminated (successfully or not).
+ * @param Pointer_Transfer The transfer.
+ * @return 1 if the transfer failed or if it succeeded and all pending bytes were sent, 0 if the transfer is still running.
+ */
+int ProtocolIsTransferTerminated(TProtocolTransfer *Pointer_Transfer);
+
+/** Drive a transfer on a serial port until it terminates.
+ * @param Pointer_UART The serial port the programmer is connected to.
+ * @param Pointer_Transfer The initialized transfer.
+ * @param Progress_Callback Called each time some data is acknowledged, can be NULL.
+ * @return 0 if the transfer succeeded, -1 if it failed (see the transfer String_Error field).
+ */
+int ProtocolRunTransfer(TUART *Pointer_UART, TProtocolTransfer *Pointer_Transfer, TProtocolProgressCallback Progress_Callback);
+
+#endif
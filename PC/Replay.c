@@ -0,0 +1,344 @@
+/** @file Replay.c
+ * Play the programmer side of a recorded session (see Trace.h) on a pseudo-terminal, so a Programmer build can execute the same session again without the board, then compare the recorded and replayed timings.
+ * The bytes the host sends are compared with the recorded ones. The device bytes are sent with the delay that separated them from the previous host bytes in the recorded session, so the device answers as fast as it did and the differences between both sessions come from the host.
+ * @author Adrien RICCIARDI
+ */
+#define _GNU_SOURCE // Needed by the pseudo-terminal functions
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "Protocol.h"
+#include "Trace.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many milliseconds the host can stay silent before the replay is considered failed. */
+#define REPLAY_HOST_TIMEOUT 10000
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A record loaded in memory. */
+typedef struct
+{
+	unsigned long long Time; //!< When the bytes were exchanged in the recorded session, in microseconds.
+	unsigned char Direction; //!< TRACE_DIRECTION_HOST_TO_DEVICE or TRACE_DIRECTION_DEVICE_TO_HOST.
+	unsigned int Size; //!< How many bytes were exchanged.
+	unsigned char *Pointer_Data; //!< The bytes.
+} TReplayRecord;
+
+/** The timings of a session. */
+typedef struct
+{
+	unsigned long long First_Time; //!< When the first byte was exchanged, in microseconds.
+	unsigned long long Last_Time; //!< When the last byte was exchanged, in microseconds.
+	unsigned long long Reaction_Time; //!< How many microseconds the host took to answer the device bytes, for the whole session.
+	unsigned long long Longest_Stall_Time; //!< The longest time the host took to answer device bytes, in microseconds.
+} TReplaySessionTimes;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The pseudo-terminal side the replay uses. */
+static int Replay_Terminal_Master;
+/** The pseudo-terminal side the Programmer program opens (kept opened so the master side stays usable between programs). */
+static int Replay_Terminal_Slave;
+
+/** All records of the trace. */
+static TReplayRecord *Pointer_Replay_Records = NULL;
+/** How many records the trace contains. */
+static unsigned int Replay_Records_Count = 0;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic time.
+ * @return The time in microseconds.
+ */
+static unsigned long long ReplayGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000ULL + Time.tv_nsec / 1000;
+}
+
+/** Load all trace records in memory, so reading the file does not delay the replay.
+ * @param String_File_Name The trace file.
+ * @return 0 if the trace was loaded, -1 if an error occurred (an error message is displayed).
+ */
+static int ReplayLoadTrace(char *String_File_Name)
+{
+	TTrace Trace;
+	TTraceRecord Record;
+	TReplayRecord *Pointer_Records;
+	unsigned int Allocated_Records_Count = 0;
+	int Result;
+
+	Result = TraceOpen(&Trace, String_File_Name);
+	if (Result != 0)
+	{
+		if (Result == -2) printf("Error : the file '%s' is not a trace file.\n", String_File_Name);
+		else printf("Error : could not open the trace file '%s'.\n", String_File_Name);
+		return -1;
+	}
+
+	while ((Result = TraceReadRecord(&Trace, &Record)) == 1)
+	{
+		if (Replay_Records_Count == Allocated_Records_Count)
+		{
+			Allocated_Records_Count = Allocated_Records_Count * 2 + 256;
+			Pointer_Records = realloc(Pointer_Replay_Records, Allocated_Records_Count * sizeof(TReplayRecord));
+			if (Pointer_Records == NULL) goto Exit_Out_Of_Memory;
+			Pointer_Replay_Records = Pointer_Records;
+		}
+
+		Pointer_Replay_Records[Replay_Records_Count].Time = Record.Time;
+		Pointer_Replay_Records[Replay_Records_Count].Direction = Record.Direction;
+		Pointer_Replay_Records[Replay_Records_Count].Size = Record.Size;
+		Pointer_Replay_Records[Replay_Records_Count].Pointer_Data = malloc(Record.Size + 1);
+		if (Pointer_Replay_Records[Replay_Records_Count].Pointer_Data == NULL) goto Exit_Out_Of_Memory;
+		memcpy(Pointer_Replay_Records[Replay_Records_Count].Pointer_Data, Record.Pointer_Data, Record.Size);
+		Replay_Records_Count++;
+	}
+	TraceClose(&Trace);
+
+	if (Result == -2) goto Exit_Out_Of_Memory;
+	if (Result != 0)
+	{
+		printf("Error : the trace is truncated or corrupted.\n");
+		return -1;
+	}
+	if (Replay_Records_Count == 0)
+	{
+		printf("Error : the trace does not contain any exchanged byte.\n");
+		return -1;
+	}
+	return 0;
+
+Exit_Out_Of_Memory:
+	printf("Error : could not allocate memory to load the trace.\n");
+	if (Result != -2) TraceClose(&Trace);
+	return -1;
+}
+
+/** Create the pseudo-terminal the Programmer program will connect to.
+ * @return 0 if the pseudo-terminal was created, -1 if an error occurred (an error message is displayed).
+ */
+static int ReplayCreateTerminal(void)
+{
+	char *String_Slave_Name;
+	struct termios Parameters;
+
+	Replay_Terminal_Master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((Replay_Terminal_Master == -1) || (grantpt(Replay_Terminal_Master) != 0) || (unlockpt(Replay_Terminal_Master) != 0))
+	{
+		printf("Error : could not create the pseudo-terminal (%s).\n", strerror(errno));
+		return -1;
+	}
+	String_Slave_Name = ptsname(Replay_Terminal_Master);
+
+	// Transmit the bytes as they are
+	Replay_Terminal_Slave = open(String_Slave_Name, O_RDWR | O_NOCTTY);
+	if ((Replay_Terminal_Slave == -1) || (tcgetattr(Replay_Terminal_Slave, &Parameters) != 0))
+	{
+		printf("Error : could not open the pseudo-terminal '%s' (%s).\n", String_Slave_Name, strerror(errno));
+		return -1;
+	}
+	cfmakeraw(&Parameters);
+	tcsetattr(Replay_Terminal_Slave, TCSANOW, &Parameters);
+
+	// Tell the serial port name to use
+	printf("%s\n", String_Slave_Name);
+	fflush(stdout);
+	return 0;
+}
+
+/** Receive the bytes of a host record, waiting for them as long as needed.
+ * @param Pointer_Record The record.
+ * @return How many received bytes differ from the recorded ones, or -1 if the host stopped sending (an error message is displayed).
+ */
+static int ReplayReceiveHostBytes(TReplayRecord *Pointer_Record)
+{
+	unsigned char Buffer[4096];
+	unsigned int Received_Bytes_Count = 0, i;
+	int Differing_Bytes_Count = 0;
+	ssize_t Read_Bytes_Count;
+	struct pollfd Poll_Descriptor;
+
+	Poll_Descriptor.fd = Replay_Terminal_Master;
+	Poll_Descriptor.events = POLLIN;
+	while (Received_Bytes_Count < Pointer_Record->Size)
+	{
+		if (poll(&Poll_Descriptor, 1, REPLAY_HOST_TIMEOUT) <= 0)
+		{
+			printf("Error : the host did not send the recorded bytes within %d ms.\n", REPLAY_HOST_TIMEOUT);
+			return -1;
+		}
+
+		// Do not take the bytes of the next host record, they are compared to it
+		Read_Bytes_Count = Pointer_Record->Size - Received_Bytes_Count;
+		if (Read_Bytes_Count > (ssize_t) sizeof(Buffer)) Read_Bytes_Count = sizeof(Buffer);
+		Read_Bytes_Count = read(Replay_Terminal_Master, Buffer, Read_Bytes_Count);
+		if (Read_Bytes_Count < 0)
+		{
+			if ((errno == EAGAIN) || (errno == EINTR) || (errno == EIO)) continue; // The master side reports EIO while no program has the slave side opened
+			printf("Error : could not read from the pseudo-terminal (%s).\n", strerror(errno));
+			return -1;
+		}
+
+		for (i = 0; i < (unsigned int) Read_Bytes_Count; i++)
+		{
+			if (Buffer[i] != Pointer_Record->Pointer_Data[Received_Bytes_Count + i]) Differing_Bytes_Count++;
+		}
+		Received_Bytes_Count += Read_Bytes_Count;
+	}
+
+	return Differing_Bytes_Count;
+}
+
+/** Send the bytes of a device record.
+ * @param Pointer_Record The record.
+ * @return 0 if the bytes were sent, -1 if an error occurred (an error message is displayed).
+ */
+static int ReplaySendDeviceBytes(TReplayRecord *Pointer_Record)
+{
+	unsigned int Sent_Bytes_Count = 0;
+	ssize_t Written_Bytes_Count;
+
+	while (Sent_Bytes_Count < Pointer_Record->Size)
+	{
+		Written_Bytes_Count = write(Replay_Terminal_Master, &Pointer_Record->Pointer_Data[Sent_Bytes_Count], Pointer_Record->Size - Sent_Bytes_Count);
+		if (Written_Bytes_Count < 0)
+		{
+			if (errno == EINTR) continue;
+			printf("Error : could not write to the pseudo-terminal (%s).\n", strerror(errno));
+			return -1;
+		}
+		Sent_Bytes_Count += Written_Bytes_Count;
+	}
+	return 0;
+}
+
+/** Add the time the host took to answer some device bytes to a session timings.
+ * @param Pointer_Times The session timings.
+ * @param Device_Time When the device bytes were exchanged.
+ * @param Host_Time When the host answered.
+ */
+static void ReplayAddReactionTime(TReplaySessionTimes *Pointer_Times, unsigned long long Device_Time, unsigned long long Host_Time)
+{
+	unsigned long long Time;
+
+	Time = Host_Time - Device_Time;
+	Pointer_Times->Reaction_Time += Time;
+	if (Time > Pointer_Times->Longest_Stall_Time) Pointer_Times->Longest_Stall_Time = Time;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	TReplayRecord *Pointer_Record;
+	TReplaySessionTimes Recorded_Times, Replayed_Times;
+	unsigned long long Time, Host_Recorded_Time = 0, Host_Replayed_Time = 0, Device_Replayed_Time = 0, Host_Bytes_Count = 0, Device_Bytes_Count = 0;
+	unsigned int i, Host_Records_Count = 0;
+	int Differing_Bytes_Count, Total_Differing_Bytes_Count = 0;
+
+	if (argc != 2)
+	{
+		printf("Usage : %s Trace_File\n"
+			"Play the programmer side of a session recorded by the Programmer --trace option, and print the serial port to connect to.\n"
+			"Run the same command as in the recorded session on this serial port (with the --sequence option value Replay tells), then the recorded and replayed session timings are compared.\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (ReplayLoadTrace(argv[1]) != 0) return EXIT_FAILURE;
+	if (ReplayCreateTerminal() != 0) return EXIT_FAILURE;
+
+	// The recorded acknowledges contain the recorded sequence numbers, so the host must use the same ones
+	for (i = 0; i < Replay_Records_Count; i++)
+	{
+		Pointer_Record = &Pointer_Replay_Records[i];
+		if (Pointer_Record->Direction != TRACE_DIRECTION_HOST_TO_DEVICE) continue;
+
+		if ((Pointer_Record->Size >= PROTOCOL_FRAME_HEADER_SIZE) && (Pointer_Record->Pointer_Data[0] == PROTOCOL_FRAME_MARKER) && (Pointer_Record->Pointer_Data[1] == PROTOCOL_FRAME_TYPE_COMMAND)) printf("Run the recorded command with --sequence %u on this serial port.\n", Pointer_Record->Pointer_Data[2]);
+		fflush(stdout);
+		break;
+	}
+
+	memset(&Recorded_Times, 0, sizeof(Recorded_Times));
+	memset(&Replayed_Times, 0, sizeof(Replayed_Times));
+	for (i = 0; i < Replay_Records_Count; i++)
+	{
+		Pointer_Record = &Pointer_Replay_Records[i];
+
+		if (Pointer_Record->Direction == TRACE_DIRECTION_HOST_TO_DEVICE)
+		{
+			Differing_Bytes_Count = ReplayReceiveHostBytes(Pointer_Record);
+			if (Differing_Bytes_Count < 0) return EXIT_FAILURE;
+			Total_Differing_Bytes_Count += Differing_Bytes_Count;
+			Time = ReplayGetTime();
+
+			// The sessions start when the host sends its first byte, the time the program took to start does not matter
+			if (Host_Records_Count == 0)
+			{
+				Recorded_Times.First_Time = Pointer_Record->Time;
+				Replayed_Times.First_Time = Time;
+			}
+
+			// Measure how long the host took to answer the device
+			if ((i > 0) && (Pointer_Replay_Records[i - 1].Direction == TRACE_DIRECTION_DEVICE_TO_HOST) && (Host_Records_Count > 0))
+			{
+				ReplayAddReactionTime(&Recorded_Times, Pointer_Replay_Records[i - 1].Time, Pointer_Record->Time);
+				ReplayAddReactionTime(&Replayed_Times, Device_Replayed_Time, Time);
+			}
+
+			Host_Recorded_Time = Pointer_Record->Time;
+			Host_Replayed_Time = Time;
+			Host_Records_Count++;
+			Host_Bytes_Count += Pointer_Record->Size;
+		}
+		else
+		{
+			// Answer with the recorded delay (the device bytes sent before the first host byte are sent right away)
+			if (Pointer_Record->Time > Host_Recorded_Time)
+			{
+				Time = Host_Replayed_Time + Pointer_Record->Time - Host_Recorded_Time;
+				while (ReplayGetTime() < Time) usleep(Time - ReplayGetTime() > 1000 ? 500 : 50);
+			}
+			if (ReplaySendDeviceBytes(Pointer_Record) != 0) return EXIT_FAILURE;
+			Device_Replayed_Time = ReplayGetTime();
+			Device_Bytes_Count += Pointer_Record->Size;
+		}
+	}
+	Recorded_Times.Last_Time = Pointer_Replay_Records[Replay_Records_Count - 1].Time;
+	Replayed_Times.Last_Time = ReplayGetTime();
+
+	// Let the host read the last bytes before the pseudo-terminal is closed
+	tcdrain(Replay_Terminal_Master);
+	usleep(100000);
+
+	// Compare the sessions
+	printf("Replayed %u records : %llu bytes sent by the host, %llu bytes sent by the device.\n", Replay_Records_Count, Host_Bytes_Count, Device_Bytes_Count);
+	printf("%-22s %12s %12s\n", "", "Recorded", "Replayed");
+	printf("%-22s %12.1f %12.1f\n", "Session (ms)", (Recorded_Times.Last_Time - Recorded_Times.First_Time) / 1000.0, (Replayed_Times.Last_Time - Replayed_Times.First_Time) / 1000.0);
+	printf("%-22s %12.1f %12.1f\n", "Throughput (KB/s)", (Host_Bytes_Count + Device_Bytes_Count) * 1e6 / 1024.0 / (Recorded_Times.Last_Time - Recorded_Times.First_Time + 1), (Host_Bytes_Count + Device_Bytes_Count) * 1e6 / 1024.0 / (Replayed_Times.Last_Time - Replayed_Times.First_Time + 1));
+	printf("%-22s %12.1f %12.1f\n", "Host reaction (ms)", Recorded_Times.Reaction_Time / 1000.0, Replayed_Times.Reaction_Time / 1000.0);
+	printf("%-22s %12.1f %12.1f\n", "Longest stall (ms)", Recorded_Times.Longest_Stall_Time / 1000.0, Replayed_Times.Longest_Stall_Time / 1000.0);
+
+	// The device answers do not match what a diverging host expects, so the timings are meaningless
+	if (Total_Differing_Bytes_Count > 0)
+	{
+		printf("Error : %d bytes sent by the host differ from the recorded session.\n", Total_Differing_Bytes_Count);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/** @file Test_Layout.c
+ * Check that the Intel Flash Descriptor parser retrieves the expected regions from the fixture files of the Fixtures/Layout directory.
+ * @author Adrien RICCIARDI
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Layout.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** Where the fixture files are stored, relative to the program directory. */
+#define TEST_FIXTURES_DIRECTORY "Fixtures/Layout/"
+
+/** A fixture descriptor can't contain more used regions. */
+#define TEST_MAXIMUM_FIXTURE_REGIONS_COUNT 5
+
+/** The regions of the fixture descriptor. Its region section is located at 0x50 (a decoy section is stored at the usual 0x40 offset) and the pd region is not used (its base is greater than its limit). */
+#define TEST_FIXTURE_REGIONS {{"descriptor", 0x00000000, 0x1000}, {"bios", 0x00200000, 0x600000}, {"me", 0x00003000, 0x1FD000}, {"gbe", 0x00001000, 0x2000}}
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** What parsing a fixture file must produce. */
+typedef struct
+{
+	const char *String_File_Name; //!< The file name in the fixtures directory.
+	unsigned int Descriptor_Size; //!< The size LayoutGetDescriptorSize() must return.
+	int Is_Accepted; //!< Set to 1 if LayoutParseDescriptor() must succeed.
+	unsigned int Regions_Count; //!< How many regions the layout contains.
+	TLayoutRegion Regions[TEST_MAXIMUM_FIXTURE_REGIONS_COUNT]; //!< The layout regions.
+} TTestFixture;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** All fixture files. */
+static const TTestFixture Test_Fixtures[] =
+{
+	{"Descriptor.bin", 0x64, 1, 4, TEST_FIXTURE_REGIONS},
+	// The data stops right at the region section end
+	{"Region_Section_End.bin", 0x64, 1, 4, TEST_FIXTURE_REGIONS},
+	// The data stops one byte before the region section end
+	{"Truncated_Region_Section.bin", 0x64, 0, 0, {{"", 0, 0}}},
+	// The data stops before FLMAP0 end
+	{"Truncated_Header.bin", 0, 0, 0, {{"", 0, 0}}},
+	{"No_Signature.bin", 0, 0, 0, {{"", 0, 0}}},
+	// FRBA locates the region section at 0xFF0, so it crosses the descriptor sector end
+	{"Region_Section_Beyond_Sector.bin", 0x1004, 0, 0, {{"", 0, 0}}}
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Parse a fixture file and compare the layout to the expected one.
+ * @param Pointer_Fixture The fixture.
+ * @return 0 if the layout is the expected one, -1 if not.
+ */
+static int TestCheckFixture(const TTestFixture *Pointer_Fixture)
+{
+	char String_File_Name[256];
+	unsigned char Data[LAYOUT_DESCRIPTOR_SIZE];
+	FILE *File;
+	unsigned int Size, Descriptor_Size, i;
+	TLayout Layout;
+	const TLayoutRegion *Pointer_Region, *Pointer_Expected_Region;
+	int Result;
+
+	printf("%-32s : ", Pointer_Fixture->String_File_Name);
+
+	snprintf(String_File_Name, sizeof(String_File_Name), TEST_FIXTURES_DIRECTORY "%s", Pointer_Fixture->String_File_Name);
+	File = fopen(String_File_Name, "rb");
+	if (File == NULL)
+	{
+		printf("Error : could not open the file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	Size = fread(Data, 1, sizeof(Data), File);
+	fclose(File);
+
+	Descriptor_Size = LayoutGetDescriptorSize(Data, Size);
+	if (Descriptor_Size != Pointer_Fixture->Descriptor_Size)
+	{
+		printf("Error : the descriptor size is %u bytes instead of %u bytes.\n", Descriptor_Size, Pointer_Fixture->Descriptor_Size);
+		return -1;
+	}
+
+	Result = LayoutParseDescriptor(&Layout, Data, Size);
+	if (!Pointer_Fixture->Is_Accepted)
+	{
+		if (Result == 0)
+		{
+			printf("Error : the descriptor was accepted instead of being rejected.\n");
+			return -1;
+		}
+		printf("rejected.\n");
+		return 0;
+	}
+	if (Result != 0)
+	{
+		printf("Error : the descriptor was rejected instead of being accepted.\n");
+		return -1;
+	}
+
+	if (Layout.Regions_Count != Pointer_Fixture->Regions_Count)
+	{
+		printf("Error : the layout contains %u regions instead of %u regions.\n", Layout.Regions_Count, Pointer_Fixture->Regions_Count);
+		return -1;
+	}
+	for (i = 0; i < Layout.Regions_Count; i++)
+	{
+		Pointer_Region = &Layout.Regions[i];
+		Pointer_Expected_Region = &Pointer_Fixture->Regions[i];
+		if ((strcmp(Pointer_Region->String_Name, Pointer_Expected_Region->String_Name) != 0) || (Pointer_Region->Address != Pointer_Expected_Region->Address) || (Pointer_Region->Size != Pointer_Expected_Region->Size))
+		{
+			printf("Error : the region %u is '%s' at 0x%08X (%u bytes) instead of '%s' at 0x%08X (%u bytes).\n", i, Pointer_Region->String_Name, Pointer_Region->Address, Pointer_Region->Size, Pointer_Expected_Region->String_Name, Pointer_Expected_Region->Address, Pointer_Expected_Region->Size);
+			return -1;
+		}
+	}
+
+	printf("%u regions.\n", Layout.Regions_Count);
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(Test_Fixtures) / sizeof(Test_Fixtures[0]); i++)
+	{
+		if (TestCheckFixture(&Test_Fixtures[i]) != 0) return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/** @file Test_Library.c
+ * Drive several programmers at the same time through libprogrammer, each one from its own thread : write a file, verify it, read it back, erase it and check that the flash is erased.
+ * The program is linked against the static library only, so it also checks that the library API is enough to program a chip.
+ * Usage : Test_Library File_Name Serial_Port...
+ * @author Adrien RICCIARDI
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Programmer.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many programmers can be driven at the same time. */
+#define TEST_MAXIMUM_SESSIONS_COUNT 8
+
+/** How many characters a session report can contain. */
+#define TEST_REPORT_SIZE 512
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A programmer driven by its own thread. */
+typedef struct
+{
+	char *String_Serial_Port_Name; //!< The serial port the programmer is connected to.
+	pthread_t Thread; //!< The thread driving the session.
+	unsigned char *Pointer_Read_Data; //!< The data read back from the flash.
+	unsigned int Progress_Callbacks_Count; //!< How many times the progress callback was called during the running operation.
+	int Is_Completion_Reported; //!< Set by the completion callback.
+	int Result; //!< 0 if all operations succeeded, -1 if not.
+	char String_Report[TEST_REPORT_SIZE]; //!< The operations durations, or the error that stopped the session.
+} TTestSession;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The data written to every programmer. */
+static unsigned char *Pointer_Test_Data;
+/** The data size in bytes. */
+static unsigned int Test_Data_Size;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Count the progress reports of the running operation.
+ * @see TProgrammerProgressCallback for the parameters description.
+ */
+static void TestCountProgress(TProgrammer *Pointer_Programmer, unsigned int Transferred_Bytes_Count, unsigned int Total_Bytes_Count, void *Pointer_User_Data)
+{
+	TTestSession *Pointer_Session = Pointer_User_Data;
+
+	(void) Pointer_Programmer;
+	(void) Transferred_Bytes_Count;
+	(void) Total_Bytes_Count;
+
+	Pointer_Session->Progress_Callbacks_Count++;
+}
+
+/** Remember that the running operation terminated.
+ * @see TProgrammerCompletionCallback for the parameters description.
+ */
+static void TestReportCompletion(TProgrammer *Pointer_Programmer, TProgrammerError Error, void *Pointer_User_Data)
+{
+	TTestSession *Pointer_Session = Pointer_User_Data;
+
+	(void) Pointer_Programmer;
+	(void) Error;
+
+	Pointer_Session->Is_Completion_Reported = 1;
+}
+
+/** Get a millisecond timestamp.
+ * @return The current monotonic time in milliseconds.
+ */
+static double TestGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return Time.tv_sec * 1000.0 + Time.tv_nsec / 1000000.0;
+}
+
+/** Execute an operation until it terminates and add its duration to the session report.
+ * @param Pointer_Session The session.
+ * @param Pointer_Programmer The programmer.
+ * @param String_Operation_Name The operation name, used in the report.
+ * @param Operation The operation to start.
+ * @param Pointer_Data The data to write or compare, or the buffer to fill.
+ * @return 0 if the operation succeeded, -1 if not (the error is stored in the session report).
+ */
+static int TestExecuteOperation(TTestSession *Pointer_Session, TProgrammer *Pointer_Programmer, const char *String_Operation_Name, TProgrammerOperation Operation, unsigned char *Pointer_Data)
+{
+	TProgrammerError Error;
+	double Start_Time;
+	unsigned int Length;
+
+	Pointer_Session->Progress_Callbacks_Count = 0;
+	Pointer_Session->Is_Completion_Reported = 0;
+	Start_Time = TestGetTime();
+
+	switch (Operation)
+	{
+		case PROGRAMMER_OPERATION_WRITE:
+			Error = ProgrammerStartWrite(Pointer_Programmer, 0, Pointer_Data, Test_Data_Size);
+			break;
+		case PROGRAMMER_OPERATION_VERIFY:
+			Error = ProgrammerStartVerify(Pointer_Programmer, 0, Pointer_Data, Test_Data_Size);
+			break;
+		case PROGRAMMER_OPERATION_ERASE:
+			Error = ProgrammerStartErase(Pointer_Programmer, 0, Test_Data_Size);
+			break;
+		default:
+			Error = ProgrammerStartRead(Pointer_Programmer, 0, Pointer_Data, Test_Data_Size);
+			break;
+	}
+	if (Error == PROGRAMMER_ERROR_NONE) Error = ProgrammerWait(Pointer_Programmer);
+	if (Error != PROGRAMMER_ERROR_NONE)
+	{
+		snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : the %s failed (%s).", String_Operation_Name, ProgrammerGetErrorString(Error));
+		return -1;
+	}
+	if (!Pointer_Session->Is_Completion_Reported || (Pointer_Session->Progress_Callbacks_Count == 0))
+	{
+		snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : the %s callbacks were not called.", String_Operation_Name);
+		return -1;
+	}
+
+	Length = strlen(Pointer_Session->String_Report);
+	snprintf(&Pointer_Session->String_Report[Length], sizeof(Pointer_Session->String_Report) - Length, "%s%s %u bytes in %.1f ms", Length > 0 ? ", " : "", String_Operation_Name, Test_Data_Size, TestGetTime() - Start_Time);
+	return 0;
+}
+
+/** Execute all operations on a programmer.
+ * @param Pointer_Parameters The session.
+ * @return Always NULL.
+ */
+static void *TestRunSession(void *Pointer_Parameters)
+{
+	TTestSession *Pointer_Session = Pointer_Parameters;
+	TProgrammer *Pointer_Programmer;
+	TProgrammerError Error;
+	unsigned int i;
+
+	Pointer_Session->Result = -1;
+
+	Error = ProgrammerOpen(&Pointer_Programmer, Pointer_Session->String_Serial_Port_Name);
+	if (Error != PROGRAMMER_ERROR_NONE)
+	{
+		snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : could not open the session (%s).", ProgrammerGetErrorString(Error));
+		return NULL;
+	}
+	ProgrammerSetCallbacks(Pointer_Programmer, TestCountProgress, TestReportCompletion, Pointer_Session);
+
+	if (TestExecuteOperation(Pointer_Session, Pointer_Programmer, "write", PROGRAMMER_OPERATION_WRITE, Pointer_Test_Data) != 0) goto Exit;
+	if (TestExecuteOperation(Pointer_Session, Pointer_Programmer, "verify", PROGRAMMER_OPERATION_VERIFY, Pointer_Test_Data) != 0) goto Exit;
+	if (TestExecuteOperation(Pointer_Session, Pointer_Programmer, "read", PROGRAMMER_OPERATION_READ, Pointer_Session->Pointer_Read_Data) != 0) goto Exit;
+	if (memcmp(Pointer_Session->Pointer_Read_Data, Pointer_Test_Data, Test_Data_Size) != 0)
+	{
+		snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : the read data differ from the written data.");
+		goto Exit;
+	}
+
+	// The erased flash must read as 0xFF
+	if (TestExecuteOperation(Pointer_Session, Pointer_Programmer, "erase", PROGRAMMER_OPERATION_ERASE, NULL) != 0) goto Exit;
+	Error = ProgrammerStartRead(Pointer_Programmer, 0, Pointer_Session->Pointer_Read_Data, Test_Data_Size);
+	if (Error == PROGRAMMER_ERROR_NONE) Error = ProgrammerWait(Pointer_Programmer);
+	if (Error != PROGRAMMER_ERROR_NONE)
+	{
+		snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : the erased data could not be read (%s).", ProgrammerGetErrorString(Error));
+		goto Exit;
+	}
+	for (i = 0; i < Test_Data_Size; i++)
+	{
+		if (Pointer_Session->Pointer_Read_Data[i] != 0xFF)
+		{
+			snprintf(Pointer_Session->String_Report, sizeof(Pointer_Session->String_Report), "Error : the byte at 0x%08X was not erased.", i);
+			goto Exit;
+		}
+	}
+	Pointer_Session->Result = 0;
+
+Exit:
+	ProgrammerClose(Pointer_Programmer);
+	return NULL;
+}
+
+/** Load the data to write.
+ * @param String_File_Name The file containing the data.
+ * @return 0 if the file was loaded, -1 if an error occurred (an error message is displayed).
+ */
+static int TestLoadData(char *String_File_Name)
+{
+	FILE *File;
+	long Size;
+
+	File = fopen(String_File_Name, "rb");
+	if (File == NULL)
+	{
+		printf("Error : could not open the file '%s'.\n", String_File_Name);
+		return -1;
+	}
+	fseek(File, 0, SEEK_END);
+	Size = ftell(File);
+	rewind(File);
+	if (Size <= 0)
+	{
+		printf("Error : the file '%s' is empty.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+
+	Test_Data_Size = Size;
+	Pointer_Test_Data = malloc(Test_Data_Size);
+	if ((Pointer_Test_Data == NULL) || (fread(Pointer_Test_Data, 1, Test_Data_Size, File) != Test_Data_Size))
+	{
+		printf("Error : could not load the file '%s'.\n", String_File_Name);
+		fclose(File);
+		return -1;
+	}
+	fclose(File);
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	TTestSession Sessions[TEST_MAXIMUM_SESSIONS_COUNT];
+	unsigned int Sessions_Count, i;
+	int Result = EXIT_SUCCESS;
+
+	if ((argc < 3) || (argc - 2 > TEST_MAXIMUM_SESSIONS_COUNT))
+	{
+		printf("Usage : %s File_Name Serial_Port... (up to %d serial ports)\n", argv[0], TEST_MAXIMUM_SESSIONS_COUNT);
+		return EXIT_FAILURE;
+	}
+	if (TestLoadData(argv[1]) != 0) return EXIT_FAILURE;
+
+	// Drive all programmers at the same time
+	Sessions_Count = argc - 2;
+	memset(Sessions, 0, sizeof(Sessions));
+	for (i = 0; i < Sessions_Count; i++)
+	{
+		Sessions[i].String_Serial_Port_Name = argv[i + 2];
+		Sessions[i].Pointer_Read_Data = malloc(Test_Data_Size);
+		if (Sessions[i].Pointer_Read_Data == NULL)
+		{
+			printf("Error : could not allocate the read buffers.\n");
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < Sessions_Count; i++)
+	{
+		if (pthread_create(&Sessions[i].Thread, NULL, TestRunSession, &Sessions[i]) != 0)
+		{
+			printf("Error : could not create the thread driving '%s'.\n", Sessions[i].String_Serial_Port_Name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < Sessions_Count; i++)
+	{
+		pthread_join(Sessions[i].Thread, NULL);
+		printf("%s : %s%s\n", Sessions[i].String_Serial_Port_Name, Sessions[i].String_Report, Sessions[i].Result == 0 ? "." : "");
+		if (Sessions[i].Result != 0) Result = EXIT_FAILURE;
+		free(Sessions[i].Pointer_Read_Data);
+	}
+	free(Pointer_Test_Data);
+	return Result;
+}
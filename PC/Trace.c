@@ -0,0 +1,121 @@
+/** @file Trace.c
+ * @see Trace.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Trace.h"
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The size of a record header : time, direction and size. */
+#define TRACE_RECORD_HEADER_SIZE 13
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get the current monotonic time.
+ * @return The time in microseconds.
+ */
+static unsigned long long TraceGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000ULL + Time.tv_nsec / 1000;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int TraceCreate(TTrace *Pointer_Trace, char *String_File_Name)
+{
+	memset(Pointer_Trace, 0, sizeof(TTrace));
+
+	Pointer_Trace->File = fopen(String_File_Name, "wb");
+	if (Pointer_Trace->File == NULL) return -1;
+	if (fwrite(TRACE_FILE_SIGNATURE, 1, sizeof(TRACE_FILE_SIGNATURE) - 1, Pointer_Trace->File) != sizeof(TRACE_FILE_SIGNATURE) - 1)
+	{
+		fclose(Pointer_Trace->File);
+		return -1;
+	}
+	Pointer_Trace->Start_Time = TraceGetTime();
+
+	return 0;
+}
+
+void TraceWriteRecord(TTrace *Pointer_Trace, unsigned char Direction, const void *Pointer_Data, unsigned int Size)
+{
+	unsigned char Header[TRACE_RECORD_HEADER_SIZE];
+	unsigned long long Time;
+	int i;
+
+	Time = TraceGetTime() - Pointer_Trace->Start_Time;
+	for (i = 0; i < 8; i++) Header[i] = Time >> (56 - i * 8);
+	Header[8] = Direction;
+	Header[9] = Size >> 24;
+	Header[10] = Size >> 16;
+	Header[11] = Size >> 8;
+	Header[12] = Size;
+
+	// The file is buffered, so recording does not add system calls to each serial port access
+	if ((fwrite(Header, 1, sizeof(Header), Pointer_Trace->File) != sizeof(Header)) || (fwrite(Pointer_Data, 1, Size, Pointer_Trace->File) != Size)) Pointer_Trace->Is_Failed = 1;
+}
+
+int TraceOpen(TTrace *Pointer_Trace, char *String_File_Name)
+{
+	char Signature[sizeof(TRACE_FILE_SIGNATURE) - 1];
+
+	memset(Pointer_Trace, 0, sizeof(TTrace));
+
+	Pointer_Trace->File = fopen(String_File_Name, "rb");
+	if (Pointer_Trace->File == NULL) return -1;
+	if ((fread(Signature, 1, sizeof(Signature), Pointer_Trace->File) != sizeof(Signature)) || (memcmp(Signature, TRACE_FILE_SIGNATURE, sizeof(Signature)) != 0))
+	{
+		fclose(Pointer_Trace->File);
+		return -2;
+	}
+
+	return 0;
+}
+
+int TraceReadRecord(TTrace *Pointer_Trace, TTraceRecord *Pointer_Record)
+{
+	unsigned char Header[TRACE_RECORD_HEADER_SIZE], *Pointer_Buffer;
+	size_t Read_Bytes_Count;
+	int i;
+
+	Read_Bytes_Count = fread(Header, 1, sizeof(Header), Pointer_Trace->File);
+	if (Read_Bytes_Count == 0) return 0;
+	if (Read_Bytes_Count != sizeof(Header)) return -1;
+
+	Pointer_Record->Time = 0;
+	for (i = 0; i < 8; i++) Pointer_Record->Time = (Pointer_Record->Time << 8) | Header[i];
+	Pointer_Record->Direction = Header[8];
+	Pointer_Record->Size = ((unsigned int) Header[9] << 24) | (Header[10] << 16) | (Header[11] << 8) | Header[12];
+	if ((Pointer_Record->Direction != TRACE_DIRECTION_HOST_TO_DEVICE) && (Pointer_Record->Direction != TRACE_DIRECTION_DEVICE_TO_HOST)) return -1;
+
+	// Grow the data buffer when a bigger record is found
+	if (Pointer_Record->Size > Pointer_Trace->Record_Data_Buffer_Size)
+	{
+		Pointer_Buffer = realloc(Pointer_Trace->Pointer_Record_Data, Pointer_Record->Size);
+		if (Pointer_Buffer == NULL) return -2;
+		Pointer_Trace->Pointer_Record_Data = Pointer_Buffer;
+		Pointer_Trace->Record_Data_Buffer_Size = Pointer_Record->Size;
+	}
+	if (fread(Pointer_Trace->Pointer_Record_Data, 1, Pointer_Record->Size, Pointer_Trace->File) != Pointer_Record->Size) return -1;
+	Pointer_Record->Pointer_Data = Pointer_Trace->Pointer_Record_Data;
+
+	return 1;
+}
+
+int TraceClose(TTrace *Pointer_Trace)
+{
+	if (fclose(Pointer_Trace->File) != 0) Pointer_Trace->Is_Failed = 1;
+	free(Pointer_Trace->Pointer_Record_Data);
+
+	if (Pointer_Trace->Is_Failed) return -1;
+	return 0;
+}
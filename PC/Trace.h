@@ -0,0 +1,84 @@
+/** @file Trace.h
+ * Record the bytes exchanged with a programmer and when they were exchanged, so a session can be replayed later (see Replay.c).
+ * A trace file starts with TRACE_FILE_SIGNATURE, followed by records : the time in microseconds since the trace was created (64-bit), the direction (8-bit), the data size (32-bit) and the data. All numbers are big endian.
+ * The time is taken when the bytes are handed to the operating system or received from it, so the device timings include the host serial port latency.
+ * The functions do not display anything, so the programmer library can record traces : the callers tell the user what failed.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_TRACE_H
+#define H_TRACE_H
+
+#include <stdio.h>
+
+//-------------------------------------------------------------------------------------------------
+// Constants
+//-------------------------------------------------------------------------------------------------
+/** The bytes all trace files start with. */
+#define TRACE_FILE_SIGNATURE "PRGTRACE"
+
+/** The record contains bytes sent by the host. */
+#define TRACE_DIRECTION_HOST_TO_DEVICE 'H'
+/** The record contains bytes sent by the device. */
+#define TRACE_DIRECTION_DEVICE_TO_HOST 'D'
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** An opened trace file. */
+typedef struct
+{
+	FILE *File; //!< The trace file.
+	unsigned long long Start_Time; //!< When the trace was created (in microseconds, only used when recording).
+	int Is_Failed; //!< Tell whether a record could not be written.
+	unsigned char *Pointer_Record_Data; //!< The last read record data (only used when reading).
+	unsigned int Record_Data_Buffer_Size; //!< How many bytes the record data buffer can contain.
+} TTrace;
+
+/** A trace record. */
+typedef struct
+{
+	unsigned long long Time; //!< When the bytes were exchanged, in microseconds since the trace was created.
+	unsigned char Direction; //!< TRACE_DIRECTION_HOST_TO_DEVICE or TRACE_DIRECTION_DEVICE_TO_HOST.
+	unsigned int Size; //!< How many bytes were exchanged.
+	unsigned char *Pointer_Data; //!< The bytes, valid until the next record is read.
+} TTraceRecord;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Create a trace file to record a session to.
+ * @param Pointer_Trace The trace to initialize.
+ * @param String_File_Name The file to create.
+ * @return 0 if the trace was created, -1 if the file could not be created.
+ */
+int TraceCreate(TTrace *Pointer_Trace, char *String_File_Name);
+
+/** Append exchanged bytes to a trace, timestamped with the current time.
+ * @param Pointer_Trace The trace.
+ * @param Direction TRACE_DIRECTION_HOST_TO_DEVICE or TRACE_DIRECTION_DEVICE_TO_HOST.
+ * @param Pointer_Data The bytes.
+ * @param Size How many bytes were exchanged.
+ */
+void TraceWriteRecord(TTrace *Pointer_Trace, unsigned char Direction, const void *Pointer_Data, unsigned int Size);
+
+/** Open a recorded trace file.
+ * @param Pointer_Trace The trace to initialize.
+ * @param String_File_Name The file to open.
+ * @return 0 if the trace was opened, -1 if the file could not be opened, -2 if the file is not a trace.
+ */
+int TraceOpen(TTrace *Pointer_Trace, char *String_File_Name);
+
+/** Read the next record of an opened trace.
+ * @param Pointer_Trace The trace.
+ * @param Pointer_Record On output, contain the record.
+ * @return 1 if a record was read, 0 if the trace end was reached, -1 if the trace is truncated or corrupted, -2 if there is not enough memory to load the record.
+ */
+int TraceReadRecord(TTrace *Pointer_Trace, TTraceRecord *Pointer_Record);
+
+/** Close a trace.
+ * @param Pointer_Trace The trace.
+ * @return 0 if all records were stored, -1 if some records could not be written.
+ */
+int TraceClose(TTrace *Pointer_Trace);
+
+#endif
@@ -4,20 +4,31 @@
  */
 #include "UART.h" 
  
+/** Record the exchanged bytes when a trace is attached to the serial port.
+ * @param Pointer_UART The serial port.
+ * @param Direction TRACE_DIRECTION_HOST_TO_DEVICE or TRACE_DIRECTION_DEVICE_TO_HOST.
+ * @param Pointer_Data The exchanged bytes.
+ * @param Size How many bytes were exchanged (nothing is recorded if it is not positive).
+ */
+static void UARTRecordTrace(TUART *Pointer_UART, unsigned char Direction, const void *Pointer_Data, long Size)
+{
+	if ((Pointer_UART->Pointer_Trace != NULL) && (Size > 0)) TraceWriteRecord(Pointer_UART->Pointer_Trace, Direction, Pointer_Data, Size);
+}
+
 #ifdef WIN32 // Windows
-#include <windows.h>
- 
-// This variable is global in this module in order to avoid passing it as a parameter.
-static HANDLE COM_Handle;
- 
-int UARTOpen(char *Device_File_Name)
+int UARTOpen(TUART *Pointer_UART, char *Device_File_Name)
 {
 	DCB COM_Parameters;
 	COMMTIMEOUTS Timing_Parameters;
 	
+	Pointer_UART->Read_Calls_Count = 0;
+	Pointer_UART->Write_Calls_Count = 0;
+	Pointer_UART->Wait_Calls_Count = 0;
+	Pointer_UART->Pointer_Trace = NULL;
+	
 	// Open the serial port and set all access rights
-	COM_Handle = CreateFile(Device_File_Name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-	if (COM_Handle == INVALID_HANDLE_VALUE) return 0; // Error : can't access to serial port
+	Pointer_UART->COM_Handle = CreateFile(Device_File_Name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (Pointer_UART->COM_Handle == INVALID_HANDLE_VALUE) return 0; // Error : can't access to serial port
 	
 	// Configure port
 	COM_Parameters.DCBlength = sizeof(DCB);
@@ -53,7 +64,7 @@ int UARTOpen(char *Device_File_Name)
 	COM_Parameters.BaudRate = CBR_230400;
 	
 	// Set new parameters
-	SetCommState(COM_Handle, &COM_Parameters);
+	SetCommState(Pointer_UART->COM_Handle, &COM_Parameters);
 	
 	// Make reads non blocking
 	Timing_Parameters.ReadIntervalTimeout = MAXDWORD; // According to MSDN, make the ReadFile() function returns immediately
@@ -61,108 +72,258 @@ int UARTOpen(char *Device_File_Name)
 	Timing_Parameters.ReadTotalTimeoutConstant = 0;
 	Timing_Parameters.WriteTotalTimeoutMultiplier = 0;
 	Timing_Parameters.WriteTotalTimeoutConstant = 0;
-	SetCommTimeouts(COM_Handle, &Timing_Parameters);
+	SetCommTimeouts(Pointer_UART->COM_Handle, &Timing_Parameters);
 	
 	// No error
 	return 1;
 }
 
-unsigned char UARTReadByte(void)
+unsigned char UARTReadByte(TUART *Pointer_UART)
 {
 	unsigned char Byte;
 	DWORD Number_Bytes_Read;
 	
 	do
 	{
-		ReadFile(COM_Handle, &Byte, 1, &Number_Bytes_Read, NULL);
+		ReadFile(Pointer_UART->COM_Handle, &Byte, 1, &Number_Bytes_Read, NULL);
+		Pointer_UART->Read_Calls_Count++;
 	} while (Number_Bytes_Read == 0);
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, &Byte, 1);
 	return Byte;
 }
 
-void UARTWriteByte(unsigned char Byte)
+void UARTWriteByte(TUART *Pointer_UART, unsigned char Byte)
 {
 	DWORD Number_Bytes_Written;
 	
-	WriteFile(COM_Handle, &Byte, 1, &Number_Bytes_Written, NULL);
+	WriteFile(Pointer_UART->COM_Handle, &Byte, 1, &Number_Bytes_Written, NULL);
+	Pointer_UART->Write_Calls_Count++;
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_HOST_TO_DEVICE, &Byte, Number_Bytes_Written);
 }
 
-int UARTIsByteAvailable(unsigned char *Available_Byte)
+int UARTIsByteAvailable(TUART *Pointer_UART, unsigned char *Available_Byte)
 {
 	DWORD Number_Bytes_Read;
 	
-	ReadFile(COM_Handle, Available_Byte, 1, &Number_Bytes_Read, NULL);
+	ReadFile(Pointer_UART->COM_Handle, Available_Byte, 1, &Number_Bytes_Read, NULL);
+	Pointer_UART->Read_Calls_Count++;
 	if (Number_Bytes_Read == 0) return 0;
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, Available_Byte, 1);
 	return 1;
 }
 
-void UARTClose(void)
+int UARTReadBuffer(TUART *Pointer_UART, void *Pointer_Buffer, unsigned int Maximum_Size)
+{
+	DWORD Number_Bytes_Read;
+	
+	Pointer_UART->Read_Calls_Count++;
+	if (!ReadFile(Pointer_UART->COM_Handle, Pointer_Buffer, Maximum_Size, &Number_Bytes_Read, NULL)) return -1;
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, Pointer_Buffer, Number_Bytes_Read);
+	return Number_Bytes_Read;
+}
+
+int UARTWriteBuffer(TUART *Pointer_UART, const void *Pointer_Buffer, unsigned int Size)
 {
-	CloseHandle(COM_Handle);
+	DWORD Number_Bytes_Written;
+	
+	Pointer_UART->Write_Calls_Count++;
+	if (!WriteFile(Pointer_UART->COM_Handle, Pointer_Buffer, Size, &Number_Bytes_Written, NULL)) return -1;
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_HOST_TO_DEVICE, Pointer_Buffer, Number_Bytes_Written);
+	return Number_Bytes_Written;
+}
+
+void UARTWaitForEvents(TUART *Pointer_UART, int Is_Output_Pending, int Timeout)
+{
+	// Reads return immediately and writes are blocking, so just give some time to the serial port to receive data
+	(void) Is_Output_Pending;
+	Pointer_UART->Wait_Calls_Count++;
+	if (Timeout > 0) Sleep(1);
+}
+
+int UARTSetLowLatency(TUART *Pointer_UART, int Is_Enabled)
+{
+	// The serial driver settings are not available to applications
+	(void) Pointer_UART;
+	(void) Is_Enabled;
+	return -1;
+}
+
+void UARTClose(TUART *Pointer_UART)
+{
+	CloseHandle(Pointer_UART->COM_Handle);
 }	
 
 #else // Linux / UNIX
-#include <termios.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifdef __linux__
+	#include <linux/serial.h>
+	#include <sys/ioctl.h>
+#endif
 
-// File representing the UART
-static int File_Descriptor_UART;
-
-// Old UART parameters
-static struct termios Parameters_Old;
-
-int UARTOpen(char *Device_File_Name)
+int UARTOpen(TUART *Pointer_UART, char *Device_File_Name)
 {
 	struct termios Parameters_New;
 	
+	Pointer_UART->Read_Calls_Count = 0;
+	Pointer_UART->Write_Calls_Count = 0;
+	Pointer_UART->Wait_Calls_Count = 0;
+	Pointer_UART->Pointer_Trace = NULL;
+	Pointer_UART->Is_Serial_Flags_Changed = 0;
+	
 	// Open device file
-	File_Descriptor_UART = open(Device_File_Name, O_RDWR | O_NONBLOCK);
-	if (File_Descriptor_UART == -1) return 0;
+	Pointer_UART->File_Descriptor = open(Device_File_Name, O_RDWR | O_NONBLOCK);
+	if (Pointer_UART->File_Descriptor == -1) return 0;
 	
 	// Backup old UART parameters
-	if (tcgetattr(File_Descriptor_UART, &Parameters_Old) == -1) return 0;
+	if (tcgetattr(Pointer_UART->File_Descriptor, &Pointer_UART->Parameters_Old) == -1)
+	{
+		close(Pointer_UART->File_Descriptor);
+		return 0;
+	}
 	
 	// Configure new parameters
 	Parameters_New.c_iflag = IGNBRK | IGNPAR; // Ignore break, no parity
 	Parameters_New.c_oflag = 0;
 	Parameters_New.c_cflag = CS8 | CREAD | CLOCAL; // 8 data bits, receiver enabled, ignore modem control lines
 	Parameters_New.c_lflag = 0; // Use raw mode
+	memset(Parameters_New.c_cc, 0, sizeof(Parameters_New.c_cc)); // Reads return immediately with the already received bytes
 	
 	// Set speeds
-	if (cfsetispeed(&Parameters_New, B230400) == -1) return 0;
-	if (cfsetospeed(&Parameters_New, B230400) == -1) return 0;
+	if ((cfsetispeed(&Parameters_New, B230400) == -1) || (cfsetospeed(&Parameters_New, B230400) == -1))
+	{
+		close(Pointer_UART->File_Descriptor);
+		return 0;
+	}
 	
 	// Set parameters
-	if (tcsetattr(File_Descriptor_UART, TCSANOW, &Parameters_New) == -1) return 0;
+	if (tcsetattr(Pointer_UART->File_Descriptor, TCSANOW, &Parameters_New) == -1)
+	{
+		close(Pointer_UART->File_Descriptor);
+		return 0;
+	}
 	return 1;
 }
 
-unsigned char UARTReadByte(void)
+unsigned char UARTReadByte(TUART *Pointer_UART)
 {
 	unsigned char Byte;
 	
-	while (read(File_Descriptor_UART, &Byte, 1) <= 0);
+	do
+	{
+		Pointer_UART->Read_Calls_Count++;
+	} while (read(Pointer_UART->File_Descriptor, &Byte, 1) <= 0);
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, &Byte, 1);
 	return Byte;
 }
 
-void UARTWriteByte(unsigned char Byte)
+void UARTWriteByte(TUART *Pointer_UART, unsigned char Byte)
 {
-	write(File_Descriptor_UART, &Byte, 1);
+	Pointer_UART->Write_Calls_Count++;
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_HOST_TO_DEVICE, &Byte, write(Pointer_UART->File_Descriptor, &Byte, 1));
 }
 
-int UARTIsByteAvailable(unsigned char *Available_Byte)
+int UARTIsByteAvailable(TUART *Pointer_UART, unsigned char *Available_Byte)
 {
-	if (read(File_Descriptor_UART, Available_Byte, 1) == 1) return 1;
+	Pointer_UART->Read_Calls_Count++;
+	if (read(Pointer_UART->File_Descriptor, Available_Byte, 1) == 1)
+	{
+		UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, Available_Byte, 1);
+		return 1;
+	}
 	return 0;
 }
 
-void UARTClose(void)
+int UARTReadBuffer(TUART *Pointer_UART, void *Pointer_Buffer, unsigned int Maximum_Size)
+{
+	ssize_t Read_Bytes_Count;
+	
+	Pointer_UART->Read_Calls_Count++;
+	Read_Bytes_Count = read(Pointer_UART->File_Descriptor, Pointer_Buffer, Maximum_Size);
+	if (Read_Bytes_Count < 0)
+	{
+		if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+		return -1;
+	}
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_DEVICE_TO_HOST, Pointer_Buffer, Read_Bytes_Count);
+	return Read_Bytes_Count;
+}
+
+int UARTWriteBuffer(TUART *Pointer_UART, const void *Pointer_Buffer, unsigned int Size)
+{
+	ssize_t Written_Bytes_Count;
+	
+	Pointer_UART->Write_Calls_Count++;
+	Written_Bytes_Count = write(Pointer_UART->File_Descriptor, Pointer_Buffer, Size);
+	if (Written_Bytes_Count < 0)
+	{
+		if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+		return -1;
+	}
+	UARTRecordTrace(Pointer_UART, TRACE_DIRECTION_HOST_TO_DEVICE, Pointer_Buffer, Written_Bytes_Count);
+	return Written_Bytes_Count;
+}
+
+void UARTWaitForEvents(TUART *Pointer_UART, int Is_Output_Pending, int Timeout)
 {
-	tcsetattr(File_Descriptor_UART, TCSANOW, &Parameters_Old);
-	close(File_Descriptor_UART);
+	struct pollfd Poll_Descriptor;
+	
+	Poll_Descriptor.fd = Pointer_UART->File_Descriptor;
+	Poll_Descriptor.events = POLLIN;
+	if (Is_Output_Pending) Poll_Descriptor.events |= POLLOUT;
+	Pointer_UART->Wait_Calls_Count++;
+	poll(&Poll_Descriptor, 1, Timeout);
 }
 
+int UARTSetLowLatency(TUART *Pointer_UART, int Is_Enabled)
+{
+#ifdef __linux__
+	struct serial_struct Serial_Parameters;
+	
+	if (ioctl(Pointer_UART->File_Descriptor, TIOCGSERIAL, &Serial_Parameters) == -1) return -1;
+	
+	// Remember the driver flags the first time they are changed
+	if (!Pointer_UART->Is_Serial_Flags_Changed)
+	{
+		Pointer_UART->Serial_Flags_Old = Serial_Parameters.flags;
+		Pointer_UART->Is_Serial_Flags_Changed = 1;
+	}
+	
+	if (Is_Enabled) Serial_Parameters.flags |= ASYNC_LOW_LATENCY;
+	else Serial_Parameters.flags &= ~ASYNC_LOW_LATENCY;
+	if (ioctl(Pointer_UART->File_Descriptor, TIOCSSERIAL, &Serial_Parameters) == -1) return -1;
+	return 0;
+#else
+	(void) Pointer_UART;
+	(void) Is_Enabled;
+	return -1;
 #endif
-	
\ No newline at end of file
+}
+
+void UARTClose(TUART *Pointer_UART)
+{
+#ifdef __linux__
+	struct serial_struct Serial_Parameters;
+	
+	// The driver flags outlive the opened file, so restore them
+	if (Pointer_UART->Is_Serial_Flags_Changed && (ioctl(Pointer_UART->File_Descriptor, TIOCGSERIAL, &Serial_Parameters) == 0))
+	{
+		Serial_Parameters.flags = Pointer_UART->Serial_Flags_Old;
+		ioctl(Pointer_UART->File_Descriptor, TIOCSSERIAL, &Serial_Parameters);
+	}
+#endif
+	tcsetattr(Pointer_UART->File_Descriptor, TCSANOW, &Pointer_UART->Parameters_Old);
+	close(Pointer_UART->File_Descriptor);
+}
+
+#endif
+
+void UARTSetTrace(TUART *Pointer_UART, TTrace *Pointer_Trace)
+{
+	Pointer_UART->Pointer_Trace = Pointer_Trace;
+}
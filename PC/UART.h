@@ -2,37 +2,110 @@
  * Easy-to-use RS-232 communication layer.
  * @author Adrien RICCIARDI
  * @version 1.0 : 24/02/2013
+ * @version 1.1 : 18/10/2026, each opened serial port is now represented by its own handle so several ports can be driven by the same process.
+ * @version 1.2 : 18/10/2026, added the low latency mode.
+ * @version 1.3 : 18/10/2026, the exchanged bytes can be recorded to a trace.
  */
 #ifndef H_UART_H
 #define H_UART_H
 
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <termios.h>
+#endif
+#include "Trace.h"
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** An opened serial port. */
+typedef struct
+{
+#ifdef WIN32
+	HANDLE COM_Handle; //!< The Windows serial port handle.
+#else
+	int File_Descriptor; //!< The device file (opened in non-blocking mode).
+	struct termios Parameters_Old; //!< The UART parameters to restore when closing the port.
+	int Serial_Flags_Old; //!< The driver flags to restore when closing the port.
+	int Is_Serial_Flags_Changed; //!< Tell whether the driver flags were changed.
+#endif
+	unsigned int Read_Calls_Count; //!< How many times the operating system was asked for received bytes.
+	unsigned int Write_Calls_Count; //!< How many times the operating system was given bytes to send.
+	unsigned int Wait_Calls_Count; //!< How many times the program waited for the serial port.
+	TTrace *Pointer_Trace; //!< Where the exchanged bytes are recorded, NULL if they are not recorded.
+} TUART;
+
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
 /** Initialize PC's UART at 230400 bit/s, 8 data bit, no parity, 1 stop bit.
+ * @param Pointer_UART The serial port handle to initialize.
  * @param Device_File_Name Name of the UART's device, like "/dev/ttyS0" or "/dev/ttyUSB0" if using USB serial port converter.
  * @return 1 if the UART was correctly initialized or 0 if not. See errno to find the error.
  */
-int UARTOpen(char *Device_File_Name);
+int UARTOpen(TUART *Pointer_UART, char *Device_File_Name);
 
 /** Read a byte from the UART.
+ * @param Pointer_UART The serial port to read from.
  * @return The read byte.
  * @warning This is a blocking function.
  */
-unsigned char UARTReadByte(void);
+unsigned char UARTReadByte(TUART *Pointer_UART);
 
 /** Write a byte to the UART.
+ * @param Pointer_UART The serial port to write to.
  * @param Byte The byte to send.
  */
-void UARTWriteByte(unsigned char Byte);
+void UARTWriteByte(TUART *Pointer_UART, unsigned char Byte);
 
 /** Check if a byte was received by the UART.
+ * @param Pointer_UART The serial port to check.
  * @param Available_Byte Store the received byte if there was one available.
  * @return 0 if no byte was received (and Available_Byte has unknown value) or 1 if a byte is available (in this case the byte is stored into Available_Byte).
  */
-int UARTIsByteAvailable(unsigned char *Available_Byte);
+int UARTIsByteAvailable(TUART *Pointer_UART, unsigned char *Available_Byte);
+
+/** Read the bytes already received by the UART without blocking.
+ * @param Pointer_UART The serial port to read from.
+ * @param Pointer_Buffer On output, contain the read bytes.
+ * @param Maximum_Size How many bytes can be stored in the buffer.
+ * @return How many bytes were read (0 if no byte was available) or -1 if the serial port can't be used anymore.
+ */
+int UARTReadBuffer(TUART *Pointer_UART, void *Pointer_Buffer, unsigned int Maximum_Size);
+
+/** Send as many bytes as the UART can accept without blocking.
+ * @param Pointer_UART The serial port to write to.
+ * @param Pointer_Buffer The bytes to send.
+ * @param Size How many bytes to send.
+ * @return How many bytes were sent (0 if the UART can't accept data for now) or -1 if the serial port can't be used anymore.
+ */
+int UARTWriteBuffer(TUART *Pointer_UART, const void *Pointer_Buffer, unsigned int Size);
 
-/** Restore previous parameters and close UART. */
-void UARTClose(void);
+/** Wait until some data is received or a timeout expires.
+ * @param Pointer_UART The serial port to watch.
+ * @param Is_Output_Pending Set to 1 to return as soon as the UART can accept more data too.
+ * @param Timeout How many milliseconds to wait at most.
+ */
+void UARTWaitForEvents(TUART *Pointer_UART, int Is_Output_Pending, int Timeout);
+
+/** Make the driver hand the received bytes to the program as soon as they arrive instead of gathering them first (USB serial adapters wait up to 16 ms by default). This speeds up exchanges made of small frames.
+ * @param Pointer_UART The serial port to configure.
+ * @param Is_Enabled Set to 1 to enable the low latency mode, set to 0 to restore the driver default behavior.
+ * @return 0 if the mode was changed, -1 if the serial port driver does not support it (this is the case of pseudo terminals).
+ * @note Reads never block and the program waits for the received bytes with UARTWaitForEvents(), so the termios VMIN and VTIME values (both 0) already add no delay.
+ */
+int UARTSetLowLatency(TUART *Pointer_UART, int Is_Enabled);
+
+/** Record all bytes the next reads and writes exchange.
+ * @param Pointer_UART The serial port to watch.
+ * @param Pointer_Trace The trace to record to, NULL to stop recording (the trace is not closed).
+ */
+void UARTSetTrace(TUART *Pointer_UART, TTrace *Pointer_Trace);
+
+/** Restore previous parameters and close UART.
+ * @param Pointer_UART The serial port to close.
+ */
+void UARTClose(TUART *Pointer_UART);
 
-#endif
\ No newline at end of file
+#endif